@@ -46,6 +46,15 @@
  * from the sample implementation.
  */
 
+/*
+ * Compilers that provide a 128-bit integer type on 64-bit targets use the
+ * radix 2^51 implementation in curve25519-donna-c64.c. Define BN_NO_INT128 to
+ * use the 32-bit code below, the same switch bnlib uses to select its word size.
+ */
+#if defined(__SIZEOF_INT128__) && !defined(BN_NO_INT128)
+#include "curve25519-donna-c64.c"
+#else
+
 #include <string.h>
 #include <stdint.h>
 
@@ -729,3 +738,5 @@ int curve25519_donna(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
   fcontract(mypublic, z);
   return 0;
 }
+
+#endif /* __SIZEOF_INT128__ */
@@ -180,13 +180,21 @@ int bnSubQMod_ (struct BigNum *rslt, unsigned n1, struct BigNum *mod)
     return 0;
 }
 
+/*
+ * If a curve is given the product goes to the curve's scratch variable and the
+ * reduction writes to rslt. Thus rslt may alias n1 or n2 without bnMul/bnSquare
+ * allocating a copy of the operand.
+ */
 int bnMulMod_ (struct BigNum *rslt, struct BigNum *n1, struct BigNum *n2, struct BigNum *mod, const EcCurve *curve)
 {
-    bnMul (rslt, n1, n2);
-    if (curve)
-        curve->modOp(rslt, rslt, mod);
-    else
+    if (curve) {
+        bnMul (curve->tm, n1, n2);
+        curve->modOp(rslt, curve->tm, mod);
+    }
+    else {
+        bnMul (rslt, n1, n2);
         bnMod(rslt, rslt, mod);
+    }
     return 0;
 }
 
@@ -202,11 +210,14 @@ int bnMulQMod_ (struct BigNum *rslt, struct BigNum *n1, unsigned n2, struct BigN
 
 int bnSquareMod_ (struct BigNum *rslt, struct BigNum *n1, struct BigNum *mod, const EcCurve *curve)
 {
-    bnSquare (rslt, n1);
-    if (curve)
-        curve->modOp(rslt, rslt, mod);
-    else
+    if (curve) {
+        bnSquare (curve->tm, n1);
+        curve->modOp(rslt, curve->tm, mod);
+    }
+    else {
+        bnSquare (rslt, n1);
         bnMod(rslt, rslt, mod);
+    }
     return 0;
 }
 
@@ -273,6 +284,19 @@ static void curveCommonInit(EcCurve *curve)
     bnBegin(&curve->_t1); curve->t1 = &curve->_t1;
     bnBegin(&curve->_t2); curve->t2 = &curve->_t2;
     bnBegin(&curve->_t3); curve->t3 = &curve->_t3;
+    bnBegin(&curve->_tm); curve->tm = &curve->_tm;
+
+    curve->tP = &curve->_tP; INIT_EC_POINT(curve->tP);
+    curve->tQ = &curve->_tQ; INIT_EC_POINT(curve->tQ);
+    curve->tN = &curve->_tN; INIT_EC_POINT(curve->tN);
+    curve->tG = &curve->_tG; INIT_EC_POINT(curve->tG);
+}
+
+static void pointPrealloc(EcPoint *P, unsigned bits)
+{
+    bnPrealloc(P->x, bits);
+    bnPrealloc(P->y, bits);
+    bnPrealloc(P->z, bits);
 }
 
 static void curveCommonPrealloc(EcCurve *curve)
@@ -288,10 +312,16 @@ static void curveCommonPrealloc(EcCurve *curve)
     bnPrealloc(curve->U1, maxBits);
     bnPrealloc(curve->H, maxBits);
     bnPrealloc(curve->R, maxBits);
-    bnPrealloc(curve->S1, maxBits);
+    bnPrealloc(curve->t0, maxBits);
     bnPrealloc(curve->t1, maxBits);
     bnPrealloc(curve->t2, maxBits);
     bnPrealloc(curve->t3, maxBits);
+    bnPrealloc(curve->tm, maxBits);
+
+    pointPrealloc(curve->tP, maxBits);
+    pointPrealloc(curve->tQ, maxBits);
+    pointPrealloc(curve->tN, maxBits);
+    pointPrealloc(curve->tG, maxBits);
 }
 
 int ecGetCurveNistECp(Curves curveId, EcCurve *curve)
@@ -457,6 +487,12 @@ void ecFreeCurveNistECp(EcCurve *curve)
     bnEnd(curve->t1);
     bnEnd(curve->t2);
     bnEnd(curve->t3);
+    bnEnd(curve->tm);
+
+    FREE_EC_POINT(curve->tP);
+    FREE_EC_POINT(curve->tQ);
+    FREE_EC_POINT(curve->tN);
+    FREE_EC_POINT(curve->tG);
 }
 
 /*
@@ -496,24 +532,19 @@ static int ecGetAffineNist(const EcCurve *curve, EcPoint *R, const EcPoint *P)
 {
     int ret = 0;
 
-    struct BigNum z_1, z_2;
-
-    bnBegin(&z_1);
-    bnBegin(&z_2);
+    struct BigNum *z_1 = curve->t0, *z_2 = curve->t1;
 
     /* affine x = X / Z^2 */
-    bnInv (&z_1, P->z, curve->p);                 /* z_1 = Z^(-1) */
-    bnMulMod_(&z_2, &z_1, &z_1, curve->p, curve); /* z_2 = Z^(-2) */
-    bnMulMod_(R->x, P->x, &z_2, curve->p, curve);
+    bnInv (z_1, P->z, curve->p);                  /* z_1 = Z^(-1) */
+    bnMulMod_(z_2, z_1, z_1, curve->p, curve);    /* z_2 = Z^(-2) */
+    bnMulMod_(R->x, P->x, z_2, curve->p, curve);
 
     /* affine y = Y / Z^3 */
-    bnMulMod_(&z_2, &z_2, &z_1, curve->p, curve); /* z_2 = Z^(-3) */
-    bnMulMod_(R->y, P->y, &z_2, curve->p, curve);
+    bnMulMod_(z_2, z_2, z_1, curve->p, curve);    /* z_2 = Z^(-3) */
+    bnMulMod_(R->y, P->y, z_2, curve->p, curve);
 
     bnSetQ(R->z, 1);
 
-    bnEnd(&z_1);
-    bnEnd(&z_2);
     return ret;
 }
 
@@ -521,20 +552,17 @@ static int ecGetAffineEd(const EcCurve *curve, EcPoint *R, const EcPoint *P)
 {
     int ret = 0;
 
-    struct BigNum z_1;
-
-    bnBegin(&z_1);
+    struct BigNum *z_1 = curve->t0;
 
     /* affine x = X / Z */
-    bnInv (&z_1, P->z, curve->p);                 /* z_1 = Z^(-1) */
-    bnMulMod_(R->x, P->x, &z_1, curve->p, curve);
+    bnInv (z_1, P->z, curve->p);                  /* z_1 = Z^(-1) */
+    bnMulMod_(R->x, P->x, z_1, curve->p, curve);
 
     /* affine y = Y / Z */
-    bnMulMod_(R->y, P->y, &z_1, curve->p, curve);
+    bnMulMod_(R->y, P->y, z_1, curve->p, curve);
 
     bnSetQ(R->z, 1);
 
-    bnEnd(&z_1);
     return ret;
 
 }
@@ -562,7 +590,6 @@ static int ecDoublePointNist(const EcCurve *curve, EcPoint *R, const EcPoint *P)
 {
     int ret = 0;
 
-    EcPoint tP;
     const EcPoint *ptP = 0;
 
     if (!bnCmp(P->y, mpiZero) || !bnCmp(P->z, mpiZero)) {
@@ -574,11 +601,10 @@ static int ecDoublePointNist(const EcCurve *curve, EcPoint *R, const EcPoint *P)
 
     /* Check for overlapping arguments, copy if necessary and set pointer */
     if (P == R) {
-        INIT_EC_POINT(&tP);
-        ptP = &tP;
-        bnCopy(tP.x, P->x);
-        bnCopy(tP.y, P->y);
-        bnCopy(tP.z, P->z);
+        ptP = curve->tP;
+        bnCopy(curve->tP->x, P->x);
+        bnCopy(curve->tP->y, P->y);
+        bnCopy(curve->tP->z, P->z);
     }
     else 
         ptP = P;
@@ -616,24 +642,20 @@ static int ecDoublePointNist(const EcCurve *curve, EcPoint *R, const EcPoint *P)
     bnMulMod_(curve->t0, ptP->y, mpiTwo, curve->p, curve);       /* t0 = 2 * Y */
     bnMulMod_(R->z, curve->t0, ptP->z, curve->p, curve);         /* Z' = to * Z */
 
-    if (P == R)
-        FREE_EC_POINT(&tP);
 
     return ret;
 }
 
 static int ecDoublePointEd(const EcCurve *curve, EcPoint *R, const EcPoint *P)
 {
-    EcPoint tP;
     const EcPoint *ptP = 0;
 
     /* Check for overlapping arguments, copy if necessary and set pointer */
     if (P == R) {
-        INIT_EC_POINT(&tP);
-        ptP = &tP;
-        bnCopy(tP.x, P->x);
-        bnCopy(tP.y, P->y);
-        bnCopy(tP.z, P->z);
+        ptP = curve->tP;
+        bnCopy(curve->tP->x, P->x);
+        bnCopy(curve->tP->y, P->y);
+        bnCopy(curve->tP->z, P->z);
     }
     else 
         ptP = P;
@@ -667,8 +689,6 @@ static int ecDoublePointEd(const EcCurve *curve, EcPoint *R, const EcPoint *P)
     /* Compute Rz */
     bnMulMod_(R->z, curve->t2, curve->t1, curve->p, curve);    /* J * E */
 
-    if (P == R)
-        FREE_EC_POINT(&tP);
 
     return 0;
 }
@@ -691,7 +711,6 @@ static int ecAddPointNist(const EcCurve *curve, EcPoint *R, const EcPoint *P, co
 {
     int ret = 0;
 
-    EcPoint tP, tQ;
     const EcPoint *ptP = 0;
     const EcPoint *ptQ = 0;
 
@@ -719,21 +738,19 @@ static int ecAddPointNist(const EcCurve *curve, EcPoint *R, const EcPoint *P, co
 
     /* Check for overlapping arguments, copy if necessary and set pointers */
     if (P == R) {
-        INIT_EC_POINT(&tP);
-        ptP = &tP;
-        bnCopy(tP.x, P->x);
-        bnCopy(tP.y, P->y);
-        bnCopy(tP.z, P->z);
+        ptP = curve->tP;
+        bnCopy(curve->tP->x, P->x);
+        bnCopy(curve->tP->y, P->y);
+        bnCopy(curve->tP->z, P->z);
     }
     else 
         ptP = P;
 
     if (Q == R) {
-        INIT_EC_POINT(&tQ);
-        ptQ = &tQ;
-        bnCopy(tQ.x, Q->x);
-        bnCopy(tQ.y, Q->y);
-        bnCopy(tQ.z, Q->z);
+        ptQ = curve->tQ;
+        bnCopy(curve->tQ->x, Q->x);
+        bnCopy(curve->tQ->y, Q->y);
+        bnCopy(curve->tQ->z, Q->z);
     }
     else
         ptQ = Q;
@@ -794,10 +811,6 @@ static int ecAddPointNist(const EcCurve *curve, EcPoint *R, const EcPoint *P, co
     bnMulMod_(curve->t2, curve->H, P->z, curve->p, curve);       /* t2 = H * Z1 */
     bnMulMod_(R->z, curve->t2, Q->z, curve->p, curve);           /* Z3 = t2 * Z2 */
 
-    if (P == R)
-        FREE_EC_POINT(&tP);
-    if (Q == R)
-        FREE_EC_POINT(&tQ);
     return ret;
 }
 
@@ -810,7 +823,6 @@ static int ecAddPointNist(const EcCurve *curve, EcPoint *R, const EcPoint *P, co
  */
 static int ecAddPointEd(const EcCurve *curve, EcPoint *R, const EcPoint *P, const EcPoint *Q)
 {
-    EcPoint tP, tQ;
     const EcPoint *ptP = 0;
     const EcPoint *ptQ = 0;
 
@@ -832,21 +844,19 @@ static int ecAddPointEd(const EcCurve *curve, EcPoint *R, const EcPoint *P, cons
 
     /* Check for overlapping arguments, copy if necessary and set pointers */
     if (P == R) {
-        INIT_EC_POINT(&tP);
-        ptP = &tP;
-        bnCopy(tP.x, P->x);
-        bnCopy(tP.y, P->y);
-        bnCopy(tP.z, P->z);
+        ptP = curve->tP;
+        bnCopy(curve->tP->x, P->x);
+        bnCopy(curve->tP->y, P->y);
+        bnCopy(curve->tP->z, P->z);
     }
     else 
         ptP = P;
 
     if (Q == R) {
-        INIT_EC_POINT(&tQ);
-        ptQ = &tQ;
-        bnCopy(tQ.x, Q->x);
-        bnCopy(tQ.y, Q->y);
-        bnCopy(tQ.z, Q->z);
+        ptQ = curve->tQ;
+        bnCopy(curve->tQ->x, Q->x);
+        bnCopy(curve->tQ->y, Q->y);
+        bnCopy(curve->tQ->z, Q->z);
     }
     else
         ptQ = Q;
@@ -889,10 +899,6 @@ static int ecAddPointEd(const EcCurve *curve, EcPoint *R, const EcPoint *P, cons
     bnMulMod_(R->y, curve->t2, R->z, curve->p, curve);           /* Ry = t2 * G */
     bnMulMod_(R->z, curve->t3, R->z, curve->p, curve);           /* Rz = F * G */
 
-    if (P == R)
-        FREE_EC_POINT(&tP);
-    if (Q == R)
-        FREE_EC_POINT(&tQ);
 
     return 0;
 }
@@ -915,12 +921,11 @@ static int ecMulPointScalarNormal(const EcCurve *curve, EcPoint *R, const EcPoin
     int ret = 0;
     int i;
     int bits = bnBits(scalar);
-    EcPoint n;
+    EcPoint *n = curve->tN;
 
-    INIT_EC_POINT(&n);
-    bnCopy(n.x, P->x);
-    bnCopy(n.y, P->y);
-    bnCopy(n.z, P->z);
+    bnCopy(n->x, P->x);
+    bnCopy(n->y, P->y);
+    bnCopy(n->z, P->z);
 
     bnSetQ(R->x, 0);
     bnSetQ(R->y, 0);
@@ -928,12 +933,11 @@ static int ecMulPointScalarNormal(const EcCurve *curve, EcPoint *R, const EcPoin
 
     for (i = 0; i < bits; i++) {
         if (bnReadBit(scalar, i))
-            ecAddPoint(curve, R, R, &n);
+            ecAddPoint(curve, R, R, n);
 
-        /*        ecAddPoint(curve, &n, &n, &n); */
-        ecDoublePoint(curve, &n, &n);
+        /*        ecAddPoint(curve, n, n, n); */
+        ecDoublePoint(curve, n, n);
     }
-    FREE_EC_POINT(&n);
     return ret;
 }
 
@@ -993,32 +997,26 @@ int ecGenerateRandomNumber(const EcCurve *curve, BigNum *d)
 
 static int ecGenerateRandomNumberNist(const EcCurve *curve, BigNum *d)
 {
-    BigNum c, nMinusOne;
+    BigNum *c = curve->t0, *nMinusOne = curve->t1;
     uint8_t ran[MAX_RANDOM_BYTES];
     size_t randomBytes = ((bnBits(curve->n) + 64) + 7) / 8;
 
     if (randomBytes > MAX_RANDOM_BYTES)
         return -1;
 
-    bnBegin(&c);
-    bnBegin(&nMinusOne);
-
-    bnCopy(&nMinusOne, curve->n);
-    bnSubMod_(&nMinusOne, mpiOne, curve->p);
+    bnCopy(nMinusOne, curve->n);
+    bnSubMod_(nMinusOne, mpiOne, curve->p);
 
     bnSetQ(d, 0);
 
     while (!bnCmpQ(d, 0)) {
         /* use _random function */
         _random(ran, randomBytes);
-        bnInsertBigBytes(&c, ran, 0, randomBytes);
-        bnMod(d, &c, &nMinusOne);
+        bnInsertBigBytes(c, ran, 0, randomBytes);
+        bnMod(d, c, nMinusOne);
         bnAddMod_(d, mpiOne, curve->p);
     }
 
-    bnEnd(&c);
-    bnEnd(&nMinusOne);
-
     return 0;
 }
 
@@ -1129,10 +1127,11 @@ static int ecCheckPubKey25519(const EcCurve *curve, const EcPoint *pub)
 static int mod3617(BigNum *r, const BigNum *a, const BigNum *modulo)
 {
     unsigned char buffer[52] = {0};
+    unsigned char high[56] = {0};
+    unsigned int ac = 0;
     int cmp;
-    BigNum tmp;
+    int i;
 
-    bnBegin(&tmp);
     cmp = bnCmp(modulo, a);
     if (cmp == 0) {             /* a is equal modulo, set resul to zero */
         bnSetQ(r, 0);
@@ -1145,19 +1144,25 @@ static int mod3617(BigNum *r, const BigNum *a, const BigNum *modulo)
     bnExtractLittleBytes(a, buffer, 0, 52);
     buffer[51] &= 0x3f;
 
-    bnCopy(&tmp, a);
-    bnRShift(&tmp, 414);
-    bnCopy(r, &tmp);
-    bnLShift(r, 4);
-    bnAdd(r, &tmp);
-
-    bnInsertLittleBytes(&tmp, buffer, 0, 52);
+    /* a is less than modulo^2, thus the upper part fits in 54 bytes */
+    bnCopy(r, a);
+    bnRShift(r, 414);
+    bnExtractLittleBytes(r, high, 0, 54);
+
+    /* r = 17 * (a >> 414) + (a & (2^414 - 1)), computed on the byte arrays to avoid a temporary */
+    for (i = 0; i < 56; i++) {
+        ac += high[i] * 17;
+        if (i < 52)
+            ac += buffer[i];
+        high[i] = ac;
+        ac >>= 8;
+    }
+    bnSetQ(r, 0);
+    bnInsertLittleBytes(r, high, 0, 56);
 
-    bnAdd(r, &tmp);
     while (bnCmp(r, modulo) >= 0) {
         bnSub(r, modulo);
     }
-    bnEnd(&tmp);
     return 0;
 }
 
@@ -1437,12 +1442,10 @@ static int newMod256(BigNum *r, const BigNum *a, const BigNum *modulo)
          * we effectiviely doing a mod(256)
          */
         if (msb > 0) {
-            BigNum tmp;
-            bnBegin(&tmp);
-            bnSetQ (&tmp, 1);
-            bnLShift (&tmp, maxMsb);
-            bnMod(r, r, &tmp);
-            bnEnd(&tmp);
+            unsigned char low[32];
+            bnExtractBigBytes(r, low, 0, 32);
+            bnSetQ(r, 0);
+            bnInsertBigBytes(r, low, 0, 32);
         }
     }
     else {
@@ -1630,12 +1633,10 @@ static int newMod384(BigNum *r, const BigNum *a, const BigNum *modulo)
          * we effectiviely doing a mod(384)
          */
         if (msb > 0) {
-            BigNum tmp;
-            bnBegin(&tmp);
-            bnSetQ (&tmp, 1);
-            bnLShift (&tmp, maxMsb);
-            bnMod(r, r, &tmp);
-            bnEnd(&tmp);
+            unsigned char low[48];
+            bnExtractBigBytes(r, low, 0, 48);
+            bnSetQ(r, 0);
+            bnInsertBigBytes(r, low, 0, 48);
         }
     }
     else {
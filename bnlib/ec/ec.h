@@ -53,6 +53,11 @@ typedef struct _EcPoint {
  * For other curves, for example curve3917 we have less parameters to fill in, mostly
  * the prime number, the base point, etc. Refer to the curve's initialization function
  * about the use of the fileds.
+ *
+ * The scratch pad variables are allocated once, sized for the curve, when the curve is
+ * initialized. The pointers refer to the structure itself, thus don't copy an initialized
+ * curve structure. Because the arithmetic functions use the scratch pad each thread must
+ * use its own curve structure.
  */
 struct EcCurve;
 struct EcCurve {
@@ -78,6 +83,14 @@ struct EcCurve {
        avoid to much memory allocation/deallocatio0n overhead */
   BigNum _S1, _U1, _H, _R, _t0, _t1, _t2, _t3;
   BigNum *S1, *U1, *H, *R, *t0, *t1, *t2, *t3;
+  /* product scratch of the modular multiply/square functions, holds the
+     unreduced result so the reduction never works on an aliased operand */
+  BigNum _tm;
+  BigNum *tm;
+  /* scratch points: copies of aliased arguments in add/double (tP, tQ), the
+     running point of the scalar multiplication (tN) and the ECDH temporary (tG) */
+  EcPoint _tP, _tQ, _tN, _tG;
+  EcPoint *tP, *tQ, *tN, *tG;
   int (*affineOp)(const struct EcCurve *curve, EcPoint *R, const EcPoint *P);
   int (*doubleOp)(const struct EcCurve *curve, EcPoint *R, const EcPoint *P);
   int (*addOp)(const struct EcCurve *curve, EcPoint *R, const EcPoint *P, const EcPoint *Q);
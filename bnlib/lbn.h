@@ -128,6 +128,16 @@
 #define BNWORD64 uint64_t
 #endif
 
-/* We don't even try to find a 128-bit type at the moment */
+/*
+ * GCC and Clang provide a 128-bit unsigned type on 64-bit targets.  With
+ * it the 64-bit library gets selected instead of the 32-bit one, which
+ * needs a quarter of the multiplies.  Define BN_NO_INT128 to keep the
+ * old behaviour.
+ */
+#if !defined(BNWORD128) && defined(BNWORD64) && defined(__SIZEOF_INT128__) && \
+    !defined(BN_NO_INT128)
+__extension__ typedef unsigned __int128 bnword128_t;
+#define BNWORD128 bnword128_t
+#endif
 
 #endif /* !LBN_H */
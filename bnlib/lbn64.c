@@ -543,6 +543,70 @@ lbnMulN1_64(BNWORD64 *out, BNWORD64 const *in, unsigned len, BNWORD64 k)
 #endif
 #endif /* lbnMulN1_64 */
 
+/*
+ * x86-64 MULX/ADCX/ADOX version of lbnMulAdd1_64.  MULX does not touch
+ * the flags, and ADCX and ADOX use two independent carry chains (CF
+ * and OF), so the low halves of the products are added to the
+ * destination on one chain while the high halves of the previous
+ * products ride on the other.  The loop counter uses LEA and JRCXZ to
+ * keep both chains intact.
+ *
+ * BMI2 and ADX are not part of the x86-64 baseline, so the CPU is
+ * checked once at run time and lbnMulAdd1_64 below dispatches to this
+ * kernel.  Define BN_NO_ADX to leave it out.
+ *
+ * On AArch64 no special code is necessary: the BNWORD128 multiply
+ * below compiles to a MUL/UMULH pair.
+ */
+#if !defined(lbnMulAdd1_64) && defined(BNWORD128) && defined(__GNUC__) && \
+    defined(__x86_64__) && !defined(BN_BIG_ENDIAN) && !defined(BN_NO_ADX)
+#define LBN_ADX_64 1
+#include <cpuid.h>
+
+static int
+lbnHaveAdx_64(void)
+{
+	static int haveAdx = -1;
+	unsigned a, b, c, d;
+
+	if (haveAdx < 0) {
+		haveAdx = __get_cpuid_count(7, 0, &a, &b, &c, &d) &&
+		    (b & bit_BMI2) && (b & bit_ADX);
+	}
+	return haveAdx;
+}
+
+static BNWORD64
+lbnMulAdd1Adx_64(BNWORD64 *out, BNWORD64 const *in, unsigned len, BNWORD64 k)
+{
+	BNWORD64 carry;
+	BNWORD64 n = len;
+
+	__asm__ __volatile__ (
+		"xorl	%k[c], %k[c]\n\t"	/* Clears CF and OF too */
+		"1:\n\t"
+		"jrcxz	2f\n\t"
+		"mulxq	(%[in]), %%rax, %%r9\n\t"
+		"adcxq	(%[out]), %%rax\n\t"
+		"adoxq	%[c], %%rax\n\t"
+		"movq	%%rax, (%[out])\n\t"
+		"movq	%%r9, %[c]\n\t"
+		"leaq	8(%[in]), %[in]\n\t"
+		"leaq	8(%[out]), %[out]\n\t"
+		"leaq	-1(%%rcx), %%rcx\n\t"
+		"jmp	1b\n"
+		"2:\n\t"
+		"movl	$0, %%eax\n\t"		/* MOV leaves the flags alone */
+		"adcxq	%%rax, %[c]\n\t"
+		"adoxq	%%rax, %[c]\n\t"
+		: [c] "=&r" (carry), [in] "+r" (in), [out] "+r" (out), "+c" (n)
+		: "d" (k)
+		: "rax", "r9", "cc", "memory");
+
+	return carry;
+}
+#endif /* LBN_ADX_64 */
+
 /*
  * lbnMulAdd1_64: Multiply an n-word input by a 1-word input and add the
  * low n words of the product to the destination.  *Returns the n+1st word
@@ -586,6 +650,11 @@ lbnMulAdd1_64(BNWORD64 *out, BNWORD64 const *in, unsigned len, BNWORD64 k)
 
 	assert(len > 0);
 
+#ifdef LBN_ADX_64
+	if (lbnHaveAdx_64())
+		return lbnMulAdd1Adx_64(out, in, len, k);
+#endif
+
 	p = (BNWORD128)BIGLITTLE(*--in,*in++) * k + BIGLITTLE(*--out,*out);
 	BIGLITTLE(*out,*out++) = (BNWORD64)p;
 
@@ -0,0 +1,729 @@
+/*
+  Copyright (C) 2013 Werner Dittmann
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Reference SRTP media relay and load generator.
+ *
+ * The relay receives SRTP packets, unprotects them with the inbound keys,
+ * protects them with the outbound keys and forwards them. Packets that come
+ * from the forward address go back to the last sender of the other side, the
+ * relay swaps the keys for this direction. ZRTP and other non-RTP packets pass
+ * unchanged, thus two ZRTP endpoints can run their handshake through the
+ * relay. The program moves packets in batches with
+ * recvmmsg/sendmmsg, uses pre-allocated packet rings and creates one SRTP
+ * crypto context per SSRC and direction. The relay and the sink keep the
+ * context of a new SSRC only after its first packet authenticated, and at
+ * most -n contexts per direction.
+ *
+ * Modes:
+ *   relay  receive on -l port, forward to -f address:port and back
+ *   gen    send SRTP load of -s streams to -f address:port
+ *   sink   receive on -l port, unprotect, check and count the packets
+ *   bench  run gen, relay and sink in one process over loopback
+ *
+ * The inbound key of the relay is the key of the generator (-k), the outbound
+ * key is the key of the sink (-K). Keys are 30 hex bytes: 16 bytes master key
+ * followed by 14 bytes master salt, the suite is AES_CM_128_HMAC_SHA1_80.
+ *
+ * Usage: srtprelay <mode> [options]
+ *
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include <CryptoContext.h>
+#include <SrtpHandler.h>
+#include <common/osSpecifics.h>
+
+#define RELAY_BATCH         64          // Packets per recvmmsg/sendmmsg call
+#define RELAY_SLOT          2048        // Size of a packet buffer
+#define RELAY_MAX_PACKET    1500        // Largest packet we receive, leaves room for the SRTP tag
+#define RELAY_HEADER        12          // RTP header without CSRC and extension
+#define RELAY_ZRTP_MAGIC    0x5a525450
+#define RELAY_MAX_STREAMS   1024        // Default limit of SSRCs the relay and the sink accept
+#define RELAY_NO_CONTEXT    (-3)        // Unprotect result if all contexts are in use
+
+static const char* defaultInKey  = "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d";
+static const char* defaultOutKey = "f0e0d0c0b0a090807060504030201000f1e1d1c1b1a19181716151413121";
+
+static std::atomic<bool> stopped(false);
+
+static void onSignal(int)
+{
+    stopped.store(true);
+}
+
+/*
+ * Command line options
+ */
+struct Options {
+    const char* mode;
+    uint16_t listenPort;
+    struct sockaddr_in forward;
+    uint8_t inKey[30];
+    uint8_t outKey[30];
+    int32_t streams;
+    int32_t maxStreams;                 // Limit of SRTP contexts per direction of relay and sink
+    int32_t payloadLength;
+    int32_t rate;                       // Packets per second of the generator, 0: as fast as possible
+    int32_t seconds;                    // Run time, 0: until SIGINT
+};
+
+/*
+ * Counters, updated by one thread and read by the reporting thread
+ */
+struct Counters {
+    std::atomic<uint64_t> packets;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> passed;       // ZRTP and other non-RTP packets forwarded unchanged
+    std::atomic<uint64_t> authFailed;
+    std::atomic<uint64_t> replayFailed;
+    std::atomic<uint64_t> noContext;    // Packets of new SSRCs dropped because all contexts are in use
+    std::atomic<uint64_t> dropped;      // Packets the relay could not protect or has no return address for
+    std::atomic<uint64_t> badPayload;
+    std::atomic<uint64_t> lost;
+    std::atomic<uint64_t> srtpNs;       // Time spent in SRTP functions
+
+    Counters(): packets(0), bytes(0), passed(0), authFailed(0), replayFailed(0), noContext(0), dropped(0),
+        badPayload(0), lost(0), srtpNs(0) { }
+};
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool parseKey(const char* hex, uint8_t* key)
+{
+    if (strlen(hex) != 60)
+        return false;
+    for (int i = 0; i < 30; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1)
+            return false;
+        key[i] = (uint8_t)byte;
+    }
+    return true;
+}
+
+static bool parseAddress(const char* text, struct sockaddr_in* addr)
+{
+    char host[64];
+    const char* colon = strrchr(text, ':');
+
+    if (colon == NULL || colon - text >= (int)sizeof(host))
+        return false;
+    memcpy(host, text, colon - text);
+    host[colon - text] = 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)atoi(colon + 1));
+    return inet_pton(AF_INET, host, &addr->sin_addr) == 1;
+}
+
+static int openSocket(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int size = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Wait until the socket is readable, returns false on timeout. The timeout
+ * lets the loops check the stop flag.
+ */
+static bool waitReadable(int fd)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 100) > 0;
+}
+
+/*
+ * A ring of pre-allocated packet buffers with their message headers, set up
+ * once and reused for every recvmmsg/sendmmsg call.
+ */
+class PacketRing {
+public:
+    PacketRing(): buffers(RELAY_BATCH * RELAY_SLOT) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < RELAY_BATCH; i++) {
+            iovs[i].iov_base = packet(i);
+            iovs[i].iov_len = RELAY_MAX_PACKET;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+    }
+
+    uint8_t* packet(int i) { return &buffers[i * RELAY_SLOT]; }
+
+    /* Source address of received slot i */
+    const struct sockaddr_in& address(int i) const { return addrs[i]; }
+
+    /* Prepare all slots to receive */
+    void resetForReceive() {
+        for (int i = 0; i < RELAY_BATCH; i++) {
+            iovs[i].iov_len = RELAY_MAX_PACKET;
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+    }
+
+    /* Prepare slot i to send length bytes to addr */
+    void setSend(int i, size_t length, const struct sockaddr_in& addr) {
+        iovs[i].iov_len = length;
+        addrs[i] = addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+
+    struct mmsghdr msgs[RELAY_BATCH];
+
+private:
+    std::vector<uint8_t> buffers;
+    struct iovec iovs[RELAY_BATCH];
+    struct sockaddr_in addrs[RELAY_BATCH];
+};
+
+/*
+ * Send count packets of the ring, sendmmsg may send less than requested.
+ */
+static void sendAll(int fd, PacketRing& ring, int count)
+{
+    int sent = 0;
+    while (sent < count && !stopped.load(std::memory_order_relaxed)) {
+        int n = sendmmsg(fd, ring.msgs + sent, count - sent, 0);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS)
+                continue;
+            perror("sendmmsg");
+            return;
+        }
+        sent += n;
+    }
+}
+
+/*
+ * The SRTP contexts of one direction, one per SSRC, at most maxContexts. The
+ * template context holds the master key, newCryptoContextForSSRC() derives
+ * the others.
+ */
+class SrtpContexts {
+public:
+    SrtpContexts(const uint8_t* key, int32_t maxContexts): maxContexts((size_t)maxContexts) {
+        templateContext = new CryptoContext(0, 0, 0L, SrtpEncryptionAESCM, SrtpAuthenticationSha1Hmac,
+                                            const_cast<uint8_t*>(key), 16, const_cast<uint8_t*>(key + 16), 14,
+                                            16, 20, 14, 10);
+    }
+
+    ~SrtpContexts() {
+        for (ContextMap::iterator it = contexts.begin(); it != contexts.end(); ++it)
+            delete it->second;
+        delete templateContext;
+    }
+
+    /*
+     * Get the context of a SSRC to protect packets, create it if necessary.
+     * Returns NULL if all contexts are in use.
+     */
+    CryptoContext* get(uint32_t ssrc) {
+        ContextMap::iterator it = contexts.find(ssrc);
+        if (it != contexts.end())
+            return it->second;
+        if (contexts.size() >= maxContexts)
+            return NULL;
+
+        CryptoContext* pcc = newContext(ssrc);
+        contexts[ssrc] = pcc;
+        return pcc;
+    }
+
+    /*
+     * Unprotect a received packet. The packet of an unknown SSRC gets a
+     * temporary context that we keep only if the packet authenticates, thus
+     * packets with spoofed SSRCs don't allocate contexts. Returns the
+     * SrtpHandler::unprotect() result or RELAY_NO_CONTEXT if all
+     * contexts are in use.
+     */
+    int32_t unprotect(uint32_t ssrc, uint8_t* packet, size_t length, size_t* newLength) {
+        ContextMap::iterator it = contexts.find(ssrc);
+        if (it != contexts.end())
+            return SrtpHandler::unprotect(it->second, packet, length, newLength);
+        if (contexts.size() >= maxContexts)
+            return RELAY_NO_CONTEXT;
+
+        CryptoContext* pcc = newContext(ssrc);
+        int32_t rc = SrtpHandler::unprotect(pcc, packet, length, newLength);
+        if (rc == 1)
+            contexts[ssrc] = pcc;
+        else
+            delete pcc;
+        return rc;
+    }
+
+private:
+    CryptoContext* newContext(uint32_t ssrc) {
+        CryptoContext* pcc = templateContext->newCryptoContextForSSRC(ssrc, 0, 0L);
+        pcc->deriveSrtpKeys(0);
+        return pcc;
+    }
+
+    typedef std::unordered_map<uint32_t, CryptoContext*> ContextMap;
+    CryptoContext* templateContext;
+    ContextMap contexts;
+    size_t maxContexts;
+};
+
+/* Count a failed unprotect */
+static void countUnprotectError(Counters& counters, int32_t rc)
+{
+    if (rc == -2)
+        counters.replayFailed.fetch_add(1, std::memory_order_relaxed);
+    else if (rc == RELAY_NO_CONTEXT)
+        counters.noContext.fetch_add(1, std::memory_order_relaxed);
+    else
+        counters.authFailed.fetch_add(1, std::memory_order_relaxed);
+}
+
+static bool sameAddress(const struct sockaddr_in& a, const struct sockaddr_in& b)
+{
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+static bool isRtp(const uint8_t* packet, size_t length)
+{
+    if (length < RELAY_HEADER || (packet[0] & 0xc0) != 0x80)
+        return false;
+    uint32_t magic;
+    memcpy(&magic, packet + 4, sizeof(magic));
+    return zrtpNtohl(magic) != RELAY_ZRTP_MAGIC;
+}
+
+static uint32_t getSsrc(const uint8_t* packet)
+{
+    uint32_t ssrc;
+    memcpy(&ssrc, packet + 8, sizeof(ssrc));
+    return zrtpNtohl(ssrc);
+}
+
+static uint16_t getSeq(const uint8_t* packet)
+{
+    return (uint16_t)((packet[2] << 8) | packet[3]);
+}
+
+/* The payload pattern of the generator, the sink checks it */
+static uint8_t payloadByte(uint16_t seq, int32_t i)
+{
+    return (uint8_t)(seq + i * 7);
+}
+
+/*
+ * Relay: unprotect with the inbound keys, protect with the outbound keys.
+ * Packets from the forward address go back to the last sender of the other
+ * side with the keys swapped. The send ring uses the receive buffers, the
+ * packets are not copied.
+ */
+static void runRelay(const Options& opt, int fd, Counters& counters)
+{
+    PacketRing ring;
+    SrtpContexts inbound(opt.inKey, opt.maxStreams);
+    SrtpContexts outbound(opt.outKey, opt.maxStreams);
+    SrtpContexts returnInbound(opt.outKey, opt.maxStreams);
+    SrtpContexts returnOutbound(opt.inKey, opt.maxStreams);
+    struct sockaddr_in peer;
+    bool havePeer = false;
+
+    while (!stopped.load(std::memory_order_relaxed)) {
+        if (!waitReadable(fd))
+            continue;
+        ring.resetForReceive();
+        int received = recvmmsg(fd, ring.msgs, RELAY_BATCH, MSG_DONTWAIT, NULL);
+        if (received <= 0)
+            continue;
+
+        int toSend = 0;
+        uint64_t start = nowNs();
+        for (int i = 0; i < received; i++) {
+            uint8_t* packet = ring.packet(i);
+            size_t length = ring.msgs[i].msg_len;
+
+            counters.packets.fetch_add(1, std::memory_order_relaxed);
+            counters.bytes.fetch_add(length, std::memory_order_relaxed);
+
+            bool back = sameAddress(ring.address(i), opt.forward);
+            if (back && !havePeer) {
+                counters.dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (!back) {
+                peer = ring.address(i);
+                havePeer = true;
+            }
+            // Copy the target, setSend() overwrites the source address of the slot
+            struct sockaddr_in target = back ? peer : opt.forward;
+
+            if (!isRtp(packet, length)) {
+                counters.passed.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                uint32_t ssrc = getSsrc(packet);
+                size_t plainLength;
+                int32_t rc = (back ? returnInbound : inbound).unprotect(ssrc, packet, length, &plainLength);
+                if (rc != 1) {
+                    countUnprotectError(counters, rc);
+                    continue;
+                }
+                CryptoContext* pcc = (back ? returnOutbound : outbound).get(ssrc);
+                if (pcc == NULL || !SrtpHandler::protect(pcc, packet, plainLength, &length)) {
+                    counters.dropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+            }
+            // Compact the ring: the packet goes to the next send slot
+            if (toSend != i)
+                memcpy(ring.packet(toSend), packet, length);
+            ring.setSend(toSend, length, target);
+            toSend++;
+        }
+        counters.srtpNs.fetch_add(nowNs() - start, std::memory_order_relaxed);
+        sendAll(fd, ring, toSend);
+    }
+}
+
+/*
+ * Generator: SRTP packets of several streams, round robin.
+ */
+static void runGenerator(const Options& opt, int fd, Counters& counters)
+{
+    PacketRing ring;
+    SrtpContexts outbound(opt.inKey, opt.streams);
+    std::vector<uint16_t> seqs(opt.streams, 0);
+    uint32_t timestamp = 0;
+    int32_t stream = 0;
+    uint64_t start = nowNs();
+    uint64_t sent = 0;
+
+    while (!stopped.load(std::memory_order_relaxed)) {
+        int32_t batch = RELAY_BATCH;
+        if (opt.rate > 0) {
+            // Pace: send what the rate allows up to now
+            uint64_t due = (nowNs() - start) * (uint64_t)opt.rate / 1000000000ULL;
+            if (due <= sent) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            if (due - sent < (uint64_t)batch)
+                batch = (int32_t)(due - sent);
+        }
+
+        uint64_t srtpStart = nowNs();
+        for (int32_t i = 0; i < batch; i++) {
+            uint8_t* packet = ring.packet(i);
+            uint16_t seq = seqs[stream]++;
+            uint32_t ssrc = zrtpHtonl(0x10000000 + stream);
+
+            packet[0] = 0x80;
+            packet[1] = 0;
+            packet[2] = (uint8_t)(seq >> 8);
+            packet[3] = (uint8_t)seq;
+            uint32_t ts = zrtpHtonl(timestamp);
+            memcpy(packet + 4, &ts, 4);
+            memcpy(packet + 8, &ssrc, 4);
+            for (int32_t j = 0; j < opt.payloadLength; j++)
+                packet[RELAY_HEADER + j] = payloadByte(seq, j);
+
+            size_t length;
+            SrtpHandler::protect(outbound.get(0x10000000 + stream), packet, RELAY_HEADER + opt.payloadLength, &length);
+            ring.setSend(i, length, opt.forward);
+
+            counters.packets.fetch_add(1, std::memory_order_relaxed);
+            counters.bytes.fetch_add(length, std::memory_order_relaxed);
+            if (++stream == opt.streams) {
+                stream = 0;
+                timestamp += 160;
+            }
+        }
+        counters.srtpNs.fetch_add(nowNs() - srtpStart, std::memory_order_relaxed);
+        sendAll(fd, ring, batch);
+        sent += batch;
+    }
+}
+
+/*
+ * Sink: unprotect with the outbound keys of the relay and check the payload.
+ */
+static void runSink(const Options& opt, int fd, Counters& counters)
+{
+    PacketRing ring;
+    SrtpContexts inbound(opt.outKey, opt.maxStreams);
+    std::unordered_map<uint32_t, uint16_t> nextSeq;
+
+    while (!stopped.load(std::memory_order_relaxed)) {
+        if (!waitReadable(fd))
+            continue;
+        ring.resetForReceive();
+        int received = recvmmsg(fd, ring.msgs, RELAY_BATCH, MSG_DONTWAIT, NULL);
+        if (received <= 0)
+            continue;
+
+        uint64_t start = nowNs();
+        for (int i = 0; i < received; i++) {
+            uint8_t* packet = ring.packet(i);
+            size_t length = ring.msgs[i].msg_len;
+
+            counters.packets.fetch_add(1, std::memory_order_relaxed);
+            counters.bytes.fetch_add(length, std::memory_order_relaxed);
+            if (!isRtp(packet, length)) {
+                counters.passed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            uint32_t ssrc = getSsrc(packet);
+            size_t plainLength;
+            int32_t rc = inbound.unprotect(ssrc, packet, length, &plainLength);
+            if (rc != 1) {
+                countUnprotectError(counters, rc);
+                continue;
+            }
+            uint16_t seq = getSeq(packet);
+            for (size_t j = RELAY_HEADER; j < plainLength; j++) {
+                if (packet[j] != payloadByte(seq, (int32_t)(j - RELAY_HEADER))) {
+                    counters.badPayload.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            // Count gaps in the sequence numbers as loss, late packets are not counted
+            std::unordered_map<uint32_t, uint16_t>::iterator it = nextSeq.find(ssrc);
+            if (it != nextSeq.end()) {
+                uint16_t gap = seq - it->second;
+                if (gap < 0x8000)
+                    counters.lost.fetch_add(gap, std::memory_order_relaxed);
+            }
+            nextSeq[ssrc] = seq + 1;
+        }
+        counters.srtpNs.fetch_add(nowNs() - start, std::memory_order_relaxed);
+    }
+}
+
+static void report(const char* name, Counters& counters, uint64_t& lastPackets, uint64_t& lastBytes, double seconds)
+{
+    uint64_t packets = counters.packets.load();
+    uint64_t bytes = counters.bytes.load();
+    uint64_t srtpNs = counters.srtpNs.load();
+
+    printf("%-6s %9.0f pkt/s %8.1f Mbit/s  srtp %6.2f us/pkt  pass %llu auth %llu replay %llu full %llu drop %llu bad %llu lost %llu\n",
+           name, (packets - lastPackets) / seconds, (bytes - lastBytes) * 8.0 / seconds / 1e6,
+           packets > 0 ? srtpNs / 1000.0 / packets : 0.0,
+           (unsigned long long)counters.passed.load(), (unsigned long long)counters.authFailed.load(),
+           (unsigned long long)counters.replayFailed.load(), (unsigned long long)counters.noContext.load(),
+           (unsigned long long)counters.dropped.load(),
+           (unsigned long long)counters.badPayload.load(),
+           (unsigned long long)counters.lost.load());
+    lastPackets = packets;
+    lastBytes = bytes;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s relay|gen|sink|bench [options]\n"
+            "  -l port       listen port (relay: 20000, sink: 20001)\n"
+            "  -f addr:port  forward/target address (relay: 127.0.0.1:20001, gen: 127.0.0.1:20000)\n"
+            "  -k hex        generator / relay inbound key, 16 byte key + 14 byte salt\n"
+            "  -K hex        relay outbound / sink key\n"
+            "  -s streams    number of generated streams (10)\n"
+            "  -n streams    maximum number of SSRCs relay and sink accept (1024)\n"
+            "  -p bytes      payload length of generated packets (160)\n"
+            "  -r pps        generated packets per second, 0 = as fast as possible (0)\n"
+            "  -t seconds    run time, 0 = until interrupted (bench: 5)\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    bool haveForward = false;
+    bool haveListen = false;
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    opt.mode = argv[1];
+    opt.listenPort = 0;
+    opt.streams = 10;
+    opt.maxStreams = RELAY_MAX_STREAMS;
+    opt.payloadLength = 160;
+    opt.rate = 0;
+    opt.seconds = (strcmp(opt.mode, "bench") == 0) ? 5 : 0;
+    parseKey(defaultInKey, opt.inKey);
+    parseKey(defaultOutKey, opt.outKey);
+
+    int c;
+    optind = 2;
+    while ((c = getopt(argc, argv, "l:f:k:K:s:n:p:r:t:")) != -1) {
+        switch (c) {
+        case 'l': opt.listenPort = (uint16_t)atoi(optarg); haveListen = true; break;
+        case 'f':
+            if (!parseAddress(optarg, &opt.forward)) {
+                fprintf(stderr, "Bad address: %s\n", optarg);
+                return 1;
+            }
+            haveForward = true;
+            break;
+        case 'k':
+            if (!parseKey(optarg, opt.inKey)) {
+                fprintf(stderr, "Key must have 60 hex digits\n");
+                return 1;
+            }
+            break;
+        case 'K':
+            if (!parseKey(optarg, opt.outKey)) {
+                fprintf(stderr, "Key must have 60 hex digits\n");
+                return 1;
+            }
+            break;
+        case 's': opt.streams = atoi(optarg); break;
+        case 'n': opt.maxStreams = atoi(optarg); break;
+        case 'p': opt.payloadLength = atoi(optarg); break;
+        case 'r': opt.rate = atoi(optarg); break;
+        case 't': opt.seconds = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.streams <= 0 || opt.maxStreams <= 0 || opt.payloadLength < 0 || opt.payloadLength > RELAY_MAX_PACKET - RELAY_HEADER - 64) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    const char* names[3];
+    Counters counters[3];
+    std::vector<std::thread> threads;
+    std::vector<int> fds;
+    int32_t roles = 0;
+
+    bool bench = strcmp(opt.mode, "bench") == 0;
+    if (bench || strcmp(opt.mode, "sink") == 0) {
+        int fd = openSocket(haveListen && !bench ? opt.listenPort : 20001);
+        if (fd < 0)
+            return 1;
+        fds.push_back(fd);
+        names[roles] = "sink";
+        threads.push_back(std::thread(runSink, std::cref(opt), fd, std::ref(counters[roles])));
+        roles++;
+    }
+    if (bench || strcmp(opt.mode, "relay") == 0) {
+        Options relayOpt = opt;
+        if (bench || !haveForward)
+            parseAddress("127.0.0.1:20001", &relayOpt.forward);
+        int fd = openSocket(haveListen && !bench ? opt.listenPort : 20000);
+        if (fd < 0)
+            return 1;
+        fds.push_back(fd);
+        names[roles] = "relay";
+        threads.push_back(std::thread([relayOpt, fd, &counters, roles]() {
+            runRelay(relayOpt, fd, counters[roles]);
+        }));
+        roles++;
+    }
+    if (bench || strcmp(opt.mode, "gen") == 0) {
+        Options genOpt = opt;
+        if (bench || !haveForward)
+            parseAddress("127.0.0.1:20000", &genOpt.forward);
+        int fd = openSocket(0);
+        if (fd < 0)
+            return 1;
+        fds.push_back(fd);
+        names[roles] = "gen";
+        threads.push_back(std::thread([genOpt, fd, &counters, roles]() {
+            runGenerator(genOpt, fd, counters[roles]);
+        }));
+        roles++;
+    }
+    if (roles == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint64_t lastPackets[3] = { 0, 0, 0 };
+    uint64_t lastBytes[3] = { 0, 0, 0 };
+    uint64_t start = nowNs();
+    uint64_t last = start;
+    while (!stopped.load()) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t now = nowNs();
+        for (int32_t i = 0; i < roles; i++)
+            report(names[i], counters[i], lastPackets[i], lastBytes[i], (now - last) / 1e9);
+        last = now;
+        if (opt.seconds > 0 && now - start >= (uint64_t)opt.seconds * 1000000000ULL)
+            stopped.store(true);
+    }
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    for (size_t i = 0; i < fds.size(); i++)
+        close(fds[i]);
+
+    // Fail if a packet did not authenticate, was replayed or has a wrong payload
+    int rc = 0;
+    for (int32_t i = 0; i < roles; i++) {
+        if (counters[i].authFailed.load() > 0 || counters[i].replayFailed.load() > 0 || counters[i].badPayload.load() > 0)
+            rc = 1;
+    }
+    return rc;
+}
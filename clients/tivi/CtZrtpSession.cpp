@@ -428,6 +428,66 @@ int32_t CtZrtpSession::processIncomingRtp(uint8_t *buffer, size_t length, size_t
     return stream->processIncomingRtp(buffer, length, newLength);
 }
 
+// Check the batch buffers, slots must not overlap the end of the packet buffer
+static bool checkBatch(size_t packetsLength, size_t lengthsCount, int32_t count, size_t slotSize) {
+    if (count < 0 || slotSize == 0 || (size_t)count > lengthsCount)
+        return false;
+    return (size_t)count <= packetsLength / slotSize;
+}
+
+int32_t CtZrtpSession::processOutgoingRtpBatch(uint8_t *packets, size_t packetsLength, int32_t *lengths, size_t lengthsCount,
+                                               int32_t count, size_t slotSize, streamName streamNm) {
+    if (!isReady || !(streamNm >= 0 && streamNm < AllStreams && streams[streamNm] != NULL))
+        return -1;
+
+    if (packets == NULL || lengths == NULL || !checkBatch(packetsLength, lengthsCount, count, slotSize))
+        return -1;
+
+    CtZrtpStream *stream = streams[streamNm];
+    int32_t toSend = 0;
+
+    for (int32_t i = 0; i < count; i++) {
+        size_t newLength = 0;
+        // SRTP appends its trailer in place, reject packets without enough headroom in the slot
+        if (stream->isStopped || lengths[i] <= 0 || (size_t)lengths[i] + CT_ZRTP_BATCH_HEADROOM > slotSize ||
+            !stream->processOutgoingRtp(packets + i * slotSize, lengths[i], &newLength)) {
+            lengths[i] = 0;
+            continue;
+        }
+        lengths[i] = (int32_t)newLength;
+        toSend++;
+    }
+    return toSend;
+}
+
+int32_t CtZrtpSession::processIncomingRtpBatch(uint8_t *packets, size_t packetsLength, int32_t *lengths, size_t lengthsCount,
+                                               int32_t count, size_t slotSize, streamName streamNm) {
+    if (!isReady || !(streamNm >= 0 && streamNm < AllStreams && streams[streamNm] != NULL))
+        return -1;
+
+    if (packets == NULL || lengths == NULL || !checkBatch(packetsLength, lengthsCount, count, slotSize))
+        return -1;
+
+    CtZrtpStream *stream = streams[streamNm];
+    int32_t toProcess = 0;
+
+    for (int32_t i = 0; i < count; i++) {
+        if (stream->isStopped || lengths[i] <= 0 || (size_t)lengths[i] > slotSize) {
+            lengths[i] = 0;
+            continue;
+        }
+        size_t newLength = 0;
+        int32_t rc = stream->processIncomingRtp(packets + i * slotSize, lengths[i], &newLength);
+        if (rc != 1) {
+            lengths[i] = rc;
+            continue;
+        }
+        lengths[i] = (int32_t)newLength;
+        toProcess++;
+    }
+    return toProcess;
+}
+
 bool CtZrtpSession::isStarted(streamName streamNm) {
     if (!isReady || !(streamNm >= 0 && streamNm < AllStreams && streams[streamNm] != NULL))
         return false;
@@ -688,12 +748,41 @@ int32_t CtZrtpSession::getSrtpTraceData(SrtpErrorData* data, streamName streamNm
     return stream->getSrtpTraceData(data);
 }
 
+bool CtZrtpSession::getSrtpMetrics(SrtpMetricsSnapshot* snapshot, streamName streamNm) {
+    if (!isReady || !(streamNm >= 0 && streamNm < AllStreams && streams[streamNm] != NULL))
+        return false;
+
+    CtZrtpStream *stream = streams[streamNm];
+    stream->getSrtpMetrics(snapshot);
+    return true;
+}
+
 
 
 void CtZrtpSession::cleanCache() {
     getZidCacheInstance()->cleanup();
 }
 
+bool CtZrtpSession::setEventLoopTimers(bool yesNo) {
+    return CtZrtpStream::setEventLoopTimers(yesNo);
+}
+
+int64_t CtZrtpSession::getNextTimeout() {
+    return CtZrtpStream::getNextTimeout();
+}
+
+int32_t CtZrtpSession::runExpiredTimers(uint64_t now) {
+    return CtZrtpStream::runExpiredTimers(now);
+}
+
+void CtZrtpSession::getAggregateSrtpMetrics(SrtpMetricsSnapshot* snapshot) {
+    CtZrtpStream::getAggregateSrtpMetrics(snapshot);
+}
+
+void CtZrtpSession::setSrtpTiming(bool yesNo) {
+    SrtpStreamMetrics::setTimingEnabled(yesNo);
+}
+
 void CtZrtpSession::synchEnter() {
     sessionLock.Lock();
 }
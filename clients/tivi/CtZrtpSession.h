@@ -26,6 +26,14 @@
   #endif
 #endif
 
+/**
+ * Headroom a batch slot must provide behind the RTP packet.
+ *
+ * SRTP appends the authentication tag and an optional MKI to the packet.
+ * If SDES and ZRTP protect a packet twice the packet gets two trailers. The
+ * value covers two tags of at most 20 bytes and two MKI of at most 4 bytes.
+ */
+#define CT_ZRTP_BATCH_HEADROOM  (2 * (20 + 4))
 
 class CtZrtpStream;
 class CtZrtpCb;
@@ -34,6 +42,7 @@ class ZrtpConfigure;
 class ZRtp;
 class CMutexClass;
 typedef struct _SrtpErrorData SrtpErrorData;
+typedef struct _SrtpMetricsSnapshot SrtpMetricsSnapshot;
 
 extern "C" __EXPORT const char *getZrtpBuildInfo();
 
@@ -98,6 +107,74 @@ public:
      */
     static int initCache(const char *zidFilename);
 
+    /**
+     * @brief Run the ZRTP timeouts in the application's event loop.
+     *
+     * By default a timeout thread delivers the ZRTP timeouts. If an application
+     * enables event loop timers no timeout thread is started. Instead the
+     * application uses getNextTimeout() to compute the timeout of its poll or
+     * epoll call and calls runExpiredTimers() after the call returns. The ZRTP
+     * timeouts then run in the thread of the event loop. All sessions share one
+     * timeout provider that locks internally, thus media threads may still
+     * process packets of their streams.
+     *
+     * Call this method before the first init(). The first stream fixes the
+     * timer mode of the process, later calls cannot change it.
+     *
+     * @param yesNo
+     *     If @c true use event loop timers.
+     *
+     * @return
+     *     @c false if a stream exists already and uses the other timer mode.
+     */
+    static bool setEventLoopTimers(bool yesNo);
+
+    /**
+     * @brief Get the deadline of the next ZRTP timeout.
+     *
+     * @return
+     *     the deadline in ms of the zrtpGetMonotonicMs() clock, -1 if no ZRTP timeout
+     *     is pending or event loop timers are not enabled.
+     */
+    static int64_t getNextTimeout();
+
+    /**
+     * @brief Deliver expired ZRTP timeouts.
+     *
+     * @param now
+     *     Current time of the zrtpGetMonotonicMs() clock.
+     *
+     * @return
+     *     the number of delivered timeouts.
+     */
+    static int32_t runExpiredTimers(uint64_t now);
+
+    /**
+     * @brief Get the SRTP metrics of all streams.
+     *
+     * The snapshot contains the sum of all active streams and of all streams
+     * stopped since the application started. The streams record their metrics
+     * without locks, thus an application may call this method from any thread,
+     * for example a statistics timer.
+     *
+     * @param snapshot
+     *     Receives the packet and byte counters, the bytes per cipher suite and
+     *     the protect and unprotect latency histograms, see SrtpMetrics.h.
+     */
+    static void getAggregateSrtpMetrics(SrtpMetricsSnapshot* snapshot);
+
+    /**
+     * @brief Enable or disable the SRTP latency histograms.
+     *
+     * Latency measurement reads the monotonic clock twice per packet. The
+     * packet and byte counters are always active. Latency measurement is
+     * enabled by default.
+     *
+     * @param yesNo
+     *     If @c false don't measure protect and unprotect latencies.
+     */
+    static void setSrtpTiming(bool yesNo);
+
     /** @brief Initialize CtZrtpSession.
      *
      * Before an application can use ZRTP it has to initialize the
@@ -284,6 +361,59 @@ public:
      */
     int32_t processIncomingRtp(uint8_t *buffer, size_t length, size_t *newLength, streamName streamNm);
 
+    /**
+     * @brief Process a batch of outgoing packets.
+     *
+     * Processes @c count packets with one call, language bindings use this to
+     * cross the language boundary once for many packets. The packets are
+     * stored in slots of @c slotSize bytes, packet @c i starts at offset
+     * <code>i * slotSize</code> of @c packets. SRTP appends its trailer in
+     * place, thus each slot must provide @c CT_ZRTP_BATCH_HEADROOM bytes
+     * behind the packet: the function rejects a packet if
+     * <code>lengths[i] + CT_ZRTP_BATCH_HEADROOM > slotSize</code>.
+     *
+     * @param packets contains the packets in RTP packet format
+     *
+     * @param packetsLength length of the @c packets buffer in bytes
+     *
+     * @param lengths on input the lengths of the packets. On return the new
+     *                lengths of the packets to send, 0 if the application
+     *                must not send a packet or if its slot has not enough
+     *                headroom.
+     *
+     * @param lengthsCount number of elements in @c lengths
+     *
+     * @param count number of packets to process
+     *
+     * @param slotSize size of a packet slot in bytes
+     *
+     * @param streamNm specifies which stream to use
+     *
+     * @return number of packets to send, -1 if the stream is not available or
+     *         if the buffers are too small for @c count packets.
+     */
+    int32_t processOutgoingRtpBatch(uint8_t *packets, size_t packetsLength, int32_t *lengths, size_t lengthsCount,
+                                    int32_t count, size_t slotSize, streamName streamNm);
+
+    /**
+     * @brief Process a batch of incoming packets.
+     *
+     * Same buffer layout as @c processOutgoingRtpBatch. Incoming packets
+     * shrink, thus their slots need no headroom.
+     *
+     * @param lengths on input the lengths of the packets. On return the new
+     *                lengths of the RTP data, 0 if the application must drop
+     *                a packet, -1 if SRTP authentication failed and -2 if the
+     *                SRTP replay check failed.
+     *
+     * @return number of packets to process, -1 if the stream is not available
+     *         or if the buffers are too small for @c count packets.
+     *
+     * @see processOutgoingRtpBatch
+     */
+    int32_t processIncomingRtpBatch(uint8_t *packets, size_t packetsLength, int32_t *lengths, size_t lengthsCount,
+                                    int32_t count, size_t slotSize, streamName streamNm);
+
     /**
      * @brief Check if a stream was started.
      *
@@ -712,6 +842,17 @@ public:
      */
     int32_t getSrtpTraceData(SrtpErrorData* data, streamName streamNm);
 
+    /**
+     * @brief Get the SRTP metrics of a stream.
+     *
+     * @param snapshot Receives the stream's counters and latency histograms.
+     *
+     * @param streamNm stream identifier.
+     *
+     * @return @c true if the stream exists, @c false otherwise.
+     */
+    bool getSrtpMetrics(SrtpMetricsSnapshot* snapshot, streamName streamNm);
+
     /**
      * @brief Get the Tivi engine's call id.
      */
@@ -40,6 +40,14 @@ int getCallInfo(int iCallID, const char *key, char *p, int iMax);
 #endif
 
 static TimeoutProvider<std::string, CtZrtpStream*>* staticTimeoutProvider = NULL;
+// Shared by all sessions, the provider locks, media threads and the event loop may use it
+static EventLoopTimeoutProvider<std::string, CtZrtpStream*>* eventLoopTimeoutProvider = NULL;
+static bool useEventLoopTimers = false;
+
+// SRTP metrics of all streams: live streams plus the totals of stopped streams
+static CMutexClass metricsLock;
+static std::vector<CtZrtpStream*> metricsStreams;
+static SrtpMetricsSnapshot retiredMetrics;
 
 static std::map<int32_t, std::string*> infoMap;
 static std::map<int32_t, std::string*> warningMap;
@@ -89,7 +97,11 @@ CtZrtpStream::CtZrtpStream():
 {
     synchLock = new CMutexClass();
 
-    if (staticTimeoutProvider == NULL) {
+    if (useEventLoopTimers) {
+        if (eventLoopTimeoutProvider == NULL)
+            eventLoopTimeoutProvider = new EventLoopTimeoutProvider<std::string, CtZrtpStream*>();
+    }
+    else if (staticTimeoutProvider == NULL) {
         staticTimeoutProvider = new TimeoutProvider<std::string, CtZrtpStream*>();
         staticTimeoutProvider->Event(&staticTimeoutProvider);  // Event argument is dummy, not used
     }
@@ -97,6 +109,10 @@ CtZrtpStream::CtZrtpStream():
     ZrtpRandom::getRandomData((uint8_t*)&senderZrtpSeqNo, 2);
     senderZrtpSeqNo &= 0x7fff;
     memset((void*)srtpErrorInfo, 0, sizeof(srtpErrorInfo));
+
+    metricsLock.Lock();
+    metricsStreams.push_back(this);
+    metricsLock.Unlock();
 }
 
 void CtZrtpStream::setUserCallback(CtZrtpCb* ucb) {
@@ -109,6 +125,16 @@ void CtZrtpStream::setSendCallback(CtZrtpSendCb* scb) {
 
 CtZrtpStream::~CtZrtpStream() {
     stopStream();
+
+    metricsLock.Lock();
+    for (std::vector<CtZrtpStream*>::iterator it = metricsStreams.begin(); it != metricsStreams.end(); ++it) {
+        if (*it == this) {
+            metricsStreams.erase(it);
+            break;
+        }
+    }
+    metricsLock.Unlock();
+
     delete synchLock;
     synchLock = NULL;
 }
@@ -140,6 +166,12 @@ void CtZrtpStream::stopStream() {
     sdesProtect = 0;
     unprotectFailed = 0;
 
+    // Keep the metrics of this stream in the aggregate view, the stream may be reused
+    metricsLock.Lock();
+    metrics.addTo(&retiredMetrics);
+    metrics.reset();
+    metricsLock.Unlock();
+
     ZrtpRandom::getRandomData((uint8_t*)&senderZrtpSeqNo, 2);
     senderZrtpSeqNo &= 0x7fff;
     zrtpHashMatch= false;
@@ -185,6 +217,7 @@ void CtZrtpStream::stopStream() {
 
 bool CtZrtpStream::processOutgoingRtp(uint8_t *buffer, size_t length, size_t *newLength) {
     bool rc = true;
+    uint64_t start = SrtpStreamMetrics::startTime();
     if (sendSrtp == NULL) {                 // ZRTP/SRTP inactive
         *newLength = length;
         // Check if ZRTP engine is started and check states to determine if we should send the RTP packet.
@@ -195,8 +228,12 @@ bool CtZrtpStream::processOutgoingRtp(uint8_t *buffer, size_t length, size_t *ne
 //             return false;
 //         }
         if (useSdesForMedia && sdes != NULL) {   // SDES stream available, let SDES protect if necessary
+            const CryptoContext* sdesSrtp = sdes->getSendSrtpContext();
             rc = sdes->outgoingRtp(buffer, length, newLength);
             sdesProtect++;
+            // Record only if SDES really protected the packet, not if it passed plain RTP
+            if (rc && sdesSrtp != NULL)
+                metrics.recordProtect(start, length, sdesSrtp->getEncryptionAlgorithm(), sdesSrtp->getAuthenticationAlgorithm());
         }
          /* In discriminator mode:
           * No ZRTP/SRTP and no SDES/SRTP available
@@ -211,21 +248,27 @@ bool CtZrtpStream::processOutgoingRtp(uint8_t *buffer, size_t length, size_t *ne
     }
     // At this point ZRTP/SRTP is active
     if (useSdesForMedia && sdes != NULL) {       // We still have a SDES - other client did not send zrtp-hash thus we protect twice
-        rc = sdes->outgoingRtp(buffer, length, newLength);
+        rc = sdes->outgoingDoubleRtp(sendSrtp, buffer, length, newLength);
         if (!rc) {
             return rc;
         }
         sdesProtect++;
     }
-    rc = SrtpHandler::protect(sendSrtp, buffer, length, newLength);
+    else {
+        rc = SrtpHandler::protect(sendSrtp, buffer, length, newLength);
+    }
     if (rc) {
         zrtpProtect++;
+        metrics.recordProtect(start, length, sendSrtp->getEncryptionAlgorithm(), sendSrtp->getAuthenticationAlgorithm());
     }
     return rc;
 }
 
 int32_t CtZrtpStream::processIncomingRtp(uint8_t *buffer, const size_t length, size_t *newLength) {
     int32_t rc = 0;
+    bool zrtpDecoded = false;
+    const CryptoContext* sdesSrtp = NULL;
+    uint64_t start = SrtpStreamMetrics::startTime();
     // check if this could be a real RTP/SRTP packet.
     if ((*buffer & 0xc0) == 0x80) {             // A real RTP, check if we are in secure mode
         if (supressCounter < supressWarn)       // Don't report SRTP problems while in startup mode
@@ -244,6 +287,7 @@ int32_t CtZrtpStream::processIncomingRtp(uint8_t *buffer, const size_t length, s
                 }
                 return 1;
             }
+            sdesSrtp = sdes->getRecvSrtpContext();
             rc = sdes->incomingRtp(buffer, length, newLength, srtpErrorElement());
             if (rc == 1) {                      // SDES unprotect OK, do some statistics and return success
                 sdesUnprotect++;
@@ -253,19 +297,25 @@ int32_t CtZrtpStream::processIncomingRtp(uint8_t *buffer, const size_t length, s
         }
         else {
             // At this point we have an active ZRTP/SRTP context, unprotect with ZRTP/SRTP first
-            rc = SrtpHandler::unprotect(recvSrtp, buffer, length, newLength, srtpErrorElement());
-            if (rc == 1) {
+            bool zrtpValid;
+            if (useSdesForMedia && sdes != NULL) {    // We still have a SDES - other client did not send matching zrtp-hash
+                rc = sdes->incomingDoubleRtp(recvSrtp, buffer, length, newLength, &zrtpValid, srtpErrorElement());
+            }
+            else {
+                rc = SrtpHandler::unprotect(recvSrtp, buffer, length, newLength, srtpErrorElement());
+                zrtpValid = (rc == 1);
+            }
+            if (zrtpValid) {
                 zrtpUnprotect++;
+                zrtpDecoded = true;
                 // Got a good SRTP, check state and if in WaitConfAck (an Initiator state)
                 // then simulate a conf2Ack, refer to RFC 6189, chapter 4.6, last paragraph
                 if (zrtpEngine->inState(WaitConfAck)) {
                     zrtpEngine->conf2AckSecure();
                 }
-                if (useSdesForMedia && sdes != NULL) {    // We still have a SDES - other client did not send matching zrtp-hash
-                    rc = sdes->incomingRtp(buffer, *newLength, newLength, srtpErrorElement());
-                }
             }
             else if (sdes != NULL) {
+                sdesSrtp = sdes->getRecvSrtpContext();
                 rc = sdes->incomingRtp(buffer, length, newLength, srtpErrorElement());
             }
         }
@@ -273,6 +323,10 @@ int32_t CtZrtpStream::processIncomingRtp(uint8_t *buffer, const size_t length, s
             srtpAuthErrorBurst = 0;
             srtpReplayErrorBurst = 0;
             srtpDecodeErrorBurst = 0;
+            if (zrtpDecoded)
+                metrics.recordUnprotect(start, length, recvSrtp->getEncryptionAlgorithm(), recvSrtp->getAuthenticationAlgorithm());
+            else if (sdesSrtp != NULL)         // SDES unprotected the packet, plain RTP is not recorded
+                metrics.recordUnprotect(start, length, sdesSrtp->getEncryptionAlgorithm(), sdesSrtp->getAuthenticationAlgorithm());
             return 1;
         }
         // We come to this point only if we have some problems during SRTP unprotect
@@ -290,6 +344,7 @@ int32_t CtZrtpStream::processIncomingRtp(uint8_t *buffer, const size_t length, s
         }
 
         unprotectFailed++;
+        metrics.recordUnprotectError(rc);
         if (supressCounter >= supressWarn) {
             if (rc == 0 && srtpDecodeErrorBurst > srtpErrorBurstThreshold && zrtpUserCallback != NULL) {
                 zrtpUserCallback->onZrtpWarning(session, (char*)srtpDecodeFailedMsg, index);
@@ -1033,7 +1088,10 @@ void CtZrtpStream::srtpSecretsOff(EnableSecurity part) {
 
 int32_t CtZrtpStream::activateTimer(int32_t time) {
     std::string s("ZRTP");
-    if (staticTimeoutProvider != NULL) {
+    if (eventLoopTimeoutProvider != NULL) {
+        eventLoopTimeoutProvider->requestTimeout(time, this, s);
+    }
+    else if (staticTimeoutProvider != NULL) {
         staticTimeoutProvider->requestTimeout(time, this, s);
     }
     return 1;
@@ -1041,12 +1099,35 @@ int32_t CtZrtpStream::activateTimer(int32_t time) {
 
 int32_t CtZrtpStream::cancelTimer() {
     std::string s("ZRTP");
-    if (staticTimeoutProvider != NULL) {
+    if (eventLoopTimeoutProvider != NULL) {
+        eventLoopTimeoutProvider->cancelRequest(this, s);
+    }
+    else if (staticTimeoutProvider != NULL) {
         staticTimeoutProvider->cancelRequest(this, s);
     }
     return 1;
 }
 
+bool CtZrtpStream::setEventLoopTimers(bool yesNo) {
+    // The first stream created the timeout provider, the streams cannot switch to the other one
+    if (staticTimeoutProvider != NULL || eventLoopTimeoutProvider != NULL)
+        return yesNo == (eventLoopTimeoutProvider != NULL);
+    useEventLoopTimers = yesNo;
+    return true;
+}
+
+int64_t CtZrtpStream::getNextTimeout() {
+    if (eventLoopTimeoutProvider == NULL)
+        return -1;
+    return eventLoopTimeoutProvider->getNextDeadline();
+}
+
+int32_t CtZrtpStream::runExpiredTimers(uint64_t now) {
+    if (eventLoopTimeoutProvider == NULL)
+        return 0;
+    return eventLoopTimeoutProvider->runExpiredTimers(now);
+}
+
 void CtZrtpStream::handleTimeout(const std::string &c) {
     if (zrtpEngine != NULL) {
         zrtpEngine->processTimeout();
@@ -1312,6 +1393,19 @@ int32_t CtZrtpStream::getSrtpTraceData(SrtpErrorData* data) {
     return index;
 }
 
+void CtZrtpStream::getSrtpMetrics(SrtpMetricsSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(SrtpMetricsSnapshot));
+    metrics.addTo(snapshot);
+}
+
+void CtZrtpStream::getAggregateSrtpMetrics(SrtpMetricsSnapshot* snapshot) {
+    metricsLock.Lock();
+    memcpy(snapshot, &retiredMetrics, sizeof(SrtpMetricsSnapshot));
+    for (std::vector<CtZrtpStream*>::iterator it = metricsStreams.begin(); it != metricsStreams.end(); ++it)
+        (*it)->metrics.addTo(snapshot);
+    metricsLock.Unlock();
+}
+
 void CtZrtpStream::initStrings() {
     if (initialized) {
         return;
@@ -15,9 +15,11 @@
 #include <libzrtpcpp/ZrtpCallback.h>
 #include <libzrtpcpp/ZrtpSdesStream.h>
 #include <srtp/SrtpHandler.h>
+#include <srtp/SrtpMetrics.h>
 
 #include <CtZrtpSession.h>
 #include <TiviTimeoutProvider.h>
+#include <common/EventLoopTimeoutProvider.h>
 
 // Define sizer of internal buffers.
 // NOTE: ZRTP buffer is large. An application shall never use ZRTP protocol
@@ -59,6 +61,7 @@ protected:
     uint64_t          zrtpUnprotect;
     uint64_t          sdesUnprotect;
     uint64_t          unprotectFailed;
+    SrtpStreamMetrics metrics;             //!< SRTP counters and latencies, readable by other threads
 
     bool              enableZrtp;          //!< Enable the streams ZRTP engine
     bool              started;             //!< This stream's ZRTP engine is started
@@ -69,6 +72,30 @@ protected:
     CtZrtpStream();
     friend class CtZrtpSession;
     friend class TimeoutProvider<std::string, CtZrtpStream*>;
+    friend class EventLoopTimeoutProvider<std::string, CtZrtpStream*>;
+
+    /**
+     * Use the event loop timeout provider instead of the timeout thread.
+     *
+     * Must be called before the first stream is created, returns false if
+     * a stream created the other timeout provider already.
+     */
+    static bool setEventLoopTimers(bool yesNo);
+
+    /**
+     * Get the deadline of the next ZRTP timeout, see CtZrtpSession::getNextTimeout().
+     */
+    static int64_t getNextTimeout();
+
+    /**
+     * Deliver expired ZRTP timeouts, see CtZrtpSession::runExpiredTimers().
+     */
+    static int32_t runExpiredTimers(uint64_t now);
+
+    /**
+     * Add the SRTP metrics of all streams to a snapshot, see CtZrtpSession::getAggregateSrtpMetrics().
+     */
+    static void getAggregateSrtpMetrics(SrtpMetricsSnapshot* snapshot);
 
 
     virtual ~CtZrtpStream();
@@ -436,6 +463,13 @@ protected:
      */
     int32_t getSrtpTraceData(SrtpErrorData* data);
 
+    /**
+     * @brief Get the SRTP metrics of this stream.
+     *
+     * @param snapshot receives a copy of the stream's counters and latency histograms.
+     */
+    void getSrtpMetrics(SrtpMetricsSnapshot* snapshot);
+
     /*
      * The following methods implement the GNU ZRTP callback interface.
      * For detailed documentation refer to file ZrtpCallback.h
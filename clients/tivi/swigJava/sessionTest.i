@@ -89,6 +89,51 @@ typedef int int32_t;
  */
 %apply (uint8_t *BYTE)   { (uint8_t *buffer) };
 
+/*
+ * Typemaps for direct NIO buffers. The JNI code uses the buffer's memory
+ * directly and does not copy the data. The batch functions take a direct
+ * ByteBuffer with the packet slots and a direct IntBuffer with the packet
+ * lengths. Create the IntBuffer in native byte order, for example:
+ *
+ *   ByteBuffer.allocateDirect(4 * n).order(ByteOrder.nativeOrder()).asIntBuffer()
+ *
+ * SRTP appends its trailer in place. Each outgoing slot must provide
+ * CT_ZRTP_BATCH_HEADROOM bytes behind the packet, otherwise the batch function
+ * drops the packet and sets its length to 0. Size the slots as
+ * maximum RTP packet length + tiviSessionConstants.CT_ZRTP_BATCH_HEADROOM.
+ *
+ * A batch with one packet replaces the single packet functions if the
+ * application wants to avoid the copy of the byte[] typemap above.
+ */
+%typemap(in)     (uint8_t *DIRECT, size_t CAPACITY) {
+    $1 = (uint8_t *) JCALL1(GetDirectBufferAddress, jenv, $input);
+    if ($1 == NULL) {
+        SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, "ByteBuffer must be direct");
+        return $null;
+    }
+    $2 = (size_t) JCALL1(GetDirectBufferCapacity, jenv, $input);
+}
+%typemap(jni)    (uint8_t *DIRECT, size_t CAPACITY) "jobject"
+%typemap(jtype)  (uint8_t *DIRECT, size_t CAPACITY) "java.nio.ByteBuffer"
+%typemap(jstype) (uint8_t *DIRECT, size_t CAPACITY) "java.nio.ByteBuffer"
+%typemap(javain) (uint8_t *DIRECT, size_t CAPACITY) "$javainput"
+
+%typemap(in)     (int32_t *DIRECT, size_t CAPACITY) {
+    $1 = (int32_t *) JCALL1(GetDirectBufferAddress, jenv, $input);
+    if ($1 == NULL) {
+        SWIG_JavaThrowException(jenv, SWIG_JavaIllegalArgumentException, "IntBuffer must be direct");
+        return $null;
+    }
+    $2 = (size_t) JCALL1(GetDirectBufferCapacity, jenv, $input);    // capacity in int elements
+}
+%typemap(jni)    (int32_t *DIRECT, size_t CAPACITY) "jobject"
+%typemap(jtype)  (int32_t *DIRECT, size_t CAPACITY) "java.nio.IntBuffer"
+%typemap(jstype) (int32_t *DIRECT, size_t CAPACITY) "java.nio.IntBuffer"
+%typemap(javain) (int32_t *DIRECT, size_t CAPACITY) "$javainput"
+
+%apply (uint8_t *DIRECT, size_t CAPACITY) { (uint8_t *packets, size_t packetsLength) };
+%apply (int32_t *DIRECT, size_t CAPACITY) { (int32_t *lengths, size_t lengthsCount) };
+
 /*
  * Converts char* to Java byte[] array and not to Java String as usual.
  * A Java byte[] is more versatile because we can modify data inside the array
@@ -0,0 +1,191 @@
+/*
+  Copyright (C) 2006 - 2013 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _EVENTLOOPTIMEOUTPROVIDER_H_
+#define _EVENTLOOPTIMEOUTPROVIDER_H_
+
+/**
+ * @file EventLoopTimeoutProvider.h
+ * @brief Timeout provider for applications that run their own event loop
+ *
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <map>
+#include <mutex>
+#include <stdint.h>
+
+#include <common/osSpecifics.h>
+
+/**
+ * Provides timeouts without an own thread.
+ *
+ * The interface to request and cancel timeouts is the same as for the
+ * thread based TimeoutProvider of the clients. Instead of a thread that
+ * waits for the next timeout the application's event loop asks for the
+ * next deadline, uses it as timeout for its poll/epoll call and then calls
+ * runExpiredTimers(). The subscriber's @c handleTimeout method runs in the
+ * thread of the event loop.
+ *
+ * All deadlines use the monotonic clock of zrtpGetMonotonicMs(), thus changes
+ * of the system time don't affect the timeouts.
+ *
+ * A mutex protects the requests, thus any thread may request and cancel
+ * timeouts, for example the media threads that process incoming ZRTP packets.
+ * runExpiredTimers() calls @c handleTimeout without holding the mutex, the
+ * handlers may request or cancel timeouts.
+ *
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+template<class TOCommand, class TOSubscriber>
+class EventLoopTimeoutProvider {
+
+private:
+    struct Request {
+        TOSubscriber subscriber;
+        TOCommand command;
+        uint64_t sequence;
+    };
+
+    // Ordered by deadline, requests with the same deadline keep their order
+    typedef std::multimap<uint64_t, Request> RequestMap;
+    RequestMap requests;
+    uint64_t sequence;
+    mutable std::mutex lock;
+
+public:
+
+    EventLoopTimeoutProvider(): requests(), sequence(0) { }
+
+    /**
+     * @brief Remove all timeout requests.
+     */
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        requests.clear();
+    }
+
+    /**
+     * Request a timeout trigger.
+     *
+     * @param time_ms   Number of milli-seconds until the timeout is wanted.
+     * @param subscriber The receiver of the callback when the command has timed
+     *          out. This argument must not be NULL.
+     * @param command   Specifies the command to be passed back in the
+     *          callback.
+     */
+    void requestTimeout(int32_t time_ms, TOSubscriber subscriber, const TOCommand &command)
+    {
+        Request request;
+        request.subscriber = subscriber;
+        request.command = command;
+
+        std::lock_guard<std::mutex> guard(lock);
+        request.sequence = sequence++;
+        requests.insert(typename RequestMap::value_type(zrtpGetMonotonicMs() + time_ms, request));
+    }
+
+    /**
+     * Removes timeout requests that belong to a subscriber and command.
+     *
+     * @see requestTimeout
+     */
+    void cancelRequest(TOSubscriber subscriber, const TOCommand &command)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (typename RequestMap::iterator i = requests.begin(); i != requests.end(); ) {
+            if (i->second.command == command && i->second.subscriber == subscriber) {
+                requests.erase(i++);
+                continue;
+            }
+            i++;
+        }
+    }
+
+    /**
+     * @brief Get the deadline of the next timeout.
+     *
+     * @return the deadline in ms of the zrtpGetMonotonicMs() clock, -1 if no
+     *         timeout is pending.
+     */
+    int64_t getNextDeadline() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (requests.empty())
+            return -1;
+        return (int64_t)requests.begin()->first;
+    }
+
+    /**
+     * @brief Get the time until the next timeout.
+     *
+     * The result can be used directly as timeout of @c poll or @c epoll_wait.
+     *
+     * @param now current time of the zrtpGetMonotonicMs() clock
+     * @return milli-seconds until the next timeout, 0 if a timeout expired,
+     *         -1 if no timeout is pending.
+     */
+    int32_t getMsToNextTimeout(uint64_t now) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (requests.empty())
+            return -1;
+        uint64_t when = requests.begin()->first;
+        if (when <= now)
+            return 0;
+        return (int32_t)(when - now);
+    }
+
+    /**
+     * @brief Deliver all expired timeouts.
+     *
+     * Calls @c handleTimeout of the subscribers whose timeouts expired at
+     * @c now. Timeouts that the subscribers request during this call are
+     * delivered by the next call at the earliest.
+     *
+     * @param now current time of the zrtpGetMonotonicMs() clock
+     * @return number of delivered timeouts.
+     */
+    int32_t runExpiredTimers(uint64_t now)
+    {
+        int32_t delivered = 0;
+
+        std::unique_lock<std::mutex> guard(lock);
+        uint64_t limit = sequence;
+
+        typename RequestMap::iterator i = requests.begin();
+        while (i != requests.end() && i->first <= now) {
+            if (i->second.sequence >= limit) {      // requested during this call
+                i++;
+                continue;
+            }
+            Request request = i->second;
+            requests.erase(i);
+
+            // Call the handler with free mutex, it may request or cancel timeouts, start again at the front
+            guard.unlock();
+            request.subscriber->handleTimeout(request.command);
+            guard.lock();
+            delivered++;
+            i = requests.begin();
+        }
+        return delivered;
+    }
+};
+
+#endif
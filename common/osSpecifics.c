@@ -42,9 +42,15 @@ uint64_t  zrtpGetTickCount()
 
    return ret / 10;             //return msec
 }
+
+uint64_t zrtpGetMonotonicMs()
+{
+   return GetTickCount64();     // Vista and later
+}
 #else
 # include <netinet/in.h>
 # include <sys/time.h>
+# include <time.h>
 
 uint64_t zrtpGetTickCount()
 {
@@ -54,6 +60,14 @@ uint64_t zrtpGetTickCount()
    return ((uint64_t)tv.tv_sec) * (uint64_t)1000 + ((uint64_t)tv.tv_usec) / (uint64_t)1000;
 }
 
+uint64_t zrtpGetMonotonicMs()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ((uint64_t)ts.tv_sec) * (uint64_t)1000 + ((uint64_t)ts.tv_nsec) / (uint64_t)1000000;
+}
+
 #endif
 
 uint32_t zrtpNtohl (uint32_t net)
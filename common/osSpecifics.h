@@ -71,6 +71,16 @@ extern "C"
  */
 extern uint64_t zrtpGetTickCount();
 
+/**
+ * Get the time of a monotonic clock in milli-seconds.
+ *
+ * The clock does not jump if the system time changes, use it to compute
+ * timer deadlines. The start point of the clock is unspecified.
+ *
+ * @return current monotonic time in ms.
+ */
+extern uint64_t zrtpGetMonotonicMs();
+
 /**
  * Convert a 32bit variable from network to host order.
  *
@@ -391,6 +391,21 @@ int Skein_512_Final(Skein_512_Ctxt_t *ctx, u08b_t *hashVal)
     /* now output the result */
     byteCnt = (ctx->h.hashBitLen + 7) >> 3;             /* total number of output bytes */
 
+    /* Fast path for results up to one block (all MACs and hashes up to 512 bits,
+     * thus every SRTP packet): the only counter block is all zero, process it
+     * directly. This skips clearing b[] and saving/restoring the chaining
+     * variables, ctx->X holds the output block afterwards. */
+    if (byteCnt <= SKEIN_512_BLOCK_BYTES)
+    {
+        static const u08b_t zeroCounter[SKEIN_512_BLOCK_BYTES] = {0};
+
+        Skein_Start_New_Type(ctx,OUT_FINAL);
+        Skein_512_Process_Block(ctx,zeroCounter,1,sizeof(u64b_t));
+        Skein_Put64_LSB_First(hashVal,ctx->X,byteCnt);
+        Skein_Show_Final(512,&ctx->h,byteCnt,hashVal);
+        return SKEIN_SUCCESS;
+    }
+
     /* run Threefish in "counter mode" to generate output */
     memset(ctx->b,0,sizeof(ctx->b));  /* zero out b[], so it can hold the counter */
     memcpy(X,ctx->X,sizeof(X));       /* keep a local copy of counter mode "key" */
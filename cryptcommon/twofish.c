@@ -637,6 +637,8 @@ static int test_vector( Twofish_Byte key[], int key_len, Twofish_Byte p[16], Two
     { 
     Twofish_Byte tmp[16];               /* scratch pad. */ 
     Twofish_key xkey;           /* The expanded key */ 
+    Twofish_compact_key ckey;   /* The compact form of the key */
+    Twofish_Byte blocks[9*16];  /* multi-block scratch pad */
     int i; 
  
  
@@ -666,6 +668,39 @@ static int test_vector( Twofish_Byte key[], int key_len, Twofish_Byte p[16], Two
             } 
         } 
  
+    /*
+     * The multi-block encryption must produce the same ciphertext as the
+     * single block encryption. Each block gets a different plaintext, thus
+     * a mixed up block order or lane is detected.
+     */
+    for( i=0; i<9; i++ )
+        {
+        memcpy( blocks+16*i, p, 16 );
+        blocks[16*i] ^= (Twofish_Byte)i;
+        blocks[16*i+15] ^= (Twofish_Byte)(i << 4);
+        }
+    Twofish_encrypt_blocks( &xkey, blocks, blocks, 9 );
+    for( i=0; i<9; i++ )
+        {
+        memcpy( tmp, p, 16 );
+        tmp[0] ^= (Twofish_Byte)i;
+        tmp[15] ^= (Twofish_Byte)(i << 4);
+        Twofish_encrypt( &xkey, tmp, tmp );
+        if( memcmp( tmp, blocks+16*i, 16 ) != 0 )
+            {
+	      Twofish_fatal( "Twofish multi-block encryption failure", ERR_TEST_ENC );
+            }
+        }
+
+    /* The compact key form must produce the same ciphertext. */
+    if ((i = Twofish_prepare_compact_key( key, key_len, &ckey)) < 0)
+	return i;
+    Twofish_encrypt_compact( &ckey, p, tmp );
+    if( memcmp( c, tmp, 16 ) != 0 )
+        {
+	  Twofish_fatal( "Twofish compact key encryption failure", ERR_TEST_ENC );
+        }
+
     /* The test keys are not secret, so we don't need to wipe xkey. */
     return SUCCESS;
     }
@@ -1345,7 +1380,8 @@ static void * (*volatile memset_volatile)(void *, int, size_t) = memset;
  * xkey     Pointer to an Twofish_key structure that will be filled  
  *             with the internal form of the cipher key. 
  */ 
-int Twofish_prepare_key( Twofish_Byte key[], int key_len, Twofish_key * xkey ) 
+static int prepare_key( Twofish_Byte key[], int key_len, Twofish_UInt32 roundKeys[40],
+                        Twofish_Byte S[32], int * kCyclesOut )
     { 
     /* We use a single array to store all key material in,  
      * to simplify the wiping of the key material at the end. 
@@ -1469,8 +1505,8 @@ int Twofish_prepare_key( Twofish_Byte key[], int key_len, Twofish_key * xkey )
         /* Compute and store the round keys. */ 
         A += B; 
         B += A; 
-        xkey->K[i]   = A; 
-        xkey->K[i+1] = ROL32( B, 9 ); 
+        roundKeys[i]   = A; 
+        roundKeys[i+1] = ROL32( B, 9 ); 
         } 
  
     /* Wipe variables that contained key material. */ 
@@ -1580,13 +1616,43 @@ int Twofish_prepare_key( Twofish_Byte key[], int key_len, Twofish_key * xkey )
     /* Wipe variables that contained key material. */ 
     b = bx = bxx = 0; 
  
-    /* And finally, we can compute the key-dependent S-boxes. */ 
-    fill_keyed_sboxes( &K[32], kCycles, xkey ); 
- 
+    /* Hand out the S vector, the callers compute or store the S-boxes. */
+    memcpy( S, &K[32], 32 );
+    *kCyclesOut = kCycles;
+
     /* Wipe array that contained key material. */ 
     (*memset_volatile)( K, 0, sizeof( K ) );
     return SUCCESS;
     } 
+
+int Twofish_prepare_key( Twofish_Byte key[], int key_len, Twofish_key * xkey )
+    {
+    Twofish_Byte S[32];
+    int kCycles;
+    int ret;
+
+    if ((ret = prepare_key( key, key_len, xkey->K, S, &kCycles )) < 0)
+        return ret;
+
+    /* And finally, we can compute the key-dependent S-boxes. */
+    ret = fill_keyed_sboxes( S, kCycles, xkey );
+
+    (*memset_volatile)( S, 0, sizeof( S ) );
+    return ret;
+    }
+
+/*
+ * Prepare a compact key. This runs the same key schedule but keeps the
+ * S vector instead of the pre-computed keyed S-boxes.
+ */
+int Twofish_prepare_compact_key( Twofish_Byte key[], int key_len, Twofish_compact_key * xkey )
+    {
+    int ret;
+
+    if ((ret = prepare_key( key, key_len, xkey->K, xkey->S, &xkey->kCycles )) < 0)
+        return ret;
+    return SUCCESS;
+    }
  
  
 /* 
@@ -1733,6 +1799,183 @@ void Twofish_decrypt( Twofish_key * xkey, Twofish_Byte c[16], Twofish_Byte p[16]
     PUT_OUTPUT( C,D,A,B, p, xkey, 0 ); 
     } 
  
+/*
+ * Multi-block encryption, used by the counter mode and the CFB decryption
+ * which encrypt independent blocks.
+ *
+ * On x86-64 CPUs with AVX2 encrypt eight blocks in parallel. The four state
+ * words of the eight blocks are transposed into four vectors, the keyed S-box
+ * lookups become gathers from the pre-computed S-boxes. The function checks
+ * the CPU once. Define TWOFISH_NO_AVX2 to build only the C code.
+ */
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(TWOFISH_NO_AVX2)
+#define TWOFISH_AVX2 1
+#include <cpuid.h>
+#include <immintrin.h>
+
+static int have_avx2()
+    {
+    static int haveAvx2 = -1;
+    unsigned int a, b, c, d;
+
+    if (haveAvx2 < 0)
+        {
+        haveAvx2 = 0;
+        /* The OS must save the YMM registers, check XCR0 before CPUID leaf 7 */
+        if (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_OSXSAVE) && (c & bit_AVX))
+            {
+            __asm__ ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+            if ((a & 6) == 6 && __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2))
+                haveAvx2 = 1;
+            }
+        }
+    return haveAvx2;
+    }
+
+/* 4x4 transpose of 32-bit words inside each 128-bit lane, its own inverse */
+#define TRANSPOSE_AVX2( X0,X1,X2,X3, Y0,Y1,Y2,Y3 ) \
+    { __m256i t0 = _mm256_unpacklo_epi32(X0, X1), t1 = _mm256_unpackhi_epi32(X0, X1); \
+      __m256i t2 = _mm256_unpacklo_epi32(X2, X3), t3 = _mm256_unpackhi_epi32(X2, X3); \
+      Y0 = _mm256_unpacklo_epi64(t0, t2); Y1 = _mm256_unpackhi_epi64(t0, t2); \
+      Y2 = _mm256_unpacklo_epi64(t1, t3); Y3 = _mm256_unpackhi_epi64(t1, t3); }
+
+#define SBOX_AVX2( n, X ) _mm256_i32gather_epi32( (const int *)xkey->s[n], (X), 4 )
+#define B0_AVX2( X )  _mm256_and_si256( (X), mask )
+#define B1_AVX2( X )  _mm256_and_si256( _mm256_srli_epi32( (X), 8 ), mask )
+#define B2_AVX2( X )  _mm256_and_si256( _mm256_srli_epi32( (X), 16 ), mask )
+#define B3_AVX2( X )  _mm256_srli_epi32( (X), 24 )
+
+#define G0_AVX2( X ) \
+    _mm256_xor_si256( _mm256_xor_si256( SBOX_AVX2( 0, B0_AVX2(X) ), SBOX_AVX2( 1, B1_AVX2(X) ) ), \
+                      _mm256_xor_si256( SBOX_AVX2( 2, B2_AVX2(X) ), SBOX_AVX2( 3, B3_AVX2(X) ) ) )
+
+#define G1_AVX2( X ) \
+    _mm256_xor_si256( _mm256_xor_si256( SBOX_AVX2( 0, B3_AVX2(X) ), SBOX_AVX2( 1, B0_AVX2(X) ) ), \
+                      _mm256_xor_si256( SBOX_AVX2( 2, B1_AVX2(X) ), SBOX_AVX2( 3, B2_AVX2(X) ) ) )
+
+#define ENCRYPT_RND_AVX2( A,B,C,D, T0, T1, r ) \
+    T0 = G0_AVX2( A ); T1 = G1_AVX2( B ); \
+    C = _mm256_xor_si256( C, _mm256_add_epi32( _mm256_add_epi32( T0, T1 ), \
+                                               _mm256_set1_epi32( xkey->K[8+2*(r)] ) ) ); \
+    C = _mm256_or_si256( _mm256_srli_epi32( C, 1 ), _mm256_slli_epi32( C, 31 ) ); \
+    D = _mm256_or_si256( _mm256_slli_epi32( D, 1 ), _mm256_srli_epi32( D, 31 ) ); \
+    D = _mm256_xor_si256( D, _mm256_add_epi32( _mm256_add_epi32( T0, _mm256_add_epi32( T1, T1 ) ), \
+                                               _mm256_set1_epi32( xkey->K[8+2*(r)+1] ) ) )
+
+__attribute__((target("avx2")))
+static void encrypt_8_blocks_avx2( Twofish_key * xkey, const Twofish_Byte * p, Twofish_Byte * c )
+    {
+    const __m256i mask = _mm256_set1_epi32( 0xff );
+    __m256i X0, X1, X2, X3;
+    __m256i A, B, C, D, T0, T1;
+    int r;
+
+    /*
+     * Each load holds two blocks. After the transpose A holds the first word
+     * of all blocks, B the second word, and so on.
+     */
+    X0 = _mm256_loadu_si256( (const __m256i *)(p) );
+    X1 = _mm256_loadu_si256( (const __m256i *)(p+32) );
+    X2 = _mm256_loadu_si256( (const __m256i *)(p+64) );
+    X3 = _mm256_loadu_si256( (const __m256i *)(p+96) );
+    TRANSPOSE_AVX2( X0,X1,X2,X3, A,B,C,D );
+
+    A = _mm256_xor_si256( A, _mm256_set1_epi32( xkey->K[0] ) );
+    B = _mm256_xor_si256( B, _mm256_set1_epi32( xkey->K[1] ) );
+    C = _mm256_xor_si256( C, _mm256_set1_epi32( xkey->K[2] ) );
+    D = _mm256_xor_si256( D, _mm256_set1_epi32( xkey->K[3] ) );
+
+    for( r=0; r<8; r++ )
+        {
+        ENCRYPT_RND_AVX2( A,B,C,D, T0,T1, 2*r );
+        ENCRYPT_RND_AVX2( C,D,A,B, T0,T1, 2*r+1 );
+        }
+
+    /* Final swap and output whitening, see PUT_OUTPUT */
+    C = _mm256_xor_si256( C, _mm256_set1_epi32( xkey->K[4] ) );
+    D = _mm256_xor_si256( D, _mm256_set1_epi32( xkey->K[5] ) );
+    A = _mm256_xor_si256( A, _mm256_set1_epi32( xkey->K[6] ) );
+    B = _mm256_xor_si256( B, _mm256_set1_epi32( xkey->K[7] ) );
+    TRANSPOSE_AVX2( C,D,A,B, X0,X1,X2,X3 );
+    _mm256_storeu_si256( (__m256i *)(c), X0 );
+    _mm256_storeu_si256( (__m256i *)(c+32), X1 );
+    _mm256_storeu_si256( (__m256i *)(c+64), X2 );
+    _mm256_storeu_si256( (__m256i *)(c+96), X3 );
+    }
+#endif
+
+void Twofish_encrypt_blocks( Twofish_key * xkey, const Twofish_Byte * p, Twofish_Byte * c, int blocks )
+    {
+#if TWOFISH_AVX2
+    if( blocks >= 8 && have_avx2() )
+        {
+        for( ; blocks >= 8; blocks -= 8 )
+            {
+            encrypt_8_blocks_avx2( xkey, p, c );
+            p += 128;
+            c += 128;
+            }
+        }
+#endif
+    for( ; blocks > 0; blocks-- )
+        {
+        Twofish_encrypt( xkey, (Twofish_Byte *)p, c );
+        p += 16;
+        c += 16;
+        }
+    }
+
+/*
+ * Compact key encryption. The g() function computes the keyed S-boxes on
+ * the fly with the Hxx macros, that is the q-table lookups and the MDS table
+ * lookup per byte. The q-tables and MDS tables are shared by all keys.
+ * The n argument is the number of key cycles, it selects the Hxx macros.
+ */
+#define cg0(X,xkey,n) \
+ (H0##n(b0(X),xkey->S)^H1##n(b1(X),xkey->S)^H2##n(b2(X),xkey->S)^H3##n(b3(X),xkey->S))
+
+#define cg1(X,xkey,n) \
+ (H0##n(b3(X),xkey->S)^H1##n(b0(X),xkey->S)^H2##n(b1(X),xkey->S)^H3##n(b2(X),xkey->S))
+
+#define COMPACT_ENCRYPT_RND( A,B,C,D, T0, T1, xkey, r, n ) \
+    T0 = cg0(A,xkey,n); T1 = cg1(B,xkey,n);\
+    C ^= T0+T1+xkey->K[8+2*(r)]; C = ROR32(C,1);\
+    D = ROL32(D,1); D ^= T0+2*T1+xkey->K[8+2*(r)+1]
+
+/* One encryption function per key cycle count, loop over the 8 cycles */
+#define COMPACT_ENCRYPT_FUNCTION( n ) \
+static void encrypt_compact_##n( Twofish_compact_key * xkey, Twofish_Byte p[16], Twofish_Byte c[16]) \
+    { \
+    Twofish_UInt32 A,B,C,D,T0,T1; \
+    int r; \
+    GET_INPUT( p, A,B,C,D, xkey, 0 ); \
+    for( r=0; r<8; r++ ) \
+        { \
+        COMPACT_ENCRYPT_RND( A,B,C,D,T0,T1,xkey,2*r,n ); \
+        COMPACT_ENCRYPT_RND( C,D,A,B,T0,T1,xkey,2*r+1,n ); \
+        } \
+    PUT_OUTPUT( C,D,A,B, c, xkey, 4 ); \
+    }
+
+COMPACT_ENCRYPT_FUNCTION( 2 )
+COMPACT_ENCRYPT_FUNCTION( 3 )
+COMPACT_ENCRYPT_FUNCTION( 4 )
+
+void Twofish_encrypt_compact( Twofish_compact_key * xkey, Twofish_Byte p[16], Twofish_Byte c[16])
+    {
+    switch( xkey->kCycles ) {
+    case 2:
+        encrypt_compact_2( xkey, p, c );
+        break;
+    case 3:
+        encrypt_compact_3( xkey, p, c );
+        break;
+    default:
+        encrypt_compact_4( xkey, p, c );
+        break;
+        }
+    }
+
 /* 
  * Using the macros it is easy to make special routines for 
  * CBC mode, CTR mode etc. The only thing you might want to 
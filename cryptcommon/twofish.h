@@ -107,6 +107,26 @@ typedef
         }
     Twofish_key; 
 
+/**
+ * Structure that contains a compact prepared Twofish key.
+ *
+ * This form stores the round keys and the S vector only, 196 bytes on a
+ * platform with 32-bit unsigned values. The encryption computes the keyed
+ * S-boxes on the fly from the S vector and the q-tables and MDS tables which
+ * all keys share. This trades encryption speed for memory: use it if an
+ * application holds many keys at the same time.
+ *
+ * Treat this as an opague structure as well.
+ */
+typedef
+    struct
+        {
+        Twofish_UInt32 K[40];       /* Round key words */
+        Twofish_Byte S[32];         /* S vector, in the byte order h() uses */
+        int kCycles;                /* Number of key cycles, 2, 3, or 4 */
+        }
+    Twofish_compact_key;
+
 
 /**
  * Initialise and test the Twofish implementation.  
@@ -170,6 +190,24 @@ extern int Twofish_prepare_key(
                                 );
 
 
+/**
+ * Convert a cipher key to the compact internal form.
+ *
+ * Same as Twofish_prepare_key() but fills a Twofish_compact_key structure.
+ * Wipe the structure once you are done with the key data.
+ *
+ * @param key      Array of key bytes
+ * @param key_len  Number of key bytes, must be in the range 0,1,...,32.
+ * @param xkey     Pointer to an Twofish_compact_key structure that will be filled
+ *                 with the compact internal form of the cipher key.
+ * @returns a negative number if an error happend, +1 otherwise
+ */
+extern int Twofish_prepare_compact_key(
+                                Twofish_Byte key[],
+                                int key_len,
+                                Twofish_compact_key * xkey
+                                );
+
 /**
  * Encrypt a single block of data. 
  * 
@@ -193,6 +231,46 @@ extern void Twofish_encrypt(
                             ); 
 
 
+/**
+ * Encrypt several independent blocks of data.
+ *
+ * Same as calling Twofish_encrypt() for each block, but uses a parallel
+ * implementation if the CPU supports it. Use it for cipher modes that
+ * encrypt independent blocks, such as CTR mode or CFB decryption.
+ *
+ * @param xkey     pointer to Twofish_key, internal form of the key
+ *                 produces by Twofish_prepare_key()
+ * @param p        Plaintext blocks to be encrypted, 16 * blocks bytes
+ * @param c        Place to store the ciphertext blocks, 16 * blocks bytes
+ * @param blocks   Number of 16 byte blocks
+ */
+extern void Twofish_encrypt_blocks(
+                            Twofish_key * xkey,
+                            const Twofish_Byte * p,
+                            Twofish_Byte * c,
+                            int blocks
+                            );
+
+
+/**
+ * Encrypt a single block of data with a compact key.
+ *
+ * Produces the same result as Twofish_encrypt() with the same cipher key.
+ * There is no compact decryption: the SRTP and CFB modes need the encryption
+ * only.
+ *
+ * @param xkey     pointer to Twofish_compact_key, compact form of the key
+ *                 produced by Twofish_prepare_compact_key()
+ * @param p        Plaintext to be encrypted
+ * @param c        Place to store the ciphertext
+ */
+extern void Twofish_encrypt_compact(
+                            Twofish_compact_key * xkey,
+                            Twofish_Byte p[16],
+                            Twofish_Byte c[16]
+                            );
+
+
 /**
  * Decrypt a single block of data. 
  * 
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "twofish.h"
 
@@ -72,16 +73,25 @@ void Twofish_cfb128_decrypt(Twofish_key* keyCtx, Twofish_Byte* in,
       --len;
       n = (n+1) % 16;
     }
+    /*
+     * The key stream input are the IV and the previous ciphertext blocks,
+     * all known: encrypt up to 8 of them in one call.
+     */
     while (len>=16) {
-      Twofish_encrypt(keyCtx, ivec, ivec);
-      for (n=0; n<16; n+=sizeof(size_t)) {
-	size_t t = *(size_t*)(in+n);
-	*(size_t*)(out+n) = *(size_t*)(ivec+n) ^ t;
-	*(size_t*)(ivec+n) = t;
-      }
-      len -= 16;
-      out += 16;
-      in  += 16;
+      Twofish_Byte stream[8*16];
+      size_t blocks = len/16, i;
+
+      if (blocks > 8)
+        blocks = 8;
+      memcpy(stream, ivec, 16);
+      memcpy(stream+16, in, (blocks-1)*16);
+      memcpy(ivec, in+(blocks-1)*16, 16);     /* last ciphertext block is the next IV */
+      Twofish_encrypt_blocks(keyCtx, stream, stream, (int)blocks);
+      for (i=0; i<blocks*16; i++)
+        out[i] = in[i] ^ stream[i];
+      len -= blocks*16;
+      out += blocks*16;
+      in  += blocks*16;
     }
     n = 0;
     if (len) {
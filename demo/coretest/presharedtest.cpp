@@ -0,0 +1,181 @@
+// Test the fallback from ZRTP Preshared mode to DH mode
+//
+// Copyright (C) 2012 Werner Dittmann <Werner.Dittmann@t-online.de>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/*
+ * Preshared mode fallback test.
+ *
+ * Runs ZRTP handshakes of two engines in one process, the engines exchange
+ * their packets through queues. The first call uses DH mode and sets up the
+ * retained secrets, then we corrupt the retained secret of one side. The
+ * Responder rejects the Preshared Commit with Error NoSharedSecret, the
+ * Initiator must fall back to DH mode and complete the handshake without
+ * reporting an error to the application.
+ *
+ * Returns 0 if all checks pass.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <libzrtpcpp/ZRtp.h>
+#include <libzrtpcpp/ZrtpConfigure.h>
+#include <libzrtpcpp/ZIDCache.h>
+#include <libzrtpcpp/ZrtpCodes.h>
+
+using namespace GnuZrtpCodes;
+
+typedef std::deque<std::vector<uint8_t> > PacketQueue;
+
+class TestCallback : public ZrtpCallback {
+public:
+    TestCallback(const char* name, PacketQueue* out): name(name), out(out), secure(false), errors(0) { }
+
+    int32_t sendDataZRTP(const uint8_t* data, int32_t length) {
+        out->push_back(std::vector<uint8_t>(data, data + length));
+        return 1;
+    }
+    int32_t activateTimer(int32_t time) { return 1; }
+    int32_t cancelTimer() { return 1; }
+    void sendInfo(MessageSeverity severity, int32_t subCode) {
+        if (severity == ZrtpError || severity == Severe) {
+            fprintf(stderr, "%s: error info, severity %d, code %d\n", name, severity, subCode);
+            errors++;
+        }
+    }
+    bool srtpSecretsReady(SrtpSecret_t* secrets, EnableSecurity part) { sas = secrets->sas; return true; }
+    void srtpSecretsOff(EnableSecurity part) { }
+    void srtpSecretsOn(std::string c, std::string s, bool verified) { cipher = c; secure = true; }
+    void handleGoClear() { }
+    void zrtpNegotiationFailed(MessageSeverity severity, int32_t subCode) {
+        fprintf(stderr, "%s: negotiation failed, severity %d, code %d\n", name, severity, subCode);
+        errors++;
+    }
+    void zrtpNotSuppOther() { errors++; }
+    void synchEnter() { }
+    void synchLeave() { }
+    void zrtpAskEnrollment(InfoEnrollment info) { }
+    void zrtpInformEnrollment(InfoEnrollment info) { }
+    void signSAS(uint8_t* sasHash) { }
+    bool checkSASSignature(uint8_t* sasHash) { return true; }
+
+    const char* name;
+    PacketQueue* out;
+    std::string cipher;
+    std::string sas;
+    bool secure;
+    int32_t errors;
+};
+
+static uint8_t zidA[IDENTIFIER_LEN] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+static uint8_t zidB[IDENTIFIER_LEN] = {12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+
+/*
+ * Run one call, returns true if both sides went secure with the same SAS and
+ * reported no error. Sets preshared if a side used Preshared mode.
+ */
+static bool runCall(bool bStartsFirst, bool* preshared)
+{
+    PacketQueue toA, toB;
+    TestCallback callbackA("A", &toB);
+    TestCallback callbackB("B", &toA);
+
+    ZrtpConfigure configA, configB;
+    configA.setStandardConfig();
+    configA.setPreSharedPolicy(ZrtpConfigure::PreSharedAlways);
+    configB.setStandardConfig();
+    configB.setPreSharedPolicy(ZrtpConfigure::PreSharedAlways);
+
+    ZRtp* a = new ZRtp(zidA, &callbackA, "A", &configA);
+    ZRtp* b = new ZRtp(zidB, &callbackB, "B", &configB);
+    if (bStartsFirst) {
+        b->startZrtpEngine();
+        a->startZrtpEngine();
+    }
+    else {
+        a->startZrtpEngine();
+        b->startZrtpEngine();
+    }
+    // The fixed RTP header of 12 bytes is not part of the queued packets
+    for (int i = 0; i < 200 && (!toA.empty() || !toB.empty()); i++) {
+        if (!toA.empty()) {
+            std::vector<uint8_t> packet = toA.front();
+            toA.pop_front();
+            a->processZrtpMessage(&packet[0], 2, packet.size() + 12);
+        }
+        if (!toB.empty()) {
+            std::vector<uint8_t> packet = toB.front();
+            toB.pop_front();
+            b->processZrtpMessage(&packet[0], 1, packet.size() + 12);
+        }
+    }
+    *preshared = a->isPresharedMode() || b->isPresharedMode();
+    bool ok = callbackA.secure && callbackB.secure && callbackA.sas == callbackB.sas &&
+              callbackA.errors == 0 && callbackB.errors == 0;
+    delete a;
+    delete b;
+    return ok;
+}
+
+/* Replace the retained secret B stores for A, B then rejects A's Preshared Commit */
+static void corruptRs1()
+{
+    uint8_t junk[RS_LENGTH];
+    memset(junk, 0x5a, sizeof(junk));
+
+    ZIDRecord* record = getZidCacheInstance()->getRecord(zidA);
+    record->setNewRs1(junk);
+    getZidCacheInstance()->saveRecord(record);
+    delete record;
+}
+
+int main(int argc, char *argv[])
+{
+    const char* cacheFile = "presharedtest.zid";
+    int32_t failed = 0;
+    bool preshared;
+
+    for (int32_t order = 0; order < 2; order++) {
+        // Start each order with an empty cache
+        unlink(cacheFile);
+        if (getZidCacheInstance()->open((char*)cacheFile) < 0) {
+            fprintf(stderr, "Cannot open ZID cache %s\n", cacheFile);
+            return 1;
+        }
+        // First call: no retained secrets, DH mode
+        if (!runCall(order == 1, &preshared) || preshared) {
+            fprintf(stderr, "DH call failed (order %d)\n", order);
+            failed++;
+        }
+        // Second call: the Responder rejects the Preshared Commit, fallback to DH
+        corruptRs1();
+        if (!runCall(order == 1, &preshared) || preshared) {
+            fprintf(stderr, "Preshared fallback call failed (order %d)\n", order);
+            failed++;
+        }
+        getZidCacheInstance()->close();
+    }
+    unlink(cacheFile);
+
+    printf("Preshared fallback test: %s\n", failed == 0 ? "passed" : "FAILED");
+    return failed == 0 ? 0 : 1;
+}
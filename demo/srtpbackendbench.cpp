@@ -0,0 +1,88 @@
+/*
+ * Run the self benchmark of the SRTP crypto backends and compare the SRTP
+ * protect time of AES-CM/HMAC-SHA1 with the embedded and the selected
+ * backends.
+ *
+ * Build the library with -DSRTP_OPENSSL=true to get the OpenSSL backend.
+ *
+ * Usage: srtpbackendbench [payload length] [number of packets]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <CryptoContext.h>
+#include <SrtpHandler.h>
+#include <crypto/SrtpCryptoBackend.h>
+
+using namespace std::chrono;
+
+static uint8_t masterKey[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+
+static uint8_t masterSalt[14] = {
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d };
+
+static double protectUs(uint32_t payloadLength, int packets)
+{
+    // The context sets its keys now, thus it uses the currently selected backends
+    CryptoContext ctx(0x12345678, 0, 0, SrtpEncryptionAESCM, SrtpAuthenticationSha1Hmac,
+                      masterKey, sizeof(masterKey), masterSalt, sizeof(masterSalt),
+                      16, 20, 14, 10);
+    ctx.deriveSrtpKeys(0);
+
+    uint8_t packet[1600];
+    size_t newLength;
+
+    memset(packet, 0x5a, sizeof(packet));
+    packet[0] = 0x80;
+    packet[1] = 0;
+
+    steady_clock::time_point start = steady_clock::now();
+    for (int i = 0; i < packets; i++) {
+        packet[2] = (uint8_t)(i >> 8);
+        packet[3] = (uint8_t)i;
+        SrtpHandler::protect(&ctx, packet, 12 + payloadLength, &newLength);
+    }
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0 / packets;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t payloadLength = 160;
+    int packets = 200000;
+    const char* primitives[numberOfSrtpPrimitives] = { "AES", "SHA1" };
+
+    if (argc > 1)
+        payloadLength = atoi(argv[1]);
+    if (argc > 2)
+        packets = atoi(argv[2]);
+    if (payloadLength > 1500 || packets <= 0) {
+        fprintf(stderr, "Usage: %s [payload length <= 1500] [number of packets]\n", argv[0]);
+        return 1;
+    }
+
+    double embeddedUs = protectUs(payloadLength, packets);
+
+    SrtpBackendTimings timings;
+    SrtpCryptoBackend::selectFastest(payloadLength, &timings);
+
+    printf("Self benchmark, %u bytes payload, ns per packet\n", payloadLength);
+    for (int p = 0; p < numberOfSrtpPrimitives; p++) {
+        printf("%-6s", primitives[p]);
+        for (int b = 0; b < numberOfSrtpBackends; b++) {
+            if (SrtpCryptoBackend::isAvailable(p, b))
+                printf("  %s %8.1f", SrtpCryptoBackend::getName(b), timings.nsPerPacket[p][b]);
+        }
+        printf("  -> %s\n", SrtpCryptoBackend::getName(SrtpCryptoBackend::getSelected(p)));
+    }
+
+    double selectedUs = protectUs(payloadLength, packets);
+    printf("SRTP protect AES-CM/HMAC-SHA1: embedded %.2f us, selected %.2f us per packet\n",
+           embeddedUs, selectedUs);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Compare the full and the compact Twofish key form of SrtpSymCrypto.
+ *
+ * For each key form the program reports the memory a key needs, the time to
+ * set a new key, and the time to encrypt a typical SRTP payload in counter
+ * mode. AES is included as reference.
+ *
+ * Usage: twofishbench [payload length] [number of packets]
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <crypto/SrtpSymCrypto.h>
+#include <cryptcommon/twofish.h>
+
+using namespace std::chrono;
+
+static uint8_t key[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f };
+
+static void bench(const char* name, int algo, size_t keyMemory, int keyLength, uint32_t payloadLength, int packets)
+{
+    SrtpSymCrypto cipher(algo);
+    uint8_t payload[1500];
+    uint8_t iv[16];
+
+    memset(payload, 0x5a, sizeof(payload));
+    memset(iv, 0, sizeof(iv));
+
+    const int keys = 10000;
+    steady_clock::time_point start = steady_clock::now();
+    for (int i = 0; i < keys; i++) {
+        key[0] = (uint8_t)i;
+        cipher.setNewKey(key, keyLength);
+    }
+    double keyUs = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0 / keys;
+
+    start = steady_clock::now();
+    for (int i = 0; i < packets; i++) {
+        iv[13] = (uint8_t)i;
+        cipher.ctr_encrypt(payload, payloadLength, iv);
+    }
+    double pktUs = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0 / packets;
+
+    printf("%-16s %3d bit  key memory %5zu bytes  key setup %7.2f us  packet %6.2f us  %7.1f MB/s\n",
+           name, keyLength * 8, keyMemory, keyUs, pktUs, payloadLength / pktUs);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t payloadLength = 160;
+    int packets = 200000;
+
+    if (argc > 1)
+        payloadLength = atoi(argv[1]);
+    if (argc > 2)
+        packets = atoi(argv[2]);
+    if (payloadLength > 1500 || packets <= 0) {
+        fprintf(stderr, "Usage: %s [payload length <= 1500] [number of packets]\n", argv[0]);
+        return 1;
+    }
+    printf("Counter mode, %u bytes payload, %d packets\n", payloadLength, packets);
+
+    for (int keyLength = 16; keyLength <= 32; keyLength += 16) {
+        bench("AES", SrtpEncryptionAESCM, sizeof(SrtpSymCrypto), keyLength, payloadLength, packets);
+
+        SrtpSymCrypto::setTwofishCompactKey(false);
+        bench("Twofish full", SrtpEncryptionTWOCM, sizeof(SrtpSymCrypto) + sizeof(Twofish_key),
+              keyLength, payloadLength, packets);
+
+        SrtpSymCrypto::setTwofishCompactKey(true);
+        bench("Twofish compact", SrtpEncryptionTWOCM, sizeof(SrtpSymCrypto), keyLength, payloadLength, packets);
+    }
+    return 0;
+}
@@ -23,12 +23,97 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 #include <common/osSpecifics.h>
 
 #include <CryptoContext.h>
 #include <crypto/SrtpSymCrypto.h>
 
+static SrtpContextAlloc contextAlloc = NULL;
+static SrtpContextFree contextFree = NULL;
+
+void setSrtpContextAllocator(SrtpContextAlloc allocFunc, SrtpContextFree freeFunc)
+{
+    contextAlloc = allocFunc;
+    contextFree = freeFunc;
+}
+
+void* srtpContextAlloc(size_t size)
+{
+    if (contextAlloc != NULL)
+        return contextAlloc(size);
+#ifdef _WIN32
+    return _aligned_malloc(size, SRTP_CACHE_LINE);
+#else
+    void* ptr;
+    if (posix_memalign(&ptr, SRTP_CACHE_LINE, size) != 0)
+        return NULL;
+    return ptr;
+#endif
+}
+
+void srtpContextFree(void* ptr)
+{
+    if (contextFree != NULL) {
+        contextFree(ptr);
+        return;
+    }
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+SrtpReplayWindow::SrtpReplayWindow(int32_t windowSize)
+{
+    if (windowSize < 64)
+        windowSize = 64;
+    if (windowSize > SRTP_MAX_REPLAY_WINDOW)
+        windowSize = SRTP_MAX_REPLAY_WINDOW;
+    size = windowSize;
+
+    // One word more than the window needs, rounded up to a power of two
+    uint32_t words = (size + 63) / 64 + 1;
+    uint32_t ringWords = 1;
+    while (ringWords < words)
+        ringWords <<= 1;
+    mask = ringWords - 1;
+
+    bits = inlineBits;
+    if (ringWords > SRTP_REPLAY_INLINE_WORDS) {
+        bits = static_cast<uint64_t*>(srtpContextAlloc(ringWords * sizeof(uint64_t)));
+        if (bits == NULL)
+            throw std::bad_alloc();
+    }
+    memset(bits, 0, ringWords * sizeof(uint64_t));
+}
+
+SrtpReplayWindow::~SrtpReplayWindow()
+{
+    if (bits != inlineBits)
+        srtpContextFree(bits);
+}
+
+void* CryptoContext::operator new(size_t size)
+{
+    void* ptr = srtpContextAlloc(size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void CryptoContext::operator delete(void* ptr)
+{
+    if (ptr != NULL)
+        srtpContextFree(ptr);
+}
+
 CryptoContext::CryptoContext( uint32_t ssrc,
                               int32_t roc,
                               int64_t key_deriv_rate,
@@ -41,69 +126,57 @@ CryptoContext::CryptoContext( uint32_t ssrc,
                               int32_t ekeyl,
                               int32_t akeyl,
                               int32_t skeyl,
-                              int32_t tagLength):
+                              int32_t tagLength,
+                              int32_t replayWindowSize):
 
-        ssrcCtx(ssrc), mkiLength(0),mki(NULL), roc(roc),guessed_roc(0),
-        s_l(0),key_deriv_rate(key_deriv_rate), labelBase(0), seqNumSet(false), 
-        macCtx(NULL), cipher(NULL), f8Cipher(NULL)
+        ssrcCtx(ssrc), roc(roc), guessed_roc(0), s_l(0), seqNumSet(false), labelBase(0),
+        mkiLength(0), ivTemplateSsrc(ssrc), replayWindow(replayWindowSize), macCtx(NULL), cipher(ealg), f8Cipher(ealg),
+        key_deriv_rate(key_deriv_rate), mki(NULL), authFailureLimit(SRTP_AUTH_FAILURE_LIMIT), authFailures(0),
+        authFailureWindow(0), authThrottled(false)
 {
-    replay_window[0] = replay_window[1] = 0;
     this->ealg = ealg;
     this->aalg = aalg;
+    ivTemplate[0] = ivTemplate[1] = 0;
+
+    // Lengths beyond the inline key storage make the context invalid, it keeps no key material then
+    valid = srtpKeyLengthsValid(ealg, aalg, master_key_length, master_salt_length, ekeyl, akeyl, skeyl, tagLength);
+    if (!valid)
+        master_key_length = master_salt_length = ekeyl = akeyl = skeyl = tagLength = 0;
+
     this->ekeyl = ekeyl;
     this->akeyl = akeyl;
     this->skeyl = skeyl;
 
     this->master_key_length = master_key_length;
-    this->master_key = new uint8_t[master_key_length];
     memcpy(this->master_key, master_key, master_key_length);
 
     this->master_salt_length = master_salt_length;
-    this->master_salt = new uint8_t[master_salt_length];
     memcpy(this->master_salt, master_salt, master_salt_length);
 
     switch (ealg) {
         case SrtpEncryptionNull:
             n_e = 0;
-            k_e = NULL;
             n_s = 0;
-            k_s = NULL;
             break;
 
         case SrtpEncryptionTWOF8:
-            f8Cipher = new SrtpSymCrypto(SrtpEncryptionTWOF8);
-
         case SrtpEncryptionTWOCM:
-            n_e = ekeyl;
-            k_e = new uint8_t[n_e];
-            n_s = skeyl;
-            k_s = new uint8_t[n_s];
-            cipher = new SrtpSymCrypto(SrtpEncryptionTWOCM);
-            break;
-
         case SrtpEncryptionAESF8:
-            f8Cipher = new SrtpSymCrypto(SrtpEncryptionAESF8);
-
         case SrtpEncryptionAESCM:
             n_e = ekeyl;
-            k_e = new uint8_t[n_e];
             n_s = skeyl;
-            k_s = new uint8_t[n_s];
-            cipher = new SrtpSymCrypto(SrtpEncryptionAESCM);
             break;
     }
 
     switch (aalg ) {
         case SrtpAuthenticationNull:
             n_a = 0;
-            k_a = NULL;
             this->tagLength = 0;
             break;
 
         case SrtpAuthenticationSha1Hmac:
         case SrtpAuthenticationSkeinHmac:
             n_a = akeyl;
-            k_a = new uint8_t[n_a];
             this->tagLength = tagLength;
             break;
     }
@@ -123,92 +196,236 @@ CryptoContext::~CryptoContext() {
     if (mki)
         delete [] mki;
 
-    if (master_key_length > 0) {
-        memset_volatile(master_key, 0, master_key_length);
-        master_key_length = 0;
-        delete [] master_key;
-    }
-    if (master_salt_length > 0) {
-        memset_volatile(master_salt, 0, master_salt_length);
-        master_salt_length = 0;
-        delete [] master_salt;
-    }
-    if (n_e > 0) {
-        memset_volatile(k_e, 0, n_e);
-        n_e = 0;
-        delete [] k_e;
-    }
-    if (n_s > 0) {
-        memset_volatile(k_s, 0, n_s);
-        n_s = 0;
-        delete [] k_s;
-    }
-    if (n_a > 0) {
-        memset_volatile(k_a, 0, n_a);
-        n_a = 0;
-        delete [] k_a;
+    memset_volatile(master_key, 0, sizeof(master_key));
+    master_key_length = 0;
+    memset_volatile(master_salt, 0, sizeof(master_salt));
+    master_salt_length = 0;
+    memset_volatile(k_e, 0, sizeof(k_e));
+    n_e = 0;
+    memset_volatile(k_s, 0, sizeof(k_s));
+    n_s = 0;
+    memset_volatile(k_a, 0, sizeof(k_a));
+    n_a = 0;
+}
+
+/*
+ * The CM IV (refer to chapter 4.1.1 in RFC 3711):
+ *
+ * k_s   XX XX XX XX XX XX XX XX XX XX XX XX XX XX
+ * SSRC              XX XX XX XX
+ * index                         XX XX XX XX XX XX
+ * ------------------------------------------------------XOR
+ * IV    XX XX XX XX XX XX XX XX XX XX XX XX XX XX 00 00
+ *
+ * The template holds the part that changes with the session salt and the
+ * SSRC only, the index of each packet goes into the second 64 bit word.
+ */
+void srtpCtrIvTemplate(uint64_t* ivTemplate, const uint8_t* salt, uint32_t ssrc)
+{
+    uint8_t iv[SRTP_BLOCK_SIZE];
+
+    memcpy(iv, salt, 14);
+    iv[4] ^= (uint8_t)(ssrc >> 24);
+    iv[5] ^= (uint8_t)(ssrc >> 16);
+    iv[6] ^= (uint8_t)(ssrc >> 8);
+    iv[7] ^= (uint8_t)ssrc;
+    iv[14] = iv[15] = 0;
+
+    memcpy(ivTemplate, iv, SRTP_BLOCK_SIZE);
+}
+
+void srtpCtrIv(uint64_t* iv, const uint64_t* ivTemplate, uint64_t index)
+{
+    // The index in network order in bytes 8 - 13, the block counter bytes stay zero
+    uint8_t indexBytes[8];
+    indexBytes[0] = (uint8_t)(index >> 40);
+    indexBytes[1] = (uint8_t)(index >> 32);
+    indexBytes[2] = (uint8_t)(index >> 24);
+    indexBytes[3] = (uint8_t)(index >> 16);
+    indexBytes[4] = (uint8_t)(index >> 8);
+    indexBytes[5] = (uint8_t)index;
+    indexBytes[6] = indexBytes[7] = 0;
+
+    uint64_t indexWord;
+    memcpy(&indexWord, indexBytes, sizeof(indexWord));
+
+    iv[0] = ivTemplate[0];
+    iv[1] = ivTemplate[1] ^ indexWord;
+}
+
+bool srtpKeyLengthsValid(int32_t ealg, int32_t aalg, int32_t masterKeyLength, int32_t masterSaltLength,
+                         int32_t ekeyl, int32_t akeyl, int32_t skeyl, int32_t tagLength)
+{
+    if (masterKeyLength < 0 || masterKeyLength > SRTP_MAX_KEY_LENGTH ||
+        masterSaltLength < 0 || masterSaltLength > SRTP_MAX_SALT_LENGTH)
+        return false;
+
+    if (ealg != SrtpEncryptionNull &&
+        (ekeyl < 0 || ekeyl > SRTP_MAX_KEY_LENGTH || skeyl < 0 || skeyl > SRTP_MAX_SALT_LENGTH))
+        return false;
+
+    if (aalg != SrtpAuthenticationNull &&
+        (akeyl < 0 || akeyl > SRTP_MAX_AUTH_KEY_LENGTH || tagLength < 0 || tagLength > SRTP_MAX_TAG_LENGTH))
+        return false;
+
+    return true;
+}
+
+void CryptoContext::setIvTemplate(uint32_t ssrc)
+{
+    srtpCtrIvTemplate(ivTemplate, k_s, ssrc);
+    ivTemplateSsrc = ssrc;
+}
+
+void CryptoContext::computeCtrIv(uint64_t* iv, uint64_t index, uint32_t ssrc)
+{
+    // A context with SSRC 0 serves any SSRC, the template follows the SSRC of the packets
+    if (ssrc != ivTemplateSsrc)
+        setIvTemplate(ssrc);
+    srtpCtrIv(iv, ivTemplate, index);
+}
+
+void CryptoContext::computeF8Iv(uint64_t* iv, const uint8_t* pkt)
+{
+    /* Create the F8 IV (refer to chapter 4.1.2.2 in RFC 3711):
+     *
+     * IV = 0x00 || M || PT || SEQ  ||      TS    ||    SSRC   ||    ROC
+     *      8Bit  1bit  7bit  16bit       32bit        32bit        32bit
+     * ------------\     /--------------------------------------------------
+     *       XX       XX      XX XX   XX XX XX XX   XX XX XX XX  XX XX XX XX
+     */
+    uint8_t* ivBytes = (uint8_t*)iv;
+    uint32_t beRoc = zrtpHtonl(roc);
+
+    memcpy(ivBytes, pkt, 12);
+    ivBytes[0] = 0;
+
+    // set ROC in network order into IV
+    memcpy(ivBytes + 12, &beRoc, sizeof(beRoc));
+}
+
+void CryptoContext::srtpEncrypt(uint8_t* pkt, uint8_t* payload, uint32_t paylen, uint64_t index, uint32_t ssrc ) {
+
+    srtpEncrypt(pkt, payload, paylen, payload, index, ssrc);
+}
+
+void CryptoContext::srtpEncrypt(const uint8_t* pkt, const uint8_t* payload, uint32_t paylen, uint8_t* out,
+                                uint64_t index, uint32_t ssrc) {
+
+    if (ealg == SrtpEncryptionNull) {
+        if (out != payload)
+            memcpy(out, payload, paylen);
+        return;
     }
-    if (cipher != NULL) {
-        delete cipher;
-        cipher = NULL;
+    if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
+        uint64_t iv[2];
+        computeCtrIv(iv, index, ssrc);
+        cipher.ctr_encrypt(payload, paylen, out, (uint8_t*)iv);
     }
-    if (f8Cipher != NULL) {
-        delete f8Cipher;
-        f8Cipher = NULL;
+
+    if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8) {
+        uint64_t iv[2];
+        computeF8Iv(iv, pkt);
+        cipher.f8_encrypt(payload, paylen, out, (uint8_t*)iv, &f8Cipher);
     }
 }
 
-void CryptoContext::srtpEncrypt(uint8_t* pkt, uint8_t* payload, uint32_t paylen, uint64_t index, uint32_t ssrc ) {
+void CryptoContext::srtpEncrypt(uint8_t* pkt, const SrtpIoVec* payload, int32_t count, uint64_t index, uint32_t ssrc) {
 
     if (ealg == SrtpEncryptionNull) {
         return;
     }
-    if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
+    if (count == 1) {
+        srtpEncrypt(pkt, payload[0].base, (uint32_t)payload[0].length, index, ssrc);
+        return;
+    }
+    uint32_t paylen = 0;
+    for (int32_t i = 0; i < count; i++) {
+        paylen += payload[i].length;
+    }
+    if (paylen == 0) {
+        return;
+    }
 
-        /* Compute the CM IV (refer to chapter 4.1.1 in RFC 3711):
-         *
-         * k_s   XX XX XX XX XX XX XX XX XX XX XX XX XX XX
-         * SSRC              XX XX XX XX
-         * index                         XX XX XX XX XX XX
-         * ------------------------------------------------------XOR
-         * IV    XX XX XX XX XX XX XX XX XX XX XX XX XX XX 00 00
-         */
-
-        unsigned char iv[16];
-        memcpy(iv, k_s, 4);
-
-        int i;
-        for (i = 4; i < 8; i++ ) {
-            iv[i] = (0xFF & (ssrc >> ((7-i)*8))) ^ k_s[i];
-        }
-        for (i = 8; i < 14; i++ ) {
-            iv[i] = (0xFF & (unsigned char)(index >> ((13-i)*8) ) ) ^ k_s[i];
-        }
-        iv[14] = iv[15] = 0;
+    // Key stream (CM) or gathered payload (F8), on the stack for packets up to the usual MTU
+    uint8_t localBuffer[SRTP_IOV_STACK_BUFFER];
+    uint8_t* buffer = paylen <= sizeof(localBuffer) ? localBuffer : new uint8_t[paylen];
 
-        cipher->ctr_encrypt(payload, paylen, iv);
+    if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
+        uint64_t iv[2];
+        computeCtrIv(iv, index, ssrc);
+        cipher.get_ctr_cipher_stream(buffer, paylen, (uint8_t*)iv);
+
+        const uint8_t* stream = buffer;
+        for (int32_t i = 0; i < count; i++) {
+            uint8_t* data = payload[i].base;
+            for (size_t j = 0; j < payload[i].length; j++) {
+                data[j] ^= *stream++;
+            }
+        }
     }
 
     if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8) {
+        // F8 chains the key stream blocks, encrypt the gathered payload in one run
+        uint8_t* ptr = buffer;
+        for (int32_t i = 0; i < count; i++) {
+            memcpy(ptr, payload[i].base, payload[i].length);
+            ptr += payload[i].length;
+        }
+        uint64_t iv[2];
+        computeF8Iv(iv, pkt);
+        cipher.f8_encrypt(buffer, paylen, (uint8_t*)iv, &f8Cipher);
+
+        ptr = buffer;
+        for (int32_t i = 0; i < count; i++) {
+            memcpy(payload[i].base, ptr, payload[i].length);
+            ptr += payload[i].length;
+        }
+    }
+    if (buffer != localBuffer)
+        delete [] buffer;
+}
 
-        /* Create the F8 IV (refer to chapter 4.1.2.2 in RFC 3711):
-         *
-         * IV = 0x00 || M || PT || SEQ  ||      TS    ||    SSRC   ||    ROC
-         *      8Bit  1bit  7bit  16bit       32bit        32bit        32bit
-         * ------------\     /--------------------------------------------------
-         *       XX       XX      XX XX   XX XX XX XX   XX XX XX XX  XX XX XX XX
-         */
+void CryptoContext::srtpKeyStream(const uint8_t* pkt, uint8_t* stream, uint32_t length, uint64_t index, uint32_t ssrc) {
 
-        unsigned char iv[16];
-        uint32_t *ui32p = (uint32_t *)iv;
+    if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
+        uint64_t iv[2];
+        computeCtrIv(iv, index, ssrc);
+        cipher.get_ctr_cipher_stream(stream, length, (uint8_t*)iv);
+        return;
+    }
+    memset(stream, 0, length);
 
-        memcpy(iv, pkt, 12);
-        iv[0] = 0;
+    // F8 does not feed the payload back, encrypting zeros yields the key stream
+    if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8) {
+        uint64_t iv[2];
+        computeF8Iv(iv, pkt);
+        cipher.f8_encrypt(stream, length, (uint8_t*)iv, &f8Cipher);
+    }
+}
 
-        // set ROC in network order into IV
-        ui32p[3] = zrtpHtonl(roc);
+void CryptoContext::computeTag(const uint8_t* chunks[], uint32_t chunkLength[], uint8_t* tag)
+{
+    int32_t macL;
+    unsigned char temp[20];
 
-        cipher->f8_encrypt(payload, paylen, iv, f8Cipher);
+    switch (aalg) {
+    case SrtpAuthenticationSha1Hmac:
+        hmacSha1Ctx(macCtx,
+                    chunks,           // data chunks to hash
+                    chunkLength,      // length of the data to hash
+                    temp, &macL);
+        /* truncate the result */
+        memcpy(tag, temp, getTagLength());
+        break;
+    case SrtpAuthenticationSkeinHmac:
+        macSkeinCtx(macCtx,
+                    chunks,           // data chunks to hash
+                    chunkLength,      // length of the data to hash
+                    temp);
+        /* truncate the result */
+        memcpy(tag, temp, getTagLength());
+        break;
     }
 }
 
@@ -219,35 +436,79 @@ void CryptoContext::srtpAuthenticate(uint8_t* pkt, uint32_t pktlen, uint32_t roc
     if (aalg == SrtpAuthenticationNull) {
         return;
     }
-    int32_t macL;
-
-    unsigned char temp[20];
-    const unsigned char* chunks[3];
-    unsigned int chunkLength[3];
+    const uint8_t* chunks[3];
+    uint32_t chunkLength[3];
     uint32_t beRoc = zrtpHtonl(roc);
 
     chunks[0] = pkt;
     chunkLength[0] = pktlen;
 
-    chunks[1] = (unsigned char *)&beRoc;
+    chunks[1] = (uint8_t *)&beRoc;
     chunkLength[1] = 4;
     chunks[2] = NULL;
 
+    computeTag(chunks, chunkLength, tag);
+}
+
+void CryptoContext::srtpAuthenticate(const SrtpIoVec* pkt, int32_t count, uint32_t roc, uint8_t* tag)
+{
+
+    if (aalg == SrtpAuthenticationNull || count > SRTP_MAX_IOVEC) {
+        return;
+    }
+    const uint8_t* chunks[SRTP_MAX_IOVEC + 2];
+    uint32_t chunkLength[SRTP_MAX_IOVEC + 2];
+    uint32_t beRoc = zrtpHtonl(roc);
+
+    int32_t n = 0;
+    for (int32_t i = 0; i < count; i++) {
+        if (pkt[i].length == 0)
+            continue;
+        chunks[n] = pkt[i].base;
+        chunkLength[n++] = (uint32_t)pkt[i].length;
+    }
+    chunks[n] = (uint8_t *)&beRoc;
+    chunkLength[n++] = 4;
+    chunks[n] = NULL;
+
+    computeTag(chunks, chunkLength, tag);
+}
+
+void CryptoContext::srtpMacBegin()
+{
+    // The Skein MAC context is always reset after a tag computation
+    if (aalg == SrtpAuthenticationSha1Hmac)
+        hmacSha1CtxBegin(macCtx);
+}
+
+void CryptoContext::srtpMacUpdate(const uint8_t* data, uint32_t length)
+{
     switch (aalg) {
     case SrtpAuthenticationSha1Hmac:
-        hmacSha1Ctx(macCtx,
-                    chunks,           // data chunks to hash
-                    chunkLength,      // length of the data to hash
-                    temp, &macL);
-        /* truncate the result */
+        hmacSha1CtxUpdate(macCtx, data, length);
+        break;
+    case SrtpAuthenticationSkeinHmac:
+        skeinUpdate((SkeinCtx_t*)macCtx, data, length);
+        break;
+    }
+}
+
+void CryptoContext::srtpMacEnd(uint32_t roc, uint8_t* tag)
+{
+    int32_t macL;
+    unsigned char temp[20];
+    uint32_t beRoc = zrtpHtonl(roc);
+
+    switch (aalg) {
+    case SrtpAuthenticationSha1Hmac:
+        hmacSha1CtxUpdate(macCtx, (uint8_t *)&beRoc, 4);
+        hmacSha1CtxEnd(macCtx, temp, &macL);
         memcpy(tag, temp, getTagLength());
         break;
     case SrtpAuthenticationSkeinHmac:
-        macSkeinCtx(macCtx,
-                    chunks,           // data chunks to hash
-                    chunkLength,      // length of the data to hash
-                    temp);
-        /* truncate the result */
+        skeinUpdate((SkeinCtx_t*)macCtx, (uint8_t *)&beRoc, 4);
+        skeinFinal((SkeinCtx_t*)macCtx, temp);
+        skeinReset((SkeinCtx_t*)macCtx);
         memcpy(tag, temp, getTagLength());
         break;
     }
@@ -292,19 +553,22 @@ void CryptoContext::deriveSrtpKeys(uint64_t index)
 {
     uint8_t iv[16];
 
+    if (!valid)
+        return;
+
     // prepare cipher to compute derived keys.
-    cipher->setNewKey(master_key, master_key_length);
+    cipher.setNewKey(master_key, master_key_length);
     memset(master_key, 0, master_key_length);
 
     // compute the session encryption key
     uint64_t label = labelBase + 0;
     computeIv(iv, label, index, key_deriv_rate, master_salt);
-    cipher->get_ctr_cipher_stream(k_e, n_e, iv);
+    cipher.get_ctr_cipher_stream(k_e, n_e, iv);
 
     // compute the session authentication key
     label = labelBase + 0x01;
     computeIv(iv, label, index, key_deriv_rate, master_salt);
-    cipher->get_ctr_cipher_stream(k_a, n_a, iv);
+    cipher.get_ctr_cipher_stream(k_a, n_a, iv);
 
     // Initialize MAC context with the derived key
     switch (aalg) {
@@ -324,13 +588,14 @@ void CryptoContext::deriveSrtpKeys(uint64_t index)
     // compute the session salt
     label = labelBase + 0x02;
     computeIv(iv, label, index, key_deriv_rate, master_salt);
-    cipher->get_ctr_cipher_stream(k_s, n_s, iv);
+    cipher.get_ctr_cipher_stream(k_s, n_s, iv);
     memset(master_salt, 0, master_salt_length);
+    setIvTemplate(ssrcCtx);
 
     // as last step prepare cipher with derived key.
-    cipher->setNewKey(k_e, n_e);
-    if (f8Cipher != NULL)
-        cipher->f8_deriveForIV(f8Cipher, k_e, n_e, k_s, n_s);
+    cipher.setNewKey(k_e, n_e);
+    if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8)
+        cipher.f8_deriveForIV(&f8Cipher, k_e, n_e, k_s, n_s);
     memset(k_e, 0, n_e);
 }
 
@@ -384,68 +649,23 @@ bool CryptoContext::checkReplay(uint16_t newSeq)
     uint64_t guessed_index = guessIndex(newSeq);
     uint64_t local_index = (((uint64_t)roc) << 16) | s_l;
 
-    int64_t delta = guessed_index - local_index;
-    if (delta > 0) {
-        return true;           /* Packet not yet received*/
-    }
-    else {
-        if (-delta >= REPLAY_WINDOW_SIZE) {
-            return false;      /* Packet too old */
-        }
-
-        delta = -delta;
-        int idx = (int)delta / 64;
-        uint64_t bit = (uint64_t)1UL << (delta % 64);
-        if ((replay_window[idx] & bit) == bit) {
-            return false;  /* Packet already received ! */
-        }
-        else {
-            return true;  /* Packet not yet received */
-        }
-    }
+    return replayWindow.check(guessed_index, local_index);
 }
 
-// This function assumes that it never gets a sequence number that is out of order
-// greater or equal than REPLAY_WINDOW_SIZE. Thus an application MUST perform a 
-// replay check first and discard any packet which fails this check. This restriction
-// applies to older packets only, a new (not seen) packet's sequence number can jump 
-// ahead by more than REPLAY_WINDOW_SIZE.
+// An application MUST perform a replay check first and discard any packet which
+// fails this check. A new (not seen) packet's sequence number can jump ahead by
+// more than the replay window size.
 void CryptoContext::update(uint16_t newSeq)
 {
     // Get the index of the new sequence number and compute the delta to the
     // index of the highest sequence number we received so far. If the delta 
     // is negative then we received an older packet, thus we will not
     // update the locally stored remote sequence number (s_l) below.
-    int64_t delta = guessIndex(newSeq) - (((uint64_t)roc) << 16 | s_l );
-    int64_t rocDelta = delta;
-    uint64_t carry = 0;
-
-    // update the replay shift register
-    // The shift register array stores bits of newer packets (higher sequence numbers) at 
-    // index 0 and shifts older packets (lower sequence numbers) left to index one
-    if (delta > 0) {                         // We got a new packet, no yet seen
-        if (delta >= REPLAY_WINDOW_SIZE) {
-            replay_window[0] = 1;
-            replay_window[1] = 0;
-        }
-        else {
-            if (delta < REPLAY_WINDOW_SIZE/2) {
-                carry = replay_window[0] >> ((REPLAY_WINDOW_SIZE/2) - delta);
-                replay_window[0] = (replay_window[0] << delta) | 1;
-                replay_window[1] = (replay_window[1] << delta) | carry;
-            }
-            else {
-                replay_window[1] = replay_window[0] << (delta - REPLAY_WINDOW_SIZE/2);
-                replay_window[0] = 1;
-            }
-        }
-    }
-    else {
-        delta = -delta;
-        int idx = (int)delta / 64;
-        uint64_t bit = (uint64_t)1UL << (delta % 64);
-        replay_window[idx] |= bit;
-    }
+    uint64_t guessed_index = guessIndex(newSeq);
+    uint64_t local_index = (((uint64_t)roc) << 16) | s_l;
+    int64_t rocDelta = guessed_index - local_index;
+
+    replayWindow.update(guessed_index, local_index);
 
     // update the locally stored ROC and highest sequence number if we received a not
     // yet received packet, i.e. the delta is > 0
@@ -460,6 +680,44 @@ void CryptoContext::update(uint16_t newSeq)
     }
 }
 
+// Start a new one second window. A throttled context keeps throttling if it
+// rejected more packets than the limit in the last window.
+void CryptoContext::rollAuthFailureWindow()
+{
+    uint64_t now = zrtpGetMonotonicMs();
+    if (now - authFailureWindow < 1000)
+        return;
+    authThrottled = authThrottled && authFailures > authFailureLimit;
+    authFailures = 0;
+    authFailureWindow = now;
+}
+
+// The clock is read only after a failure or while throttling, the good path
+// does not pay for the limiter.
+bool CryptoContext::checkAuthLimit(uint64_t guessedIndex)
+{
+    if (!authThrottled)
+        return true;
+    rollAuthFailureWindow();
+    if (!authThrottled)
+        return true;
+
+    uint64_t local_index = (((uint64_t)roc) << 16) | s_l;
+    if (guessedIndex <= local_index + SRTP_AUTH_THROTTLE_AHEAD)
+        return true;
+    authFailures++;
+    return false;
+}
+
+void CryptoContext::authFailed()
+{
+    if (authFailureLimit == 0)
+        return;
+    rollAuthFailureWindow();
+    if (++authFailures > authFailureLimit)
+        authThrottled = true;
+}
+
 CryptoContext* CryptoContext::newCryptoContextForSSRC(uint32_t ssrc, int roc, int64_t keyDerivRate)
 {
     CryptoContext* pcc = new CryptoContext(
@@ -475,7 +733,10 @@ CryptoContext* CryptoContext::newCryptoContextForSSRC(uint32_t ssrc, int roc, in
         this->ekeyl,                             // encryption keyl
         this->akeyl,                             // authentication key len
         this->skeyl,                             // session salt len
-        this->tagLength);                        // authentication tag len
+        this->tagLength,                         // authentication tag len
+        replayWindow.getSize());                 // replay window size
 
+    pcc->valid = valid;                          // a copy of an invalid context stays invalid
+    pcc->setAuthFailureLimit(authFailureLimit);
     return pcc;
 }
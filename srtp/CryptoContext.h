@@ -28,15 +28,177 @@
 
 #define REPLAY_WINDOW_SIZE 128
 
-const int SrtpAuthenticationNull      = 0;
-const int SrtpAuthenticationSha1Hmac  = 1;
-const int SrtpAuthenticationSkeinHmac = 2;
+/*
+ * Authentication failures per second a context accepts before it throttles.
+ * A throttled context checks the tag only of packets with an index close to
+ * the highest received index, it rejects other packets before it computes
+ * the MAC. See CryptoContext::setAuthFailureLimit().
+ */
+#define SRTP_AUTH_FAILURE_LIMIT     100
+#define SRTP_AUTH_THROTTLE_AHEAD    1024
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SrtpConstants.h>
+
+/**
+ * Function to allocate memory for a crypto context, must return memory aligned
+ * to SRTP_CACHE_LINE or NULL.
+ */
+typedef void* (*SrtpContextAlloc)(size_t size);
+
+/**
+ * Function to return memory of a crypto context.
+ */
+typedef void (*SrtpContextFree)(void* ptr);
+
+/**
+ * @brief Set the memory allocator for CryptoContext and CryptoContextCtrl.
+ *
+ * Each crypto context is one block of memory that holds the keys, the key
+ * schedules, the MAC state and the replay window. Applications that handle many
+ * streams may set functions that take these blocks from a pool. Set the allocator
+ * before creating the first context and don't change it while contexts exist.
+ *
+ * @param allocFunc
+ *    Allocates the memory, if @c NULL use the default aligned heap allocation.
+ *    The memory must be aligned to SRTP_CACHE_LINE, SrtpPipeline allocates its
+ *    cache line aligned workers with this function too.
+ *
+ * @param freeFunc
+ *    Returns memory allocated by @c allocFunc.
+ */
+void setSrtpContextAllocator(SrtpContextAlloc allocFunc, SrtpContextFree freeFunc);
+
+void* srtpContextAlloc(size_t size);
+void srtpContextFree(void* ptr);
+
+/*
+ * Counter mode IV of SRTP and SRTCP packets, refer to chapter 4.1.1 in RFC 3711.
+ * The template holds the session salt XOR SSRC, srtpCtrIv() adds the packet
+ * index in bytes 8 - 13: the 48 bit SRTP index or the 31 bit SRTCP index.
+ */
+void srtpCtrIvTemplate(uint64_t* ivTemplate, const uint8_t* salt, uint32_t ssrc);
+void srtpCtrIv(uint64_t* iv, const uint64_t* ivTemplate, uint64_t index);
+
+/*
+ * Check the key, salt and tag lengths of a SRTP or SRTCP crypto context against
+ * the SRTP_MAX_* limits of the inline key storage.
+ */
+bool srtpKeyLengthsValid(int32_t ealg, int32_t aalg, int32_t masterKeyLength, int32_t masterSaltLength,
+                         int32_t ekeyl, int32_t akeyl, int32_t skeyl, int32_t tagLength);
+
+/*
+ * Upper limit of the replay window size in packets. The SRTP index estimation
+ * works for packets less than 2^15 sequence numbers apart, thus larger windows
+ * make no sense. The replay bitmap of the default window size is part of the
+ * crypto context, larger bitmaps use an own block of memory from the context
+ * allocator.
+ */
+#define SRTP_MAX_REPLAY_WINDOW      16384
+#define SRTP_REPLAY_INLINE_WORDS    4
+
+/**
+ * @brief Replay window of a SRTP or SRTCP crypto context.
+ *
+ * The window is a ring of bits, the bit of a packet index is at position
+ * <code>index mod ringSize</code>. If a new packet advances the highest index
+ * the window clears the 64 bit words between the old and the new highest
+ * index instead of shifting the whole bitmap. Thus checking and updating
+ * takes the same time for small and large windows.
+ *
+ * The ring is at least one 64 bit word larger than the window size, the words
+ * cleared when the highest index advances never hold bits of packets inside the
+ * window.
+ */
+class SrtpReplayWindow {
+public:
+    /**
+     * @brief Create a replay window.
+     *
+     * @param windowSize
+     *    Number of packets before the highest received packet that the window
+     *    tracks. Values are limited to 64 ... SRTP_MAX_REPLAY_WINDOW.
+     */
+    explicit SrtpReplayWindow(int32_t windowSize);
+
+    ~SrtpReplayWindow();
+
+    /**
+     * @brief Return the window size in packets.
+     */
+    int32_t getSize() const { return (int32_t)size; }
+
+    /**
+     * @brief Check if a packet index is new.
+     *
+     * @param index
+     *    The packet index to check.
+     * @param highest
+     *    The highest packet index received so far.
+     * @return <code>true</code> if the packet is new, <code>false</code> if
+     *    it is too old or was already received.
+     */
+    bool check(uint64_t index, uint64_t highest) const {
+        if (index > highest)
+            return true;
+        if (highest - index >= size)
+            return false;
+        return (bits[(index >> 6) & mask] & ((uint64_t)1 << (index & 63))) == 0;
+    }
+
+    /**
+     * @brief Mark a packet index as received.
+     *
+     * @param index
+     *    The packet index to mark, must pass check() before.
+     * @param highest
+     *    The highest packet index received before this packet.
+     */
+    void update(uint64_t index, uint64_t highest) {
+        if (index > highest) {
+            uint64_t words = (index >> 6) - (highest >> 6);
+            if (words > mask)
+                words = mask + 1;
+            for (uint64_t w = (highest >> 6) + 1; words > 0; w++, words--)
+                bits[w & mask] = 0;
+        }
+        else if (highest - index >= size) {
+            return;
+        }
+        bits[(index >> 6) & mask] |= (uint64_t)1 << (index & 63);
+    }
+
+private:
+    SrtpReplayWindow(const SrtpReplayWindow& other);
+    SrtpReplayWindow& operator=(const SrtpReplayWindow& other);
+
+    uint64_t* bits;
+    uint32_t  mask;
+    uint32_t  size;
+    uint64_t  inlineBits[SRTP_REPLAY_INLINE_WORDS];
+};
 
-const int SrtpEncryptionNull  = 0;
-const int SrtpEncryptionAESCM = 1;
-const int SrtpEncryptionAESF8 = 2;
-const int SrtpEncryptionTWOCM = 3;
-const int SrtpEncryptionTWOF8 = 4;
+/**
+ * @brief One buffer of a scattered RTP packet.
+ *
+ * Applications that keep the RTP header, header extension and payload of a
+ * packet in separate buffers describe the packet with an array of these
+ * structures, in packet order.
+ */
+struct SrtpIoVec {
+    uint8_t* base;          //!< Start of the buffer
+    size_t   length;        //!< Number of bytes in the buffer
+};
+
+/*
+ * Maximum number of buffers of a scattered packet. Scattered payloads up to
+ * SRTP_IOV_STACK_BUFFER bytes need no heap memory during encryption.
+ */
+#define SRTP_MAX_IOVEC              16
+#define SRTP_IOV_STACK_BUFFER       2048
+
+#include <crypto/SrtpSymCrypto.h>
 
 // Check if included via CryptoContextCtrl.cpp - avoid double definitions
 #ifndef CRYPTOCONTEXTCTRL_H
@@ -48,8 +210,6 @@ const int SrtpEncryptionTWOF8 = 4;
 #include <crypto/hmac.h>
 #include <cryptcommon/macSkein.h>
 
-class SrtpSymCrypto;
-
 /**
  * @brief Implementation for a SRTP cryptographic context.
  *
@@ -134,7 +294,7 @@ class SrtpSymCrypto;
  * 
  * @author Werner Dittmann <Werner.Dittmann@t-online.de>
  */
-class CryptoContext {
+class alignas(SRTP_CACHE_LINE) CryptoContext {
 public:
     /**
      * @brief Constructor for an active SRTP cryptographic context.
@@ -211,6 +371,14 @@ public:
      *    to the RTP packet. The @c CryptoContext supports @c SrtpAuthenticationSha1Hmac
      *    with 4 and 10 byte (32 and 80 bits) and @c SrtpAuthenticationSkeinHmac
      *    with 4 and 8 bytes (32 and 64 bits) tag length. Refer to chapter 4.2. in RFC 3711.
+     *
+     *    If a key, salt or tag length exceeds its @c SRTP_MAX_* limit the context
+     *    stores no key material and isValid() returns @c false.
+     *
+     * @param replayWindowSize
+     *    The number of packets the replay check tracks before the highest received
+     *    packet, at most SRTP_MAX_REPLAY_WINDOW. Use larger windows for streams with
+     *    heavy reordering, for example after a jitter buffer or on multipath links.
      */
     CryptoContext(uint32_t ssrc, int32_t roc,
                    int64_t  keyDerivRate,
@@ -223,7 +391,8 @@ public:
                    int32_t  ekeyl,
                    int32_t  akeyl,
                    int32_t  skeyl,
-                   int32_t  tagLength);
+                   int32_t  tagLength,
+                   int32_t  replayWindowSize = REPLAY_WINDOW_SIZE);
 
     /**
      * @brief Destructor.
@@ -232,6 +401,13 @@ public:
      */
     ~CryptoContext();
 
+    /**
+     * @brief Allocate a context via the allocator set with setSrtpContextAllocator().
+     */
+    static void* operator new(size_t size);
+
+    static void operator delete(void* ptr);
+
     /**
      * @brief Set the Roll-Over-Counter.
      *
@@ -277,6 +453,83 @@ public:
      */
     void srtpEncrypt(uint8_t* pkt, uint8_t* payload, uint32_t paylen, uint64_t index, uint32_t ssrc);
 
+    /**
+     * @brief Perform SRTP encryption into a separate output buffer.
+     *
+     * Same as above, but reads the payload from @c payload and writes the
+     * result to @c out. The input stays unchanged, thus an application can
+     * encrypt one payload for several crypto contexts. The buffers may be the
+     * same but must not overlap otherwise.
+     *
+     * @param pkt
+     *    Pointer to the RTP header, used for F8.
+     *
+     * @param payload
+     *    The data to encrypt.
+     *
+     * @param paylen
+     *    Length of payload.
+     *
+     * @param out
+     *    Buffer for the result, must hold @c paylen bytes.
+     *
+     * @param index
+     *    The 48 bit SRTP packet index.
+     *
+     * @param ssrc
+     *    The RTP SSRC data in <em>host</em> order.
+     */
+    void srtpEncrypt(const uint8_t* pkt, const uint8_t* payload, uint32_t paylen, uint8_t* out,
+                     uint64_t index, uint32_t ssrc);
+
+    /**
+     * @brief Perform SRTP encryption of a scattered payload.
+     *
+     * Same as above, the payload may be spread over several buffers. The
+     * method encrypts the buffers in place and in the given order.
+     *
+     * @param pkt
+     *    Pointer to the fixed RTP header, used for F8.
+     *
+     * @param payload
+     *    The buffers that contain the payload data.
+     *
+     * @param count
+     *    Number of buffers.
+     *
+     * @param index
+     *    The 48 bit SRTP packet index.
+     *
+     * @param ssrc
+     *    The RTP SSRC data in <em>host</em> order.
+     */
+    void srtpEncrypt(uint8_t* pkt, const SrtpIoVec* payload, int32_t count, uint64_t index, uint32_t ssrc);
+
+    /**
+     * @brief Get the SRTP key stream of a packet.
+     *
+     * SRTP encryption XORs the payload with this key stream. Counter mode
+     * and F8 both produce a key stream that does not depend on the payload,
+     * thus a caller can combine the key streams of several crypto contexts.
+     * The key stream of the Null cipher is all zeros.
+     *
+     * @param pkt
+     *    Pointer to the RTP header, used for F8.
+     *
+     * @param stream
+     *    Buffer for the key stream, must hold @c length bytes.
+     *
+     * @param length
+     *    Length of the key stream, usually the payload length.
+     *
+     * @param index
+     *    The 48 bit SRTP packet index.
+     *
+     * @param ssrc
+     *    The RTP SSRC data in <em>host</em> order.
+     */
+    void srtpKeyStream(const uint8_t* pkt, uint8_t* stream, uint32_t length, uint64_t index, uint32_t ssrc);
+
     /**
      * @brief Compute the authentication tag.
      *
@@ -298,6 +551,57 @@ public:
      */
     void srtpAuthenticate(uint8_t* pkt, uint32_t pktlen, uint32_t roc, uint8_t* tag);
 
+    /**
+     * @brief Compute the authentication tag of a scattered RTP packet.
+     *
+     * @param pkt
+     *    The buffers that contain the RTP packet, in packet order.
+     *
+     * @param count
+     *    Number of buffers, at most @c SRTP_MAX_IOVEC.
+     *
+     * @param roc
+     *    The 32 bit SRTP roll-over-counter.
+     *
+     * @param tag
+     *    Points to a buffer that hold the computed tag. This buffer must
+     *    be able to hold <code>tagLength</code> bytes.
+     */
+    void srtpAuthenticate(const SrtpIoVec* pkt, int32_t count, uint32_t roc, uint8_t* tag);
+
+    /**
+     * @brief Start to compute an authentication tag incrementally.
+     *
+     * Call srtpMacUpdate() for each part of the RTP packet, in packet
+     * order, then call srtpMacEnd() to get the tag. The result is the same
+     * as of srtpAuthenticate(). Use this if the packet data is produced
+     * while the tag is computed, the caller must always call srtpMacEnd().
+     */
+    void srtpMacBegin();
+
+    /**
+     * @brief Add RTP packet data to the authentication tag.
+     *
+     * @param data
+     *    The next part of the RTP packet.
+     *
+     * @param length
+     *    Length of the data.
+     */
+    void srtpMacUpdate(const uint8_t* data, uint32_t length);
+
+    /**
+     * @brief Finish the authentication tag.
+     *
+     * @param roc
+     *    The 32 bit SRTP roll-over-counter.
+     *
+     * @param tag
+     *    Points to a buffer that hold the computed tag. This buffer must
+     *    be able to hold <code>tagLength</code> bytes.
+     */
+    void srtpMacEnd(uint32_t roc, uint8_t* tag);
+
     /**
      * @brief Perform key derivation according to SRTP specification
      *
@@ -334,8 +638,8 @@ public:
      * The method check if a received packet is either to old or was already
      * received.
      *
-     * The method supports a 64 packet history relative the the given
-     * sequence number.
+     * The method supports a history of the replay window size (see
+     * constructor) relative to the highest received sequence number.
      *
      * @param newSeqNumber
      *    The sequence number of the received RTP packet in host order.
@@ -356,6 +660,46 @@ public:
      */
     void update(uint16_t newSeqNumber);
 
+    /**
+     * @brief Check if the authentication failure limit allows to authenticate a packet.
+     *
+     * If the context saw more than the limit of authentication failures in
+     * one second it throttles: it accepts only packets with an index that is
+     * at most @c SRTP_AUTH_THROTTLE_AHEAD ahead of the highest received
+     * index. Spoofed packets with random sequence numbers fail this check and
+     * do not cost a MAC computation, the packets of the real sender pass. The
+     * context stops throttling after one second with less failures than the
+     * limit.
+     *
+     * Call this method after the replay check.
+     *
+     * @param guessedIndex
+     *    The index of the packet, see guessIndex().
+     *
+     * @return <code>true</code> if the caller shall check the tag,
+     *    <code>false</code> if the caller shall drop the packet.
+     */
+    bool checkAuthLimit(uint64_t guessedIndex);
+
+    /**
+     * @brief Record a failed authentication.
+     */
+    void authFailed();
+
+    /**
+     * @brief Set the authentication failure limit.
+     *
+     * @param failuresPerSecond
+     *    Authentication failures per second before the context throttles,
+     *    0 switches the limit off. The default is @c SRTP_AUTH_FAILURE_LIMIT.
+     */
+    void setAuthFailureLimit(uint32_t failuresPerSecond) { authFailureLimit = failuresPerSecond; authThrottled = false; }
+
+    /**
+     * @brief Check if the context currently throttles, see checkAuthLimit().
+     */
+    bool isAuthThrottled() const { return authThrottled; }
+
     /**
      * @brief Get the length of the SRTP authentication tag in bytes.
      *
@@ -370,6 +714,37 @@ public:
      */
     int32_t getMkiLength() const { return mkiLength; }
 
+    /**
+     * @brief Get the size of the replay window in packets.
+     *
+     * @return the replay window size.
+     */
+    int32_t getReplayWindowSize() const { return replayWindow.getSize(); }
+
+    /**
+     * @brief Get the encryption algorithm of this context.
+     *
+     * @return one of the @c SrtpEncryption algorithm values.
+     */
+    int32_t getEncryptionAlgorithm() const { return ealg; }
+
+    /**
+     * @brief Get the authentication algorithm of this context.
+     *
+     * @return one of the @c SrtpAuthentication algorithm values.
+     */
+    int32_t getAuthenticationAlgorithm() const { return aalg; }
+
+    /**
+     * @brief Check if the constructor accepted the key, salt and tag lengths.
+     *
+     * The SrtpHandler functions refuse to protect or unprotect packets with an
+     * invalid context.
+     *
+     * @return @c false if a length exceeded its @c SRTP_MAX_* limit.
+     */
+    bool isValid() const { return valid; }
+
     /**
      * @brief Get the SSRC of this SRTP Cryptograhic context.
      *
@@ -418,6 +793,16 @@ public:
     CryptoContext* newCryptoContextForSSRC(uint32_t ssrc, int roc, int64_t keyDerivRate);
 
 private:
+    void setIvTemplate(uint32_t ssrc);
+
+    void computeCtrIv(uint64_t* iv, uint64_t index, uint32_t ssrc);
+
+    void computeF8Iv(uint64_t* iv, const uint8_t* pkt);
+
+    void computeTag(const uint8_t* chunks[], uint32_t chunkLength[], uint8_t* tag);
+
+    void rollAuthFailureWindow();
+
     typedef union _hmacCtx {
         SkeinCtx_t       hmacSkeinCtx;
 #ifdef ZRTP_OPENSSL
@@ -428,45 +813,59 @@ private:
     } HmacCtx;
 
 
+    /* Fields the per-packet path touches, keep them in the first cache line */
     uint32_t ssrcCtx;
-    uint32_t mkiLength;
-    uint8_t* mki;
-
     uint32_t roc;
     uint32_t guessed_roc;
     uint16_t s_l;
-    int64_t  key_deriv_rate;
+    bool     seqNumSet;
+    uint8_t  labelBase;
+    int32_t  ealg;
+    int32_t  aalg;
+    int32_t  tagLength;
+    uint32_t mkiLength;
+    bool     valid;
+
+    /* Session salt XOR SSRC, the CM IV of a packet is this template XOR the packet index */
+    uint64_t ivTemplate[2];
+    uint32_t ivTemplateSsrc;
+
+    /* ring bitmap for replay check */
+    SrtpReplayWindow replayWindow;
+
+    /* Session salt, used to compute the IV of each packet */
+    uint8_t  k_s[SRTP_MAX_SALT_LENGTH];
+
+    void*   macCtx;
+    SrtpSymCrypto cipher;
+    HmacCtx hmacCtx;
+    SrtpSymCrypto f8Cipher;
 
-    /* bitmask for replay check */
-    uint64_t replay_window[2];
+    /* Key derivation data */
+    int64_t  key_deriv_rate;
+    uint8_t* mki;
 
-    uint8_t* master_key;
+    uint8_t  master_key[SRTP_MAX_KEY_LENGTH];
     uint32_t master_key_length;
-    uint8_t* master_salt;
+    uint8_t  master_salt[SRTP_MAX_SALT_LENGTH];
     uint32_t master_salt_length;
 
-    /* Session Encryption, Authentication keys, Salt */
+    /* Session Encryption, Authentication keys */
+    uint8_t  k_e[SRTP_MAX_KEY_LENGTH];
+    uint8_t  k_a[SRTP_MAX_AUTH_KEY_LENGTH];
     int32_t  n_e;
-    uint8_t* k_e;
     int32_t  n_a;
-    uint8_t* k_a;
     int32_t  n_s;
-    uint8_t* k_s;
 
-    int32_t ealg;
-    int32_t aalg;
     int32_t ekeyl;
     int32_t akeyl;
     int32_t skeyl;
-    int32_t tagLength;
-    uint8_t labelBase;
-    bool  seqNumSet;
-
-    void*   macCtx;
-    HmacCtx hmacCtx;
 
-    SrtpSymCrypto* cipher;
-    SrtpSymCrypto* f8Cipher;
+    /* Authentication failure limit, failures count rejected packets of the current second */
+    uint32_t authFailureLimit;
+    uint32_t authFailures;
+    uint64_t authFailureWindow;
+    bool     authThrottled;
 };
 
 #endif
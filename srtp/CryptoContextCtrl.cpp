@@ -23,6 +23,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <new>
 
 #include <common/osSpecifics.h>
 
@@ -32,6 +33,20 @@
 #include <crypto/SrtpSymCrypto.h>
 
 
+void* CryptoContextCtrl::operator new(size_t size)
+{
+    void* ptr = srtpContextAlloc(size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void CryptoContextCtrl::operator delete(void* ptr)
+{
+    if (ptr != NULL)
+        srtpContextFree(ptr);
+}
+
 CryptoContextCtrl::CryptoContextCtrl(uint32_t ssrc,
                                 const int32_t ealg,
                                 const int32_t aalg,
@@ -42,67 +57,54 @@ CryptoContextCtrl::CryptoContextCtrl(uint32_t ssrc,
                                 int32_t ekeyl,
                                 int32_t akeyl,
                                 int32_t skeyl,
-                                int32_t tagLength):
-ssrcCtx(ssrc), mkiLength(0),mki(NULL), replay_window(0), srtcpIndex(0),
-labelBase(3), macCtx(NULL), cipher(NULL), f8Cipher(NULL)        // SRTCP labels start at 3
-
+                                int32_t tagLength,
+                                int32_t replayWindowSize):
+ssrcCtx(ssrc), s_l(0), srtcpIndex(0), mkiLength(0), labelBase(3),   // SRTCP labels start at 3
+ivTemplateSsrc(ssrc), replayWindow(replayWindowSize), macCtx(NULL), cipher(ealg), f8Cipher(ealg), mki(NULL)
 {
     this->ealg = ealg;
     this->aalg = aalg;
+    ivTemplate[0] = ivTemplate[1] = 0;
+
+    // Lengths beyond the inline key storage make the context invalid, it keeps no key material then
+    valid = srtpKeyLengthsValid(ealg, aalg, master_key_length, master_salt_length, ekeyl, akeyl, skeyl, tagLength);
+    if (!valid)
+        master_key_length = master_salt_length = ekeyl = akeyl = skeyl = tagLength = 0;
+
     this->ekeyl = ekeyl;
     this->akeyl = akeyl;
     this->skeyl = skeyl;
 
     this->master_key_length = master_key_length;
-    this->master_key = new uint8_t[master_key_length];
     memcpy(this->master_key, master_key, master_key_length);
 
     this->master_salt_length = master_salt_length;
-    this->master_salt = new uint8_t[master_salt_length];
     memcpy(this->master_salt, master_salt, master_salt_length);
 
     switch (ealg) {
         case SrtpEncryptionNull:
             n_e = 0;
-            k_e = NULL;
             n_s = 0;
-            k_s = NULL;
             break;
 
         case SrtpEncryptionTWOF8:
-            f8Cipher = new SrtpSymCrypto(SrtpEncryptionTWOF8);
-
         case SrtpEncryptionTWOCM:
-            n_e = ekeyl;
-            k_e = new uint8_t[n_e];
-            n_s = skeyl;
-            k_s = new uint8_t[n_s];
-            cipher = new SrtpSymCrypto(SrtpEncryptionTWOCM);
-            break;
-
         case SrtpEncryptionAESF8:
-            f8Cipher = new SrtpSymCrypto(SrtpEncryptionAESF8);
-
         case SrtpEncryptionAESCM:
             n_e = ekeyl;
-            k_e = new uint8_t[n_e];
             n_s = skeyl;
-            k_s = new uint8_t[n_s];
-            cipher = new SrtpSymCrypto(SrtpEncryptionAESCM);
             break;
     }
 
     switch (aalg) {
         case SrtpAuthenticationNull:
             n_a = 0;
-            k_a = NULL;
             this->tagLength = 0;
             break;
 
         case SrtpAuthenticationSha1Hmac:
         case SrtpAuthenticationSkeinHmac:
             n_a = akeyl;
-            k_a = new uint8_t[n_a];
             this->tagLength = tagLength;
             break;
     }
@@ -122,39 +124,49 @@ CryptoContextCtrl::~CryptoContextCtrl(){
     if (mki)
         delete [] mki;
 
-    if (master_key_length > 0) {
-        memset_volatile(master_key, 0, master_key_length);
-        master_key_length = 0;
-        delete [] master_key;
-    }
-    if (master_salt_length > 0) {
-        memset_volatile(master_salt, 0, master_salt_length);
-        master_salt_length = 0;
-        delete [] master_salt;
-    }
-    if (n_e > 0) {
-        memset_volatile(k_e, 0, n_e);
-        n_e = 0;
-        delete [] k_e;
-    }
-    if (n_s > 0) {
-        memset_volatile(k_s, 0, n_s);
-        n_s = 0;
-        delete [] k_s;
-    }
-    if (n_a > 0) {
-        n_a = 0;
-        memset_volatile(k_a, 0, n_a);
-        delete [] k_a;
-    }
-    if (cipher != NULL) {
-        delete cipher;
-        cipher = NULL;
-    }
-    if (f8Cipher != NULL) {
-        delete f8Cipher;
-        f8Cipher = NULL;
+    memset_volatile(master_key, 0, sizeof(master_key));
+    master_key_length = 0;
+    memset_volatile(master_salt, 0, sizeof(master_salt));
+    master_salt_length = 0;
+    memset_volatile(k_e, 0, sizeof(k_e));
+    n_e = 0;
+    memset_volatile(k_s, 0, sizeof(k_s));
+    n_s = 0;
+    memset_volatile(k_a, 0, sizeof(k_a));
+    n_a = 0;
+}
+
+void CryptoContextCtrl::computeCtrIv(uint64_t* iv, uint32_t index, uint32_t ssrc)
+{
+    /* The CM IV (refer to chapter 4.1.1 in RFC 3711):
+     *
+     * k_s   XX XX XX XX XX XX XX XX XX XX XX XX XX XX
+     * SSRC              XX XX XX XX
+     * index                               XX XX XX XX
+     * ------------------------------------------------------XOR
+     * IV    XX XX XX XX XX XX XX XX XX XX XX XX XX XX 00 00
+     *        0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15
+     */
+    if (ssrc != ivTemplateSsrc) {
+        srtpCtrIvTemplate(ivTemplate, k_s, ssrc);
+        ivTemplateSsrc = ssrc;
     }
+    srtpCtrIv(iv, ivTemplate, index);
+}
+
+void CryptoContextCtrl::computeF8Iv(uint64_t* iv, const uint8_t* header, uint32_t index)
+{
+    /* The F8 IV (refer to chapter 4.1.2.3 in RFC 3711):
+     *
+     * IV = 0..0 || E || SRTCP index || V || P || RC || PT || length || SSRC
+     *      32bit  1bit   31bit        2bit 1bit 5bit  8bit   16bit    32bit
+     */
+    uint8_t* ivBytes = (uint8_t*)iv;
+    uint32_t beIndex = zrtpHtonl(index | 0x80000000);      // F8 always encrypts, the E flag is set
+
+    memset(ivBytes, 0, 4);
+    memcpy(ivBytes + 4, &beIndex, sizeof(beIndex));
+    memcpy(ivBytes + 8, header, 8);
 }
 
 void CryptoContextCtrl::srtcpEncrypt( uint8_t* rtp, int32_t len, uint32_t index, uint32_t ssrc )
@@ -162,67 +174,36 @@ void CryptoContextCtrl::srtcpEncrypt( uint8_t* rtp, int32_t len, uint32_t index,
     if (ealg == SrtpEncryptionNull) {
         return;
     }
-    if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
+    uint64_t iv[2];
 
-        /* Compute the CM IV (refer to chapter 4.1.1 in RFC 3711):
-        *
-        * k_s   XX XX XX XX XX XX XX XX XX XX XX XX XX XX
-        * SSRC              XX XX XX XX
-        * index                               XX XX XX XX
-        * ------------------------------------------------------XOR
-        * IV    XX XX XX XX XX XX XX XX XX XX XX XX XX XX 00 00
-        *        0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15
-        */
-        unsigned char iv[16];
-
-        iv[0] = k_s[0];
-        iv[1] = k_s[1];
-        iv[2] = k_s[2];
-        iv[3] = k_s[3];
-
-        // The shifts transform the ssrc and index into network order
-        iv[4] = ((ssrc >> 24) & 0xff) ^ k_s[4];
-        iv[5] = ((ssrc >> 16) & 0xff) ^ k_s[5];
-        iv[6] = ((ssrc >> 8) & 0xff) ^ k_s[6];
-        iv[7] = (ssrc & 0xff) ^ k_s[7];
-
-        iv[8] = k_s[8];
-        iv[9] = k_s[9];
-
-        iv[10] = ((index >> 24) & 0xff) ^ k_s[10];
-        iv[11] = ((index >> 16) & 0xff) ^ k_s[11];
-        iv[12] = ((index >> 8) & 0xff) ^ k_s[12];
-        iv[13] = (index & 0xff) ^ k_s[13];
-
-        iv[14] = iv[15] = 0;
-
-        cipher->ctr_encrypt(rtp, len, iv);
+    if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
+        computeCtrIv(iv, index, ssrc);
+        cipher.ctr_encrypt(rtp, len, (uint8_t*)iv);
     }
 
     if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8) {
+        computeF8Iv(iv, rtp, index);
+        cipher.f8_encrypt(rtp, len, (uint8_t*)iv, &f8Cipher);
+    }
+}
 
-        unsigned char iv[16];
-
-        // 4 bytes of the iv are zero
-        // the first byte of the RTP header is not used.
-        iv[0] = 0;
-        iv[1] = 0;
-        iv[2] = 0;
-        iv[3] = 0;
-
-        // Need the encryption flag
-        index = index | 0x80000000;
-
-        // set the index and the encrypt flag in network order into IV
-        iv[4] = index >> 24;
-        iv[5] = index >> 16;
-        iv[6] = index >> 8;
-        iv[7] = index;
+void CryptoContextCtrl::srtcpEncryptPacket(uint8_t* pkt, int32_t length, uint32_t index)
+{
+    if (ealg == SrtpEncryptionNull || length <= 8) {
+        return;
+    }
+    uint64_t iv[2];
 
-        // The fixed header follows and fills the rest of the IV
-        memcpy(iv+8, rtp, 8);
+    if (ealg == SrtpEncryptionAESCM || ealg == SrtpEncryptionTWOCM) {
+        uint32_t ssrc;
+        memcpy(&ssrc, pkt + 4, sizeof(ssrc));               // always SSRC of sender
+        computeCtrIv(iv, index, zrtpNtohl(ssrc));
+        cipher.ctr_encrypt(pkt + 8, length - 8, (uint8_t*)iv);
+    }
 
-        cipher->f8_encrypt(rtp, len, iv, f8Cipher);
+    if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8) {
+        computeF8Iv(iv, pkt, index);
+        cipher.f8_encrypt(pkt + 8, length - 8, (uint8_t*)iv, &f8Cipher);
     }
 }
 
@@ -289,19 +270,22 @@ void CryptoContextCtrl::deriveSrtcpKeys()
 {
     uint8_t iv[16];
 
+    if (!valid)
+        return;
+
     // prepare cipher to compute derived keys.
-    cipher->setNewKey(master_key, master_key_length);
+    cipher.setNewKey(master_key, master_key_length);
     memset(master_key, 0, master_key_length);
 
     // compute the session encryption key
     uint8_t label = labelBase;
     computeIv(iv, label, master_salt);
-    cipher->get_ctr_cipher_stream(k_e, n_e, iv);
+    cipher.get_ctr_cipher_stream(k_e, n_e, iv);
 
     // compute the session authentication key
     label = labelBase + 1;
     computeIv(iv, label, master_salt);
-    cipher->get_ctr_cipher_stream(k_a, n_a, iv);
+    cipher.get_ctr_cipher_stream(k_a, n_a, iv);
 
     // Initialize MAC context with the derived key
     switch (aalg) {
@@ -321,13 +305,15 @@ void CryptoContextCtrl::deriveSrtcpKeys()
     // compute the session salt
     label = labelBase + 2;
     computeIv(iv, label, master_salt);
-    cipher->get_ctr_cipher_stream(k_s, n_s, iv);
+    cipher.get_ctr_cipher_stream(k_s, n_s, iv);
     memset(master_salt, 0, master_salt_length);
+    srtpCtrIvTemplate(ivTemplate, k_s, ssrcCtx);
+    ivTemplateSsrc = ssrcCtx;
 
     // as last step prepare cipher with derived key.
-    cipher->setNewKey(k_e, n_e);
-    if (f8Cipher != NULL)
-        cipher->f8_deriveForIV(f8Cipher, k_e, n_e, k_s, n_s);
+    cipher.setNewKey(k_e, n_e);
+    if (ealg == SrtpEncryptionAESF8 || ealg == SrtpEncryptionTWOF8)
+        cipher.f8_deriveForIV(&f8Cipher, k_e, n_e, k_s, n_s);
     memset(k_e, 0, n_e);
 }
 
@@ -338,38 +324,13 @@ bool CryptoContextCtrl::checkReplay( uint32_t index )
         return true;
     }
 
-    int64_t delta = index - s_l;
-    if (delta > 0) {
-        /* Packet not yet received*/
-        return true;
-    }
-    else {
-        if( -delta >= REPLAY_WINDOW_SIZE ) {
-            return false;       /* Packet too old */
-        }
-        else {
-            if((replay_window >> (-delta)) & 0x1) {
-                return false;   /* Packet already received ! */
-            }
-            else {
-                return true;    /* Packet not yet received */
-            }
-        }
-    }
+    return replayWindow.check(index, s_l);
 }
 
 void CryptoContextCtrl::update(uint32_t index)
 {
-    int64_t delta = index - s_l;
+    replayWindow.update(index, s_l);
 
-    /* update the replay bitmask */
-    if( delta > 0 ){
-        replay_window = replay_window << delta;
-        replay_window |= 1;
-    }
-    else {
-        replay_window |= ( (uint64_t)1 << -delta );
-    }
     if (index > s_l)
         s_l = index;
 }
@@ -387,7 +348,9 @@ CryptoContextCtrl* CryptoContextCtrl::newCryptoContextForSSRC(uint32_t ssrc)
             this->ekeyl,                             // encryption keyl
             this->akeyl,                             // authentication key len
             this->skeyl,                             // session salt len
-            this->tagLength);                        // authentication tag len
+            this->tagLength,                         // authentication tag len
+            replayWindow.getSize());                 // replay window size
 
+    pcc->valid = valid;                          // a copy of an invalid context stays invalid
     return pcc;
 }
@@ -28,8 +28,15 @@
 
 #include <crypto/hmac.h>
 #include <cryptcommon/macSkein.h>
+#include <crypto/SrtpSymCrypto.h>
+#include <CryptoContext.h>
 
-class SrtpSymCrypto;
+/*
+ * Default replay window of SRTCP contexts. Video feedback (NACK, PLI, REMB,
+ * transport-cc) reaches hundreds of RTCP packets per second and stream, thus
+ * use the largest window that still fits into the context.
+ */
+#define SRTCP_REPLAY_WINDOW_SIZE    ((SRTP_REPLAY_INLINE_WORDS - 1) * 64)
 
 /**
  * The implementation for a SRTCP cryptographic context.
@@ -53,7 +60,7 @@ class SrtpSymCrypto;
  *
  * @author Werner Dittmann <Werner.Dittmann@t-online.de>
  */
-class CryptoContextCtrl {
+class alignas(SRTP_CACHE_LINE) CryptoContextCtrl {
     public:
     /**
      * @brief Constructor for an active SRTCP cryptographic context.
@@ -121,6 +128,11 @@ class CryptoContextCtrl {
      * @param tagLength
      *    The length is bytes of the authentication tag that SRTCP appends
      *    to the RTP packet. Refer to chapter 4.2. in the RFC 3711.
+     *
+     * @param replayWindowSize
+     *    The number of packets the replay check tracks before the highest received
+     *    SRTCP index, at most SRTP_MAX_REPLAY_WINDOW. Windows up to the default
+     *    size need no memory outside the context.
      */
     CryptoContextCtrl(uint32_t ssrc,
                const  int32_t ealg,
@@ -132,7 +144,8 @@ class CryptoContextCtrl {
                int32_t  ekeyl,
                int32_t  akeyl,
                int32_t  skeyl,
-               int32_t  tagLength);
+               int32_t  tagLength,
+               int32_t  replayWindowSize = SRTCP_REPLAY_WINDOW_SIZE);
 
     /**
      * @brief Destructor.
@@ -141,12 +154,23 @@ class CryptoContextCtrl {
      */
     ~CryptoContextCtrl();
 
+    /**
+     * @brief Allocate a context via the allocator set with setSrtpContextAllocator().
+     */
+    static void* operator new(size_t size);
+
+    static void operator delete(void* ptr);
+
     /**
      * @brief Perform SRTCP encryption.
      *
      * This method encrypts <em>and</em> decrypts SRTCP payload data. Plain
      * data gets encrypted, encrypted data get decrypted.
      *
+     * In F8 mode this method builds the IV from the first 8 bytes of
+     * @c rtp, thus @c rtp must point to the RTCP header and the header gets
+     * encrypted as well. Use srtcpEncryptPacket() to encrypt a RTCP packet.
+     *
      * @param rtp
      *    The RTP packet that contains the data to encrypt.
      *
@@ -161,6 +185,25 @@ class CryptoContextCtrl {
      */
     void srtcpEncrypt(uint8_t* rtp, int32_t len, uint32_t index, uint32_t ssrc);
 
+    /**
+     * @brief Encrypt or decrypt a RTCP packet.
+     *
+     * Encrypts the packet after the fixed 8 byte header. Other than
+     * srtcpEncrypt() this method takes the SSRC and, for F8 mode, the IV
+     * from the header as RFC 3711, chapter 4.1.2.3, requires. SrtpHandler
+     * uses this method.
+     *
+     * @param pkt
+     *    The RTCP packet, starting with the fixed RTCP header.
+     *
+     * @param length
+     *    Length of the RTCP packet, without SRTCP index, MKI and tag.
+     *
+     * @param index
+     *    The 31 bit SRTCP packet index.
+     */
+    void srtcpEncryptPacket(uint8_t* pkt, int32_t length, uint32_t index);
+
     /**
      * @brief Compute the authentication tag.
      *
@@ -201,8 +244,8 @@ class CryptoContextCtrl {
      * The method check if a received packet is either to old or was already
      * received.
      *
-     * The method supports a 64 packet history relative the the given
-     * sequence number.
+     * The method supports a history of the replay window size (see
+     * constructor) relative to the highest received SRTCP index.
      *
      * @param newSeqNumber
      *    The sequence number of the received RTCP packet in host order.
@@ -230,6 +273,15 @@ class CryptoContextCtrl {
      */
     inline int32_t getTagLength() const { return tagLength; }
 
+    /**
+     * @brief Check if the constructor accepted the key, salt and tag lengths.
+     *
+     * @return @c false if a length exceeded its @c SRTP_MAX_* limit.
+     *
+     * @see CryptoContext::isValid()
+     */
+    inline bool isValid() const { return valid; }
+
     /**
      * @brief Get the length of the MKI in bytes.
      *
@@ -237,6 +289,13 @@ class CryptoContextCtrl {
      */
     inline int32_t getMkiLength() const { return mkiLength; }
 
+    /**
+     * @brief Get the size of the replay window in packets.
+     *
+     * @return the replay window size.
+     */
+    inline int32_t getReplayWindowSize() const { return replayWindow.getSize(); }
+
     /**
      * @brief Get the SSRC of this SRTCP Cryptograhic context.
      *
@@ -296,48 +355,59 @@ class CryptoContextCtrl {
     CryptoContextCtrl* newCryptoContextForSSRC(uint32_t ssrc);
 
     private:
+        void computeCtrIv(uint64_t* iv, uint32_t index, uint32_t ssrc);
+
+        void computeF8Iv(uint64_t* iv, const uint8_t* header, uint32_t index);
 
         typedef union _hmacCtx {
             SkeinCtx_t       hmacSkeinCtx;
             hmacSha1Context  hmacSha1Ctx;
         } HmacCtx;
 
+        /* Fields the per-packet path touches, keep them in the first cache line */
         uint32_t ssrcCtx;
+        uint32_t s_l;
+        uint32_t srtcpIndex;
+        int32_t ealg;
+        int32_t aalg;
+        int32_t tagLength;
         uint32_t mkiLength;
-        uint8_t* mki;
+        uint8_t labelBase;
+        bool valid;
 
-        uint32_t s_l;
+        /* Session salt XOR SSRC, see srtpCtrIvTemplate() */
+        uint32_t ivTemplateSsrc;
+        uint64_t ivTemplate[2];
 
-        /* bitmask for replay check */
-        uint64_t replay_window;
+        /* ring bitmap for replay check */
+        SrtpReplayWindow replayWindow;
 
-        uint8_t* master_key;
+        /* Session salt, used to compute the IV of each packet */
+        uint8_t  k_s[SRTP_MAX_SALT_LENGTH];
+
+        void*   macCtx;
+        SrtpSymCrypto cipher;
+        HmacCtx hmacCtx;
+        SrtpSymCrypto f8Cipher;
+
+        /* Key derivation data */
+        uint8_t* mki;
+
+        uint8_t  master_key[SRTP_MAX_KEY_LENGTH];
         uint32_t master_key_length;
-        uint8_t* master_salt;
+        uint8_t  master_salt[SRTP_MAX_SALT_LENGTH];
         uint32_t master_salt_length;
 
-        /* Session Encryption, Authentication keys, Salt */
+        /* Session Encryption, Authentication keys */
+        uint8_t  k_e[SRTP_MAX_KEY_LENGTH];
+        uint8_t  k_a[SRTP_MAX_AUTH_KEY_LENGTH];
         int32_t  n_e;
-        uint8_t* k_e;
         int32_t  n_a;
-        uint8_t* k_a;
         int32_t  n_s;
-        uint8_t* k_s;
 
-        int32_t ealg;
-        int32_t aalg;
         int32_t ekeyl;
         int32_t akeyl;
         int32_t skeyl;
-        int32_t tagLength;
-        uint32_t srtcpIndex;
-        uint8_t labelBase;
-
-        void*   macCtx;
-        HmacCtx hmacCtx;
-
-        SrtpSymCrypto* cipher;
-        SrtpSymCrypto* f8Cipher;
     };
 
 /**
@@ -0,0 +1,135 @@
+/*
+  Copyright (C) 2012 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#ifndef _SPSCQUEUE_H_
+#define _SPSCQUEUE_H_
+
+/**
+ * @file SpscQueue.h
+ * @brief Lock-free single producer, single consumer queue
+ * @ingroup Z_SRTP
+ * @{
+ *
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <stdint.h>
+#include <atomic>
+
+#ifndef SRTP_CACHE_LINE
+#define SRTP_CACHE_LINE 64
+#endif
+
+/**
+ * A bounded ring buffer for one producer and one consumer thread.
+ *
+ * The producer owns the tail index, the consumer the head index. Each side
+ * keeps a private copy of the other side's index and reads the shared index
+ * only if the copy says the queue is full or empty. Thus push and pop touch
+ * the other thread's cache line rarely. The indices run freely, the slot of
+ * an index is <code>index & mask</code>.
+ *
+ * The queue copies the items, use it for small structures.
+ */
+template <class T>
+class SpscQueue {
+
+public:
+    /**
+     * @brief Create a queue.
+     *
+     * @param size minimum number of items, rounded up to a power of two
+     */
+    explicit SpscQueue(uint32_t size): head(0), cachedTail(0), tail(0), cachedHead(0) {
+        uint32_t slotCount = 2;
+        while (slotCount < size)
+            slotCount <<= 1;
+        mask = slotCount - 1;
+        slots = new T[slotCount];
+    }
+
+    ~SpscQueue() {
+        delete[] slots;
+    }
+
+    /**
+     * @brief Append an item, producer thread only.
+     *
+     * @return false if the queue is full.
+     */
+    bool push(const T& item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead > mask)
+                return false;
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Remove the oldest item, consumer thread only.
+     *
+     * @return false if the queue is empty.
+     */
+    bool pop(T& item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail)
+                return false;
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Check if the queue is empty, any thread.
+     *
+     * The result is a snapshot, the other thread may change it at once.
+     */
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Get the number of slots.
+     */
+    uint32_t capacity() const { return mask + 1; }
+
+private:
+    SpscQueue(const SpscQueue& other);
+    SpscQueue& operator=(const SpscQueue& other);
+
+    T* slots;
+    uint32_t mask;
+
+    alignas(SRTP_CACHE_LINE) std::atomic<uint32_t> head;   ///< Next item to pop, written by the consumer
+    uint32_t cachedTail;                                    ///< Consumer's copy of tail
+
+    alignas(SRTP_CACHE_LINE) std::atomic<uint32_t> tail;   ///< Next free slot, written by the producer
+    uint32_t cachedHead;                                    ///< Producer's copy of head
+};
+
+/**
+ * @}
+ */
+#endif
@@ -0,0 +1,60 @@
+/*
+  Copyright (C) 2012 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#ifndef SRTPCONSTANTS_H
+#define SRTPCONSTANTS_H
+
+/**
+ * @file SrtpConstants.h
+ * @brief Algorithm identifiers and storage limits of the SRTP implementation
+ *
+ * The crypto contexts and the SRTP cipher classes share these definitions.
+ * The header has no dependencies, thus both may include it.
+ *
+ * @ingroup Z_SRTP
+ * @{
+ */
+
+const int SrtpAuthenticationNull      = 0;
+const int SrtpAuthenticationSha1Hmac  = 1;
+const int SrtpAuthenticationSkeinHmac = 2;
+
+const int SrtpEncryptionNull  = 0;
+const int SrtpEncryptionAESCM = 1;
+const int SrtpEncryptionAESF8 = 2;
+const int SrtpEncryptionTWOCM = 3;
+const int SrtpEncryptionTWOF8 = 4;
+
+/*
+ * Upper limits of the key material the SRTP and SRTCP crypto contexts store
+ * inline and of the authentication tag length. The contexts reject longer
+ * keys, salts or tags, see CryptoContext::isValid().
+ */
+#define SRTP_MAX_KEY_LENGTH         32
+#define SRTP_MAX_SALT_LENGTH        16
+#define SRTP_MAX_AUTH_KEY_LENGTH    32
+#define SRTP_MAX_TAG_LENGTH         20
+
+#ifndef SRTP_CACHE_LINE
+#define SRTP_CACHE_LINE 64
+#endif
+
+/**
+ * @}
+ */
+#endif
@@ -81,6 +81,81 @@ bool SrtpHandler::decodeRtp(uint8_t* buffer, int32_t length, uint32_t *ssrc, uin
     return true;
 }
 
+/* Copy bytes at a packet offset out of a scattered packet, returns false if the packet is too short */
+static bool copyFromIov(const SrtpIoVec* iov, int32_t iovCount, size_t offset, uint8_t* out, size_t length)
+{
+    for (int32_t i = 0; i < iovCount && length > 0; i++) {
+        if (offset >= iov[i].length) {
+            offset -= iov[i].length;
+            continue;
+        }
+        size_t l = iov[i].length - offset;
+        if (l > length)
+            l = length;
+        memcpy(out, iov[i].base + offset, l);
+        out += l;
+        length -= l;
+        offset = 0;
+    }
+    return length == 0;
+}
+
+bool SrtpHandler::decodeRtp(const SrtpIoVec* iov, int32_t iovCount, uint32_t *ssrc, uint16_t *seq, SrtpIoVec* payload,
+                            int32_t *payloadCount, size_t *length)
+{
+    if (iovCount < 1 || iovCount > SRTP_MAX_IOVEC)
+        return false;
+
+    /* The fixed RTP header must be in the first buffer. */
+    const uint8_t* buffer = iov[0].base;
+    if (iov[0].length < RTP_HEADER_LENGTH)
+        return false;
+    if ((*buffer & 0xC0) != 0x80) {         // check version bits
+        return false;
+    }
+
+    size_t total = 0;
+    for (int32_t i = 0; i < iovCount; i++)
+        total += iov[i].length;
+    *length = total;
+
+    uint16_t tmp16 = ((const uint16_t*)buffer)[1];  // get seq number
+    *seq = zrtpNtohs(tmp16);                        // and return in host oder
+
+    uint32_t tmp32 = ((const uint32_t*)buffer)[2];  // get SSRC
+    *ssrc = zrtpNtohl(tmp32);                       // and return in host order
+
+    /* Payload is located right after header plus CSRC */
+    int32_t numCC = buffer[0] & 0x0f;
+    size_t offset = RTP_HEADER_LENGTH + (numCC * sizeof(uint32_t));
+
+    /* Adjust payload offset if RTP extension is used, the extension may be in another buffer. */
+    if ((*buffer & 0x10) == 0x10) {
+        uint8_t extHeader[4];
+        if (!copyFromIov(iov, iovCount, offset, extHeader, sizeof(extHeader)))
+            return false;
+        offset += ((extHeader[2] << 8 | extHeader[3]) + 1) * sizeof(uint32_t);
+    }
+    /* Sanity check */
+    if (offset > total)
+        return false;
+
+    /* Describe the payload, it starts inside or after the buffer that holds the header end. */
+    int32_t n = 0;
+    for (int32_t i = 0; i < iovCount; i++) {
+        if (offset >= iov[i].length) {
+            offset -= iov[i].length;
+            continue;
+        }
+        payload[n].base = iov[i].base + offset;
+        payload[n].length = iov[i].length - offset;
+        offset = 0;
+        n++;
+    }
+    *payloadCount = n;
+    return true;
+}
+
 static void fillErrorData(SrtpErrorData* data, SrtpErrorType type, uint8_t* buffer, size_t length, uint64_t guessedIndex)
 {
     data->errorType = type;
@@ -89,6 +164,25 @@ static void fillErrorData(SrtpErrorData* data, SrtpErrorType type, uint8_t* buff
     data->guessedIndex = guessedIndex;
 }
 
+/*
+ * Compare a received tag with the computed MAC. The time must not depend on
+ * the position of the first differing byte, otherwise an attacker could
+ * forge a tag byte by byte.
+ */
+static bool tagEqual(const uint8_t* tag, const uint8_t* mac, int32_t length)
+{
+    uint8_t diff = 0;
+    for (int32_t i = 0; i < length; i++)
+        diff |= tag[i] ^ mac[i];
+    return diff == 0;
+}
+
+/* A context with SSRC 0 accepts packets of any SSRC, for example the contexts of ZrtpSdesStream */
+static bool ssrcMatches(const CryptoContext* pcc, uint32_t ssrc)
+{
+    return pcc->getSsrc() == 0 || pcc->getSsrc() == ssrc;
+}
+
 bool SrtpHandler::protect(CryptoContext* pcc, uint8_t* buffer, size_t length, size_t* newLength)
 {
     uint8_t* payload = NULL;
@@ -97,7 +191,7 @@ bool SrtpHandler::protect(CryptoContext* pcc, uint8_t* buffer, size_t length, si
     uint32_t ssrc;
 
 
-    if (pcc == NULL) {
+    if (pcc == NULL || !pcc->isValid()) {
         return false;
     }
     if (!decodeRtp(buffer, length, &ssrc, &seqnum, &payload, &payloadlen))
@@ -124,6 +218,41 @@ bool SrtpHandler::protect(CryptoContext* pcc, uint8_t* buffer, size_t length, si
     return true;
 }
 
+bool SrtpHandler::protect(CryptoContext* pcc, const uint8_t* buffer, size_t length, uint8_t* output, size_t* newLength)
+{
+    uint8_t* payload = NULL;
+    int32_t payloadlen = 0;
+    uint16_t seqnum;
+    uint32_t ssrc;
+
+    if (pcc == NULL || !pcc->isValid()) {
+        return false;
+    }
+    // decodeRtp only reads the buffer
+    if (!decodeRtp(const_cast<uint8_t*>(buffer), length, &ssrc, &seqnum, &payload, &payloadlen))
+        return false;
+
+    /* Copy the header, encrypt the payload into the output buffer */
+    size_t headerLength = payload - buffer;
+    memcpy(output, buffer, headerLength);
+
+    uint64_t index = ((uint64_t)pcc->getRoc() << 16) | (uint64_t)seqnum;
+
+    pcc->srtpEncrypt(buffer, payload, payloadlen, output + headerLength, index, ssrc);
+
+    /* Compute MAC and store at end of SRTP packet data */
+    if (pcc->getTagLength() > 0) {
+        pcc->srtpAuthenticate(output, length, pcc->getRoc(), output+length);
+    }
+    *newLength = length + pcc->getTagLength();
+
+    /* Update the ROC if necessary */
+    if (seqnum == 0xFFFF ) {
+        pcc->setRoc(pcc->getRoc() + 1);
+    }
+    return true;
+}
+
 int32_t SrtpHandler::unprotect(CryptoContext* pcc, uint8_t* buffer, size_t length, size_t* newLength, SrtpErrorData* errorData)
 {
     uint8_t* payload = NULL;
@@ -131,11 +260,18 @@ int32_t SrtpHandler::unprotect(CryptoContext* pcc, uint8_t* buffer, size_t lengt
     uint16_t seqnum;
     uint32_t ssrc;
 
-    if (pcc == NULL) {
+    if (pcc == NULL || !pcc->isValid()) {
         return 0;
     }
 
-    if (!decodeRtp(buffer, length, &ssrc, &seqnum, &payload, &payloadlen)) {
+    /*
+     * Reject junk before any crypto: the cheap checks come first, the MAC
+     * computation last. Header, SSRC and length checks, then the replay
+     * window, then the authentication failure limit.
+     */
+    int32_t trailer = pcc->getTagLength() + pcc->getMkiLength();
+    if (!decodeRtp(buffer, length, &ssrc, &seqnum, &payload, &payloadlen) || payloadlen < trailer ||
+        !ssrcMatches(pcc, ssrc)) {
         if (errorData != NULL)
             fillErrorData(errorData, DecodeError, buffer, length, 0);
         return 0;
@@ -178,8 +314,14 @@ int32_t SrtpHandler::unprotect(CryptoContext* pcc, uint8_t* buffer, size_t lengt
         uint32_t guessedRoc = guessedIndex >> 16;
         uint8_t mac[20];
 
+        if (!pcc->checkAuthLimit(guessedIndex)) {
+            if (errorData != NULL)
+                fillErrorData(errorData, AuthLimitError, buffer, length, guessedIndex);
+            return -1;
+        }
         pcc->srtpAuthenticate(buffer, (uint32_t)length, guessedRoc, mac);
-        if (memcmp(tag, mac, pcc->getTagLength()) != 0) {
+        if (!tagEqual(tag, mac, pcc->getTagLength())) {
+            pcc->authFailed();
             if (errorData != NULL)
                 fillErrorData(errorData, AuthError, buffer, length, guessedIndex);
             return -1;
@@ -194,25 +336,327 @@ int32_t SrtpHandler::unprotect(CryptoContext* pcc, uint8_t* buffer, size_t lengt
     return 1;
 }
 
-
-bool SrtpHandler::protectCtrl(CryptoContextCtrl* pcc, uint8_t* buffer, size_t length, size_t* newLength)
+bool SrtpHandler::protect(CryptoContext* pcc, const SrtpIoVec* iov, int32_t iovCount, uint8_t* tag, size_t* newLength)
 {
+    SrtpIoVec payload[SRTP_MAX_IOVEC];
+    int32_t payloadCount = 0;
+    size_t length;
+    uint16_t seqnum;
+    uint32_t ssrc;
 
-    if (pcc == NULL) {
+    if (pcc == NULL || !pcc->isValid()) {
         return false;
     }
+    if (!decodeRtp(iov, iovCount, &ssrc, &seqnum, payload, &payloadCount, &length))
+        return false;
+
     /* Encrypt the packet */
-    uint32_t ssrc = *(reinterpret_cast<uint32_t*>(buffer + 4)); // always SSRC of sender
-    ssrc = zrtpNtohl(ssrc);
+    uint64_t index = ((uint64_t)pcc->getRoc() << 16) | (uint64_t)seqnum;
+
+    pcc->srtpEncrypt(iov[0].base, payload, payloadCount, index, ssrc);
+
+    /* Compute MAC and store in the tag buffer */
+    if (pcc->getTagLength() > 0) {
+        pcc->srtpAuthenticate(iov, iovCount, pcc->getRoc(), tag);
+    }
+    *newLength = length + pcc->getTagLength();
+
+    /* Update the ROC if necessary */
+    if (seqnum == 0xFFFF ) {
+        pcc->setRoc(pcc->getRoc() + 1);
+    }
+    return true;
+}
+
+int32_t SrtpHandler::unprotect(CryptoContext* pcc, const SrtpIoVec* iov, int32_t iovCount, const uint8_t* tag,
+                               size_t* newLength, SrtpErrorData* errorData)
+{
+    SrtpIoVec payload[SRTP_MAX_IOVEC];
+    int32_t payloadCount = 0;
+    size_t length = 0;
+    uint16_t seqnum;
+    uint32_t ssrc;
+
+    if (pcc == NULL || !pcc->isValid()) {
+        return 0;
+    }
+
+    if (!decodeRtp(iov, iovCount, &ssrc, &seqnum, payload, &payloadCount, &length) || !ssrcMatches(pcc, ssrc)) {
+        if (errorData != NULL) {
+            uint8_t header[RTP_HEADER_LENGTH] = {0};
+            if (iovCount > 0 && iovCount <= SRTP_MAX_IOVEC)
+                copyFromIov(iov, iovCount, 0, header, RTP_HEADER_LENGTH);
+            fillErrorData(errorData, DecodeError, header, length, 0);
+        }
+        return 0;
+    }
+    *newLength = length;
+
+    /* Guess the index */
+    uint64_t guessedIndex = pcc->guessIndex(seqnum);
+
+    /* Replay control */
+    if (!pcc->checkReplay(seqnum)) {
+        if (errorData != NULL)
+            fillErrorData(errorData, ReplayError, iov[0].base, length, guessedIndex);
+        return -2;
+    }
+
+    if (pcc->getTagLength() > 0) {
+        uint32_t guessedRoc = guessedIndex >> 16;
+        uint8_t mac[20];
+
+        if (!pcc->checkAuthLimit(guessedIndex)) {
+            if (errorData != NULL)
+                fillErrorData(errorData, AuthLimitError, iov[0].base, length, guessedIndex);
+            return -1;
+        }
+        pcc->srtpAuthenticate(iov, iovCount, guessedRoc, mac);
+        if (!tagEqual(tag, mac, pcc->getTagLength())) {
+            pcc->authFailed();
+            if (errorData != NULL)
+                fillErrorData(errorData, AuthError, iov[0].base, length, guessedIndex);
+            return -1;
+        }
+    }
+    /* Decrypt the content */
+    pcc->srtpEncrypt(iov[0].base, payload, payloadCount, guessedIndex, ssrc);
+
+    /* Update the Crypto-context */
+    pcc->update(seqnum);
+
+    return 1;
+}
+
+/*
+ * The double protection processes the payload in blocks of this size, thus the
+ * intermediate data of the inner protection stays in the first level cache.
+ */
+#define SRTP_DOUBLE_BLOCK   256
+
+/*
+ * Apply two key streams to the data: the intermediate result goes to @c block,
+ * the final result replaces the data. Works on 64 bit words where possible.
+ */
+static void xorTwice(uint8_t* data, uint8_t* block, const uint8_t* first, const uint8_t* second, int32_t length)
+{
+    int32_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t d, k;
+        memcpy(&d, data + i, 8);
+        memcpy(&k, first + i, 8);
+        d ^= k;
+        memcpy(block + i, &d, 8);
+        memcpy(&k, second + i, 8);
+        d ^= k;
+        memcpy(data + i, &d, 8);
+    }
+    for (; i < length; i++) {
+        block[i] = data[i] ^ first[i];
+        data[i] = block[i] ^ second[i];
+    }
+}
+
+bool SrtpHandler::protectDouble(CryptoContext* inner, CryptoContext* outer, uint8_t* buffer, size_t length, size_t* newLength)
+{
+    uint8_t* payload = NULL;
+    int32_t payloadlen = 0;
+    uint16_t seqnum;
+    uint32_t ssrc;
+
+    if (inner == NULL || outer == NULL || !inner->isValid() || !outer->isValid()) {
+        return false;
+    }
+    if (!decodeRtp(buffer, length, &ssrc, &seqnum, &payload, &payloadlen))
+        return false;
+
+    // The outer context also encrypts the inner tag
+    int32_t innerTagLength = inner->getTagLength();
+    int32_t outerlen = payloadlen + innerTagLength;
+    uint32_t innerRoc = inner->getRoc();
+    uint32_t outerRoc = outer->getRoc();
+
+    uint8_t localBuffer[2 * SRTP_IOV_STACK_BUFFER];
+    uint8_t* innerStream = (2 * outerlen <= (int32_t)sizeof(localBuffer)) ? localBuffer : new uint8_t[2 * outerlen];
+    uint8_t* outerStream = innerStream + outerlen;
+
+    inner->srtpKeyStream(buffer, innerStream, payloadlen, ((uint64_t)innerRoc << 16) | (uint64_t)seqnum, ssrc);
+    outer->srtpKeyStream(buffer, outerStream, outerlen, ((uint64_t)outerRoc << 16) | (uint64_t)seqnum, ssrc);
+
+    uint32_t headerLength = payload - buffer;
+    inner->srtpMacBegin();
+    outer->srtpMacBegin();
+    inner->srtpMacUpdate(buffer, headerLength);
+    outer->srtpMacUpdate(buffer, headerLength);
+
+    // Read each payload byte once: inner encryption, inner MAC, outer encryption, outer MAC
+    uint8_t block[SRTP_DOUBLE_BLOCK];
+    for (int32_t offset = 0; offset < payloadlen; offset += SRTP_DOUBLE_BLOCK) {
+        int32_t n = payloadlen - offset;
+        if (n > SRTP_DOUBLE_BLOCK)
+            n = SRTP_DOUBLE_BLOCK;
+        uint8_t* data = payload + offset;
+        xorTwice(data, block, innerStream + offset, outerStream + offset, n);
+        inner->srtpMacUpdate(block, n);
+        outer->srtpMacUpdate(data, n);
+    }
+
+    // The inner tag follows the payload, encrypt and authenticate it with the outer context
+    uint8_t* tag = buffer + length;
+    inner->srtpMacEnd(innerRoc, tag);
+    for (int32_t i = 0; i < innerTagLength; i++) {
+        tag[i] ^= outerStream[payloadlen + i];
+    }
+    outer->srtpMacUpdate(tag, innerTagLength);
+    outer->srtpMacEnd(outerRoc, tag + innerTagLength);
+
+    *newLength = length + innerTagLength + outer->getTagLength();
+
+    if (innerStream != localBuffer)
+        delete [] innerStream;
+
+    /* Update the ROCs if necessary */
+    if (seqnum == 0xFFFF ) {
+        inner->setRoc(innerRoc + 1);
+        outer->setRoc(outerRoc + 1);
+    }
+    return true;
+}
+
+int32_t SrtpHandler::unprotectDouble(CryptoContext* inner, CryptoContext* outer, uint8_t* buffer, size_t length,
+                                     size_t* newLength, bool* outerValid, SrtpErrorData* errorData)
+{
+    uint8_t* payload = NULL;
+    int32_t payloadlen = 0;
+    uint16_t seqnum;
+    uint32_t ssrc;
+
+    *outerValid = false;
+    if (inner == NULL || outer == NULL || !inner->isValid() || !outer->isValid()) {
+        return 0;
+    }
+
+    // The outer payload contains the inner payload, the inner MKI and the inner tag
+    int32_t outerTrailer = outer->getTagLength() + outer->getMkiLength();
+    int32_t innerTrailer = inner->getTagLength() + inner->getMkiLength();
+
+    if (!decodeRtp(buffer, length, &ssrc, &seqnum, &payload, &payloadlen) || payloadlen < outerTrailer + innerTrailer ||
+        !ssrcMatches(outer, ssrc) || !ssrcMatches(inner, ssrc)) {
+        if (errorData != NULL)
+            fillErrorData(errorData, DecodeError, buffer, length, 0);
+        return 0;
+    }
+    int32_t outerlen = payloadlen - outerTrailer;
+    int32_t innerlen = outerlen - innerTrailer;
+    size_t outerLength = length - outerTrailer;
+    size_t innerLength = outerLength - innerTrailer;
+    *newLength = outerLength;
+
+    uint64_t outerIndex = outer->guessIndex(seqnum);
+    if (!outer->checkReplay(seqnum)) {
+        if (errorData != NULL)
+            fillErrorData(errorData, ReplayError, buffer, outerLength, outerIndex);
+        return -2;
+    }
+    if (outer->getTagLength() > 0 && !outer->checkAuthLimit(outerIndex)) {
+        if (errorData != NULL)
+            fillErrorData(errorData, AuthLimitError, buffer, outerLength, outerIndex);
+        return -1;
+    }
+    uint64_t innerIndex = inner->guessIndex(seqnum);
+
+    uint8_t localBuffer[2 * SRTP_IOV_STACK_BUFFER];
+    uint8_t* outerStream = (2 * outerlen <= (int32_t)sizeof(localBuffer)) ? localBuffer : new uint8_t[2 * outerlen];
+    uint8_t* innerStream = outerStream + outerlen;
+
+    outer->srtpKeyStream(buffer, outerStream, outerlen, outerIndex, ssrc);
+    inner->srtpKeyStream(buffer, innerStream, innerlen, innerIndex, ssrc);
+
+    uint32_t headerLength = payload - buffer;
+    outer->srtpMacBegin();
+    inner->srtpMacBegin();
+    outer->srtpMacUpdate(buffer, headerLength);
+    inner->srtpMacUpdate(buffer, headerLength);
+
+    // Read each payload byte once: outer MAC, outer decryption, inner MAC, inner decryption
+    uint8_t block[SRTP_DOUBLE_BLOCK];
+    for (int32_t offset = 0; offset < innerlen; offset += SRTP_DOUBLE_BLOCK) {
+        int32_t n = innerlen - offset;
+        if (n > SRTP_DOUBLE_BLOCK)
+            n = SRTP_DOUBLE_BLOCK;
+        uint8_t* data = payload + offset;
+        outer->srtpMacUpdate(data, n);
+        xorTwice(data, block, outerStream + offset, innerStream + offset, n);
+        inner->srtpMacUpdate(block, n);
+    }
+    // Inner MKI and tag, protected by the outer context only
+    uint8_t* innerTrailerData = payload + innerlen;
+    outer->srtpMacUpdate(innerTrailerData, innerTrailer);
+    for (int32_t i = 0; i < innerTrailer; i++) {
+        innerTrailerData[i] ^= outerStream[innerlen + i];
+    }
+
+    uint8_t outerMac[20];
+    uint8_t innerMac[20];
+    outer->srtpMacEnd(outerIndex >> 16, outerMac);
+    inner->srtpMacEnd(innerIndex >> 16, innerMac);
+
+    if (outer->getTagLength() > 0 && !tagEqual(buffer + outerLength + outer->getMkiLength(), outerMac, outer->getTagLength())) {
+        outer->authFailed();
+        // Restore the received packet, the caller may try another crypto context
+        for (int32_t i = 0; i < innerlen; i++) {
+            payload[i] ^= innerStream[i] ^ outerStream[i];
+        }
+        for (int32_t i = 0; i < innerTrailer; i++) {
+            innerTrailerData[i] ^= outerStream[innerlen + i];
+        }
+        if (outerStream != localBuffer)
+            delete [] outerStream;
+        if (errorData != NULL)
+            fillErrorData(errorData, AuthError, buffer, outerLength, outerIndex);
+        return -1;
+    }
+    if (outerStream != localBuffer)
+        delete [] outerStream;
+
+    outer->update(seqnum);
+    *outerValid = true;
+    *newLength = innerLength;
+
+    if (!inner->checkReplay(seqnum)) {
+        if (errorData != NULL)
+            fillErrorData(errorData, ReplayError, buffer, innerLength, innerIndex);
+        return -2;
+    }
+    if (inner->getTagLength() > 0 && !inner->checkAuthLimit(innerIndex)) {
+        if (errorData != NULL)
+            fillErrorData(errorData, AuthLimitError, buffer, innerLength, innerIndex);
+        return -1;
+    }
+    if (inner->getTagLength() > 0 && !tagEqual(buffer + innerLength + inner->getMkiLength(), innerMac, inner->getTagLength())) {
+        inner->authFailed();
+        if (errorData != NULL)
+            fillErrorData(errorData, AuthError, buffer, innerLength, innerIndex);
+        return -1;
+    }
+    inner->update(seqnum);
 
-    uint32_t encIndex = pcc->getSrtcpIndex();
-    pcc->srtcpEncrypt(buffer + 8, length - 8, encIndex, ssrc);
+    return 1;
+}
 
-    encIndex |= 0x80000000;                                     // set the E flag
+/*
+ * Protect one RTCP packet with the given SRTCP index. The index and tag
+ * fields may be unaligned, thus store them with memcpy.
+ */
+static void protectCtrlPacket(CryptoContextCtrl* pcc, uint8_t* buffer, size_t length, uint32_t index, size_t* newLength)
+{
+    pcc->srtcpEncryptPacket(buffer, length, index);
+
+    uint32_t encIndex = index | 0x80000000;                     // set the E flag
 
     // Fill SRTCP index as last word
-    uint32_t* ip = reinterpret_cast<uint32_t*>(buffer+length);
-    *ip = zrtpHtonl(encIndex);
+    uint32_t beIndex = zrtpHtonl(encIndex);
+    memcpy(buffer + length, &beIndex, sizeof(beIndex));
 
     // NO MKI support yet - here we assume MKI is zero. To build in MKI
     // take MKI length into account when storing the authentication tag.
@@ -220,29 +664,71 @@ bool SrtpHandler::protectCtrl(CryptoContextCtrl* pcc, uint8_t* buffer, size_t le
     // Compute MAC and store in packet after the SRTCP index field
     pcc->srtcpAuthenticate(buffer, length, encIndex, buffer + length + sizeof(uint32_t));
 
-    encIndex++;
-    encIndex &= ~0x80000000;                                // clear the E-flag and modulo 2^31
-    pcc->setSrtcpIndex(encIndex);
     *newLength = length + pcc->getTagLength() + sizeof(uint32_t);
+}
 
+bool SrtpHandler::protectCtrl(CryptoContextCtrl* pcc, uint8_t* buffer, size_t length, size_t* newLength)
+{
+
+    if (pcc == NULL || !pcc->isValid() || length < 8) {
+        return false;
+    }
+    uint32_t index = pcc->getSrtcpIndex();
+    protectCtrlPacket(pcc, buffer, length, index, newLength);
+
+    pcc->setSrtcpIndex((index + 1) & ~0x80000000);          // modulo 2^31
     return true;
 }
 
+int32_t SrtpHandler::protectCtrl(CryptoContextCtrl* pcc, SrtpCtrlPacket* packets, int32_t count)
+{
+    int32_t protectedPackets = 0;
+
+    if (pcc == NULL || !pcc->isValid()) {
+        return 0;
+    }
+    // The packets get consecutive indices, the context's index is written once
+    uint32_t index = pcc->getSrtcpIndex();
+    for (int32_t i = 0; i < count; i++) {
+        SrtpCtrlPacket& packet = packets[i];
+        if (packet.buffer == NULL || packet.length < 8) {
+            packet.result = 0;
+            continue;
+        }
+        protectCtrlPacket(pcc, packet.buffer, packet.length, index, &packet.length);
+        index = (index + 1) & ~0x80000000;
+        packet.result = 1;
+        protectedPackets++;
+    }
+    pcc->setSrtcpIndex(index);
+    return protectedPackets;
+}
+
 int32_t SrtpHandler::unprotectCtrl(CryptoContextCtrl* pcc, uint8_t* buffer, size_t length, size_t* newLength)
 {
 
-    if (pcc == NULL) {
+    if (pcc == NULL || !pcc->isValid()) {
         return 0;
     }
 
+    // The fixed RTCP header, the SRTCP index, MKI and tag must fit
+    if (length < 8 + 4 + (size_t)(pcc->getTagLength() + pcc->getMkiLength()))
+        return 0;
+
+    uint32_t ssrc;
+    memcpy(&ssrc, buffer + 4, sizeof(ssrc));                   // always SSRC of sender
+    ssrc = zrtpNtohl(ssrc);
+    if (pcc->getSsrc() != 0 && pcc->getSsrc() != ssrc)
+        return 0;
+
     // Compute the total length of the payload
     int32_t payloadLen = length - (pcc->getTagLength() + pcc->getMkiLength() + 4);
     *newLength = payloadLen;
 
-    // point to the SRTCP index field just after the real payload
-    const uint32_t* index = reinterpret_cast<uint32_t*>(buffer + payloadLen);
-
-    uint32_t encIndex = zrtpNtohl(*index);
+    // The SRTCP index field follows the real payload, it may be unaligned
+    uint32_t encIndex;
+    memcpy(&encIndex, buffer + payloadLen, sizeof(encIndex));
+    encIndex = zrtpNtohl(encIndex);
     uint32_t remoteIndex = encIndex & ~0x80000000;    // get index without Encryption flag
 
     if (!pcc->checkReplay(remoteIndex)) {
@@ -256,16 +742,13 @@ int32_t SrtpHandler::unprotectCtrl(CryptoContextCtrl* pcc, uint8_t* buffer, size
 
     // Authenticate includes the index, but not MKI and not (obviously) the tag itself
     pcc->srtcpAuthenticate(buffer, payloadLen, encIndex, mac);
-    if (memcmp(tag, mac, pcc->getTagLength()) != 0) {
+    if (!tagEqual(tag, mac, pcc->getTagLength())) {
         return -1;
     }
 
-    uint32_t ssrc = *(reinterpret_cast<uint32_t*>(buffer + 4)); // always SSRC of sender
-    ssrc = zrtpNtohl(ssrc);
-
     // Decrypt the content, exclude the very first SRTCP header (fixed, 8 bytes)
     if (encIndex & 0x80000000)
-        pcc->srtcpEncrypt(buffer + 8, payloadLen - 8, remoteIndex, ssrc);
+        pcc->srtcpEncryptPacket(buffer, payloadLen, remoteIndex);
 
     // Update the Crypto-context
     pcc->update(remoteIndex);
@@ -273,3 +756,22 @@ int32_t SrtpHandler::unprotectCtrl(CryptoContextCtrl* pcc, uint8_t* buffer, size
     return 1;
 }
 
+int32_t SrtpHandler::unprotectCtrl(CryptoContextCtrl* pcc, SrtpCtrlPacket* packets, int32_t count)
+{
+    int32_t unprotectedPackets = 0;
+
+    if (pcc == NULL || !pcc->isValid()) {
+        return 0;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        SrtpCtrlPacket& packet = packets[i];
+        size_t newLength = 0;
+
+        packet.result = packet.buffer != NULL ? unprotectCtrl(pcc, packet.buffer, packet.length, &newLength) : 0;
+        if (packet.result == 1) {
+            packet.length = newLength;
+            unprotectedPackets++;
+        }
+    }
+    return unprotectedPackets;
+}
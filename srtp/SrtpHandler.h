@@ -24,6 +24,16 @@
 
 class CryptoContext;
 class CryptoContextCtrl;
+struct SrtpIoVec;
+
+/**
+ * @brief A RTCP packet of the batch protectCtrl() and unprotectCtrl() functions.
+ */
+typedef struct _SrtpCtrlPacket {
+    uint8_t* buffer;        ///< The packet data, processed in place
+    size_t   length;        ///< On call the packet length, on return the new length if @c result is 1
+    int32_t  result;        ///< The result of the single packet function, 1 for a successful protect
+} SrtpCtrlPacket;
 
 /**
  * @brief SRTP and SRTCP protect and unprotect functions.
@@ -58,6 +68,31 @@ public:
      */
     static bool protect(CryptoContext* pcc, uint8_t* buffer, size_t length, size_t* newLength);
 
+    /**
+     * @brief Protect an RTP packet into a separate output buffer.
+     *
+     * The function reads the RTP packet from @c buffer and writes the SRTP
+     * packet, including the authentication tag, to @c output. The source
+     * buffer stays unchanged. An application that sends one RTP packet to
+     * several destinations, each with its own crypto context, can protect
+     * the packet for each destination from the same source buffer.
+     *
+     * @param pcc the SRTP CryptoContext instance
+     *
+     * @param buffer the RTP packet to protect
+     *
+     * @param length the length of the RTP packet data in bytes
+     *
+     * @param output buffer for the SRTP packet, must hold @c length bytes plus
+     *               the tag length of the crypto context and must not overlap
+     *               @c buffer
+     *
+     * @param newLength the length of the resulting SRTP packet data in bytes
+     *
+     * @return @c true if protection was successful, @c false otherwise
+     */
+    static bool protect(CryptoContext* pcc, const uint8_t* buffer, size_t length, uint8_t* output, size_t* newLength);
+
     /**
      * @brief Unprotect a SRTP packet.
      * 
@@ -65,6 +100,12 @@ public:
      * in case of an error return. The caller may store and evaluate this data to further
      * trace the problem.
      *
+     * The function rejects a packet before it computes the MAC if the packet is too
+     * short, if its SSRC does not match the SSRC of the crypto context (unless the
+     * context's SSRC is 0), if the replay check fails or if the context throttles
+     * after too many authentication failures, see CryptoContext::checkAuthLimit().
+     * The tag compare runs in constant time.
+     *
      * @param pcc the SRTP CryptoContext instance
      *
      * @param buffer the SRTP packet to unprotect
@@ -77,12 +118,111 @@ public:
      *
      * @return an integer value
      *         - 1 - success
-     *         - 0 - SRTP/RTP packet decode error
-     *         - -1 - SRTP authentication failed
+     *         - 0 - SRTP/RTP packet decode error, wrong length or SSRC
+     *         - -1 - SRTP authentication failed or dropped by the authentication failure limit
      *         - -2 - SRTP replay check failed
      */
     static int32_t unprotect(CryptoContext* pcc, uint8_t* buffer, size_t length, size_t* newLength, SrtpErrorData* errorData=NULL);
 
+    /**
+     * @brief Protect a scattered RTP packet.
+     *
+     * The RTP header, header extension and payload may be in different buffers.
+     * The first buffer must contain at least the fixed RTP header (12 bytes).
+     * The function encrypts the payload in place and stores the authentication
+     * tag in a separate buffer, the caller sends the tag after the last buffer.
+     *
+     * @param pcc the SRTP CryptoContext instance
+     *
+     * @param iov the buffers of the RTP packet, in packet order
+     *
+     * @param iovCount the number of buffers, at most @c SRTP_MAX_IOVEC
+     *
+     * @param tag buffer that receives the authentication tag, must be able to
+     *            hold @c getTagLength() bytes of the crypto context
+     *
+     * @param newLength the length of the resulting SRTP packet data in bytes,
+     *                  including the tag
+     *
+     * @return @c true if protection was successful, @c false otherwise
+     */
+    static bool protect(CryptoContext* pcc, const SrtpIoVec* iov, int32_t iovCount, uint8_t* tag, size_t* newLength);
+
+    /**
+     * @brief Unprotect a scattered SRTP packet.
+     *
+     * The buffers contain the SRTP packet without the authentication tag, the
+     * first buffer must contain at least the fixed RTP header (12 bytes). The
+     * function decrypts the payload in place.
+     *
+     * @param pcc the SRTP CryptoContext instance
+     *
+     * @param iov the buffers of the SRTP packet without tag, in packet order
+     *
+     * @param iovCount the number of buffers, at most @c SRTP_MAX_IOVEC
+     *
+     * @param tag the received authentication tag
+     *
+     * @param newLength the length of the resulting RTP packet data in bytes
+     *
+     * @param errorData Pointer to @c errorData structure or @c NULL, default is @c NULL
+     *
+     * @return an integer value, see unprotect() above
+     */
+    static int32_t unprotect(CryptoContext* pcc, const SrtpIoVec* iov, int32_t iovCount, const uint8_t* tag,
+                             size_t* newLength, SrtpErrorData* errorData=NULL);
+
+    /**
+     * @brief Protect an RTP packet with two crypto contexts.
+     *
+     * The result is the same as calling protect() with the @c inner and then
+     * with the @c outer crypto context: the outer context encrypts and
+     * authenticates the inner SRTP packet including its tag. This function
+     * decodes the RTP header once and runs both key streams and both
+     * authentications in one pass over the payload.
+     *
+     * @param inner the crypto context of the first protection, for example SDES
+     *
+     * @param outer the crypto context of the second protection, for example ZRTP
+     *
+     * @param buffer the RTP packet to protect, must have room for both tags
+     *
+     * @param length the length of the RTP packet data in bytes
+     *
+     * @param newLength the length of the resulting SRTP packet data in bytes
+     *
+     * @return @c true if protection was successful, @c false otherwise
+     */
+    static bool protectDouble(CryptoContext* inner, CryptoContext* outer, uint8_t* buffer, size_t length, size_t* newLength);
+
+    /**
+     * @brief Unprotect a SRTP packet that was protected with two crypto contexts.
+     *
+     * The reverse of protectDouble(), the result is the same as calling unprotect()
+     * with the @c outer and then with the @c inner crypto context. If the outer
+     * unprotect fails the buffer is unchanged, thus the caller may try another
+     * crypto context. If only the inner unprotect fails the content of the buffer
+     * is undefined.
+     *
+     * @param inner the crypto context of the first protection, for example SDES
+     *
+     * @param outer the crypto context of the second protection, for example ZRTP
+     *
+     * @param buffer the SRTP packet to unprotect
+     *
+     * @param length the length of the SRTP packet data in bytes
+     *
+     * @param newLength the length of the resulting RTP packet data in bytes
+     *
+     * @param outerValid set to @c true if the outer crypto context accepted the packet
+     *
+     * @param errorData Pointer to @c errorData structure or @c NULL, default is @c NULL
+     *
+     * @return an integer value, see unprotect() above
+     */
+    static int32_t unprotectDouble(CryptoContext* inner, CryptoContext* outer, uint8_t* buffer, size_t length,
+                                   size_t* newLength, bool* outerValid, SrtpErrorData* errorData=NULL);
+
     /**
      * @brief Protect an RTCP packet.
      *
@@ -110,15 +250,49 @@ public:
      * @param newLength the length of the resulting RTCP packet data in bytes
      *
      * @return an integer value
-     *         - 0 - illegal packet (too short, not a valid RTP header byte), dismiss it
+     *         - 0 - illegal packet (too short, wrong SSRC), dismiss it
      *         - 1 - success
      *         - -1 - SRTCP authentication failed
      *         - -2 - SRTCP replay check failed
      */
     static int32_t unprotectCtrl(CryptoContextCtrl* pcc, uint8_t* buffer, size_t length, size_t* newLength);
 
+    /**
+     * @brief Protect several RTCP packets of one SRTCP context.
+     *
+     * The packets get consecutive SRTCP indices in array order. Each buffer
+     * must have room for the SRTCP index, MKI and tag. Each packet may be a
+     * compound RTCP packet, SRTCP protects a compound packet as one unit.
+     *
+     * @param pcc the SRTCP CryptoContextCtrl instance
+     *
+     * @param packets the packets, the function sets @c length and @c result
+     *
+     * @param count the number of packets
+     *
+     * @return the number of protected packets
+     */
+    static int32_t protectCtrl(CryptoContextCtrl* pcc, SrtpCtrlPacket* packets, int32_t count);
+
+    /**
+     * @brief Unprotect several SRTCP packets of one SRTCP context.
+     *
+     * @param pcc the SRTCP CryptoContextCtrl instance
+     *
+     * @param packets the packets, the function sets @c result to the return
+     *                value of unprotectCtrl() above and @c length on success
+     *
+     * @param count the number of packets
+     *
+     * @return the number of unprotected packets
+     */
+    static int32_t unprotectCtrl(CryptoContextCtrl* pcc, SrtpCtrlPacket* packets, int32_t count);
+
 private:
     static bool decodeRtp(uint8_t* buffer, int32_t length, uint32_t *ssrc, uint16_t *seq, uint8_t** payload, int32_t *payloadlen);
 
+    static bool decodeRtp(const SrtpIoVec* iov, int32_t iovCount, uint32_t *ssrc, uint16_t *seq, SrtpIoVec* payload,
+                          int32_t *payloadCount, size_t *length);
+
 };
 #endif // _SRTPHANDLER_H_
\ No newline at end of file
@@ -0,0 +1,311 @@
+/*
+  Copyright (C) 2013 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _SRTPMETRICS_H_
+#define _SRTPMETRICS_H_
+
+/**
+ * @file SrtpMetrics.h
+ * @brief Counters and latency histograms of SRTP streams
+ * @ingroup Z_SRTP
+ * @{
+ *
+ * A stream owns a SrtpStreamMetrics instance and records each protect and
+ * unprotect operation. The recording functions use relaxed atomic operations
+ * only, thus other threads can take a snapshot at any time without locking
+ * the stream. Snapshots of several streams add up to an aggregate view.
+ *
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+/*
+ * The latency histograms use HDR-style log-linear buckets: each power of two
+ * has SRTP_HISTOGRAM_SUB_BUCKETS buckets, thus a bucket covers at most 25% of
+ * its value. The buckets cover 0 ns up to 2^32 ns (about 4.3 s), longer times
+ * go to the last bucket.
+ */
+#define SRTP_HISTOGRAM_SUB_BITS     2
+#define SRTP_HISTOGRAM_SUB_BUCKETS  (1 << SRTP_HISTOGRAM_SUB_BITS)
+#define SRTP_HISTOGRAM_BUCKETS      ((32 - SRTP_HISTOGRAM_SUB_BITS + 1) * SRTP_HISTOGRAM_SUB_BUCKETS)
+
+/* Number of encryption and authentication algorithms, see CryptoContext.h */
+#define SRTP_METRICS_CIPHERS        5
+#define SRTP_METRICS_AUTHS          3
+
+/**
+ * @brief Copy of a latency histogram.
+ */
+typedef struct _SrtpHistogramSnapshot {
+    uint64_t counts[SRTP_HISTOGRAM_BUCKETS];
+    uint64_t count;                     //!< Number of recorded values
+    uint64_t sumNs;                     //!< Sum of all recorded values
+    uint64_t maxNs;                     //!< Largest recorded value
+
+    /**
+     * @brief Get the smallest value a bucket holds, in ns.
+     */
+    static uint64_t bucketValue(int32_t bucket) {
+        if (bucket < SRTP_HISTOGRAM_SUB_BUCKETS)
+            return bucket;
+        int32_t shift = bucket / SRTP_HISTOGRAM_SUB_BUCKETS - 1;
+        uint64_t mantissa = SRTP_HISTOGRAM_SUB_BUCKETS + bucket % SRTP_HISTOGRAM_SUB_BUCKETS;
+        return mantissa << shift;
+    }
+
+    /**
+     * @brief Get a percentile of the recorded values.
+     *
+     * @param percent the percentile, for example 50.0 or 99.9
+     * @return the lower bound of the bucket that holds the percentile, in ns.
+     */
+    uint64_t percentile(double percent) const {
+        if (count == 0)
+            return 0;
+        uint64_t wanted = (uint64_t)(count * percent / 100.0);
+        if (wanted >= count)
+            wanted = count - 1;
+        uint64_t seen = 0;
+        for (int32_t i = 0; i < SRTP_HISTOGRAM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > wanted)
+                return bucketValue(i);
+        }
+        return maxNs;
+    }
+} SrtpHistogramSnapshot;
+
+/**
+ * @brief Copy of the metrics of one or more SRTP streams.
+ */
+typedef struct _SrtpMetricsSnapshot {
+    uint64_t protectPackets;
+    uint64_t protectBytes;
+    uint64_t unprotectPackets;
+    uint64_t unprotectBytes;
+    uint64_t decodeErrors;
+    uint64_t authErrors;
+    uint64_t replayErrors;
+
+    /** Bytes protected or unprotected, by encryption and authentication algorithm */
+    uint64_t suiteBytes[SRTP_METRICS_CIPHERS][SRTP_METRICS_AUTHS];
+
+    SrtpHistogramSnapshot protectLatency;
+    SrtpHistogramSnapshot unprotectLatency;
+} SrtpMetricsSnapshot;
+
+/**
+ * @brief Latency histogram with relaxed atomic buckets.
+ */
+class SrtpLatencyHistogram {
+public:
+    SrtpLatencyHistogram() { reset(); }
+
+    static int32_t bucketIndex(uint64_t ns) {
+        if (ns < SRTP_HISTOGRAM_SUB_BUCKETS)
+            return (int32_t)ns;
+        if (ns >> 32)
+            return SRTP_HISTOGRAM_BUCKETS - 1;
+#if defined(__GNUC__)
+        int32_t shift = 63 - __builtin_clzll(ns) - SRTP_HISTOGRAM_SUB_BITS;
+#else
+        int32_t shift = 0;
+        while ((ns >> shift) >= 2 * SRTP_HISTOGRAM_SUB_BUCKETS)
+            shift++;
+#endif
+        return (shift + 1) * SRTP_HISTOGRAM_SUB_BUCKETS + (int32_t)((ns >> shift) - SRTP_HISTOGRAM_SUB_BUCKETS);
+    }
+
+    void record(uint64_t ns) {
+        counts[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+        sumNs.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = maxNs.load(std::memory_order_relaxed);
+        while (ns > max && !maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+            ;
+    }
+
+    /**
+     * @brief Add the histogram data to a snapshot.
+     */
+    void addTo(SrtpHistogramSnapshot* snapshot) const {
+        for (int32_t i = 0; i < SRTP_HISTOGRAM_BUCKETS; i++) {
+            uint64_t c = counts[i].load(std::memory_order_relaxed);
+            snapshot->counts[i] += c;
+            snapshot->count += c;
+        }
+        snapshot->sumNs += sumNs.load(std::memory_order_relaxed);
+        uint64_t max = maxNs.load(std::memory_order_relaxed);
+        if (max > snapshot->maxNs)
+            snapshot->maxNs = max;
+    }
+
+    void reset() {
+        for (int32_t i = 0; i < SRTP_HISTOGRAM_BUCKETS; i++)
+            counts[i].store(0, std::memory_order_relaxed);
+        sumNs.store(0, std::memory_order_relaxed);
+        maxNs.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> counts[SRTP_HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> sumNs;
+    std::atomic<uint64_t> maxNs;
+};
+
+/**
+ * @brief Metrics of one SRTP stream.
+ *
+ * One thread records, any thread may read. Latency measurement costs two
+ * clock reads per packet, applications can switch it off with
+ * setTimingEnabled(). The counters are always active.
+ */
+class SrtpStreamMetrics {
+public:
+    SrtpStreamMetrics() { reset(); }
+
+    /**
+     * @brief Enable or disable latency measurement for all streams.
+     */
+    static void setTimingEnabled(bool yesNo) { timingEnabled().store(yesNo, std::memory_order_relaxed); }
+
+    /**
+     * @brief Get a start time for a latency measurement.
+     *
+     * @return the current time in ns or 0 if latency measurement is disabled.
+     */
+    static uint64_t startTime() {
+        if (!timingEnabled().load(std::memory_order_relaxed))
+            return 0;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Record a successful protect operation.
+     *
+     * @param start value of startTime() before the operation
+     * @param bytes length of the RTP packet
+     * @param ealg encryption algorithm of the crypto context
+     * @param aalg authentication algorithm of the crypto context
+     */
+    void recordProtect(uint64_t start, size_t bytes, int32_t ealg, int32_t aalg) {
+        protectPackets.fetch_add(1, std::memory_order_relaxed);
+        protectBytes.fetch_add(bytes, std::memory_order_relaxed);
+        addSuiteBytes(ealg, aalg, bytes);
+        if (start != 0)
+            protectLatency.record(elapsed(start));
+    }
+
+    /**
+     * @brief Record a successful unprotect operation, parameters see recordProtect().
+     */
+    void recordUnprotect(uint64_t start, size_t bytes, int32_t ealg, int32_t aalg) {
+        unprotectPackets.fetch_add(1, std::memory_order_relaxed);
+        unprotectBytes.fetch_add(bytes, std::memory_order_relaxed);
+        addSuiteBytes(ealg, aalg, bytes);
+        if (start != 0)
+            unprotectLatency.record(elapsed(start));
+    }
+
+    /**
+     * @brief Record a failed unprotect operation.
+     *
+     * @param rc return code of SrtpHandler::unprotect()
+     */
+    void recordUnprotectError(int32_t rc) {
+        if (rc == 0)
+            decodeErrors.fetch_add(1, std::memory_order_relaxed);
+        else if (rc == -1)
+            authErrors.fetch_add(1, std::memory_order_relaxed);
+        else if (rc == -2)
+            replayErrors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Add the stream's metrics to a snapshot.
+     *
+     * Clear the snapshot with memset before the first call.
+     */
+    void addTo(SrtpMetricsSnapshot* snapshot) const {
+        snapshot->protectPackets += protectPackets.load(std::memory_order_relaxed);
+        snapshot->protectBytes += protectBytes.load(std::memory_order_relaxed);
+        snapshot->unprotectPackets += unprotectPackets.load(std::memory_order_relaxed);
+        snapshot->unprotectBytes += unprotectBytes.load(std::memory_order_relaxed);
+        snapshot->decodeErrors += decodeErrors.load(std::memory_order_relaxed);
+        snapshot->authErrors += authErrors.load(std::memory_order_relaxed);
+        snapshot->replayErrors += replayErrors.load(std::memory_order_relaxed);
+        for (int32_t e = 0; e < SRTP_METRICS_CIPHERS; e++) {
+            for (int32_t a = 0; a < SRTP_METRICS_AUTHS; a++)
+                snapshot->suiteBytes[e][a] += suiteBytes[e][a].load(std::memory_order_relaxed);
+        }
+        protectLatency.addTo(&snapshot->protectLatency);
+        unprotectLatency.addTo(&snapshot->unprotectLatency);
+    }
+
+    void reset() {
+        protectPackets.store(0, std::memory_order_relaxed);
+        protectBytes.store(0, std::memory_order_relaxed);
+        unprotectPackets.store(0, std::memory_order_relaxed);
+        unprotectBytes.store(0, std::memory_order_relaxed);
+        decodeErrors.store(0, std::memory_order_relaxed);
+        authErrors.store(0, std::memory_order_relaxed);
+        replayErrors.store(0, std::memory_order_relaxed);
+        for (int32_t e = 0; e < SRTP_METRICS_CIPHERS; e++) {
+            for (int32_t a = 0; a < SRTP_METRICS_AUTHS; a++)
+                suiteBytes[e][a].store(0, std::memory_order_relaxed);
+        }
+        protectLatency.reset();
+        unprotectLatency.reset();
+    }
+
+private:
+    static std::atomic<bool>& timingEnabled() {
+        static std::atomic<bool> enabled(true);
+        return enabled;
+    }
+
+    static uint64_t elapsed(uint64_t start) {
+        uint64_t now = startTime();
+        return now > start ? now - start : 0;
+    }
+
+    void addSuiteBytes(int32_t ealg, int32_t aalg, size_t bytes) {
+        if (ealg >= 0 && ealg < SRTP_METRICS_CIPHERS && aalg >= 0 && aalg < SRTP_METRICS_AUTHS)
+            suiteBytes[ealg][aalg].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> protectPackets;
+    std::atomic<uint64_t> protectBytes;
+    std::atomic<uint64_t> unprotectPackets;
+    std::atomic<uint64_t> unprotectBytes;
+    std::atomic<uint64_t> decodeErrors;
+    std::atomic<uint64_t> authErrors;
+    std::atomic<uint64_t> replayErrors;
+    std::atomic<uint64_t> suiteBytes[SRTP_METRICS_CIPHERS][SRTP_METRICS_AUTHS];
+    SrtpLatencyHistogram protectLatency;
+    SrtpLatencyHistogram unprotectLatency;
+};
+
+/**
+ * @}
+ */
+#endif
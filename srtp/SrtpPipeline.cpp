@@ -0,0 +1,249 @@
+/*
+  Copyright (C) 2012 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+/**
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <new>
+#include <chrono>
+#include <vector>
+
+#include <CryptoContext.h>
+#include <CryptoContextCtrl.h>
+#include <SrtpHandler.h>
+#include <SrtpPipeline.h>
+
+/* Number of empty polls before an idle worker goes to sleep */
+#define SRTP_PIPELINE_SPINS     200
+
+/* A sleeping worker checks its queue at least this often, guards against a lost wakeup */
+#define SRTP_PIPELINE_SLEEP_MS  10
+
+void* SrtpPipeline::Worker::operator new(size_t size)
+{
+    void* ptr = srtpContextAlloc(size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void SrtpPipeline::Worker::operator delete(void* ptr)
+{
+    if (ptr != NULL)
+        srtpContextFree(ptr);
+}
+
+SrtpPipeline::SrtpPipeline(int32_t workerThreads, uint32_t queueSize): workers(NULL), numberOfWorkers(workerThreads),
+    nextPoll(0), running(true)
+{
+    if (numberOfWorkers <= 0)
+        numberOfWorkers = std::thread::hardware_concurrency();
+    if (numberOfWorkers <= 0)
+        numberOfWorkers = 1;
+
+    workers = new Worker*[numberOfWorkers];
+    for (int32_t i = 0; i < numberOfWorkers; i++)
+        workers[i] = new Worker(queueSize);
+    for (int32_t i = 0; i < numberOfWorkers; i++)
+        workers[i]->thread = std::thread(&SrtpPipeline::run, this, workers[i]);
+}
+
+SrtpPipeline::~SrtpPipeline()
+{
+    running.store(false);
+    for (int32_t i = 0; i < numberOfWorkers; i++) {
+        {
+            std::lock_guard<std::mutex> guard(workers[i]->lock);
+            workers[i]->wakeup.notify_one();
+        }
+        workers[i]->thread.join();
+        delete workers[i];
+    }
+    delete[] workers;
+}
+
+int32_t SrtpPipeline::getWorker(uint32_t ssrc) const
+{
+    // Multiplicative hash, spreads SSRCs that differ in few bits only
+    uint32_t hash = ssrc * 2654435761U;
+    return (int32_t)(((uint64_t)hash * numberOfWorkers) >> 32);
+}
+
+bool SrtpPipeline::enqueue(const SrtpPipelinePacket& packet, Worker** worker)
+{
+    uint32_t ssrc;
+
+    if (packet.context == NULL)
+        return false;
+    if (packet.operation == SrtpPipelineProtect || packet.operation == SrtpPipelineUnprotect)
+        ssrc = static_cast<CryptoContext*>(packet.context)->getSsrc();
+    else
+        ssrc = static_cast<CryptoContextCtrl*>(packet.context)->getSsrc();
+
+    // SDES contexts have SSRC 0, select their worker by the context, not all by the same SSRC
+    if (ssrc == 0) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(packet.context) / SRTP_CACHE_LINE;
+        ssrc = (uint32_t)(address ^ ((uint64_t)address >> 32));
+    }
+    Worker* w = workers[getWorker(ssrc)];
+    if (!w->input.push(packet))
+        return false;
+    w->submitted.fetch_add(1, std::memory_order_relaxed);
+    *worker = w;
+    return true;
+}
+
+void SrtpPipeline::wake(Worker* worker)
+{
+    // Pairs with the fence in run(): either the worker sees the new packet or we see it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (worker->sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> guard(worker->lock);
+        worker->wakeup.notify_one();
+    }
+}
+
+bool SrtpPipeline::submit(const SrtpPipelinePacket& packet)
+{
+    Worker* worker;
+
+    if (!enqueue(packet, &worker))
+        return false;
+    wake(worker);
+    return true;
+}
+
+int32_t SrtpPipeline::submit(const SrtpPipelinePacket* packets, int32_t count)
+{
+    Worker* worker;
+    int32_t submitted = 0;
+
+    for (; submitted < count; submitted++) {
+        if (!enqueue(packets[submitted], &worker))
+            break;
+    }
+    if (submitted > 0) {
+        for (int32_t i = 0; i < numberOfWorkers; i++)
+            wake(workers[i]);
+    }
+    return submitted;
+}
+
+int32_t SrtpPipeline::poll(SrtpPipelinePacket* packets, int32_t maxPackets)
+{
+    int32_t found = 0;
+
+    // Start at a different worker each time, a busy worker must not starve the others
+    for (int32_t i = 0; i < numberOfWorkers && found < maxPackets; i++) {
+        Worker* worker = workers[(nextPoll + i) % numberOfWorkers];
+        while (found < maxPackets && worker->output.pop(packets[found]))
+            found++;
+    }
+    nextPoll = (nextPoll + 1) % numberOfWorkers;
+    return found;
+}
+
+int32_t SrtpPipeline::drain(SrtpPipelinePacket* packets, int32_t maxPackets)
+{
+    int32_t found = 0;
+
+    if (packets == NULL || maxPackets <= 0)
+        return -1;
+
+    // The targets are the packets submitted up to now, a worker pushes a packet before it counts it
+    std::vector<uint64_t> targets(numberOfWorkers);
+    for (int32_t i = 0; i < numberOfWorkers; i++)
+        targets[i] = workers[i]->submitted.load(std::memory_order_relaxed);
+
+    for (;;) {
+        bool done = true;
+        for (int32_t i = 0; i < numberOfWorkers && done; i++)
+            done = workers[i]->processed.load(std::memory_order_acquire) >= targets[i];
+
+        // Poll even if not done, a worker may wait for room in its output queue
+        found += poll(packets + found, maxPackets - found);
+        if (done || found == maxPackets)
+            return found;
+        std::this_thread::yield();
+    }
+}
+
+void SrtpPipeline::process(SrtpPipelinePacket& packet)
+{
+    size_t newLength = 0;
+
+    switch (packet.operation) {
+    case SrtpPipelineProtect:
+        packet.result = SrtpHandler::protect(static_cast<CryptoContext*>(packet.context), packet.buffer,
+                                             packet.length, &newLength) ? 1 : 0;
+        break;
+
+    case SrtpPipelineUnprotect:
+        packet.result = SrtpHandler::unprotect(static_cast<CryptoContext*>(packet.context), packet.buffer,
+                                               packet.length, &newLength);
+        break;
+
+    case SrtpPipelineProtectCtrl:
+        packet.result = SrtpHandler::protectCtrl(static_cast<CryptoContextCtrl*>(packet.context), packet.buffer,
+                                                 packet.length, &newLength) ? 1 : 0;
+        break;
+
+    case SrtpPipelineUnprotectCtrl:
+        packet.result = SrtpHandler::unprotectCtrl(static_cast<CryptoContextCtrl*>(packet.context), packet.buffer,
+                                                   packet.length, &newLength);
+        break;
+
+    default:
+        packet.result = 0;
+        return;
+    }
+    if (packet.result == 1)
+        packet.length = newLength;
+}
+
+void SrtpPipeline::run(Worker* worker)
+{
+    SrtpPipelinePacket packet;
+    int32_t idle = 0;
+
+    while (running.load(std::memory_order_relaxed)) {
+        if (worker->input.pop(packet)) {
+            process(packet);
+            while (!worker->output.push(packet)) {
+                if (!running.load(std::memory_order_relaxed))
+                    return;
+                std::this_thread::yield();
+            }
+            worker->processed.fetch_add(1, std::memory_order_release);
+            idle = 0;
+            continue;
+        }
+        if (++idle < SRTP_PIPELINE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(worker->lock);
+        worker->sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (worker->input.empty() && running.load(std::memory_order_relaxed))
+            worker->wakeup.wait_for(guard, std::chrono::milliseconds(SRTP_PIPELINE_SLEEP_MS));
+        worker->sleeping.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
@@ -0,0 +1,209 @@
+/*
+  Copyright (C) 2012 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#ifndef _SRTPPIPELINE_H_
+#define _SRTPPIPELINE_H_
+
+/**
+ * @file SrtpPipeline.h
+ * @brief Process SRTP and SRTCP packets on worker threads
+ * @ingroup Z_SRTP
+ * @{
+ *
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <SpscQueue.h>
+
+class CryptoContext;
+class CryptoContextCtrl;
+
+/**
+ * Operations of a pipeline packet.
+ */
+enum SrtpPipelineOperations {
+    SrtpPipelineProtect = 1,        ///< SrtpHandler::protect, @c context is a CryptoContext
+    SrtpPipelineUnprotect,          ///< SrtpHandler::unprotect, @c context is a CryptoContext
+    SrtpPipelineProtectCtrl,        ///< SrtpHandler::protectCtrl, @c context is a CryptoContextCtrl
+    SrtpPipelineUnprotectCtrl       ///< SrtpHandler::unprotectCtrl, @c context is a CryptoContextCtrl
+};
+
+/**
+ * A packet that travels through the pipeline.
+ *
+ * The pipeline copies this descriptor, not the packet data. The buffer
+ * must stay valid until the packet comes back from poll(). For protect
+ * operations the buffer must have room for the authentication tag and MKI.
+ */
+typedef struct _SrtpPipelinePacket {
+    void*    context;       ///< CryptoContext or CryptoContextCtrl, see @c operation
+    uint8_t* buffer;        ///< The packet data, processed in place
+    size_t   length;        ///< On submit the packet length, on poll the new length
+    int32_t  operation;     ///< One of @c SrtpPipelineOperations
+    int32_t  result;        ///< On poll the result of the SrtpHandler function, 1 for a successful protect
+    void*    userData;      ///< Not used by the pipeline, for example the destination address
+} SrtpPipelinePacket;
+
+/**
+ * Processes SRTP and SRTCP packets of many streams on worker threads.
+ *
+ * The application thread that reads the sockets submits packets, the
+ * pipeline distributes them to the worker threads and the application
+ * polls the processed packets. The pipeline selects the worker by the
+ * SSRC of the crypto context, or by the context itself if its SSRC is 0 as
+ * for SDES contexts, thus all packets of a crypto context run on the same
+ * worker in submit order. This keeps the ROC and the replay window
+ * of a context consistent without locks. poll() returns the packets of a
+ * context in submit order, packets of different workers may overtake each
+ * other.
+ *
+ * Each worker has a lock-free input and output queue. The queues have a
+ * single producer and a single consumer, thus one thread may call submit()
+ * and one thread may call poll(), this may be the same thread. If an output
+ * queue is full the worker waits until poll() makes room.
+ *
+ * An idle worker spins for a short time and then sleeps until submit()
+ * wakes it up.
+ *
+ * The application must not delete a crypto context while the pipeline
+ * holds packets that use it, drain() returns all packets from the pipeline.
+ */
+class SrtpPipeline {
+
+public:
+    /**
+     * @brief Create a pipeline and start the worker threads.
+     *
+     * @param workers number of worker threads, 0 uses one per hardware thread
+     * @param queueSize size of each input and output queue in packets
+     */
+    explicit SrtpPipeline(int32_t workers = 0, uint32_t queueSize = 1024);
+
+    /**
+     * @brief Stop the worker threads.
+     *
+     * Packets that are not yet processed or not yet polled are dropped.
+     */
+    ~SrtpPipeline();
+
+    /**
+     * @brief Submit a packet for processing.
+     *
+     * @return false if the input queue of the packet's worker is full or if
+     *         the packet has no context.
+     */
+    bool submit(const SrtpPipelinePacket& packet);
+
+    /**
+     * @brief Submit several packets.
+     *
+     * Wakes up the workers once per call.
+     *
+     * @return number of submitted packets, submission stops at the first
+     *         packet that does not fit into its worker's queue.
+     */
+    int32_t submit(const SrtpPipelinePacket* packets, int32_t count);
+
+    /**
+     * @brief Get processed packets.
+     *
+     * @param packets array that receives the processed packets
+     * @param maxPackets size of the array
+     * @return number of packets stored in @c packets.
+     */
+    int32_t poll(SrtpPipelinePacket* packets, int32_t maxPackets);
+
+    /**
+     * @brief Wait until the workers processed all submitted packets.
+     *
+     * While it waits drain() polls the processed packets, thus workers that
+     * wait for room in a full output queue make progress. Call it from the
+     * thread that calls poll() or if no other thread polls.
+     *
+     * If drain() returns less than @c maxPackets the workers processed all
+     * packets submitted before the call and the pipeline holds no more
+     * processed packets of them. If it returns @c maxPackets the array is
+     * full, call drain() again.
+     *
+     * @param packets array that receives the processed packets
+     * @param maxPackets size of the array, must be positive
+     * @return number of packets stored in @c packets, -1 if @c packets is
+     *         @c NULL or @c maxPackets is not positive.
+     */
+    int32_t drain(SrtpPipelinePacket* packets, int32_t maxPackets);
+
+    /**
+     * @brief Get the number of worker threads.
+     */
+    int32_t getNumberOfWorkers() const { return numberOfWorkers; }
+
+    /**
+     * @brief Get the worker that processes the packets of an SSRC.
+     *
+     * Not valid for crypto contexts with SSRC 0, the pipeline distributes
+     * them by their address.
+     */
+    int32_t getWorker(uint32_t ssrc) const;
+
+private:
+    SrtpPipeline(const SrtpPipeline& other);
+    SrtpPipeline& operator=(const SrtpPipeline& other);
+
+    /*
+     * Allocated via srtpContextAlloc(), thus the allocator set with
+     * setSrtpContextAllocator() must return memory aligned to SRTP_CACHE_LINE.
+     */
+    struct alignas(SRTP_CACHE_LINE) Worker {
+        explicit Worker(uint32_t queueSize): input(queueSize), output(queueSize),
+            submitted(0), processed(0), sleeping(false) { }
+
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
+        SpscQueue<SrtpPipelinePacket> input;
+        SpscQueue<SrtpPipelinePacket> output;
+        std::atomic<uint64_t> submitted;        ///< Written by the submitting thread
+        std::atomic<uint64_t> processed;        ///< Written by the worker
+        std::atomic<bool> sleeping;
+        std::mutex lock;                        ///< Protects the sleep, not the queues
+        std::condition_variable wakeup;
+        std::thread thread;
+    };
+
+    void run(Worker* worker);
+    void process(SrtpPipelinePacket& packet);
+    bool enqueue(const SrtpPipelinePacket& packet, Worker** worker);
+    void wake(Worker* worker);
+
+    Worker** workers;
+    int32_t numberOfWorkers;
+    int32_t nextPoll;                           ///< Worker where poll() starts, round robin
+    std::atomic<bool> running;
+};
+
+/**
+ * @}
+ */
+#endif
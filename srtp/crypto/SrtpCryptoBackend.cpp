@@ -0,0 +1,283 @@
+/*
+  Copyright (C) 2012 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+/**
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <string.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+
+#ifdef SRTP_OPENSSL
+// The SHA1 functions are deprecated in OpenSSL 3 but they use the same
+// assembler code as the EVP interface and need no heap context
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#endif
+
+#include <crypto/SrtpCryptoBackend.h>
+#include <crypto/sha1.h>
+#include <cryptcommon/aesopt.h>
+
+static void * (*volatile memset_volatile)(void *, int, size_t) = memset;
+
+/*
+ * Embedded backend
+ */
+static_assert(sizeof(AESencrypt) <= SRTP_AES_BACKEND_STORAGE, "SRTP_AES_BACKEND_STORAGE too small for AES key");
+static_assert(sizeof(sha1_ctx) <= SRTP_SHA1_BACKEND_STORAGE, "SRTP_SHA1_BACKEND_STORAGE too small for SHA1 context");
+
+static bool embeddedAesSetKey(void* storage, const uint8_t* key, int32_t keyLength) {
+    AESencrypt *saAes = new (storage) AESencrypt();
+    if (keyLength == 16)
+        saAes->key128(key);
+    else
+        saAes->key256(key);
+    return true;
+}
+
+static void embeddedAesEncrypt(void* storage, const uint8_t* in, uint8_t* out, int32_t blocks) {
+    AESencrypt *saAes = reinterpret_cast<AESencrypt*>(storage);
+    for (int32_t i = 0; i < blocks; i++)
+        saAes->encrypt(in + i * 16, out + i * 16);
+}
+
+static void embeddedAesRelease(void* storage) {
+    AESencrypt *saAes = reinterpret_cast<AESencrypt*>(storage);
+    memset_volatile(saAes->cx, 0, sizeof(aes_encrypt_ctx));
+    saAes->~AESencrypt();
+}
+
+static void embeddedSha1Begin(void* ctx) {
+    sha1_begin((sha1_ctx*)ctx);
+}
+
+static void embeddedSha1Update(void* ctx, const uint8_t* data, uint32_t length) {
+    sha1_hash(data, length, (sha1_ctx*)ctx);
+}
+
+static void embeddedSha1End(void* ctx, uint8_t* digest) {
+    sha1_end(digest, (sha1_ctx*)ctx);
+}
+
+static const SrtpAesBackend embeddedAes = { embeddedAesSetKey, embeddedAesEncrypt, embeddedAesRelease };
+static const SrtpSha1Backend embeddedSha1 = { embeddedSha1Begin, embeddedSha1Update, embeddedSha1End };
+
+/*
+ * OpenSSL backend. AES uses an ECB context, the SRTP code builds the counter
+ * and F8 blocks and EVP encrypts them in parallel with AES-NI.
+ */
+#ifdef SRTP_OPENSSL
+static_assert(sizeof(SHA_CTX) <= SRTP_SHA1_BACKEND_STORAGE, "SRTP_SHA1_BACKEND_STORAGE too small for SHA1 context");
+
+static bool opensslAesSetKey(void* storage, const uint8_t* key, int32_t keyLength) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL)
+        return false;
+
+    const EVP_CIPHER* cipher = (keyLength == 16) ? EVP_aes_128_ecb() : EVP_aes_256_ecb();
+    if (EVP_EncryptInit_ex(ctx, cipher, NULL, key, NULL) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        return false;
+    }
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    *(EVP_CIPHER_CTX**)storage = ctx;
+    return true;
+}
+
+static void opensslAesEncrypt(void* storage, const uint8_t* in, uint8_t* out, int32_t blocks) {
+    int outLength;
+    EVP_EncryptUpdate(*(EVP_CIPHER_CTX**)storage, out, &outLength, in, blocks * 16);
+}
+
+static void opensslAesRelease(void* storage) {
+    EVP_CIPHER_CTX_free(*(EVP_CIPHER_CTX**)storage);    // also wipes the key schedule
+    *(EVP_CIPHER_CTX**)storage = NULL;
+}
+
+static void opensslSha1Begin(void* ctx) {
+    SHA1_Init((SHA_CTX*)ctx);
+}
+
+static void opensslSha1Update(void* ctx, const uint8_t* data, uint32_t length) {
+    SHA1_Update((SHA_CTX*)ctx, data, length);
+}
+
+static void opensslSha1End(void* ctx, uint8_t* digest) {
+    SHA1_Final(digest, (SHA_CTX*)ctx);
+}
+
+static const SrtpAesBackend opensslAes = { opensslAesSetKey, opensslAesEncrypt, opensslAesRelease };
+static const SrtpSha1Backend opensslSha1 = { opensslSha1Begin, opensslSha1Update, opensslSha1End };
+#endif
+
+/*
+ * The registry, a NULL entry means the backend does not implement the primitive
+ */
+#ifdef SRTP_OPENSSL
+static const SrtpAesBackend* aesBackends[numberOfSrtpBackends] = { &embeddedAes, &opensslAes };
+static const SrtpSha1Backend* sha1Backends[numberOfSrtpBackends] = { &embeddedSha1, &opensslSha1 };
+#else
+static const SrtpAesBackend* aesBackends[numberOfSrtpBackends] = { &embeddedAes, NULL };
+static const SrtpSha1Backend* sha1Backends[numberOfSrtpBackends] = { &embeddedSha1, NULL };
+#endif
+
+static const char* backendNames[numberOfSrtpBackends] = { "embedded", "OpenSSL" };
+
+static std::atomic<int32_t> selected[numberOfSrtpPrimitives];
+
+bool SrtpCryptoBackend::isAvailable(int32_t primitive, int32_t backend) {
+    if (backend < 0 || backend >= numberOfSrtpBackends)
+        return false;
+    if (primitive == SrtpPrimitiveAES)
+        return aesBackends[backend] != NULL;
+    if (primitive == SrtpPrimitiveSha1)
+        return sha1Backends[backend] != NULL;
+    return false;
+}
+
+bool SrtpCryptoBackend::select(int32_t primitive, int32_t backend) {
+    if (!isAvailable(primitive, backend))
+        return false;
+    selected[primitive].store(backend, std::memory_order_relaxed);
+    return true;
+}
+
+int32_t SrtpCryptoBackend::getSelected(int32_t primitive) {
+    if (primitive < 0 || primitive >= numberOfSrtpPrimitives)
+        return SrtpBackendEmbedded;
+    return selected[primitive].load(std::memory_order_relaxed);
+}
+
+const char* SrtpCryptoBackend::getName(int32_t backend) {
+    if (backend < 0 || backend >= numberOfSrtpBackends)
+        return "unknown";
+    return backendNames[backend];
+}
+
+const SrtpAesBackend* SrtpCryptoBackend::getAes() {
+    return aesBackends[getSelected(SrtpPrimitiveAES)];
+}
+
+const SrtpSha1Backend* SrtpCryptoBackend::getSha1() {
+    return sha1Backends[getSelected(SrtpPrimitiveSha1)];
+}
+
+/*
+ * Self benchmark. Each measurement runs some rounds of packets and keeps the
+ * fastest round, this filters out interrupts and the first cold round.
+ */
+#define BENCH_ROUNDS    5
+#define BENCH_PACKETS   200
+#define BENCH_MAX_BLOCKS (1536 / 16)
+
+static double now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double benchAes(const SrtpAesBackend* aes, uint32_t payloadLength) {
+    alignas(16) uint8_t storage[SRTP_AES_BACKEND_STORAGE];
+    uint8_t key[16] = { 0 };
+    uint8_t in[BENCH_MAX_BLOCKS * 16];
+    uint8_t out[BENCH_MAX_BLOCKS * 16];
+    int32_t blocks = (payloadLength + 15) / 16;
+
+    if (!aes->setKey(storage, key, sizeof(key)))
+        return 0.0;
+
+    memset(in, 0, sizeof(in));
+    double best = 0.0;
+    for (int32_t round = 0; round < BENCH_ROUNDS; round++) {
+        double start = now();
+        for (int32_t i = 0; i < BENCH_PACKETS; i++) {
+            in[0] = (uint8_t)i;
+            aes->encrypt(storage, in, out, blocks);
+        }
+        double time = (now() - start) / BENCH_PACKETS;
+        if (round == 0 || time < best)
+            best = time;
+    }
+    aes->release(storage);
+    return best;
+}
+
+static double benchSha1(const SrtpSha1Backend* sha1, uint32_t payloadLength) {
+    alignas(16) uint8_t ctx[SRTP_SHA1_BACKEND_STORAGE];
+    uint8_t data[BENCH_MAX_BLOCKS * 16 + 12];
+    uint8_t digest[20];
+    uint32_t length = payloadLength + 12;       // the MAC covers the RTP header too
+
+    memset(data, 0, sizeof(data));
+    double best = 0.0;
+    for (int32_t round = 0; round < BENCH_ROUNDS; round++) {
+        double start = now();
+        for (int32_t i = 0; i < BENCH_PACKETS; i++) {
+            data[0] = (uint8_t)i;
+            sha1->begin(ctx);
+            sha1->update(ctx, data, length);
+            sha1->end(ctx, digest);
+        }
+        double time = (now() - start) / BENCH_PACKETS;
+        if (round == 0 || time < best)
+            best = time;
+    }
+    return best;
+}
+
+void SrtpCryptoBackend::selectFastest(uint32_t payloadLength, SrtpBackendTimings* timings) {
+    SrtpBackendTimings local;
+
+    if (payloadLength > BENCH_MAX_BLOCKS * 16)
+        payloadLength = BENCH_MAX_BLOCKS * 16;
+
+    for (int32_t backend = 0; backend < numberOfSrtpBackends; backend++) {
+        local.nsPerPacket[SrtpPrimitiveAES][backend] =
+            (aesBackends[backend] != NULL) ? benchAes(aesBackends[backend], payloadLength) : 0.0;
+        local.nsPerPacket[SrtpPrimitiveSha1][backend] =
+            (sha1Backends[backend] != NULL) ? benchSha1(sha1Backends[backend], payloadLength) : 0.0;
+    }
+
+    for (int32_t primitive = 0; primitive < numberOfSrtpPrimitives; primitive++) {
+        int32_t fastest = SrtpBackendEmbedded;
+        for (int32_t backend = 0; backend < numberOfSrtpBackends; backend++) {
+            double time = local.nsPerPacket[primitive][backend];
+            if (time > 0.0 && time < local.nsPerPacket[primitive][fastest])
+                fastest = backend;
+        }
+        select(primitive, fastest);
+    }
+    if (timings != NULL)
+        *timings = local;
+}
@@ -0,0 +1,162 @@
+/*
+  Copyright (C) 2012 Werner Dittmann
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef SRTPCRYPTOBACKEND_H
+#define SRTPCRYPTOBACKEND_H
+
+/**
+ * @file SrtpCryptoBackend.h
+ * @brief Run time selection of the SRTP crypto primitives
+ *
+ * @ingroup GNU_ZRTP
+ * @{
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <common/osSpecifics.h>
+
+/**
+ * The primitives that have more than one implementation.
+ *
+ * Twofish and Skein have the embedded implementation only.
+ */
+enum SrtpCryptoPrimitives {
+    SrtpPrimitiveAES = 0,       ///< AES block encryption, used by AES-CM and AES-F8
+    SrtpPrimitiveSha1,          ///< SHA1 compression, used by HMAC-SHA1
+    numberOfSrtpPrimitives
+};
+
+/**
+ * The implementations of the primitives.
+ */
+enum SrtpCryptoBackends {
+    SrtpBackendEmbedded = 0,    ///< Embedded code in cryptcommon and srtp/crypto, always available
+    SrtpBackendOpenSSL,         ///< OpenSSL EVP and SHA functions, uses AES-NI and SHA-NI if the CPU has them
+    numberOfSrtpBackends
+};
+
+/**
+ * Size of the storage for an expanded AES key of a backend.
+ */
+#define SRTP_AES_BACKEND_STORAGE 256
+
+/**
+ * Size of the storage for a SHA1 context of a backend.
+ */
+#define SRTP_SHA1_BACKEND_STORAGE 96
+
+/**
+ * AES functions of a backend.
+ *
+ * The expanded key lives in a storage of SRTP_AES_BACKEND_STORAGE bytes
+ * that the caller provides.
+ */
+typedef struct _SrtpAesBackend {
+    bool (*setKey)(void* storage, const uint8_t* key, int32_t keyLength);   ///< Expand a 16 or 32 byte key
+    void (*encrypt)(void* storage, const uint8_t* in, uint8_t* out, int32_t blocks);  ///< Encrypt consecutive blocks
+    void (*release)(void* storage);                                         ///< Wipe and release the key
+} SrtpAesBackend;
+
+/**
+ * SHA1 functions of a backend.
+ *
+ * The context lives in a storage of SRTP_SHA1_BACKEND_STORAGE bytes, it
+ * does not point to other memory. Thus a memcpy copies a context, HMAC uses
+ * this to restart with the precomputed inner and outer hash.
+ */
+typedef struct _SrtpSha1Backend {
+    void (*begin)(void* ctx);
+    void (*update)(void* ctx, const uint8_t* data, uint32_t length);
+    void (*end)(void* ctx, uint8_t* digest);
+} SrtpSha1Backend;
+
+/**
+ * Timing of all primitives and backends, see SrtpCryptoBackend::selectFastest().
+ */
+typedef struct _SrtpBackendTimings {
+    double nsPerPacket[numberOfSrtpPrimitives][numberOfSrtpBackends];  ///< 0 if the backend is not available
+} SrtpBackendTimings;
+
+/**
+ * Registry of the SRTP crypto backends.
+ *
+ * The embedded backend is always available. The build option
+ * @c SRTP_OPENSSL adds the OpenSSL backend. The application selects a
+ * backend per primitive, either explicitly or with the self benchmark of
+ * selectFastest(). The default is the embedded backend.
+ *
+ * A selection applies to keys and HMAC contexts set up after the call,
+ * existing crypto contexts keep their backend. Thus an application usually
+ * selects the backends once during startup.
+ */
+class __EXPORT SrtpCryptoBackend {
+
+public:
+    /**
+     * @brief Check if a backend implements a primitive in this build.
+     */
+    static bool isAvailable(int32_t primitive, int32_t backend);
+
+    /**
+     * @brief Select a backend for a primitive.
+     *
+     * @return false if the backend is not available, the selection does not
+     *         change in this case.
+     */
+    static bool select(int32_t primitive, int32_t backend);
+
+    /**
+     * @brief Get the selected backend of a primitive.
+     */
+    static int32_t getSelected(int32_t primitive);
+
+    /**
+     * @brief Get the name of a backend.
+     */
+    static const char* getName(int32_t backend);
+
+    /**
+     * @brief Measure all available backends and select the fastest.
+     *
+     * For each primitive the function measures the work of a typical
+     * packet: AES encrypts the blocks of @c payloadLength bytes, SHA1 hashes
+     * @c payloadLength bytes plus the RTP header. The measurement takes a few
+     * milliseconds.
+     *
+     * @param payloadLength the payload length of the application's packets
+     * @param timings if not NULL the function stores the measured times here
+     */
+    static void selectFastest(uint32_t payloadLength = 160, SrtpBackendTimings* timings = NULL);
+
+    /**
+     * @brief Get the AES functions of the selected backend.
+     */
+    static const SrtpAesBackend* getAes();
+
+    /**
+     * @brief Get the SHA1 functions of the selected backend.
+     */
+    static const SrtpSha1Backend* getSha1();
+};
+
+/**
+ * @}
+ */
+#endif
@@ -38,49 +38,63 @@
 #include <stdlib.h>
 #include <crypto/SrtpSymCrypto.h>
 #include <cryptcommon/twofish.h>
-#include <cryptcommon/aesopt.h>
 #include <string.h>
 #include <stdio.h>
 #include <common/osSpecifics.h>
 
-SrtpSymCrypto::SrtpSymCrypto(int algo):key(NULL), algorithm(algo) {
+static_assert(SRTP_AES_BACKEND_STORAGE <= SRTP_SYM_KEY_STORAGE, "SRTP_SYM_KEY_STORAGE too small for AES key");
+static_assert(sizeof(Twofish_compact_key) <= SRTP_SYM_KEY_STORAGE, "SRTP_SYM_KEY_STORAGE too small for Twofish key");
+
+SrtpSymCrypto::SrtpSymCrypto(int algo):key(NULL), algorithm(algo), compactKey(false), aesBackend(NULL) {
 }
 
 SrtpSymCrypto::SrtpSymCrypto( uint8_t* k, int32_t keyLength, int algo):
-    key(NULL), algorithm(algo) {
+    key(NULL), algorithm(algo), compactKey(false), aesBackend(NULL) {
 
     setNewKey(k, keyLength);
 }
 
+static void * (*volatile memset_volatile)(void *, int, size_t) = memset;
+
+/*
+ * The AES key of the backend and the compact Twofish key use the inline storage,
+ * the full Twofish key is too big and lives on the heap.
+ */
+static void releaseKey(void* key, int32_t algorithm, bool compactKey, const SrtpAesBackend* aesBackend) {
+    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+        aesBackend->release(key);
+    }
+    else if (compactKey) {
+        memset_volatile(key, 0, sizeof(Twofish_compact_key));
+    }
+    else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
+        memset_volatile(key, 0, sizeof(Twofish_key));
+        delete[] (uint8_t*)key;
+    }
+}
+
 SrtpSymCrypto::~SrtpSymCrypto() {
     if (key != NULL) {
-        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
-            AESencrypt *saAes = reinterpret_cast<AESencrypt*>(key);
-            memset(saAes->cx, 0, sizeof(aes_encrypt_ctx));
-            delete saAes;
-        }
-        else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
-            memset(key, 0, sizeof(Twofish_key));
-            delete[] (uint8_t*)key;
-        }
+        releaseKey(key, algorithm, compactKey, aesBackend);
         key = NULL;
     }
 }
 
 static int twoFishInit = 0;
 
+#ifndef SRTP_TWOFISH_COMPACT_KEY
+#define SRTP_TWOFISH_COMPACT_KEY 0
+#endif
+static bool twofishCompact = SRTP_TWOFISH_COMPACT_KEY;
+
+void SrtpSymCrypto::setTwofishCompactKey(bool compact) {
+    twofishCompact = compact;
+}
+
 bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
     // release an existing key before setting a new one
     if (key != NULL) {
-        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
-            AESencrypt *saAes = reinterpret_cast<AESencrypt*>(key);
-            memset(saAes->cx, 0, sizeof(aes_encrypt_ctx));
-            delete saAes;
-        }
-        else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
-            memset(key, 0, sizeof(Twofish_key));
-            delete[] (uint8_t*)key;
-        }
+        releaseKey(key, algorithm, compactKey, aesBackend);
         key = NULL;
     }
 
@@ -88,21 +102,26 @@ bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
         return false;
     }
     if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
-        AESencrypt *saAes = new AESencrypt();
-        if (keyLength == 16)
-            saAes->key128(k);
-        else
-            saAes->key256(k);
-        key = saAes;
+        aesBackend = SrtpCryptoBackend::getAes();
+        if (!aesBackend->setKey(keyStorage, k, keyLength))
+            return false;
+        key = keyStorage;
     }
     else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
         if (!twoFishInit) {
             Twofish_initialise();
             twoFishInit = 1;
         }
-        key = new uint8_t[sizeof(Twofish_key)];
-        memset(key, 0, sizeof(Twofish_key));
-        Twofish_prepare_key((Twofish_Byte*)k, keyLength,  (Twofish_key*)key);
+        compactKey = twofishCompact;
+        if (compactKey) {
+            key = keyStorage;
+            Twofish_prepare_compact_key((Twofish_Byte*)k, keyLength, (Twofish_compact_key*)key);
+        }
+        else {
+            key = new uint8_t[sizeof(Twofish_key)];
+            memset(key, 0, sizeof(Twofish_key));
+            Twofish_prepare_key((Twofish_Byte*)k, keyLength,  (Twofish_key*)key);
+        }
     }
     else
         return false;
@@ -112,100 +131,127 @@ bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
 
 void SrtpSymCrypto::encrypt(const uint8_t* input, uint8_t* output) {
     if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
-        AESencrypt *saAes = reinterpret_cast<AESencrypt*>(key);
-        saAes->encrypt(input, output);
+        aesBackend->encrypt(key, input, output, 1);
     }
     else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
-        Twofish_encrypt((Twofish_key*)key, (Twofish_Byte*)input,
-                        (Twofish_Byte*)output); 
+        if (compactKey)
+            Twofish_encrypt_compact((Twofish_compact_key*)key, (Twofish_Byte*)input,
+                                    (Twofish_Byte*)output);
+        else
+            Twofish_encrypt((Twofish_key*)key, (Twofish_Byte*)input,
+                            (Twofish_Byte*)output); 
     }
 }
 
-void SrtpSymCrypto::get_ctr_cipher_stream(uint8_t* output, uint32_t length, uint8_t* iv) {
-    uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
-
-    for(ctr = 0; ctr < length/SRTP_BLOCK_SIZE; ctr++) {
-        //compute the cipher stream
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+/*
+ * Number of counter blocks the counter mode functions encrypt in one call.
+ * The Twofish code encrypts them in parallel if the CPU supports it.
+ */
+#define CTR_BATCH_BLOCKS 8
 
-        encrypt(iv, &output[ctr*SRTP_BLOCK_SIZE]);
+static void encryptBlocks(void* key, int32_t algorithm, bool compactKey, const SrtpAesBackend* aesBackend,
+                          const uint8_t* input, uint8_t* output, int blocks) {
+    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+        aesBackend->encrypt(key, input, output, blocks);
     }
-    if ((length % SRTP_BLOCK_SIZE) > 0) {
-        // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        memcpy(&output[ctr*SRTP_BLOCK_SIZE], temp, length % SRTP_BLOCK_SIZE );
+    else if (compactKey) {
+        for (int i = 0; i < blocks; i++)
+            Twofish_encrypt_compact((Twofish_compact_key*)key, (Twofish_Byte*)input + i * SRTP_BLOCK_SIZE,
+                                    (Twofish_Byte*)output + i * SRTP_BLOCK_SIZE);
+    }
+    else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
+        Twofish_encrypt_blocks((Twofish_key*)key, (const Twofish_Byte*)input, (Twofish_Byte*)output, blocks);
     }
 }
 
-void SrtpSymCrypto::ctr_encrypt(const uint8_t* input, uint32_t input_length, uint8_t* output, uint8_t* iv) {
-
-    if (key == NULL)
-        return;
+/*
+ * Fill the counter blocks: the first 14 bytes are the IV, the last two bytes
+ * the block counter in network order. Each block takes two 64 bit stores and
+ * the counter bytes.
+ */
+static void setCounterBlocks(uint64_t* ctrBlocks, const uint8_t* iv, uint16_t ctr, int blocks) {
+    uint64_t ivWords[2];
+    memcpy(ivWords, iv, SRTP_BLOCK_SIZE);
+
+    for (int i = 0; i < blocks; i++, ctr++) {
+        uint64_t* block = ctrBlocks + 2 * i;
+        block[0] = ivWords[0];
+        block[1] = ivWords[1];
+        uint8_t* counter = (uint8_t*)block + 14;
+        counter[0] = (uint8_t)(ctr >> 8);
+        counter[1] = (uint8_t)ctr;
+    }
+}
 
+void SrtpSymCrypto::get_ctr_cipher_stream(uint8_t* output, uint32_t length, uint8_t* iv) {
     uint16_t ctr = 0;
+    uint64_t ctrBlocks[CTR_BATCH_BLOCKS * 2];
     unsigned char temp[SRTP_BLOCK_SIZE];
 
-    int l = input_length/SRTP_BLOCK_SIZE;
-    for (ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *output++ = temp[i] ^ *input++;
-        }
+    while (length >= SRTP_BLOCK_SIZE) {
+        int blocks = length / SRTP_BLOCK_SIZE;
+        if (blocks > CTR_BATCH_BLOCKS)
+            blocks = CTR_BATCH_BLOCKS;
 
+        //compute the cipher stream
+        setCounterBlocks(ctrBlocks, iv, ctr, blocks);
+        encryptBlocks(key, algorithm, compactKey, aesBackend, (uint8_t*)ctrBlocks, output, blocks);
+        ctr += blocks;
+        output += blocks * SRTP_BLOCK_SIZE;
+        length -= blocks * SRTP_BLOCK_SIZE;
     }
-    l = input_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
+    if (length > 0) {
         // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *output++ = temp[i] ^ *input++;
-        }
+        setCounterBlocks(ctrBlocks, iv, ctr, 1);
+        encryptBlocks(key, algorithm, compactKey, aesBackend, (uint8_t*)ctrBlocks, temp, 1);
+        memcpy(output, temp, length);
     }
 }
 
-void SrtpSymCrypto::ctr_encrypt( uint8_t* data, uint32_t data_length, uint8_t* iv ) {
+void SrtpSymCrypto::ctr_encrypt(const uint8_t* input, uint32_t input_length, uint8_t* output, uint8_t* iv) {
 
     if (key == NULL)
         return;
 
     uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
-
-    int l = data_length/SRTP_BLOCK_SIZE;
-    for (ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *data++ ^= temp[i];
+    uint64_t ctrBlocks[CTR_BATCH_BLOCKS * 2];
+    uint64_t stream[CTR_BATCH_BLOCKS * 2];
+
+    while (input_length > 0) {
+        int blocks = (input_length + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+        if (blocks > CTR_BATCH_BLOCKS)
+            blocks = CTR_BATCH_BLOCKS;
+
+        setCounterBlocks(ctrBlocks, iv, ctr, blocks);
+        encryptBlocks(key, algorithm, compactKey, aesBackend, (uint8_t*)ctrBlocks, (uint8_t*)stream, blocks);
+        ctr += blocks;
+
+        // XOR full 64 bit words of key stream, then the remaining bytes
+        uint32_t l = blocks * SRTP_BLOCK_SIZE;
+        if (l > input_length)
+            l = input_length;
+        uint32_t i = 0;
+        for (; i + 8 <= l; i += 8) {
+            uint64_t d;
+            memcpy(&d, input + i, 8);
+            d ^= stream[i / 8];
+            memcpy(output + i, &d, 8);
         }
-
-    }
-    l = data_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
-        // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *data++ ^= temp[i];
+        const uint8_t* streamBytes = (const uint8_t*)stream;
+        for (; i < l; i++) {
+            output[i] = streamBytes[i] ^ input[i];
         }
+        input += l;
+        output += l;
+        input_length -= l;
     }
 }
 
+void SrtpSymCrypto::ctr_encrypt( uint8_t* data, uint32_t data_length, uint8_t* iv ) {
+
+    ctr_encrypt(data, data_length, data, iv);
+}
+
 void SrtpSymCrypto::f8_encrypt(const uint8_t* data, uint32_t data_length,
                          uint8_t* iv, SrtpSymCrypto* f8Cipher ) {
 
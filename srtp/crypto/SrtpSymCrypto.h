@@ -43,12 +43,22 @@
  */
 
 #include <stdint.h>
-#include <CryptoContext.h>
+#include <SrtpConstants.h>
+#include <crypto/SrtpCryptoBackend.h>
 
 #ifndef SRTP_BLOCK_SIZE
 #define SRTP_BLOCK_SIZE 16
 #endif
 
+/**
+ * Size of the inline key schedule storage. Large enough to hold an
+ * expanded AES-128/256 encryption key of the builtin and the openSSL
+ * backend and a compact Twofish key.
+ */
+#ifndef SRTP_SYM_KEY_STORAGE
+#define SRTP_SYM_KEY_STORAGE 256
+#endif
+
 typedef struct _f8_ctx {
     unsigned char *S;           ///< Intermetiade buffer
     unsigned char *ivAccent;    ///< second IV
@@ -130,6 +140,20 @@ public:
      */
     bool setNewKey(const uint8_t* key, int32_t keyLength);
 
+    /**
+     * @brief Select the Twofish key form for keys set after this call.
+     *
+     * The compact Twofish key computes the keyed S-boxes during encryption.
+     * It needs about 200 bytes instead of about 4 KB and lives inside the
+     * SrtpSymCrypto object, but encryption is slower. Deployments that
+     * hold many Twofish keys at the same time may select it. The default
+     * is the full key unless the build defines SRTP_TWOFISH_COMPACT_KEY.
+     *
+     * @param compact
+     *    If true use the compact key form for new Twofish keys.
+     */
+    static void setTwofishCompactKey(bool compact);
+
     /**
      * @brief Computes the cipher stream for AES CM mode.
      *
@@ -256,6 +280,15 @@ private:
     int processBlock(F8_CIPHER_CTX* f8ctx, const uint8_t* in, int32_t length, uint8_t* out);
     void* key;
     int32_t algorithm;
+    bool compactKey;
+    const SrtpAesBackend* aesBackend;      ///< AES backend of the current key, see SrtpCryptoBackend
+
+    /* Expanded key lives here if it fits, avoids a heap allocation per key */
+    alignas(16) uint8_t keyStorage[SRTP_SYM_KEY_STORAGE];
+
+    /* key points into keyStorage, thus no copies */
+    SrtpSymCrypto(const SrtpSymCrypto& other);
+    SrtpSymCrypto& operator=(const SrtpSymCrypto& other);
 };
 
 #pragma GCC visibility push(default)
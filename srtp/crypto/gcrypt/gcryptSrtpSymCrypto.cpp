@@ -46,12 +46,12 @@ extern void initializeGcrypt();
 
 #include <stdio.h>
 
-SrtpSymCrypto::SrtpSymCrypto(int algo) : key(NULL), algorithm(algo) {
+SrtpSymCrypto::SrtpSymCrypto(int algo) : key(NULL), algorithm(algo), compactKey(false) {
     initializeGcrypt();
 }
 
 SrtpSymCrypto::SrtpSymCrypto( uint8_t* k, int32_t keyLength, int algo) :
-    key(NULL),  algorithm(algo) {
+    key(NULL),  algorithm(algo), compactKey(false) {
 
     initializeGcrypt();
     setNewKey(k, keyLength);
@@ -71,6 +71,10 @@ SrtpSymCrypto::~SrtpSymCrypto() {
 
 static int twoFishInit = 0;
 
+// The gcrypt backend always uses the full Twofish key
+void SrtpSymCrypto::setTwofishCompactKey(bool compact) {
+}
+
 bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
 
     // release an existing key before setting a new one
@@ -110,6 +110,25 @@ void hmacSha1Ctx(void* ctx, const uint8_t* data[], uint32_t data_length[],
     }
 }
 
+void hmacSha1CtxBegin(void* ctx)
+{
+    gcry_md_reset((gcry_md_hd_t)ctx);
+}
+
+void hmacSha1CtxUpdate(void* ctx, const uint8_t* data, uint32_t data_length)
+{
+    gcry_md_write((gcry_md_hd_t)ctx, data, data_length);
+}
+
+void hmacSha1CtxEnd(void* ctx, uint8_t* mac, int32_t* mac_length)
+{
+    uint8_t* p = gcry_md_read((gcry_md_hd_t)ctx, GCRY_MD_SHA1);
+    memcpy(mac, p, SHA1_DIGEST_LENGTH);
+    if (mac_length != NULL) {
+        *mac_length = SHA1_DIGEST_LENGTH;
+    }
+}
+
 void freeSha1HmacContext(void* ctx)
 {
     gcry_md_hd_t pctx = (gcry_md_hd_t)ctx;
@@ -48,12 +48,13 @@ static int32_t hmacSha1Init(hmacSha1Context *ctx, const uint8_t *key, uint32_t k
         return 0;
 
     memset(ctx, 0, sizeof(hmacSha1Context));
+    ctx->sha = SrtpCryptoBackend::getSha1();
 
     /* check key length and reduce it if necessary */
     if (kLength > SHA1_BLOCK_SIZE) {
-        sha1_begin(&ctx->ctx);
-        sha1_hash(key, kLength, &ctx->ctx);
-        sha1_end(localKey, &ctx->ctx);
+        ctx->sha->begin(ctx->ctx);
+        ctx->sha->update(ctx->ctx, key, kLength);
+        ctx->sha->end(ctx->ctx, localKey);
     }
     else {
         memcpy(localKey, key, kLength);
@@ -62,18 +63,18 @@ static int32_t hmacSha1Init(hmacSha1Context *ctx, const uint8_t *key, uint32_t k
     for (i = 0; i < SHA1_BLOCK_SIZE; i++)
         localPad[i] = localKey[i] ^ 0x36;
 
-    sha1_begin(&ctx->innerCtx);
-    sha1_hash(localPad, SHA1_BLOCK_SIZE, &ctx->innerCtx);
+    ctx->sha->begin(ctx->innerCtx);
+    ctx->sha->update(ctx->innerCtx, localPad, SHA1_BLOCK_SIZE);
 
     /* prepare outer hash and hold the context */
     for (i = 0; i < SHA1_BLOCK_SIZE; i++)
         localPad[i] = localKey[i] ^ 0x5c;
 
-    sha1_begin(&ctx->outerCtx);
-    sha1_hash(localPad, SHA1_BLOCK_SIZE, &ctx->outerCtx);
+    ctx->sha->begin(ctx->outerCtx);
+    ctx->sha->update(ctx->outerCtx, localPad, SHA1_BLOCK_SIZE);
 
     /* copy prepared inner hash to work hash - ready to process data */
-    memcpy(&ctx->ctx, &ctx->innerCtx, sizeof(sha1_ctx));
+    memcpy(ctx->ctx, ctx->innerCtx, sizeof(ctx->ctx));
 
     memset(localKey, 0, sizeof(localKey));
 
@@ -83,13 +84,13 @@ static int32_t hmacSha1Init(hmacSha1Context *ctx, const uint8_t *key, uint32_t k
 static void hmacSha1Reset(hmacSha1Context *ctx)
 {
     /* copy prepared inner hash to work hash context */
-    memcpy(&ctx->ctx, &ctx->innerCtx, sizeof(sha1_ctx));
+    memcpy(ctx->ctx, ctx->innerCtx, sizeof(ctx->ctx));
 }
 
 static void hmacSha1Update(hmacSha1Context *ctx, const uint8_t *data, uint32_t dLength)
 {
     /* hash new data to work hash context */
-    sha1_hash(data, dLength, &ctx->ctx);
+    ctx->sha->update(ctx->ctx, data, dLength);
 }
 
 static void hmacSha1Final(hmacSha1Context *ctx, uint8_t *mac)
@@ -97,16 +98,16 @@ static void hmacSha1Final(hmacSha1Context *ctx, uint8_t *mac)
     uint8_t tmpDigest[SHA1_DIGEST_SIZE];
 
     /* finalize work hash context */
-    sha1_end(tmpDigest, &ctx->ctx);
+    ctx->sha->end(ctx->ctx, tmpDigest);
 
     /* copy prepared outer hash to work hash */
-    memcpy(&ctx->ctx, &ctx->outerCtx, sizeof(sha1_ctx));
+    memcpy(ctx->ctx, ctx->outerCtx, sizeof(ctx->ctx));
 
     /* hash inner digest to work (outer) hash context */
-    sha1_hash(tmpDigest, SHA1_DIGEST_SIZE, &ctx->ctx);
+    ctx->sha->update(ctx->ctx, tmpDigest, SHA1_DIGEST_SIZE);
 
     /* finalize work hash context to get the hmac*/
-    sha1_end(mac, &ctx->ctx);
+    ctx->sha->end(ctx->ctx, mac);
 }
 
 
@@ -180,6 +181,22 @@ void hmacSha1Ctx(void* ctx, const uint8_t* data[], uint32_t dataLength[],
     *macLength = SHA1_BLOCK_SIZE;
 }
 
+void hmacSha1CtxBegin(void* ctx)
+{
+    hmacSha1Reset((hmacSha1Context*)ctx);
+}
+
+void hmacSha1CtxUpdate(void* ctx, const uint8_t* data, uint32_t dataLength)
+{
+    hmacSha1Update((hmacSha1Context*)ctx, data, dataLength);
+}
+
+void hmacSha1CtxEnd(void* ctx, uint8_t* mac, int32_t* macLength)
+{
+    hmacSha1Final((hmacSha1Context*)ctx, mac);
+    *macLength = SHA1_DIGEST_SIZE;
+}
+
 void freeSha1HmacContext(void* ctx)
 {
     if (ctx) {
@@ -48,15 +48,21 @@
 
 #include <stdint.h>
 #include "crypto/sha1.h"
+#include "crypto/SrtpCryptoBackend.h"
 
 #ifndef SHA1_DIGEST_LENGTH
 #define SHA1_DIGEST_LENGTH 20
 #endif
 
+/*
+ * The SHA1 contexts belong to the backend that was selected when the key was
+ * set, see SrtpCryptoBackend.
+ */
 typedef struct _hmacSha1Context {
-    sha1_ctx ctx;
-    sha1_ctx innerCtx;
-    sha1_ctx outerCtx;
+    const SrtpSha1Backend* sha;
+    uint64_t ctx[SRTP_SHA1_BACKEND_STORAGE / 8];
+    uint64_t innerCtx[SRTP_SHA1_BACKEND_STORAGE / 8];
+    uint64_t outerCtx[SRTP_SHA1_BACKEND_STORAGE / 8];
 } hmacSha1Context;
 
 
@@ -179,6 +185,45 @@ void hmacSha1Ctx(void* ctx, const uint8_t* data, uint32_t data_length,
 void hmacSha1Ctx(void* ctx, const uint8_t* data[], uint32_t data_length[],
                 uint8_t* mac, int32_t* mac_length );
 
+/**
+ * Start an incremental SHA1 HMAC computation.
+ *
+ * Use this and the following two functions if the data is not available
+ * as a set of chunks before the computation starts, for example if the
+ * caller produces the data while it computes the HMAC.
+ *
+ * @param ctx
+ *     Pointer to initialized SHA1 HMAC context
+ */
+void hmacSha1CtxBegin(void* ctx);
+
+/**
+ * Add data to an incremental SHA1 HMAC computation.
+ *
+ * @param ctx
+ *     Pointer to SHA1 HMAC context, see hmacSha1CtxBegin
+ * @param data
+ *    Points to the data chunk.
+ * @param data_length
+ *    Length of the data in bytes
+ */
+void hmacSha1CtxUpdate(void* ctx, const uint8_t* data, uint32_t data_length);
+
+/**
+ * Finish an incremental SHA1 HMAC computation.
+ *
+ * On return the SHA1 MAC context is ready to compute another HMAC.
+ *
+ * @param ctx
+ *     Pointer to SHA1 HMAC context, see hmacSha1CtxBegin
+ * @param mac
+ *    Points to a buffer that receives the computed digest. This
+ *    buffer must have a size of at least 20 bytes (SHA1_DIGEST_LENGTH).
+ * @param mac_length
+ *    Point to an integer that receives the length of the computed HMAC.
+ */
+void hmacSha1CtxEnd(void* ctx, uint8_t* mac, int32_t* mac_length);
+
 /**
  * Free SHA1 HMAC context.
  *
@@ -43,40 +43,67 @@
 #include <stdio.h>
 #include <common/osSpecifics.h>
 
-SrtpSymCrypto::SrtpSymCrypto(int algo):key(NULL), algorithm(algo) {
+static_assert(sizeof(AES_KEY) <= SRTP_SYM_KEY_STORAGE, "SRTP_SYM_KEY_STORAGE too small for AES key");
+static_assert(sizeof(Twofish_compact_key) <= SRTP_SYM_KEY_STORAGE, "SRTP_SYM_KEY_STORAGE too small for Twofish key");
+
+SrtpSymCrypto::SrtpSymCrypto(int algo):key(NULL), algorithm(algo), compactKey(false) {
 }
 
 SrtpSymCrypto::SrtpSymCrypto( uint8_t* k, int32_t keyLength, int algo ):
-    key(NULL), algorithm(algo) {
+    key(NULL), algorithm(algo), compactKey(false) {
 
     setNewKey(k, keyLength);
 }
 
+static void * (*volatile memset_volatile)(void *, int, size_t) = memset;
+
+/*
+ * The AES key schedule and the compact Twofish key use the inline storage, the
+ * full Twofish key is too big and lives on the heap.
+ */
+static void releaseKey(void* key, int32_t algorithm, bool compactKey) {
+    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+        memset_volatile(key, 0, sizeof(AES_KEY) );
+    }
+    else if (compactKey) {
+        memset_volatile(key, 0, sizeof(Twofish_compact_key));
+    }
+    else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
+        memset_volatile(key, 0, sizeof(Twofish_key));
+        delete[] (uint8_t*)key;
+    }
+}
+
 SrtpSymCrypto::~SrtpSymCrypto() {
     if (key != NULL) {
-        if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
-            memset(key, 0, sizeof(AES_KEY) );
-        }
-        else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
-            memset(key, 0, sizeof(Twofish_key));
-        }
-        delete[] (uint8_t*)key;
+        releaseKey(key, algorithm, compactKey);
         key = NULL;
     }
 }
 
 static int twoFishInit = 0;
 
+#ifndef SRTP_TWOFISH_COMPACT_KEY
+#define SRTP_TWOFISH_COMPACT_KEY 0
+#endif
+static bool twofishCompact = SRTP_TWOFISH_COMPACT_KEY;
+
+void SrtpSymCrypto::setTwofishCompactKey(bool compact) {
+    twofishCompact = compact;
+}
+
 bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
     // release an existing key before setting a new one
-    if (key != NULL)
-        delete[] (uint8_t*)key;
+    if (key != NULL) {
+        releaseKey(key, algorithm, compactKey);
+        key = NULL;
+    }
 
     if (!(keyLength == 16 || keyLength == 32)) {
         return false;
     }
     if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
-        key = new uint8_t[sizeof(AES_KEY)];
+        key = keyStorage;
         memset(key, 0, sizeof(AES_KEY) );
         AES_set_encrypt_key(k, keyLength*8, (AES_KEY *)key);
     }
@@ -85,9 +112,16 @@ bool SrtpSymCrypto::setNewKey(const uint8_t* k, int32_t keyLength) {
             Twofish_initialise();
             twoFishInit = 1;
         }
-        key = new uint8_t[sizeof(Twofish_key)];
-        memset(key, 0, sizeof(Twofish_key));
-        Twofish_prepare_key((Twofish_Byte*)k, keyLength,  (Twofish_key*)key);
+        compactKey = twofishCompact;
+        if (compactKey) {
+            key = keyStorage;
+            Twofish_prepare_compact_key((Twofish_Byte*)k, keyLength, (Twofish_compact_key*)key);
+        }
+        else {
+            key = new uint8_t[sizeof(Twofish_key)];
+            memset(key, 0, sizeof(Twofish_key));
+            Twofish_prepare_key((Twofish_Byte*)k, keyLength,  (Twofish_key*)key);
+        }
     }
     else
         return false;
@@ -101,96 +135,105 @@ void SrtpSymCrypto::encrypt(const uint8_t* input, uint8_t* output ) {
         AES_encrypt(input, output, (AES_KEY *)key);
     }
     else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
-        Twofish_encrypt((Twofish_key*)key, (Twofish_Byte*)input,
-                        (Twofish_Byte*)output); 
+        if (compactKey)
+            Twofish_encrypt_compact((Twofish_compact_key*)key, (Twofish_Byte*)input,
+                                    (Twofish_Byte*)output);
+        else
+            Twofish_encrypt((Twofish_key*)key, (Twofish_Byte*)input,
+                            (Twofish_Byte*)output); 
     }
 }
 
-void SrtpSymCrypto::get_ctr_cipher_stream(uint8_t* output, uint32_t length,
-                                    uint8_t* iv ) {
-    uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
-
-    for(ctr = 0; ctr < length/SRTP_BLOCK_SIZE; ctr++) {
-        //compute the cipher stream
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+/*
+ * Number of counter blocks the counter mode functions encrypt in one call.
+ * The Twofish code encrypts them in parallel if the CPU supports it.
+ */
+#define CTR_BATCH_BLOCKS 8
 
-        encrypt(iv, &output[ctr*SRTP_BLOCK_SIZE]);
+static void encryptBlocks(void* key, int32_t algorithm, bool compactKey,
+                          const uint8_t* input, uint8_t* output, int blocks) {
+    if (algorithm == SrtpEncryptionAESCM || algorithm == SrtpEncryptionAESF8) {
+        for (int i = 0; i < blocks; i++)
+            AES_encrypt(input + i * SRTP_BLOCK_SIZE, output + i * SRTP_BLOCK_SIZE, (AES_KEY *)key);
     }
-    if ((length % SRTP_BLOCK_SIZE) > 0) {
-        // Treat the last bytes:
+    else if (compactKey) {
+        for (int i = 0; i < blocks; i++)
+            Twofish_encrypt_compact((Twofish_compact_key*)key, (Twofish_Byte*)input + i * SRTP_BLOCK_SIZE,
+                                    (Twofish_Byte*)output + i * SRTP_BLOCK_SIZE);
+    }
+    else if (algorithm == SrtpEncryptionTWOCM || algorithm == SrtpEncryptionTWOF8) {
+        Twofish_encrypt_blocks((Twofish_key*)key, (const Twofish_Byte*)input, (Twofish_Byte*)output, blocks);
+    }
+}
+
+/*
+ * Fill the counter blocks: the first 14 bytes are the IV, the last two bytes
+ * the block counter in network order. The IV keeps the last counter value.
+ */
+static void setCounterBlocks(uint8_t* ctrBlocks, uint8_t* iv, uint16_t ctr, int blocks) {
+    for (int i = 0; i < blocks; i++, ctr++) {
         iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
         iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        memcpy(&output[ctr*SRTP_BLOCK_SIZE], temp, length % SRTP_BLOCK_SIZE );
+        memcpy(ctrBlocks + i * SRTP_BLOCK_SIZE, iv, SRTP_BLOCK_SIZE);
     }
 }
 
-void SrtpSymCrypto::ctr_encrypt(const uint8_t* input, uint32_t input_length,
-                           uint8_t* output, uint8_t* iv ) {
-
-    if (key == NULL)
-        return;
-
+void SrtpSymCrypto::get_ctr_cipher_stream(uint8_t* output, uint32_t length, uint8_t* iv) {
     uint16_t ctr = 0;
+    unsigned char ctrBlocks[CTR_BATCH_BLOCKS * SRTP_BLOCK_SIZE];
     unsigned char temp[SRTP_BLOCK_SIZE];
 
-    int l = input_length/SRTP_BLOCK_SIZE;
-    for (ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *output++ = temp[i] ^ *input++;
-        }
+    while (length >= SRTP_BLOCK_SIZE) {
+        int blocks = length / SRTP_BLOCK_SIZE;
+        if (blocks > CTR_BATCH_BLOCKS)
+            blocks = CTR_BATCH_BLOCKS;
 
+        //compute the cipher stream
+        setCounterBlocks(ctrBlocks, iv, ctr, blocks);
+        encryptBlocks(key, algorithm, compactKey, ctrBlocks, output, blocks);
+        ctr += blocks;
+        output += blocks * SRTP_BLOCK_SIZE;
+        length -= blocks * SRTP_BLOCK_SIZE;
     }
-    l = input_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
+    if (length > 0) {
         // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *output++ = temp[i] ^ *input++;
-        }
+        setCounterBlocks(ctrBlocks, iv, ctr, 1);
+        encryptBlocks(key, algorithm, compactKey, ctrBlocks, temp, 1);
+        memcpy(output, temp, length);
     }
 }
 
-void SrtpSymCrypto::ctr_encrypt( uint8_t* data, uint32_t data_length, uint8_t* iv ) {
+void SrtpSymCrypto::ctr_encrypt(const uint8_t* input, uint32_t input_length, uint8_t* output, uint8_t* iv) {
 
     if (key == NULL)
         return;
 
     uint16_t ctr = 0;
-    unsigned char temp[SRTP_BLOCK_SIZE];
-
-    int l = data_length/SRTP_BLOCK_SIZE;
-    for (ctr = 0; ctr < l; ctr++ ) {
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
-
-        encrypt(iv, temp);
-        for (int i = 0; i < SRTP_BLOCK_SIZE; i++ ) {
-            *data++ ^= temp[i];
+    unsigned char ctrBlocks[CTR_BATCH_BLOCKS * SRTP_BLOCK_SIZE];
+    unsigned char stream[CTR_BATCH_BLOCKS * SRTP_BLOCK_SIZE];
+
+    while (input_length > 0) {
+        int blocks = (input_length + SRTP_BLOCK_SIZE - 1) / SRTP_BLOCK_SIZE;
+        if (blocks > CTR_BATCH_BLOCKS)
+            blocks = CTR_BATCH_BLOCKS;
+
+        setCounterBlocks(ctrBlocks, iv, ctr, blocks);
+        encryptBlocks(key, algorithm, compactKey, ctrBlocks, stream, blocks);
+        ctr += blocks;
+
+        uint32_t l = blocks * SRTP_BLOCK_SIZE;
+        if (l > input_length)
+            l = input_length;
+        for (uint32_t i = 0; i < l; i++) {
+            *output++ = stream[i] ^ *input++;
         }
-
+        input_length -= l;
     }
-    l = data_length % SRTP_BLOCK_SIZE;
-    if (l > 0) {
-        // Treat the last bytes:
-        iv[14] = (uint8_t)((ctr & 0xFF00) >>  8);
-        iv[15] = (uint8_t)((ctr & 0x00FF));
+}
 
-        encrypt(iv, temp);
-        for (int i = 0; i < l; i++ ) {
-            *data++ ^= temp[i];
-        }
-    }
+void SrtpSymCrypto::ctr_encrypt( uint8_t* data, uint32_t data_length, uint8_t* iv ) {
+
+    ctr_encrypt(data, data_length, data, iv);
 }
 
 void SrtpSymCrypto::f8_encrypt(const uint8_t* data, uint32_t data_length,
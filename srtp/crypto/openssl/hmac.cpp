@@ -104,6 +104,21 @@ void hmacSha1Ctx(void* ctx, const uint8_t* data[], uint32_t data_length[],
     HMAC_Final(pctx, mac, reinterpret_cast<uint32_t*>(mac_length) );
 }
 
+void hmacSha1CtxBegin(void* ctx)
+{
+    HMAC_Init_ex((HMAC_CTX*)ctx, NULL, 0, NULL, NULL );
+}
+
+void hmacSha1CtxUpdate(void* ctx, const uint8_t* data, uint32_t data_length)
+{
+    HMAC_Update((HMAC_CTX*)ctx, data, data_length );
+}
+
+void hmacSha1CtxEnd(void* ctx, uint8_t* mac, int32_t* mac_length)
+{
+    HMAC_Final((HMAC_CTX*)ctx, mac, reinterpret_cast<uint32_t*>(mac_length) );
+}
+
 void freeSha1HmacContext(void* ctx)
 {
     if (ctx) {
@@ -79,7 +79,7 @@ extern "C" {
 ZRtp::ZRtp(uint8_t *myZid, ZrtpCallback *cb, std::string id, ZrtpConfigure* config, bool mitmm, bool sasSignSupport):
         callback(cb), dhContext(NULL), DHss(NULL), auxSecret(NULL), auxSecretLength(0), rs1Valid(false),
         rs2Valid(false), msgShaContext(NULL), hash(NULL), cipher(NULL), pubKey(NULL), sasType(NULL), authLength(NULL),
-        multiStream(false), multiStreamAvailable(false), peerIsEnrolled(false), mitmSeen(false), pbxSecretTmp(NULL),
+        multiStream(false), multiStreamAvailable(false), presharedMode(false), presharedRejected(false), peerIsEnrolled(false), mitmSeen(false), pbxSecretTmp(NULL),
         enrollmentMode(false), configureAlgos(*config), zidRec(NULL), saveZidRecord(true), signSasSeen(false),
         masterStream(NULL), peerDisclosureFlagSeen(false) {
 
@@ -90,8 +90,11 @@ ZRtp::ZRtp(uint8_t *myZid, ZrtpCallback *cb, std::string id, ZrtpConfigure* conf
     enableMitmEnrollment = false;
 #endif
 
+    handshake = new HandshakeData;
+
     signatureData = NULL;
     paranoidMode = config->isParanoidMode();
+    compactSecureState = config->isCompactSecureState();
     sasSignSupport = config->isSasSignature();
 
     // setup the implicit hash function pointers and length
@@ -108,39 +111,39 @@ ZRtp::ZRtp(uint8_t *myZid, ZrtpCallback *cb, std::string id, ZrtpConfigure* conf
      * Generate H0 as a random number (256 bits, 32 bytes) and then
      * the hash chain, refer to chapter 9. Use the implicit hash function.
      */
-    randomZRTP(H0, HASH_IMAGE_SIZE);
-    sha256(H0, HASH_IMAGE_SIZE, H1);        // hash H0 and generate H1
-    sha256(H1, HASH_IMAGE_SIZE, H2);        // H2
-    sha256(H2, HASH_IMAGE_SIZE, H3);        // H3
+    randomZRTP(handshake->H0, HASH_IMAGE_SIZE);
+    sha256(handshake->H0, HASH_IMAGE_SIZE, handshake->H1);        // hash H0 and generate H1
+    sha256(handshake->H1, HASH_IMAGE_SIZE, handshake->H2);        // H2
+    sha256(handshake->H2, HASH_IMAGE_SIZE, handshake->H3);        // H3
 
     // configure all supported Hello packet versions
-    zrtpHello_11.configureHello(&configureAlgos);
-    zrtpHello_11.setH3(H3);                    // set H3 in Hello, included in helloHash
-    zrtpHello_11.setZid(ownZid);
-    zrtpHello_11.setVersion((uint8_t*)zrtpVersion_11);
+    handshake->zrtpHello_11.configureHello(&configureAlgos);
+    handshake->zrtpHello_11.setH3(handshake->H3);                    // set H3 in Hello, included in helloHash
+    handshake->zrtpHello_11.setZid(ownZid);
+    handshake->zrtpHello_11.setVersion((uint8_t*)zrtpVersion_11);
 
 
-    zrtpHello_12.configureHello(&configureAlgos);
-    zrtpHello_12.setH3(H3);                 // set H3 in Hello, included in helloHash
-    zrtpHello_12.setZid(ownZid);
-    zrtpHello_12.setVersion((uint8_t*)zrtpVersion_12);
+    handshake->zrtpHello_12.configureHello(&configureAlgos);
+    handshake->zrtpHello_12.setH3(handshake->H3);                 // set H3 in Hello, included in helloHash
+    handshake->zrtpHello_12.setZid(ownZid);
+    handshake->zrtpHello_12.setVersion((uint8_t*)zrtpVersion_12);
 
     if (mitmm) {                            // this session acts for a trusted MitM (PBX)
-        zrtpHello_11.setMitmMode();
-        zrtpHello_12.setMitmMode();
+        handshake->zrtpHello_11.setMitmMode();
+        handshake->zrtpHello_12.setMitmMode();
     }
     if (sasSignSupport) {                   // the application supports SAS signing
-        zrtpHello_11.setSasSign();
-        zrtpHello_12.setSasSign();
+        handshake->zrtpHello_11.setSasSign();
+        handshake->zrtpHello_12.setSasSign();
     }
 
     // Keep array in ascending order (greater index -> greater version)
-    helloPackets[0].packet = &zrtpHello_11;
-    helloPackets[0].version = zrtpHello_11.getVersionInt();
+    helloPackets[0].packet = &handshake->zrtpHello_11;
+    helloPackets[0].version = handshake->zrtpHello_11.getVersionInt();
     setClientId(id, &helloPackets[0]);      // set id, compute HMAC and final helloHash
 
-    helloPackets[1].packet = &zrtpHello_12;
-    helloPackets[1].version = zrtpHello_12.getVersionInt();
+    helloPackets[1].packet = &handshake->zrtpHello_12;
+    helloPackets[1].version = handshake->zrtpHello_12.getVersionInt();
     setClientId(id, &helloPackets[1]);      // set id, compute HMAC and final helloHash
  
     currentHelloPacket = helloPackets[SUPPORTED_ZRTP_VERSIONS-1].packet;  // start with highest supported version
@@ -177,6 +180,8 @@ ZRtp::~ZRtp() {
         delete zidRec;
         zidRec = NULL;
     }
+    releaseHandshakeData();
+
     memset(hmacKeyI, 0, MAX_DIGEST_LENGTH);
     memset(hmacKeyR, 0, MAX_DIGEST_LENGTH);
 
@@ -194,6 +199,7 @@ ZRtp::~ZRtp() {
     memset(srtpSaltR, 0, MAX_DIGEST_LENGTH);
 
     memset(zrtpSession, 0, MAX_DIGEST_LENGTH);
+    memset(presharedKey, 0, MAX_DIGEST_LENGTH);
 
     peerNonces.clear();
 }
@@ -248,7 +254,9 @@ bool ZRtp::handleGoClear(uint8_t *message)
 void ZRtp::startZrtpEngine() {
     Event_t ev;
 
-    if (stateEngine != NULL && stateEngine->inState(Initial)) {
+    // A released ZRtp cannot send Hello packets anymore
+    if (stateEngine != NULL && stateEngine->inState(Initial) && handshake != NULL) {
+        handshakeTrace.reset();
         ev.type = ZrtpInitial;
         stateEngine->processEvent(&ev);
     }
@@ -287,6 +295,7 @@ ZrtpPacketHelloAck* ZRtp::prepareHelloAck() {
  * to break this tie.
  */
 ZrtpPacketCommit* ZRtp::prepareCommit(ZrtpPacketHello *hello, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseCommit);
 
     myRole = Initiator;
 
@@ -305,7 +314,7 @@ ZrtpPacketCommit* ZRtp::prepareCommit(ZrtpPacketHello *hello, uint32_t* errMsg)
         *errMsg = EqualZIDHello;
         return NULL;
     }
-    memcpy(peerH3, hello->getH3(), HASH_IMAGE_SIZE);
+    memcpy(handshake->peerH3, hello->getH3(), HASH_IMAGE_SIZE);
 
     int32_t helloLen = hello->getLength() * ZRTP_WORD_SIZE;
 
@@ -355,12 +364,31 @@ ZrtpPacketCommit* ZRtp::prepareCommit(ZrtpPacketHello *hello, uint32_t* errMsg)
     }
     setNegotiatedHash(hash);
 
+    // Get our peer's retained secret data first. Preshared mode needs it to
+    // decide and DH mode to compute the retained secret ids.
+    if (zidRec != NULL)
+        delete zidRec;
+    {
+        ZrtpTraceScope cacheScope(handshakeTrace, PhaseCacheRead);
+        zidRec = getZidCacheInstance()->getRecord(peerZid);
+    }
+
+    if (checkPreshared(hello)) {
+        return prepareCommitPreshared(hello);
+    }
+    presharedMode = false;
+
     // Modify here when introducing new DH key agreement, for example
     // elliptic curves.
+    if (dhContext != NULL)
+        delete dhContext;
     dhContext = new ZrtpDH(pubKey->getName());
-    dhContext->generatePublicKey();
+    {
+        ZrtpTraceScope dhScope(handshakeTrace, PhaseDHKeyGen);
+        dhContext->generatePublicKey();
+    }
 
-    dhContext->getPubKeyBytes(pubKeyBytes);
+    dhContext->getPubKeyBytes(handshake->pubKeyBytes);
     sendInfo(Info, InfoCommitDHGenerated);
 
     // Prepare IV data that we will use during confirm packet encryption.
@@ -369,11 +397,8 @@ ZrtpPacketCommit* ZRtp::prepareCommit(ZrtpPacketHello *hello, uint32_t* errMsg)
     /*
      * Prepare our DHPart2 packet here. Required to compute HVI. If we stay
      * in Initiator role then we reuse this packet later in prepareDHPart2().
-     * To create this DH packet we have to compute the retained secret ids,
-     * thus get our peer's retained secret data first.
+     * To create this DH packet we have to compute the retained secret ids.
      */
-    zidRec = getZidCacheInstance()->getRecord(peerZid);
-
     //Compute the Initator's and Responder's retained secret ids.
     computeSharedSecretSet(zidRec);
 
@@ -389,81 +414,82 @@ ZrtpPacketCommit* ZRtp::prepareCommit(ZrtpPacketHello *hello, uint32_t* errMsg)
     // chapter 5.4.1.1.
 
     // Fill the values in the DHPart2 packet
-    zrtpDH2.setPubKeyType(pubKey->getName());
-    zrtpDH2.setMessageType((uint8_t*)DHPart2Msg);
-    zrtpDH2.setRs1Id(rs1IDi);
-    zrtpDH2.setRs2Id(rs2IDi);
-    zrtpDH2.setAuxSecretId(auxSecretIDi);
-    zrtpDH2.setPbxSecretId(pbxSecretIDi);
-    zrtpDH2.setPv(pubKeyBytes);
-    zrtpDH2.setH1(H1);
+    handshake->zrtpDH2.setPubKeyType(pubKey->getName());
+    handshake->zrtpDH2.setMessageType((uint8_t*)DHPart2Msg);
+    handshake->zrtpDH2.setRs1Id(rs1IDi);
+    handshake->zrtpDH2.setRs2Id(rs2IDi);
+    handshake->zrtpDH2.setAuxSecretId(auxSecretIDi);
+    handshake->zrtpDH2.setPbxSecretId(pbxSecretIDi);
+    handshake->zrtpDH2.setPv(handshake->pubKeyBytes);
+    handshake->zrtpDH2.setH1(handshake->H1);
 
-    int32_t len = zrtpDH2.getLength() * ZRTP_WORD_SIZE;
+    int32_t len = handshake->zrtpDH2.getLength() * ZRTP_WORD_SIZE;
 
     // Compute HMAC over DH2, excluding the HMAC field (HMAC_SIZE)
     // and store in DH2. Key to HMAC is H0, use HASH_IMAGE_SIZE bytes only.
     // Must use implicit HMAC functions.
     uint8_t hmac[IMPL_MAX_DIGEST_LENGTH];
     uint32_t macLen;
-    hmacFunctionImpl(H0, HASH_IMAGE_SIZE, (uint8_t*)zrtpDH2.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
-    zrtpDH2.setHMAC(hmac);
+    hmacFunctionImpl(handshake->H0, HASH_IMAGE_SIZE, (uint8_t*)handshake->zrtpDH2.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
+    handshake->zrtpDH2.setHMAC(hmac);
 
     // Compute the HVI, refer to chapter 5.4.1.1 of the specification
-    computeHvi(&zrtpDH2, hello);
+    computeHvi(&handshake->zrtpDH2, hello);
 
-    zrtpCommit.setZid(ownZid);
-    zrtpCommit.setHashType((uint8_t*)hash->getName());
-    zrtpCommit.setCipherType((uint8_t*)cipher->getName());
-    zrtpCommit.setAuthLen((uint8_t*)authLength->getName());
-    zrtpCommit.setPubKeyType((uint8_t*)pubKey->getName());
-    zrtpCommit.setSasType((uint8_t*)sasType->getName());
-    zrtpCommit.setHvi(hvi);
-    zrtpCommit.setH2(H2);
+    handshake->zrtpCommit.setZid(ownZid);
+    handshake->zrtpCommit.setHashType((uint8_t*)hash->getName());
+    handshake->zrtpCommit.setCipherType((uint8_t*)cipher->getName());
+    handshake->zrtpCommit.setAuthLen((uint8_t*)authLength->getName());
+    handshake->zrtpCommit.setPubKeyType((uint8_t*)pubKey->getName());
+    handshake->zrtpCommit.setSasType((uint8_t*)sasType->getName());
+    handshake->zrtpCommit.setHvi(handshake->hvi);
+    handshake->zrtpCommit.setH2(handshake->H2);
 
-    len = zrtpCommit.getLength() * ZRTP_WORD_SIZE;
+    len = handshake->zrtpCommit.getLength() * ZRTP_WORD_SIZE;
 
     // Compute HMAC over Commit, excluding the HMAC field (HMAC_SIZE)
     // and store in Hello. Key to HMAC is H1, use HASH_IMAGE_SIZE bytes only.
     // Must use implicit HMAC functions.
-    hmacFunctionImpl(H1, HASH_IMAGE_SIZE, (uint8_t*)zrtpCommit.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
-    zrtpCommit.setHMAC(hmac);
+    hmacFunctionImpl(handshake->H1, HASH_IMAGE_SIZE, (uint8_t*)handshake->zrtpCommit.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
+    handshake->zrtpCommit.setHMAC(hmac);
 
     // hash first messages to produce overall message hash
     // First the Responder's Hello message, second the Commit (always Initator's).
     // Must use negotiated hash.
     msgShaContext = createHashCtx(msgShaContext);
     hashCtxFunction(msgShaContext, (unsigned char*)hello->getHeaderBase(), helloLen);
-    hashCtxFunction(msgShaContext, (unsigned char*)zrtpCommit.getHeaderBase(), len);
+    hashCtxFunction(msgShaContext, (unsigned char*)handshake->zrtpCommit.getHeaderBase(), len);
 
     // store Hello data temporarily until we can check HMAC after receiving Commit as
     // Responder or DHPart1 as Initiator
     storeMsgTemp(hello);
 
-    return &zrtpCommit;
+    return &handshake->zrtpCommit;
 }
 
 ZrtpPacketCommit* ZRtp::prepareCommitMultiStream(ZrtpPacketHello *hello) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseCommit);
 
-    randomZRTP(hvi, ZRTP_WORD_SIZE*4);  // This is the Multi-Stream NONCE size
+    randomZRTP(handshake->hvi, ZRTP_WORD_SIZE*4);  // This is the Multi-Stream NONCE size
 
-    zrtpCommit.setZid(ownZid);
-    zrtpCommit.setHashType((uint8_t*)hash->getName());
-    zrtpCommit.setCipherType((uint8_t*)cipher->getName());
-    zrtpCommit.setAuthLen((uint8_t*)authLength->getName());
-    zrtpCommit.setPubKeyType((uint8_t*)mult);  // this is fixed because of Multi Stream mode
-    zrtpCommit.setSasType((uint8_t*)sasType->getName());
-    zrtpCommit.setNonce(hvi);
-    zrtpCommit.setH2(H2);
+    handshake->zrtpCommit.setZid(ownZid);
+    handshake->zrtpCommit.setHashType((uint8_t*)hash->getName());
+    handshake->zrtpCommit.setCipherType((uint8_t*)cipher->getName());
+    handshake->zrtpCommit.setAuthLen((uint8_t*)authLength->getName());
+    handshake->zrtpCommit.setPubKeyType((uint8_t*)mult);  // this is fixed because of Multi Stream mode
+    handshake->zrtpCommit.setSasType((uint8_t*)sasType->getName());
+    handshake->zrtpCommit.setNonce(handshake->hvi);
+    handshake->zrtpCommit.setH2(handshake->H2);
 
-    int32_t len = zrtpCommit.getLength() * ZRTP_WORD_SIZE;
+    int32_t len = handshake->zrtpCommit.getLength() * ZRTP_WORD_SIZE;
 
     // Compute HMAC over Commit, excluding the HMAC field (HMAC_SIZE)
     // and store in Hello. Key to HMAC is H1, use HASH_IMAGE_SIZE bytes only.
     // Must use the implicit HMAC function.
     uint8_t hmac[IMPL_MAX_DIGEST_LENGTH];
     uint32_t macLen;
-    hmacFunctionImpl(H1, HASH_IMAGE_SIZE, (uint8_t*)zrtpCommit.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
-    zrtpCommit.setHMACMulti(hmac);
+    hmacFunctionImpl(handshake->H1, HASH_IMAGE_SIZE, (uint8_t*)handshake->zrtpCommit.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
+    handshake->zrtpCommit.setHMACMulti(hmac);
 
 
     // hash first messages to produce overall message hash
@@ -474,13 +500,90 @@ ZrtpPacketCommit* ZRtp::prepareCommitMultiStream(ZrtpPacketHello *hello) {
 
     int32_t helloLen = hello->getLength() * ZRTP_WORD_SIZE;
     hashCtxFunction(msgShaContext, (unsigned char*)hello->getHeaderBase(), helloLen);
-    hashCtxFunction(msgShaContext, (unsigned char*)zrtpCommit.getHeaderBase(), len);
+    hashCtxFunction(msgShaContext, (unsigned char*)handshake->zrtpCommit.getHeaderBase(), len);
 
     // store Hello data temporarily until we can check HMAC after receiving Commit as
     // Responder or DHPart1 as Initiator
     storeMsgTemp(hello);
 
-    return &zrtpCommit;
+    return &handshake->zrtpCommit;
+}
+
+ZrtpPacketCommit* ZRtp::prepareCommitPreshared(ZrtpPacketHello *hello) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseCommit);
+
+    presharedMode = true;
+    pubKey = &zrtpPubKeys.getByName(prsh);
+
+    // Prepare IV data that we will use during confirm packet encryption.
+    randomZRTP(randomIV, sizeof(randomIV));
+
+    // Compute the retained secret ids even if we don't send a DH packet. If our
+    // peer's DH Commit wins a Commit clash we switch to DH mode as Responder.
+    computeSharedSecretSet(zidRec);
+
+#ifdef ZRTP_SAS_RELAY_SUPPORT
+    // Check if a PBX application set the MitM flag.
+    mitmSeen = hello->isMitmMode();
+#endif
+
+    signSasSeen = hello->isSasSign();
+
+    uint8_t keyId[2*ZRTP_WORD_SIZE];
+    computePresharedKey(keyId);
+
+    randomZRTP(handshake->hvi, ZRTP_WORD_SIZE*4);  // This is the Preshared NONCE size, same as in Multi-Stream
+
+    handshake->zrtpCommit.setZid(ownZid);
+    handshake->zrtpCommit.setHashType((uint8_t*)hash->getName());
+    handshake->zrtpCommit.setCipherType((uint8_t*)cipher->getName());
+    handshake->zrtpCommit.setAuthLen((uint8_t*)authLength->getName());
+    handshake->zrtpCommit.setPubKeyType((uint8_t*)prsh);  // this is fixed because of Preshared mode
+    handshake->zrtpCommit.setSasType((uint8_t*)sasType->getName());
+    handshake->zrtpCommit.setNonce(handshake->hvi);
+    handshake->zrtpCommit.setKeyId(keyId);
+    handshake->zrtpCommit.setH2(handshake->H2);
+
+    int32_t len = handshake->zrtpCommit.getLength() * ZRTP_WORD_SIZE;
+
+    // Compute HMAC over Commit, excluding the HMAC field (HMAC_SIZE)
+    // and store in Hello. Key to HMAC is H1, use HASH_IMAGE_SIZE bytes only.
+    // Must use the implicit HMAC function.
+    uint8_t hmac[IMPL_MAX_DIGEST_LENGTH];
+    uint32_t macLen;
+    hmacFunctionImpl(handshake->H1, HASH_IMAGE_SIZE, (uint8_t*)handshake->zrtpCommit.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
+    handshake->zrtpCommit.setHMACPreshared(hmac);
+
+    // hash first messages to produce overall message hash
+    // First the Responder's Hello message, second the Commit
+    // (always Initator's).
+    // Must use the negotiated hash.
+    msgShaContext = createHashCtx(msgShaContext);
+
+    int32_t helloLen = hello->getLength() * ZRTP_WORD_SIZE;
+    hashCtxFunction(msgShaContext, (unsigned char*)hello->getHeaderBase(), helloLen);
+    hashCtxFunction(msgShaContext, (unsigned char*)handshake->zrtpCommit.getHeaderBase(), len);
+
+    // store Hello data temporarily until we can check HMAC after receiving Commit as
+    // Responder or Confirm1 as Initiator
+    storeMsgTemp(hello);
+
+    return &handshake->zrtpCommit;
+}
+
+ZrtpPacketCommit* ZRtp::prepareCommitFallback(uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseCommit);
+
+    // The temporary message buffer still holds our peer's Hello, prepareCommit()
+    // stores the Hello again, thus work on a copy.
+    uint8_t helloData[sizeof(handshake->tempMsgBuffer)];
+    memcpy(helloData, handshake->tempMsgBuffer, sizeof(handshake->tempMsgBuffer));
+    ZrtpPacketHello hello(helloData);
+
+    presharedRejected = true;
+    memset(presharedKey, 0, MAX_DIGEST_LENGTH);
+
+    return prepareCommit(&hello, errMsg);
 }
 
 /*
@@ -493,6 +596,7 @@ ZrtpPacketCommit* ZRtp::prepareCommitMultiStream(ZrtpPacketHello *hello) {
  * hash SHA context
  */
 ZrtpPacketDHPart* ZRtp::prepareDHPart1(ZrtpPacketCommit *commit, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseDHPart1);
 
     sendInfo(Info, InfoRespCommitReceived);
 
@@ -513,10 +617,10 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart1(ZrtpPacketCommit *commit, uint32_t* errMs
     // The following code checks the hash chain according chapter 10 to detect false ZRTP packets.
     // Must use the implicit hash function.
     uint8_t tmpH3[IMPL_MAX_DIGEST_LENGTH];
-    memcpy(peerH2, commit->getH2(), HASH_IMAGE_SIZE);
-    hashFunctionImpl(peerH2, HASH_IMAGE_SIZE, tmpH3);
+    memcpy(handshake->peerH2, commit->getH2(), HASH_IMAGE_SIZE);
+    hashFunctionImpl(handshake->peerH2, HASH_IMAGE_SIZE, tmpH3);
 
-    if (memcmp(tmpH3, peerH3, HASH_IMAGE_SIZE) != 0) {
+    if (memcmp(tmpH3, handshake->peerH3, HASH_IMAGE_SIZE) != 0) {
         *errMsg = IgnorePacket;
         return NULL;
     }
@@ -524,7 +628,7 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart1(ZrtpPacketCommit *commit, uint32_t* errMs
     // Check HMAC of previous Hello packet stored in temporary buffer. The
     // HMAC key of peer's Hello packet is peer's H2 that is contained in the
     // Commit packet. Refer to chapter 9.1.
-    if (!checkMsgHmac(peerH2)) {
+    if (!checkMsgHmac(handshake->peerH2)) {
         sendInfo(Severe, SevereHelloHMACFailed);
         *errMsg = CriticalSWError;
         return NULL;
@@ -584,45 +688,50 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart1(ZrtpPacketCommit *commit, uint32_t* errMs
     }
     sasType = cp;
 
-    // dhContext cannot be NULL - always setup during prepareCommit()
+    // dhContext is NULL if prepareCommit() selected Preshared mode.
     // check if we can use the dhContext prepared by prepareCommit(),
     // if not delete old DH context and generate new one
     // The algorithm names are 4 chars only, thus we can cast to int32_t
-    if (*(int32_t*)(dhContext->getDHtype()) != *(int32_t*)(pubKey->getName())) {
-        delete dhContext;
+    presharedMode = false;
+    if (dhContext == NULL || *(int32_t*)(dhContext->getDHtype()) != *(int32_t*)(pubKey->getName())) {
+        if (dhContext != NULL)
+            delete dhContext;
         dhContext = new ZrtpDH(pubKey->getName());
-        dhContext->generatePublicKey();
+        {
+            ZrtpTraceScope dhScope(handshakeTrace, PhaseDHKeyGen);
+            dhContext->generatePublicKey();
+        }
     }
     sendInfo(Info, InfoDH1DHGenerated);
 
-    dhContext->getPubKeyBytes(pubKeyBytes);
+    dhContext->getPubKeyBytes(handshake->pubKeyBytes);
 
     // Re-compute auxSecretIDr because we changed roles *IDr with my H3, *IDi with peer's H3
     // Setup a DHPart1 packet.
     myRole = Responder;
     computeAuxSecretIds();                 // recompute AUX secret ids because we are now Responder, use different H3
 
-    zrtpDH1.setPubKeyType(pubKey->getName());
-    zrtpDH1.setMessageType((uint8_t*)DHPart1Msg);
-    zrtpDH1.setRs1Id(rs1IDr);
-    zrtpDH1.setRs2Id(rs2IDr);
-    zrtpDH1.setAuxSecretId(auxSecretIDr);
-    zrtpDH1.setPbxSecretId(pbxSecretIDr);
-    zrtpDH1.setPv(pubKeyBytes);
-    zrtpDH1.setH1(H1);
+    handshake->zrtpDH1.setPubKeyType(pubKey->getName());
+    handshake->zrtpDH1.setMessageType((uint8_t*)DHPart1Msg);
+    handshake->zrtpDH1.setRs1Id(rs1IDr);
+    handshake->zrtpDH1.setRs2Id(rs2IDr);
+    handshake->zrtpDH1.setAuxSecretId(auxSecretIDr);
+    handshake->zrtpDH1.setPbxSecretId(pbxSecretIDr);
+    handshake->zrtpDH1.setPv(handshake->pubKeyBytes);
+    handshake->zrtpDH1.setH1(handshake->H1);
 
-    int32_t len = zrtpDH1.getLength() * ZRTP_WORD_SIZE;
+    int32_t len = handshake->zrtpDH1.getLength() * ZRTP_WORD_SIZE;
 
     // Compute HMAC over DHPart1, excluding the HMAC field (HMAC_SIZE)
     // and store in DHPart1.
     // Use implicit Hash function
     uint8_t hmac[IMPL_MAX_DIGEST_LENGTH];
     uint32_t macLen;
-    hmacFunctionImpl(H0, HASH_IMAGE_SIZE, (uint8_t*)zrtpDH1.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
-    zrtpDH1.setHMAC(hmac);
+    hmacFunctionImpl(handshake->H0, HASH_IMAGE_SIZE, (uint8_t*)handshake->zrtpDH1.getHeaderBase(), len-(HMAC_SIZE), hmac, &macLen);
+    handshake->zrtpDH1.setHMAC(hmac);
 
     // We are definitly responder. Save the peer's hvi for later compare.
-    memcpy(peerHvi, commit->getHvi(), HVI_SIZE);
+    memcpy(handshake->peerHvi, commit->getHvi(), HVI_SIZE);
 
     // We are responder. Release the pre-computed SHA context because it was prepared for Initiator.
     // Setup and compute for Responder.
@@ -637,18 +746,19 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart1(ZrtpPacketCommit *commit, uint32_t* errMs
     // Must use negotiated hash.
     hashCtxFunction(msgShaContext, (unsigned char*)currentHelloPacket->getHeaderBase(), currentHelloPacket->getLength() * ZRTP_WORD_SIZE);
     hashCtxFunction(msgShaContext, (unsigned char*)commit->getHeaderBase(), commit->getLength() * ZRTP_WORD_SIZE);
-    hashCtxFunction(msgShaContext, (unsigned char*)zrtpDH1.getHeaderBase(), zrtpDH1.getLength() * ZRTP_WORD_SIZE);
+    hashCtxFunction(msgShaContext, (unsigned char*)handshake->zrtpDH1.getHeaderBase(), handshake->zrtpDH1.getLength() * ZRTP_WORD_SIZE);
 
     // store Commit data temporarily until we can check HMAC after we got DHPart2
     storeMsgTemp(commit);
 
-    return &zrtpDH1;
+    return &handshake->zrtpDH1;
 }
 
 /*
  * At this point we will take the role of the Initiator.
  */
 ZrtpPacketDHPart* ZRtp::prepareDHPart2(ZrtpPacketDHPart *dhPart1, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseDHPart2);
 
     uint8_t* pvr;
 
@@ -664,10 +774,10 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart2(ZrtpPacketDHPart *dhPart1, uint32_t* errM
     // Must use implicit hash function.
     uint8_t tmpHash[IMPL_MAX_DIGEST_LENGTH];
     hashFunctionImpl(dhPart1->getH1(), HASH_IMAGE_SIZE, tmpHash); // Compute peer's H2
-    memcpy(peerH2, tmpHash, HASH_IMAGE_SIZE);
-    hashFunctionImpl(peerH2, HASH_IMAGE_SIZE, tmpHash);          // Compute peer's H3 (tmpHash)
+    memcpy(handshake->peerH2, tmpHash, HASH_IMAGE_SIZE);
+    hashFunctionImpl(handshake->peerH2, HASH_IMAGE_SIZE, tmpHash);          // Compute peer's H3 (tmpHash)
 
-    if (memcmp(tmpHash, peerH3, HASH_IMAGE_SIZE) != 0) {
+    if (memcmp(tmpHash, handshake->peerH3, HASH_IMAGE_SIZE) != 0) {
         *errMsg = IgnorePacket;
         return NULL;
     }
@@ -675,7 +785,7 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart2(ZrtpPacketDHPart *dhPart1, uint32_t* errM
     // Check HMAC of previous Hello packet stored in temporary buffer. The
     // HMAC key of the Hello packet is peer's H2 that was computed above.
     // Refer to chapter 9.1 and chapter 10.
-    if (!checkMsgHmac(peerH2)) {
+    if (!checkMsgHmac(handshake->peerH2)) {
         sendInfo(Severe, SevereHelloHMACFailed);
         *errMsg = CriticalSWError;
         return NULL;
@@ -698,17 +808,20 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart2(ZrtpPacketDHPart *dhPart1, uint32_t* errM
         *errMsg = DHErrorWrongPV;
         return NULL;
     }
-    dhContext->computeSecretKey(pvr, DHss);
+    {
+        ZrtpTraceScope dhScope(handshakeTrace, PhaseDHSecret);
+        dhContext->computeSecretKey(pvr, DHss);
+    }
 
     // We are Initiator: the Responder's Hello and the Initiator's (our) Commit
     // are already hashed in the context. Now hash the Responder's DH1 and then
     // the Initiator's (our) DH2 in that order.
     // Use the negotiated hash function.
     hashCtxFunction(msgShaContext, (unsigned char*)dhPart1->getHeaderBase(), dhPart1->getLength() * ZRTP_WORD_SIZE);
-    hashCtxFunction(msgShaContext, (unsigned char*)zrtpDH2.getHeaderBase(), zrtpDH2.getLength() * ZRTP_WORD_SIZE);
+    hashCtxFunction(msgShaContext, (unsigned char*)handshake->zrtpDH2.getHeaderBase(), handshake->zrtpDH2.getLength() * ZRTP_WORD_SIZE);
 
     // Compute the message Hash
-    closeHashCtx(msgShaContext, messageHash);
+    closeHashCtx(msgShaContext, handshake->messageHash);
     msgShaContext = NULL;
     // Now compute the S0, all dependend keys and the new RS1. The function
     // also performs sign SAS callback if it's active.
@@ -720,13 +833,14 @@ ZrtpPacketDHPart* ZRtp::prepareDHPart2(ZrtpPacketDHPart *dhPart1, uint32_t* errM
     // TODO: at initiator we can call signSAS at this point, don't dealy until confirm1 reveived
     // store DHPart1 data temporarily until we can check HMAC after receiving Confirm1
     storeMsgTemp(dhPart1);
-    return &zrtpDH2;
+    return &handshake->zrtpDH2;
 }
 
 /*
  * At this point we are Responder.
  */
 ZrtpPacketConfirm* ZRtp::prepareConfirm1(ZrtpPacketDHPart* dhPart2, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseConfirm1);
 
     uint8_t* pvi;
 
@@ -741,7 +855,7 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1(ZrtpPacketDHPart* dhPart2, uint32_t* er
     // Use implicit hash function
     uint8_t tmpHash[IMPL_MAX_DIGEST_LENGTH];
     hashFunctionImpl(dhPart2->getH1(), HASH_IMAGE_SIZE, tmpHash);
-    if (memcmp(tmpHash, peerH2, HASH_IMAGE_SIZE) != 0) {
+    if (memcmp(tmpHash, handshake->peerH2, HASH_IMAGE_SIZE) != 0) {
         *errMsg = IgnorePacket;
         return NULL;
     }
@@ -759,7 +873,7 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1(ZrtpPacketDHPart* dhPart2, uint32_t* er
     // hvi sent in commit packet. If it doesn't macht then a MitM attack
     // may have occured.
     computeHvi(dhPart2, currentHelloPacket);
-    if (memcmp(hvi, peerHvi, HVI_SIZE) != 0) {
+    if (memcmp(handshake->hvi, handshake->peerHvi, HVI_SIZE) != 0) {
         *errMsg = DHErrorWrongHVI;
         return NULL;
     }
@@ -774,13 +888,16 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1(ZrtpPacketDHPart* dhPart2, uint32_t* er
         *errMsg = DHErrorWrongPV;
         return NULL;
     }
-    dhContext->computeSecretKey(pvi, DHss);
+    {
+        ZrtpTraceScope dhScope(handshakeTrace, PhaseDHSecret);
+        dhContext->computeSecretKey(pvi, DHss);
+    }
 
     // Hash the Initiator's DH2 into the message Hash (other messages already prepared, see method prepareDHPart1().
     // Use neotiated hash function
     hashCtxFunction(msgShaContext, (unsigned char*)dhPart2->getHeaderBase(), dhPart2->getLength() * ZRTP_WORD_SIZE);
 
-    closeHashCtx(msgShaContext, messageHash);
+    closeHashCtx(msgShaContext, handshake->messageHash);
     msgShaContext = NULL;
     /*
      * The expected shared secret Ids were already computed when we built the
@@ -794,19 +911,19 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1(ZrtpPacketDHPart* dhPart2, uint32_t* er
     dhContext = NULL;
 
     // Fill in Confirm1 packet.
-    zrtpConfirm1.setMessageType((uint8_t*)Confirm1Msg);
+    handshake->zrtpConfirm1.setMessageType((uint8_t*)Confirm1Msg);
 
     // Check if user verfied the SAS in a previous call and thus verfied
     // the retained secret. Don't set the verified flag if paranoidMode is true.
     if (zidRec->isSasVerified() && !paranoidMode) {
-        zrtpConfirm1.setSASFlag();
+        handshake->zrtpConfirm1.setSASFlag();
     }
     if (configureAlgos.isDisclosureFlag()) {
-        zrtpConfirm1.setDisclosureFlag();
+        handshake->zrtpConfirm1.setDisclosureFlag();
     }
-    zrtpConfirm1.setExpTime(0xFFFFFFFF);
-    zrtpConfirm1.setIv(randomIV);
-    zrtpConfirm1.setHashH0(H0);
+    handshake->zrtpConfirm1.setExpTime(0xFFFFFFFF);
+    handshake->zrtpConfirm1.setIv(randomIV);
+    handshake->zrtpConfirm1.setHashH0(handshake->H0);
 
 #ifdef ZRTP_SAS_RELAY_SUPPORT
     // if this runs at PBX user agent enrollment service then set flag in confirm
@@ -819,28 +936,29 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1(ZrtpPacketDHPart* dhPart2, uint32_t* er
             zidRec->setMiTMData(pbxSecretTmp);
         }
         // Set flag to enable user's client to ask for confirmation or re-confirmation.
-        zrtpConfirm1.setPBXEnrollment();
+        handshake->zrtpConfirm1.setPBXEnrollment();
     }
 #endif
     uint8_t confMac[MAX_DIGEST_LENGTH];
     uint32_t macLen;
 
     // Encrypt and HMAC with Responder's key - we are Respondere here
-    int hmlen = (zrtpConfirm1.getLength() - 9) * ZRTP_WORD_SIZE;
-    cipher->getEncrypt()(zrtpKeyR, cipher->getKeylen(), randomIV, zrtpConfirm1.getHashH0(), hmlen);
-    hmacFunction(hmacKeyR, hashLength, (unsigned char*)zrtpConfirm1.getHashH0(), hmlen, confMac, &macLen);
+    int hmlen = (handshake->zrtpConfirm1.getLength() - 9) * ZRTP_WORD_SIZE;
+    cipher->getEncrypt()(zrtpKeyR, cipher->getKeylen(), randomIV, handshake->zrtpConfirm1.getHashH0(), hmlen);
+    hmacFunction(hmacKeyR, hashLength, (unsigned char*)handshake->zrtpConfirm1.getHashH0(), hmlen, confMac, &macLen);
 
-    zrtpConfirm1.setHmac(confMac);
+    handshake->zrtpConfirm1.setHmac(confMac);
 
     // store DHPart2 data temporarily until we can check HMAC after receiving Confirm2
     storeMsgTemp(dhPart2);
-    return &zrtpConfirm1;
+    return &handshake->zrtpConfirm1;
 }
 
 /*
  * At this point we are Responder.
  */
 ZrtpPacketConfirm* ZRtp::prepareConfirm1MultiStream(ZrtpPacketCommit* commit, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseConfirm1);
 
     sendInfo(Info, InfoRespCommitReceived);
 
@@ -852,10 +970,10 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1MultiStream(ZrtpPacketCommit* commit, ui
     // false ZRTP packets.
     // Use implicit hash function
     uint8_t tmpH3[IMPL_MAX_DIGEST_LENGTH];
-    memcpy(peerH2, commit->getH2(), HASH_IMAGE_SIZE);
-    hashFunctionImpl(peerH2, HASH_IMAGE_SIZE, tmpH3);
+    memcpy(handshake->peerH2, commit->getH2(), HASH_IMAGE_SIZE);
+    hashFunctionImpl(handshake->peerH2, HASH_IMAGE_SIZE, tmpH3);
 
-    if (memcmp(tmpH3, peerH3, HASH_IMAGE_SIZE) != 0) {
+    if (memcmp(tmpH3, handshake->peerH3, HASH_IMAGE_SIZE) != 0) {
         *errMsg = IgnorePacket;
         return NULL;
     }
@@ -863,7 +981,7 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1MultiStream(ZrtpPacketCommit* commit, ui
     // Check HMAC of previous Hello packet stored in temporary buffer. The
     // HMAC key of peer's Hello packet is peer's H2 that is contained in the
     // Commit packet. Refer to chapter 9.1.
-    if (!checkMsgHmac(peerH2)) {
+    if (!checkMsgHmac(handshake->peerH2)) {
         sendInfo(Severe, SevereHelloHMACFailed);
         *errMsg = CriticalSWError;
         return NULL;
@@ -925,41 +1043,214 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm1MultiStream(ZrtpPacketCommit* commit, ui
     hashCtxFunction(msgShaContext, (unsigned char*)currentHelloPacket->getHeaderBase(), currentHelloPacket->getLength() * ZRTP_WORD_SIZE);
     hashCtxFunction(msgShaContext, (unsigned char*)commit->getHeaderBase(), commit->getLength() * ZRTP_WORD_SIZE);
 
-    closeHashCtx(msgShaContext, messageHash);
+    closeHashCtx(msgShaContext, handshake->messageHash);
     msgShaContext = NULL;
 
     generateKeysMultiStream();
 
     // Fill in Confirm1 packet.
-    zrtpConfirm1.setMessageType((uint8_t*)Confirm1Msg);
+    handshake->zrtpConfirm1.setMessageType((uint8_t*)Confirm1Msg);
+    if (configureAlgos.isDisclosureFlag()) {
+        handshake->zrtpConfirm1.setDisclosureFlag();
+    }
+    handshake->zrtpConfirm1.setExpTime(0xFFFFFFFF);
+    handshake->zrtpConfirm1.setIv(randomIV);
+    handshake->zrtpConfirm1.setHashH0(handshake->H0);
+
+    uint8_t confMac[MAX_DIGEST_LENGTH];
+    uint32_t macLen;
+
+    // Encrypt and HMAC with Responder's key - we are Respondere here
+    int32_t hmlen = (handshake->zrtpConfirm1.getLength() - 9) * ZRTP_WORD_SIZE;
+    cipher->getEncrypt()(zrtpKeyR, cipher->getKeylen(), randomIV, handshake->zrtpConfirm1.getHashH0(), hmlen);
+
+    // Use negotiated HMAC (hash)
+    hmacFunction(hmacKeyR, hashLength, (unsigned char*)handshake->zrtpConfirm1.getHashH0(), hmlen, confMac, &macLen);
+
+    handshake->zrtpConfirm1.setHmac(confMac);
+
+    // Store Commit data temporarily until we can check HMAC after receiving Confirm2
+    storeMsgTemp(commit);
+    return &handshake->zrtpConfirm1;
+}
+
+/*
+ * At this point we are Responder.
+ */
+ZrtpPacketConfirm* ZRtp::prepareConfirm1Preshared(ZrtpPacketCommit* commit, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseConfirm1);
+
+    sendInfo(Info, InfoRespCommitReceived);
+
+    if (!commit->isLengthOk(ZrtpPacketCommit::Preshared)) {
+        *errMsg = CriticalSWError;
+        return NULL;
+    }
+
+    // Check if ZID in Commit is the same as we got in Hello
+    if (memcmp(peerZid, commit->getZid(), ZID_SIZE) != 0) {       // ZIDs do not match????
+        sendInfo(Severe, SevereProtocolError);
+        *errMsg = CriticalSWError;
+        return NULL;
+    }
+
+    // The following code checks the hash chain according chapter 10 to detect
+    // false ZRTP packets.
+    // Use implicit hash function
+    uint8_t tmpH3[IMPL_MAX_DIGEST_LENGTH];
+    memcpy(handshake->peerH2, commit->getH2(), HASH_IMAGE_SIZE);
+    hashFunctionImpl(handshake->peerH2, HASH_IMAGE_SIZE, tmpH3);
+
+    if (memcmp(tmpH3, handshake->peerH3, HASH_IMAGE_SIZE) != 0) {
+        *errMsg = IgnorePacket;
+        return NULL;
+    }
+
+    // Check HMAC of previous Hello packet stored in temporary buffer. The
+    // HMAC key of peer's Hello packet is peer's H2 that is contained in the
+    // Commit packet. Refer to chapter 9.1.
+    if (!checkMsgHmac(handshake->peerH2)) {
+        sendInfo(Severe, SevereHelloHMACFailed);
+        *errMsg = CriticalSWError;
+        return NULL;
+    }
+
+    // Accept Preshared mode only if we offered it in our Hello
+    AlgorithmEnum* cp = &zrtpPubKeys.getByName(prsh);
+    if (!configureAlgos.containsAlgo(PubKeyAlgorithm, *cp)) {
+        *errMsg = UnsuppPKExchange;
+        return NULL;
+    }
+    pubKey = cp;
+
+    // check if we support the commited cipher
+    cp = &zrtpSymCiphers.getByName((const char*)commit->getCipherType());
+    if (!cp->isValid()) { // no match - something went wrong
+        *errMsg = UnsuppCiphertype;
+        return NULL;
+    }
+    cipher = cp;
+
+    // check if we support the commited Authentication length
+    cp = &zrtpAuthLengths.getByName((const char*)commit->getAuthLen());
+    if (!cp->isValid()) { // no match - something went wrong
+        *errMsg = UnsuppSRTPAuthTag;
+        return NULL;
+    }
+    authLength = cp;
+
+    // check if we support the commited SAS type
+    cp = &zrtpSasTypes.getByName((const char*)commit->getSasType());
+    if (!cp->isValid()) { // no match - something went wrong
+        *errMsg = UnsuppSASScheme;
+        return NULL;
+    }
+    sasType = cp;
+
+    // check if we support the commited hash type
+    cp = &zrtpHashes.getByName((const char*)commit->getHashType());
+    if (!cp->isValid()) { // no match - something went wrong
+        *errMsg = UnsuppHashType;
+        return NULL;
+    }
+    // check if the peer's commited hash is the same that we used when
+    // preparing our commit packet. If not do the necessary resets and
+    // recompute some data.
+    if (*(int32_t*)(hash->getName()) != *(int32_t*)(cp->getName())) {
+        hash = cp;
+        setNegotiatedHash(hash);
+        // Compute the Initator's and Responder's retained secret ids
+        // with the committed hash, DH mode needs them if the Initiator
+        // falls back.
+        computeSharedSecretSet(zidRec);
+    }
+
+    // Check if we have a retained secret that matches the Initiator's key id.
+    // If not tell the Initiator to use DH mode. Honor our Preshared policy
+    // also as Responder.
+    uint8_t keyId[2*ZRTP_WORD_SIZE];
+    ZrtpConfigure::PreSharedPolicy policy = configureAlgos.getPreSharedPolicy();
+    if (zidRec == NULL || !zidRec->isRs1Valid() || (policy == ZrtpConfigure::PreSharedIfVerified && !zidRec->isSasVerified())) {
+        *errMsg = NoSharedSecret;
+        return NULL;
+    }
+    computePresharedKey(keyId);
+    if (memcmp(keyId, commit->getKeyId(), sizeof(keyId)) != 0) {
+        memset(presharedKey, 0, MAX_DIGEST_LENGTH);
+        *errMsg = NoSharedSecret;
+        return NULL;
+    }
+
+    if (!checkAndSetNonce(commit->getNonce())) {
+        memset(presharedKey, 0, MAX_DIGEST_LENGTH);
+        *errMsg = NonceReused;
+        return NULL;
+    }
+    myRole = Responder;
+    presharedMode = true;
+
+    // We don't need the DH context prepared by prepareCommit()
+    if (dhContext != NULL) {
+        delete dhContext;
+        dhContext = NULL;
+    }
+
+    // We are responder. Release a possibly pre-computed SHA256 context
+    // because this was prepared for Initiator. Then create a new one.
+    if (msgShaContext != NULL) {
+        closeHashCtx(msgShaContext, NULL);
+    }
+    msgShaContext = createHashCtx(msgShaContext);
+
+    // Hash messages to produce overall message hash:
+    // First the Responder's (my) Hello message, second the Commit
+    // (always Initator's)
+    // use negotiated hash
+    hashCtxFunction(msgShaContext, (unsigned char*)currentHelloPacket->getHeaderBase(), currentHelloPacket->getLength() * ZRTP_WORD_SIZE);
+    hashCtxFunction(msgShaContext, (unsigned char*)commit->getHeaderBase(), commit->getLength() * ZRTP_WORD_SIZE);
+
+    closeHashCtx(msgShaContext, handshake->messageHash);
+    msgShaContext = NULL;
+
+    generateKeysPreshared();
+
+    // Fill in Confirm1 packet.
+    handshake->zrtpConfirm1.setMessageType((uint8_t*)Confirm1Msg);
+
+    // Check if user verfied the SAS in a previous call and thus verfied
+    // the retained secret. Don't set the verified flag if paranoidMode is true.
+    if (zidRec->isSasVerified() && !paranoidMode) {
+        handshake->zrtpConfirm1.setSASFlag();
+    }
     if (configureAlgos.isDisclosureFlag()) {
-        zrtpConfirm1.setDisclosureFlag();
+        handshake->zrtpConfirm1.setDisclosureFlag();
     }
-    zrtpConfirm1.setExpTime(0xFFFFFFFF);
-    zrtpConfirm1.setIv(randomIV);
-    zrtpConfirm1.setHashH0(H0);
+    handshake->zrtpConfirm1.setExpTime(0xFFFFFFFF);
+    handshake->zrtpConfirm1.setIv(randomIV);
+    handshake->zrtpConfirm1.setHashH0(handshake->H0);
 
     uint8_t confMac[MAX_DIGEST_LENGTH];
     uint32_t macLen;
 
     // Encrypt and HMAC with Responder's key - we are Respondere here
-    int32_t hmlen = (zrtpConfirm1.getLength() - 9) * ZRTP_WORD_SIZE;
-    cipher->getEncrypt()(zrtpKeyR, cipher->getKeylen(), randomIV, zrtpConfirm1.getHashH0(), hmlen);
+    int32_t hmlen = (handshake->zrtpConfirm1.getLength() - 9) * ZRTP_WORD_SIZE;
+    cipher->getEncrypt()(zrtpKeyR, cipher->getKeylen(), randomIV, handshake->zrtpConfirm1.getHashH0(), hmlen);
 
     // Use negotiated HMAC (hash)
-    hmacFunction(hmacKeyR, hashLength, (unsigned char*)zrtpConfirm1.getHashH0(), hmlen, confMac, &macLen);
+    hmacFunction(hmacKeyR, hashLength, (unsigned char*)handshake->zrtpConfirm1.getHashH0(), hmlen, confMac, &macLen);
 
-    zrtpConfirm1.setHmac(confMac);
+    handshake->zrtpConfirm1.setHmac(confMac);
 
     // Store Commit data temporarily until we can check HMAC after receiving Confirm2
     storeMsgTemp(commit);
-    return &zrtpConfirm1;
+    return &handshake->zrtpConfirm1;
 }
 
 /*
  * At this point we are Initiator.
  */
 ZrtpPacketConfirm* ZRtp::prepareConfirm2(ZrtpPacketConfirm* confirm1, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseConfirm2);
 
     sendInfo(Info, InfoInitConf1Received);
 
@@ -1021,17 +1312,17 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm2(ZrtpPacketConfirm* confirm1, uint32_t*
     zidRec->setNewRs1((const uint8_t*)newRs1);
 
     // now generate my Confirm2 message
-    zrtpConfirm2.setMessageType((uint8_t*)Confirm2Msg);
-    zrtpConfirm2.setHashH0(H0);
+    handshake->zrtpConfirm2.setMessageType((uint8_t*)Confirm2Msg);
+    handshake->zrtpConfirm2.setHashH0(handshake->H0);
 
     if (sasFlag) {
-        zrtpConfirm2.setSASFlag();
+        handshake->zrtpConfirm2.setSASFlag();
     }
     if (configureAlgos.isDisclosureFlag()) {
-        zrtpConfirm2.setDisclosureFlag();
+        handshake->zrtpConfirm2.setDisclosureFlag();
     }
-    zrtpConfirm2.setExpTime(0xFFFFFFFF);
-    zrtpConfirm2.setIv(randomIV);
+    handshake->zrtpConfirm2.setExpTime(0xFFFFFFFF);
+    handshake->zrtpConfirm2.setIv(randomIV);
 
 #ifdef ZRTP_SAS_RELAY_SUPPORT
     // Compute PBX secret if we are in enrollemnt mode (PBX user agent)
@@ -1050,21 +1341,23 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm2(ZrtpPacketConfirm* confirm1, uint32_t*
                 zidRec->setMiTMData(pbxSecretTmp);
             }
             // Set flag to enable user's client to ask for confirmation or re-confirmation.
-            zrtpConfirm2.setPBXEnrollment();
+            handshake->zrtpConfirm2.setPBXEnrollment();
         }
     }
 #endif
-    if (saveZidRecord)
+    if (saveZidRecord) {
+        ZrtpTraceScope cacheScope(handshakeTrace, PhaseCacheWrite);
         getZidCacheInstance()->saveRecord(zidRec);
+    }
 
     // Encrypt and HMAC with Initiator's key - we are Initiator here
-    hmlen = (zrtpConfirm2.getLength() - 9) * ZRTP_WORD_SIZE;
-    cipher->getEncrypt()(zrtpKeyI, cipher->getKeylen(), randomIV, zrtpConfirm2.getHashH0(), hmlen);
+    hmlen = (handshake->zrtpConfirm2.getLength() - 9) * ZRTP_WORD_SIZE;
+    cipher->getEncrypt()(zrtpKeyI, cipher->getKeylen(), randomIV, handshake->zrtpConfirm2.getHashH0(), hmlen);
 
     // Use negotiated HMAC (hash)
-    hmacFunction(hmacKeyI, hashLength, (unsigned char*)zrtpConfirm2.getHashH0(), hmlen, confMac, &macLen);
+    hmacFunction(hmacKeyI, hashLength, (unsigned char*)handshake->zrtpConfirm2.getHashH0(), hmlen, confMac, &macLen);
 
-    zrtpConfirm2.setHmac(confMac);
+    handshake->zrtpConfirm2.setHmac(confMac);
 
 #ifdef ZRTP_SAS_RELAY_SUPPORT
     // Ask for enrollment only if enabled via configuration and the
@@ -1082,13 +1375,14 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm2(ZrtpPacketConfirm* confirm1, uint32_t*
         }
     }
 #endif
-    return &zrtpConfirm2;
+    return &handshake->zrtpConfirm2;
 }
 
 /*
  * At this point we are Initiator.
  */
 ZrtpPacketConfirm* ZRtp::prepareConfirm2MultiStream(ZrtpPacketConfirm* confirm1, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseConfirm2);
 
     // check Confirm1 packet using the keys
     // prepare Confirm2 packet
@@ -1102,7 +1396,7 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm2MultiStream(ZrtpPacketConfirm* confirm1,
     uint8_t confMac[MAX_DIGEST_LENGTH];
     uint32_t macLen;
 
-    closeHashCtx(msgShaContext, messageHash);
+    closeHashCtx(msgShaContext, handshake->messageHash);
     msgShaContext = NULL;
     myRole = Initiator;
 
@@ -1130,12 +1424,12 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm2MultiStream(ZrtpPacketConfirm* confirm1,
     uint8_t tmpHash[IMPL_MAX_DIGEST_LENGTH];
     hashFunctionImpl(confirm1->getHashH0(), HASH_IMAGE_SIZE, tmpHash); // Compute peer's H1 in tmpHash
     hashFunctionImpl(tmpHash, HASH_IMAGE_SIZE, tmpHash);               // Compute peer's H2 in tmpHash
-    memcpy(peerH2, tmpHash, HASH_IMAGE_SIZE);                          // copy and truncate to peerH2
+    memcpy(handshake->peerH2, tmpHash, HASH_IMAGE_SIZE);                          // copy and truncate to peerH2
 
     // Check HMAC of previous Hello packet stored in temporary buffer. The
     // HMAC key of the Hello packet is peer's H2 that was computed above.
     // Refer to chapter 9.1 and chapter 10.
-    if (!checkMsgHmac(peerH2)) {
+    if (!checkMsgHmac(handshake->peerH2)) {
         sendInfo(Severe, SevereHelloHMACFailed);
         *errMsg = CriticalSWError;
         return NULL;
@@ -1144,29 +1438,143 @@ ZrtpPacketConfirm* ZRtp::prepareConfirm2MultiStream(ZrtpPacketConfirm* confirm1,
     peerDisclosureFlagSeen = confirm1->isDisclosureFlag();
 
     // now generate my Confirm2 message
-    zrtpConfirm2.setMessageType((uint8_t*)Confirm2Msg);
+    handshake->zrtpConfirm2.setMessageType((uint8_t*)Confirm2Msg);
     if (configureAlgos.isDisclosureFlag()) {
-        zrtpConfirm2.setDisclosureFlag();
+        handshake->zrtpConfirm2.setDisclosureFlag();
     }
-    zrtpConfirm2.setHashH0(H0);
-    zrtpConfirm2.setExpTime(0xFFFFFFFF);
-    zrtpConfirm2.setIv(randomIV);
+    handshake->zrtpConfirm2.setHashH0(handshake->H0);
+    handshake->zrtpConfirm2.setExpTime(0xFFFFFFFF);
+    handshake->zrtpConfirm2.setIv(randomIV);
 
     // Encrypt and HMAC with Initiator's key - we are Initiator here
-    hmlen = (zrtpConfirm2.getLength() - 9) * ZRTP_WORD_SIZE;
-    cipher->getEncrypt()(zrtpKeyI, cipher->getKeylen(), randomIV, zrtpConfirm2.getHashH0(), hmlen);
+    hmlen = (handshake->zrtpConfirm2.getLength() - 9) * ZRTP_WORD_SIZE;
+    cipher->getEncrypt()(zrtpKeyI, cipher->getKeylen(), randomIV, handshake->zrtpConfirm2.getHashH0(), hmlen);
 
     // Use negotiated HMAC (hash)
-    hmacFunction(hmacKeyI, hashLength, (unsigned char*)zrtpConfirm2.getHashH0(), hmlen, confMac, &macLen);
+    hmacFunction(hmacKeyI, hashLength, (unsigned char*)handshake->zrtpConfirm2.getHashH0(), hmlen, confMac, &macLen);
 
-    zrtpConfirm2.setHmac(confMac);
-    return &zrtpConfirm2;
+    handshake->zrtpConfirm2.setHmac(confMac);
+    return &handshake->zrtpConfirm2;
+}
+
+/*
+ * At this point we are Initiator.
+ */
+ZrtpPacketConfirm* ZRtp::prepareConfirm2Preshared(ZrtpPacketConfirm* confirm1, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseConfirm2);
+
+    // check Confirm1 packet using the keys
+    // prepare Confirm2 packet
+    // update RS as in DH mode
+    sendInfo(Info, InfoInitConf1Received);
+
+    if (!confirm1->isLengthOk()) {
+        *errMsg = CriticalSWError;
+        return NULL;
+    }
+    uint8_t confMac[MAX_DIGEST_LENGTH];
+    uint32_t macLen;
+
+    closeHashCtx(msgShaContext, handshake->messageHash);
+    msgShaContext = NULL;
+    myRole = Initiator;
+
+    generateKeysPreshared();
+
+    // Use the Responder's keys here because we are Initiator here and
+    // receive packets from Responder
+    int32_t hmlen = (confirm1->getLength() - 9) * ZRTP_WORD_SIZE;
+
+    // Use negotiated HMAC (hash)
+    hmacFunction(hmacKeyR, hashLength, (unsigned char*)confirm1->getHashH0(), hmlen, confMac, &macLen);
+
+    if (memcmp(confMac, confirm1->getHmac(), HMAC_SIZE) != 0) {
+        *errMsg = ConfirmHMACWrong;
+        return NULL;
+    }
+    // Cast away the const for the IV - the standalone AES CFB modifies IV on return
+    cipher->getDecrypt()(zrtpKeyR, cipher->getKeylen(), (uint8_t*)confirm1->getIv(), confirm1->getHashH0(), hmlen);
+
+    // Because we are initiator the protocol engine didn't receive Commit and
+    // because we are using Preshared mode here we also did not receive a DHPart1 and
+    // thus could not store a responder's H2 or H1. A two step hash is required to
+    // re-compute H1, H2.
+    // USe implicit hash function.
+    uint8_t tmpHash[IMPL_MAX_DIGEST_LENGTH];
+    hashFunctionImpl(confirm1->getHashH0(), HASH_IMAGE_SIZE, tmpHash); // Compute peer's H1 in tmpHash
+    hashFunctionImpl(tmpHash, HASH_IMAGE_SIZE, tmpHash);               // Compute peer's H2 in tmpHash
+    memcpy(handshake->peerH2, tmpHash, HASH_IMAGE_SIZE);                          // copy and truncate to peerH2
+
+    // Check HMAC of previous Hello packet stored in temporary buffer. The
+    // HMAC key of the Hello packet is peer's H2 that was computed above.
+    // Refer to chapter 9.1 and chapter 10.
+    if (!checkMsgHmac(handshake->peerH2)) {
+        sendInfo(Severe, SevereHelloHMACFailed);
+        *errMsg = CriticalSWError;
+        return NULL;
+    }
+    /*
+     * The Confirm1 is ok, handle the Retained secret stuff and inform
+     * GUI about state.
+     */
+    bool sasFlag = confirm1->isSASFlag();
+
+    // Our peer did not confirm the SAS in last session, thus reset
+    // our SAS flag too. Reset the flag also if paranoidMode is true.
+    if (!sasFlag || paranoidMode) {
+        zidRec->resetSasVerified();
+    }
+
+    // Store the status of the Disclosure flag
+    peerDisclosureFlagSeen = confirm1->isDisclosureFlag();
+
+    // get verified flag from current RS1 before set a new RS1. This
+    // may not be set even if peer's flag is set in confirm1 message.
+    sasFlag = zidRec->isSasVerified();
+
+    signatureLength = confirm1->getSignatureLength();
+    if (signSasSeen && signatureLength > 0 && confirm1->isSignatureLengthOk()) {
+        signatureData = confirm1->getSignatureData();
+        callback->checkSASSignature(sasHash);
+        // TODO: error handling if checkSASSignature returns false.
+    }
+    // now we are ready to save the new RS1 which inherits the verified
+    // flag from old RS1
+    zidRec->setNewRs1((const uint8_t*)newRs1);
+    if (saveZidRecord) {
+        ZrtpTraceScope cacheScope(handshakeTrace, PhaseCacheWrite);
+        getZidCacheInstance()->saveRecord(zidRec);
+    }
+
+    // now generate my Confirm2 message
+    handshake->zrtpConfirm2.setMessageType((uint8_t*)Confirm2Msg);
+    handshake->zrtpConfirm2.setHashH0(handshake->H0);
+
+    if (sasFlag) {
+        handshake->zrtpConfirm2.setSASFlag();
+    }
+    if (configureAlgos.isDisclosureFlag()) {
+        handshake->zrtpConfirm2.setDisclosureFlag();
+    }
+    handshake->zrtpConfirm2.setExpTime(0xFFFFFFFF);
+    handshake->zrtpConfirm2.setIv(randomIV);
+
+    // Encrypt and HMAC with Initiator's key - we are Initiator here
+    hmlen = (handshake->zrtpConfirm2.getLength() - 9) * ZRTP_WORD_SIZE;
+    cipher->getEncrypt()(zrtpKeyI, cipher->getKeylen(), randomIV, handshake->zrtpConfirm2.getHashH0(), hmlen);
+
+    // Use negotiated HMAC (hash)
+    hmacFunction(hmacKeyI, hashLength, (unsigned char*)handshake->zrtpConfirm2.getHashH0(), hmlen, confMac, &macLen);
+
+    handshake->zrtpConfirm2.setHmac(confMac);
+    return &handshake->zrtpConfirm2;
 }
 
 /*
  * At this point we are Responder.
  */
 ZrtpPacketConf2Ack* ZRtp::prepareConf2Ack(ZrtpPacketConfirm *confirm2, uint32_t* errMsg) {
+    ZrtpTraceScope traceScope(handshakeTrace, PhaseConf2Ack);
 
     sendInfo(Info, InfoRespConf2Received);
 
@@ -1193,7 +1601,7 @@ ZrtpPacketConf2Ack* ZRtp::prepareConf2Ack(ZrtpPacketConfirm *confirm2, uint32_t*
     // Cast away the const for the IV - the standalone AES CFB modifies IV on return
     cipher->getDecrypt()(zrtpKeyI, cipher->getKeylen(), (uint8_t*)confirm2->getIv(), confirm2->getHashH0(), hmlen);
 
-    if (!multiStream) {
+    if (!multiStream && !presharedMode) {
         // Check HMAC of DHPart2 packet stored in temporary buffer. The
         // HMAC key of the DHPart2 packet is peer's H0 that is contained in
         // Confirm2. Refer to chapter 9.1 and chapter 10.
@@ -1220,8 +1628,10 @@ ZrtpPacketConf2Ack* ZRtp::prepareConf2Ack(ZrtpPacketConfirm *confirm2, uint32_t*
         }
         // save new RS1, this inherits the verified flag from old RS1
         zidRec->setNewRs1((const uint8_t*)newRs1);
-        if (saveZidRecord)
+        if (saveZidRecord) {
+            ZrtpTraceScope cacheScope(handshakeTrace, PhaseCacheWrite);
             getZidCacheInstance()->saveRecord(zidRec);
+        }
 
 #ifdef ZRTP_SAS_RELAY_SUPPORT
         // Ask for enrollment only if enabled via configuration and the
@@ -1253,6 +1663,27 @@ ZrtpPacketConf2Ack* ZRtp::prepareConf2Ack(ZrtpPacketConfirm *confirm2, uint32_t*
             *errMsg = CriticalSWError;
             return NULL;
         }
+        // Preshared mode updates the retained secret as DH mode does
+        if (presharedMode) {
+            bool sasFlag = confirm2->isSASFlag();
+            // Our peer did not confirm the SAS in last session, thus reset
+            // our SAS flag too. Reset the flag also if paranoidMode is true.
+            if (!sasFlag || paranoidMode) {
+                zidRec->resetSasVerified();
+            }
+            signatureLength = confirm2->getSignatureLength();
+            if (signSasSeen && signatureLength > 0 && confirm2->isSignatureLengthOk() ) {
+                signatureData = confirm2->getSignatureData();
+                callback->checkSASSignature(sasHash);
+                // TODO: error handling if checkSASSignature returns false.
+            }
+            // save new RS1, this inherits the verified flag from old RS1
+            zidRec->setNewRs1((const uint8_t*)newRs1);
+            if (saveZidRecord) {
+                ZrtpTraceScope cacheScope(handshakeTrace, PhaseCacheWrite);
+                getZidCacheInstance()->saveRecord(zidRec);
+            }
+        }
     }
     // Store the status of the Disclosure flag
     peerDisclosureFlagSeen = confirm2->isDisclosureFlag();
@@ -1263,7 +1694,8 @@ ZrtpPacketConf2Ack* ZRtp::prepareConf2Ack(ZrtpPacketConfirm *confirm2, uint32_t*
 ZrtpPacketErrorAck* ZRtp::prepareErrorAck(ZrtpPacketError* epkt) {
     if (epkt->getLength() < 4)
         sendInfo(ZrtpError, CriticalSWError * -1);
-    else
+    // NoSharedSecret rejects our Preshared Commit, the Initiator falls back to DH mode: not an error
+    else if (epkt->getErrorCode() != NoSharedSecret || !(presharedMode || presharedRejected))
         sendInfo(ZrtpError, epkt->getErrorCode() * -1);
     return &zrtpErrorAck;
 }
@@ -1514,8 +1946,9 @@ AlgorithmEnum* ZRtp::findBestPubkey(ZrtpPacketHello *hello) {
     int numOwnIntersect = 0;
     for (int i = 0; i < numAlgosOwn; i++) {
         ownIntersect[numOwnIntersect] = &configureAlgos.getAlgoAt(PubKeyAlgorithm, i);
-        if (*(int32_t*)(ownIntersect[numOwnIntersect]->getName()) == *(int32_t*)mult) {
-            continue;                               // skip multi-stream mode
+        if (*(int32_t*)(ownIntersect[numOwnIntersect]->getName()) == *(int32_t*)mult ||
+            *(int32_t*)(ownIntersect[numOwnIntersect]->getName()) == *(int32_t*)prsh) {
+            continue;                               // skip multi-stream and Preshared mode
         }
         for (int ii = 0; ii < numAlgosPeer; ii++) {
             if (*(int32_t*)(ownIntersect[numOwnIntersect]->getName()) == *(int32_t*)(zrtpPubKeys.getByName((const char*)hello->getPubKeyType(ii)).getName())) {
@@ -1786,15 +2219,88 @@ bool ZRtp::checkMultiStream(ZrtpPacketHello *hello) {
     return false;
 }
 
+bool ZRtp::checkPreshared(ZrtpPacketHello *hello) {
+
+    // Never in paranoid mode or during PBX enrollment: both require the
+    // DH key agreement and a fresh SAS compare.
+    ZrtpConfigure::PreSharedPolicy policy = configureAlgos.getPreSharedPolicy();
+    if (policy == ZrtpConfigure::PreSharedNever || presharedRejected || paranoidMode || enrollmentMode)
+        return false;
+
+    if (!zidRec->isRs1Valid())
+        return false;
+    if (policy == ZrtpConfigure::PreSharedIfVerified && !zidRec->isSasVerified())
+        return false;
+
+    int num = hello->getNumPubKeys();
+    for (int i = 0; i < num; i++) {
+        if (*(int32_t*)(hello->getPubKeyType(i)) == *(int32_t*)prsh) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ZRtp::isPresharedCommit(ZrtpPacketCommit *commit) {
+    return *(int32_t*)(commit->getPubKeysType()) == *(int32_t*)prsh;
+}
+
+void ZRtp::computePresharedKey(uint8_t* keyId) {
+
+    /*
+     * preshared_key = hash(len(rs1) || rs1 || len(auxsecret) || auxsecret ||
+     *                      len(pbxsecret) || pbxsecret)
+     *
+     * Lengths are 32 bit big-endian numbers, a missing secret contributes
+     * its zero length only. Refer to chapter 4.4.2. Use negotiated hash.
+     */
+    unsigned char* data[7];
+    unsigned int   length[7];
+    uint32_t pos = 0;
+    uint32_t sLen[3];
+
+    sLen[0] = zrtpHtonl(RS_LENGTH);
+    data[pos] = (unsigned char*)&sLen[0];
+    length[pos++] = sizeof(uint32_t);
+    data[pos] = (unsigned char*)zidRec->getRs1();
+    length[pos++] = RS_LENGTH;
+
+    sLen[1] = zrtpHtonl(auxSecret != NULL ? auxSecretLength : 0);
+    data[pos] = (unsigned char*)&sLen[1];
+    length[pos++] = sizeof(uint32_t);
+    if (auxSecret != NULL) {
+        data[pos] = auxSecret;
+        length[pos++] = auxSecretLength;
+    }
+
+    sLen[2] = zrtpHtonl(zidRec->isMITMKeyAvailable() ? RS_LENGTH : 0);
+    data[pos] = (unsigned char*)&sLen[2];
+    length[pos++] = sizeof(uint32_t);
+    if (zidRec->isMITMKeyAvailable()) {
+        data[pos] = (unsigned char*)zidRec->getMiTMData();
+        length[pos++] = RS_LENGTH;
+    }
+    data[pos] = NULL;
+    hashListFunction(data, length, presharedKey);
+
+    // keyID = MAC(preshared_key, "Prsh"), truncated to 64 bits
+    uint8_t mac[MAX_DIGEST_LENGTH];
+    uint32_t macLen;
+    hmacFunction(presharedKey, hashLength, (unsigned char*)prsh, strlen(prsh), mac, &macLen);
+    memcpy(keyId, mac, 2*ZRTP_WORD_SIZE);
+}
+
 bool ZRtp::verifyH2(ZrtpPacketCommit *commit) {
     uint8_t tmpH3[IMPL_MAX_DIGEST_LENGTH];
 
     // packet does not have the correct size, treat H2 verfication as failed.
-    if (!commit->isLengthOk(multiStream ? ZrtpPacketCommit::MultiStream : ZrtpPacketCommit::DhExchange))
+    ZrtpPacketCommit::commitType type = multiStream ? ZrtpPacketCommit::MultiStream :
+        (isPresharedCommit(commit) ? ZrtpPacketCommit::Preshared : ZrtpPacketCommit::DhExchange);
+    if (!commit->isLengthOk(type))
         return false;
 
     sha256(commit->getH2(), HASH_IMAGE_SIZE, tmpH3);
-    if (memcmp(tmpH3, peerH3, HASH_IMAGE_SIZE) != 0) {
+    if (memcmp(tmpH3, handshake->peerH3, HASH_IMAGE_SIZE) != 0) {
         return false;
     }
     return true;
@@ -1815,7 +2321,7 @@ void ZRtp::computeHvi(ZrtpPacketDHPart* dh, ZrtpPacketHello *hello) {
     length[1] = hello->getLength() * ZRTP_WORD_SIZE;
 
     data[2] = NULL;            // terminate data chunks
-    hashListFunction(data, length, hvi);
+    hashListFunction(data, length, handshake->hvi);
     return;
 }
 
@@ -1873,17 +2379,17 @@ void ZRtp::computeAuxSecretIds() {
 
     if (auxSecret == NULL) {
         randomZRTP(randBuf, RS_LENGTH);
-        hmacFunction(randBuf, RS_LENGTH, H3, HASH_IMAGE_SIZE, auxSecretIDi, &macLen);
-        hmacFunction(randBuf, RS_LENGTH, H3, HASH_IMAGE_SIZE, auxSecretIDr, &macLen);
+        hmacFunction(randBuf, RS_LENGTH, handshake->H3, HASH_IMAGE_SIZE, auxSecretIDi, &macLen);
+        hmacFunction(randBuf, RS_LENGTH, handshake->H3, HASH_IMAGE_SIZE, auxSecretIDr, &macLen);
     }
     else {
         if (myRole == Initiator) {  // I'm initiator thus use my H3 for initiator's IDi, peerH3 for respnder's IDr
-            hmacFunction(auxSecret, auxSecretLength, H3, HASH_IMAGE_SIZE, auxSecretIDi, &macLen);
-            hmacFunction(auxSecret, auxSecretLength, peerH3, HASH_IMAGE_SIZE, auxSecretIDr, &macLen);
+            hmacFunction(auxSecret, auxSecretLength, handshake->H3, HASH_IMAGE_SIZE, auxSecretIDi, &macLen);
+            hmacFunction(auxSecret, auxSecretLength, handshake->peerH3, HASH_IMAGE_SIZE, auxSecretIDr, &macLen);
         }
         else {
-            hmacFunction(auxSecret, auxSecretLength, peerH3, HASH_IMAGE_SIZE, auxSecretIDi, &macLen);
-            hmacFunction(auxSecret, auxSecretLength, H3, HASH_IMAGE_SIZE, auxSecretIDr, &macLen);
+            hmacFunction(auxSecret, auxSecretLength, handshake->peerH3, HASH_IMAGE_SIZE, auxSecretIDi, &macLen);
+            hmacFunction(auxSecret, auxSecretLength, handshake->H3, HASH_IMAGE_SIZE, auxSecretIDr, &macLen);
         }
     }
 }
@@ -2024,7 +2530,7 @@ void ZRtp::generateKeysInitiator(ZrtpPacketDHPart *dhPart, ZIDRecord *zidRec) {
     length[pos++] = ZID_SIZE;
 
     // Next ist total hash (messageHash) itself
-    data[pos] = messageHash;
+    data[pos] = handshake->messageHash;
     length[pos++] = hashLength;
 
     /*
@@ -2191,7 +2697,7 @@ void ZRtp::generateKeysResponder(ZrtpPacketDHPart *dhPart, ZIDRecord *zidRec) {
     length[pos++] = ZID_SIZE;
 
     // Next ist total hash (messageHash) itself
-    data[pos] = messageHash;
+    data[pos] = handshake->messageHash;
     length[pos++] = hashLength;
 
     /*
@@ -2271,7 +2777,7 @@ void ZRtp::KDF(uint8_t* key, uint32_t keyLength, uint8_t* label, int32_t labelLe
 void ZRtp::generateKeysMultiStream() {
 
     // allocate the maximum size, compute real size to use
-    uint8_t KDFcontext[sizeof(peerZid)+sizeof(ownZid)+sizeof(messageHash)];
+    uint8_t KDFcontext[sizeof(peerZid)+sizeof(ownZid)+sizeof(handshake->messageHash)];
     int32_t kdfSize = sizeof(peerZid)+sizeof(ownZid)+hashLength;
 
     if (myRole == Responder) {
@@ -2282,7 +2788,7 @@ void ZRtp::generateKeysMultiStream() {
         memcpy(KDFcontext, ownZid, sizeof(ownZid));
         memcpy(KDFcontext+sizeof(ownZid), peerZid, sizeof(peerZid));
     }
-    memcpy(KDFcontext+sizeof(ownZid)+sizeof(peerZid), messageHash, hashLength);
+    memcpy(KDFcontext+sizeof(ownZid)+sizeof(peerZid), handshake->messageHash, hashLength);
 
     KDF(zrtpSession, hashLength, (unsigned char*)zrtpMsk, strlen(zrtpMsk)+1, KDFcontext, kdfSize, hashLength*8, s0);
 
@@ -2291,6 +2797,32 @@ void ZRtp::generateKeysMultiStream() {
     computeSRTPKeys();
 }
 
+// Compute the Preshared mode s0
+void ZRtp::generateKeysPreshared() {
+
+    // allocate the maximum size, compute real size to use
+    uint8_t KDFcontext[sizeof(peerZid)+sizeof(ownZid)+sizeof(handshake->messageHash)];
+    int32_t kdfSize = sizeof(peerZid)+sizeof(ownZid)+hashLength;
+
+    if (myRole == Responder) {
+        memcpy(KDFcontext, peerZid, sizeof(peerZid));
+        memcpy(KDFcontext+sizeof(peerZid), ownZid, sizeof(ownZid));
+    }
+    else {
+        memcpy(KDFcontext, ownZid, sizeof(ownZid));
+        memcpy(KDFcontext+sizeof(ownZid), peerZid, sizeof(peerZid));
+    }
+    memcpy(KDFcontext+sizeof(ownZid)+sizeof(peerZid), handshake->messageHash, hashLength);
+
+    KDF(presharedKey, hashLength, (unsigned char*)zrtpPsk, strlen(zrtpPsk)+1, KDFcontext, kdfSize, hashLength*8, s0);
+
+    memset(KDFcontext, 0, sizeof(KDFcontext));
+    memset_volatile(presharedKey, 0, MAX_DIGEST_LENGTH);
+
+    computeSRTPKeys();
+    memset(s0, 0, MAX_DIGEST_LENGTH);
+}
+
 void ZRtp::computePBXSecret() {
 #ifdef ZRTP_SAS_RELAY_SUPPORT
     // Construct the KDF context as per ZRTP specification chap 7.3.1:
@@ -2317,7 +2849,7 @@ void ZRtp::computePBXSecret() {
 void ZRtp::computeSRTPKeys() {
 
     // allocate the maximum size, compute real size to use
-    uint8_t KDFcontext[sizeof(peerZid)+sizeof(ownZid)+sizeof(messageHash)];
+    uint8_t KDFcontext[sizeof(peerZid)+sizeof(ownZid)+sizeof(handshake->messageHash)];
     int32_t kdfSize = sizeof(peerZid)+sizeof(ownZid)+hashLength;
 
     int32_t keyLen = cipher->getKeylen() * 8;
@@ -2330,7 +2862,7 @@ void ZRtp::computeSRTPKeys() {
         memcpy(KDFcontext, ownZid, sizeof(ownZid));
         memcpy(KDFcontext+sizeof(ownZid), peerZid, sizeof(peerZid));
     }
-    memcpy(KDFcontext+sizeof(ownZid)+sizeof(peerZid), messageHash, hashLength);
+    memcpy(KDFcontext+sizeof(ownZid)+sizeof(peerZid), handshake->messageHash, hashLength);
 
     // Inititiator key and salt
     KDF(s0, hashLength, (unsigned char*)iniMasterKey, strlen(iniMasterKey)+1, KDFcontext, kdfSize, keyLen, srtpKeyI);
@@ -2450,7 +2982,7 @@ void ZRtp::setNegotiatedHash(AlgorithmEnum* hash) {
         hmacListFunction = hmac_sha256;
 
         createHashCtx = initializeSha256Context;
-        msgShaContext = &hashCtx.sha256Ctx;
+        msgShaContext = &handshake->hashCtx.sha256Ctx;
         closeHashCtx = finalizeSha256Context;
         hashCtxFunction = sha256Ctx;
         hashCtxListFunction = sha256Ctx;
@@ -2465,7 +2997,7 @@ void ZRtp::setNegotiatedHash(AlgorithmEnum* hash) {
         hmacListFunction = hmac_sha384;
 
         createHashCtx = initializeSha384Context;
-        msgShaContext = &hashCtx.sha384Ctx;
+        msgShaContext = &handshake->hashCtx.sha384Ctx;
         closeHashCtx = finalizeSha384Context;
         hashCtxFunction = sha384Ctx;
         hashCtxListFunction = sha384Ctx;
@@ -2480,7 +3012,7 @@ void ZRtp::setNegotiatedHash(AlgorithmEnum* hash) {
         hmacListFunction = macSkein256;
 
         createHashCtx = initializeSkein256Context;
-        msgShaContext = &hashCtx.skeinCtx;
+        msgShaContext = &handshake->hashCtx.skeinCtx;
         closeHashCtx = finalizeSkein256Context;
         hashCtxFunction = skein256Ctx;
         hashCtxListFunction = skein256Ctx;
@@ -2495,7 +3027,7 @@ void ZRtp::setNegotiatedHash(AlgorithmEnum* hash) {
         hmacListFunction = macSkein384;
 
         createHashCtx = initializeSkein384Context;
-        msgShaContext = &hashCtx.skeinCtx;
+        msgShaContext = &handshake->hashCtx.skeinCtx;
         closeHashCtx = finalizeSkein384Context;
         hashCtxFunction = skein384Ctx;
         hashCtxListFunction = skein384Ctx;
@@ -2531,8 +3063,10 @@ void ZRtp::setRs2Valid() {
 
     if (zidRec != NULL) {
         zidRec->setRs2Valid();
-        if (saveZidRecord)
+        if (saveZidRecord) {
+            ZrtpTraceScope cacheScope(handshakeTrace, PhaseCacheWrite);
             getZidCacheInstance()->saveRecord(zidRec);
+        }
     }
 }
 
@@ -2608,7 +3142,7 @@ void ZRtp::setClientId(std::string id, HelloPacketVersion* hpv) {
     // use the implicit hash function
     uint8_t hmac[IMPL_MAX_DIGEST_LENGTH];
     uint32_t macLen;
-    hmacFunctionImpl(H2, HASH_IMAGE_SIZE, (uint8_t*)hpv->packet->getHeaderBase(), len-(2*ZRTP_WORD_SIZE), hmac, &macLen);
+    hmacFunctionImpl(handshake->H2, HASH_IMAGE_SIZE, (uint8_t*)hpv->packet->getHeaderBase(), len-(2*ZRTP_WORD_SIZE), hmac, &macLen);
     hpv->packet->setHMAC(hmac);
 
     // calculate hash over the final Hello packet, refer to chap 9.1 how to
@@ -2618,20 +3152,20 @@ void ZRtp::setClientId(std::string id, HelloPacketVersion* hpv) {
 
 void ZRtp::storeMsgTemp(ZrtpPacketBase* pkt) {
     uint32_t length = pkt->getLength() * ZRTP_WORD_SIZE;
-    length = (length > sizeof(tempMsgBuffer)) ? sizeof(tempMsgBuffer) : length;
-    memset(tempMsgBuffer, 0, sizeof(tempMsgBuffer));
-    memcpy(tempMsgBuffer, (uint8_t*)pkt->getHeaderBase(), length);
-    lengthOfMsgData = length;
+    length = (length > sizeof(handshake->tempMsgBuffer)) ? sizeof(handshake->tempMsgBuffer) : length;
+    memset(handshake->tempMsgBuffer, 0, sizeof(handshake->tempMsgBuffer));
+    memcpy(handshake->tempMsgBuffer, (uint8_t*)pkt->getHeaderBase(), length);
+    handshake->lengthOfMsgData = length;
 }
 
 bool ZRtp::checkMsgHmac(uint8_t* key) {
     uint8_t hmac[IMPL_MAX_DIGEST_LENGTH];
     uint32_t macLen;
-    int32_t len = lengthOfMsgData-(HMAC_SIZE);  // compute HMAC, but exlude the stored HMAC :-)
+    int32_t len = handshake->lengthOfMsgData-(HMAC_SIZE);  // compute HMAC, but exlude the stored HMAC :-)
 
     // Use the implicit hash function
-    hmacFunctionImpl(key, HASH_IMAGE_SIZE, tempMsgBuffer, len, hmac, &macLen);
-    return (memcmp(hmac, tempMsgBuffer+len, (HMAC_SIZE)) == 0 ? true : false);
+    hmacFunctionImpl(key, HASH_IMAGE_SIZE, handshake->tempMsgBuffer, len, hmac, &macLen);
+    return (memcmp(hmac, handshake->tempMsgBuffer+len, (HMAC_SIZE)) == 0 ? true : false);
 }
 
 std::string ZRtp::getHelloHash(int32_t index) {
@@ -2643,7 +3177,15 @@ std::string ZRtp::getHelloHash(int32_t index) {
     uint8_t* hp = helloPackets[index].helloHash;
 
     char version[5] = {'\0'};
-    strncpy(version, (const char*)helloPackets[index].packet->getVersion(), ZRTP_WORD_SIZE);
+    if (helloPackets[index].packet != NULL) {
+        strncpy(version, (const char*)helloPackets[index].packet->getVersion(), ZRTP_WORD_SIZE);
+    }
+    else {      // handshake data released, rebuild the version string, for example "1.10"
+        version[0] = '0' + helloPackets[index].version / 10;
+        version[1] = '.';
+        version[2] = '0' + helloPackets[index].version % 10;
+        version[3] = '0';
+    }
 
     stm << version;
     stm << " ";
@@ -2698,6 +3240,9 @@ void ZRtp::setMultiStrParams(std::string parameters, ZRtp *zrtpMaster) {
 
     char tmp[MAX_DIGEST_LENGTH + 1 + 1 + 1]; // max. hash length + cipher + authLength + hash
 
+    if (handshake == NULL)
+        return;
+
     // First get negotiated hash from parameters, set algorithms and length
     int i = parameters.at(0) & 0xff;
     hash = &zrtpHashes.getByOrdinal(i);
@@ -2727,6 +3272,10 @@ bool ZRtp::isMultiStreamAvailable() {
     return multiStreamAvailable;
 }
 
+bool ZRtp::isPresharedMode() {
+    return presharedMode;
+}
+
 void ZRtp::acceptEnrollment(bool accepted) {
 #ifdef ZRTP_SAS_RELAY_SUPPORT
     if (!accepted) {
@@ -2747,10 +3296,10 @@ void ZRtp::acceptEnrollment(bool accepted) {
 }
 
 bool ZRtp::setSignatureData(uint8_t* data, int32_t length) {
-    if ((length % 4) != 0)
+    if ((length % 4) != 0 || handshake == NULL)
         return false;
 
-    ZrtpPacketConfirm* cfrm = (myRole == Responder) ? &zrtpConfirm1 : &zrtpConfirm2;
+    ZrtpPacketConfirm* cfrm = (myRole == Responder) ? &handshake->zrtpConfirm1 : &handshake->zrtpConfirm2;
     cfrm->setSignatureLength(length / 4);
     return cfrm->setSignatureData(data, length);
 }
@@ -2775,12 +3324,47 @@ void ZRtp::conf2AckSecure() {
     }
 }
 
+void ZRtp::releaseHandshakeData() {
+    if (handshake == NULL)
+        return;
+
+    // msgShaContext may point into the handshake data
+    if (msgShaContext != NULL) {
+        closeHashCtx(msgShaContext, NULL);
+        msgShaContext = NULL;
+    }
+    for (int32_t i = 0; i < MAX_ZRTP_VERSIONS + 1; i++) {
+        helloPackets[i].packet = NULL;
+    }
+    currentHelloPacket = NULL;
+
+    // The packets contain public or encrypted data only, wipe the hash chain and the
+    // state of the message hash
+    memset_volatile(handshake->H0, 0, sizeof(handshake->H0));
+    memset_volatile(handshake->H1, 0, sizeof(handshake->H1));
+    memset_volatile(handshake->H2, 0, sizeof(handshake->H2));
+    memset_volatile(handshake->messageHash, 0, sizeof(handshake->messageHash));
+    memset_volatile(&handshake->hashCtx, 0, sizeof(handshake->hashCtx));
+    memset_volatile(handshake->tempMsgBuffer, 0, sizeof(handshake->tempMsgBuffer));
+    delete handshake;
+    handshake = NULL;
+
+    // The new retained secret is in the ZID record already, GoClear and SAS relay
+    // use the HMAC and ZRTP keys only
+    memset_volatile(newRs1, 0, MAX_DIGEST_LENGTH);
+}
+
 int32_t ZRtp::compareCommit(ZrtpPacketCommit *commit) {
-    // TODO: enhance to compare according to rules defined in chapter 4.2,
-    // but we don't support Preshared.
+    // Compare according to rules defined in chapter 4.2: a DH Commit
+    // wins over a Preshared Commit, otherwise compare the hvi or the
+    // nonce of Multi-Stream and Preshared Commits.
+    bool peerPreshared = isPresharedCommit(commit);
+    if (!multiStream && presharedMode != peerPreshared) {
+        return presharedMode ? -1 : 1;
+    }
     int32_t len = 0;
-    len = !multiStream ? HVI_SIZE : (4 * ZRTP_WORD_SIZE);
-    return (memcmp(hvi, commit->getHvi(), len));
+    len = (!multiStream && !presharedMode) ? HVI_SIZE : (4 * ZRTP_WORD_SIZE);
+    return (memcmp(handshake->hvi, commit->getHvi(), len));
 }
 
 bool ZRtp::isEnrollmentMode() {
@@ -2904,21 +3488,11 @@ uint8_t* ZRtp::getExportedKey(int32_t *length) {
 }
 
 bool ZRtp::checkAndSetNonce(uint8_t* nonce) {
-    // This is for backward compatibility if an applications uses the old
-    // get- and setMultiStrParams functions
-    if (masterStream == NULL)
-        return true;
-
-    for (std::vector<std::string>::iterator it = masterStream->peerNonces.begin() ; it != masterStream->peerNonces.end(); ++it) {
-        if (memcmp((*it).data(), nonce, ZRTP_WORD_SIZE * 4) == 0) {
-            return false;
-        }
-    }
-    // the string holds the binary nonce
-    std::string str("");
-    str.assign((char *)nonce, ZRTP_WORD_SIZE * 4);
-    masterStream->peerNonces.push_back(str);
-    return true;
+    // The master stream owns the nonce set of the session, it records the nonce
+    // of a Preshared Commit there too. A multi-stream stream set up with the old
+    // get- and setMultiStrParams functions has no master, it uses its own set.
+    ZRtp* owner = (masterStream != NULL) ? masterStream : this;
+    return owner->peerNonces.insert(nonce);
 }
 
 /** EMACS **
@@ -340,6 +340,31 @@ int32_t zrtp_getCurrentProtocolVersion(ZrtpContext* zrtpContext) {
         return zrtpContext->zrtpEngine->getCurrentProtocolVersion();
     return -1;
 }
+
+int32_t zrtp_getHandshakeTrace(ZrtpContext* zrtpContext, zrtp_TraceEntry* entries, int32_t maxEntries) {
+    ZrtpTraceEntry trace[ZRTP_TRACE_ENTRIES];
+
+    if (entries == NULL || !zrtpContext || !zrtpContext->zrtpEngine)
+        return 0;
+
+    int32_t number = zrtpContext->zrtpEngine->getHandshakeTrace(trace, maxEntries < ZRTP_TRACE_ENTRIES ? maxEntries : ZRTP_TRACE_ENTRIES);
+    for (int32_t i = 0; i < number; i++) {
+        entries[i].timeUs = trace[i].timeUs;
+        entries[i].durationUs = trace[i].durationUs;
+        entries[i].event = trace[i].event;
+        entries[i].code = trace[i].code;
+        entries[i].counter = trace[i].counter;
+    }
+    return number;
+}
+
+void zrtp_getHandshakeHistogram(zrtp_PhaseHistogram* histogram) {
+    static_assert(ZRTP_C_TRACE_PHASES == numberOfTracePhases && ZRTP_C_TRACE_BUCKETS == ZRTP_TRACE_BUCKETS,
+                  "ZrtpCWrapper.h and ZrtpHandshakeTrace.h are out of synch");
+
+    if (histogram != NULL)
+        ZRtp::getHandshakeHistogram(reinterpret_cast<ZrtpPhaseHistogram*>(histogram));
+}
 /*
  * The following methods wrap the ZRTP Configure functions
  */
@@ -508,3 +533,16 @@ int32_t zrtp_isSasSignature(ZrtpContext* zrtpContext)
         return zrtpContext->configure->isSasSignature() ? 1 : 0;
     return 0;       /* standard setting: sasSignature is false, thus if zrtp not initialized it's always false */
 }
+
+void zrtp_setCompactSecureState(ZrtpContext* zrtpContext, int32_t yesNo)
+{
+    if (zrtpContext && zrtpContext->configure)
+        zrtpContext->configure->setCompactSecureState(yesNo ? true : false);
+}
+
+int32_t zrtp_isCompactSecureState(ZrtpContext* zrtpContext)
+{
+    if (zrtpContext && zrtpContext->configure)
+        return zrtpContext->configure->isCompactSecureState() ? 1 : 0;
+    return 0;
+}
@@ -193,6 +193,7 @@ PubKeyEnum::PubKeyEnum() : EnumBase(PubKeyAlgorithm) {
     insert(dh3k, 0, "DH-3072", NULL, NULL, None);
     insert(ec38, 0, "NIST ECDH-384", NULL, NULL, None);
     insert(mult, 0, "Multi-stream",  NULL, NULL, None);
+    insert(prsh, 0, "Preshared",  NULL, NULL, None);
 #ifdef SUPPORT_NON_NIST
     insert(e255, 0, "ECDH-255", NULL, NULL, None);
     insert(e414, 0, "ECDH-414", NULL, NULL, None);
@@ -237,7 +238,7 @@ AuthLengthEnum zrtpAuthLengths;
  * The public methods are mainly a facade to the private methods.
  */
 ZrtpConfigure::ZrtpConfigure(): enableTrustedMitM(false), enableSasSignature(false), enableParanoidMode(false),
-selectionPolicy(Standard){}
+enableCompactSecureState(false), selectionPolicy(Standard), preSharedPolicy(PreSharedNever) {}
 
 ZrtpConfigure::~ZrtpConfigure() {}
 
@@ -257,6 +258,8 @@ void ZrtpConfigure::setStandardConfig() {
     addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(ec38));
     addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(dh2k));
     addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(mult));
+    if (preSharedPolicy != PreSharedNever)
+        addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(prsh));
 
     addAlgo(SasType, zrtpSasTypes.getByName(b32));
 
@@ -275,6 +278,8 @@ void ZrtpConfigure::setMandatoryOnly() {
 
     addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(dh3k));
     addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(mult));
+    if (preSharedPolicy != PreSharedNever)
+        addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(prsh));
 
     addAlgo(SasType, zrtpSasTypes.getByName(b32));
 
@@ -498,6 +503,22 @@ bool ZrtpConfigure::isDisclosureFlag() {
     return enableDisclosureFlag;
 }
 
+void ZrtpConfigure::setCompactSecureState(bool yesNo) {
+    enableCompactSecureState = yesNo;
+}
+
+bool ZrtpConfigure::isCompactSecureState() {
+    return enableCompactSecureState;
+}
+
+void ZrtpConfigure::setPreSharedPolicy(PreSharedPolicy pol) {
+    preSharedPolicy = pol;
+    if (pol != PreSharedNever)
+        addAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(prsh));
+    else
+        removeAlgo(PubKeyAlgorithm, zrtpPubKeys.getByName(prsh));
+}
+
 #if 0
 ZrtpConfigure config;
 
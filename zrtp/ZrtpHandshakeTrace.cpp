@@ -0,0 +1,127 @@
+/*
+  Copyright (C) 2006-2013 Werner Dittmann
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+#include <libzrtpcpp/ZrtpHandshakeTrace.h>
+
+// The aggregate histogram of all sessions. Sessions of different streams may
+// run in different threads, relaxed atomics are sufficient for counters.
+static std::atomic<uint32_t> phaseCounts[numberOfTracePhases][ZRTP_TRACE_BUCKETS];
+static std::atomic<uint64_t> phaseSums[numberOfTracePhases];
+
+static void recordPhase(int32_t phase, uint32_t durationUs) {
+    int32_t bucket = 0;
+    while (bucket < ZRTP_TRACE_BUCKETS - 1 && (durationUs >> bucket) != 0)
+        bucket++;
+    phaseCounts[phase][bucket].fetch_add(1, std::memory_order_relaxed);
+    phaseSums[phase].fetch_add(durationUs, std::memory_order_relaxed);
+}
+
+ZrtpHandshakeTrace::ZrtpHandshakeTrace() {
+    reset();
+}
+
+void ZrtpHandshakeTrace::reset() {
+    memset(ring, 0, sizeof(ring));
+    total = 0;
+    startUs = now();
+    stateStartUs = startUs;
+    currentState = -1;
+    inPrepare = false;
+}
+
+uint64_t ZrtpHandshakeTrace::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ZrtpHandshakeTrace::add(uint8_t event, uint8_t code, uint32_t durationUs, uint16_t counter, uint64_t nowUs) {
+    ZrtpTraceEntry* entry = &ring[total % ZRTP_TRACE_ENTRIES];
+    entry->timeUs = (uint32_t)(nowUs - startUs);
+    entry->durationUs = durationUs;
+    entry->event = event;
+    entry->code = code;
+    entry->counter = counter;
+    total++;
+}
+
+void ZrtpHandshakeTrace::stateChange(int32_t newState, bool secure) {
+    uint64_t nowUs = now();
+    uint32_t duration = (uint32_t)(nowUs - stateStartUs);
+
+    // Record the time spent in the state we leave
+    if (currentState >= 0 && currentState < ZRTP_TRACE_MAX_STATES)
+        recordPhase(PhaseStateBase + currentState, duration);
+    add(TraceStateChange, (uint8_t)newState, duration, 0, nowUs);
+    stateStartUs = nowUs;
+    currentState = newState;
+
+    if (secure) {
+        uint32_t handshake = (uint32_t)(nowUs - startUs);
+        add(TracePhase, PhaseHandshake, handshake, 0, nowUs);
+        recordPhase(PhaseHandshake, handshake);
+    }
+}
+
+void ZrtpHandshakeTrace::timeout(int32_t timer, int32_t counter) {
+    add(TraceTimeout, (uint8_t)timer, 0, (uint16_t)counter, now());
+}
+
+void ZrtpHandshakeTrace::phaseEnd(int32_t phase, uint64_t startTime) {
+    uint64_t nowUs = now();
+    uint32_t duration = (uint32_t)(nowUs - startTime);
+
+    add(TracePhase, (uint8_t)phase, duration, 0, nowUs);
+    recordPhase(phase, duration);
+}
+
+int32_t ZrtpHandshakeTrace::getEntries(ZrtpTraceEntry* entries, int32_t maxEntries) const {
+    uint32_t available = (total < ZRTP_TRACE_ENTRIES) ? total : ZRTP_TRACE_ENTRIES;
+    if (maxEntries < 0)
+        return 0;
+    if ((uint32_t)maxEntries < available)
+        available = maxEntries;
+
+    // Copy the newest entries, oldest first
+    uint32_t first = total - available;
+    for (uint32_t i = 0; i < available; i++)
+        entries[i] = ring[(first + i) % ZRTP_TRACE_ENTRIES];
+    return available;
+}
+
+void ZrtpHandshakeTrace::getPhaseHistogram(ZrtpPhaseHistogram* histogram) {
+    for (int32_t p = 0; p < numberOfTracePhases; p++) {
+        for (int32_t b = 0; b < ZRTP_TRACE_BUCKETS; b++)
+            histogram->counts[p][b] = phaseCounts[p][b].load(std::memory_order_relaxed);
+        histogram->sumUs[p] = phaseSums[p].load(std::memory_order_relaxed);
+    }
+}
+
+void ZrtpHandshakeTrace::resetPhaseHistogram() {
+    for (int32_t p = 0; p < numberOfTracePhases; p++) {
+        for (int32_t b = 0; b < ZRTP_TRACE_BUCKETS; b++)
+            phaseCounts[p][b].store(0, std::memory_order_relaxed);
+        phaseSums[p].store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,119 @@
+/*
+  Copyright (C) 2006-2013 Werner Dittmann
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @author Werner Dittmann <Werner.Dittmann@t-online.de>
+ */
+
+#include <string.h>
+#include <new>
+
+#include <crypto/zrtpDH.h>
+#include <libzrtpcpp/ZrtpNonceSet.h>
+
+ZrtpNonceSet::ZrtpNonceSet(): slots(NULL), capacity(0), count(0) {
+    seed[0] = seed[1] = 0;
+}
+
+ZrtpNonceSet::~ZrtpNonceSet() {
+    delete[] slots;
+}
+
+uint32_t ZrtpNonceSet::hash(const uint8_t* nonce) const {
+    uint64_t a, b;
+
+    memcpy(&a, nonce, sizeof(a));
+    memcpy(&b, nonce + sizeof(a), sizeof(b));
+
+    uint64_t h = (a ^ seed[0]) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+    h = (h ^ b ^ seed[1]) * 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+    return (uint32_t)h;
+}
+
+ZrtpNonceSet::Slot* ZrtpNonceSet::find(Slot* table, uint32_t tableSize, const uint8_t* nonce, bool* found) const {
+    uint32_t mask = tableSize - 1;
+
+    for (uint32_t i = hash(nonce) & mask; ; i = (i + 1) & mask) {
+        Slot* slot = &table[i];
+        if (!slot->used) {
+            *found = false;
+            return slot;
+        }
+        if (memcmp(slot->nonce, nonce, ZRTP_NONCE_SIZE) == 0) {
+            *found = true;
+            return slot;
+        }
+    }
+}
+
+bool ZrtpNonceSet::grow() {
+    uint32_t newCapacity = (capacity == 0) ? ZRTP_NONCE_SET_INITIAL : capacity * 2;
+
+    Slot* newSlots = new(std::nothrow) Slot[newCapacity];
+    if (newSlots == NULL)
+        return false;
+    memset(newSlots, 0, newCapacity * sizeof(Slot));
+
+    if (slots == NULL)
+        randomZRTP((uint8_t*)seed, sizeof(seed));
+
+    bool found;
+    for (uint32_t i = 0; i < capacity; i++) {
+        if (!slots[i].used)
+            continue;
+        Slot* slot = find(newSlots, newCapacity, slots[i].nonce, &found);
+        *slot = slots[i];
+    }
+    delete[] slots;
+    slots = newSlots;
+    capacity = newCapacity;
+    return true;
+}
+
+bool ZrtpNonceSet::insert(const uint8_t* nonce) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Keep the load factor at 1/2 or below, probe sequences stay short
+    if ((count + 1) * 2 > capacity && !grow())
+        return false;
+
+    bool found;
+    Slot* slot = find(slots, capacity, nonce, &found);
+    if (found)
+        return false;
+
+    memcpy(slot->nonce, nonce, ZRTP_NONCE_SIZE);
+    slot->used = true;
+    count++;
+    return true;
+}
+
+uint32_t ZrtpNonceSet::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+void ZrtpNonceSet::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+
+    delete[] slots;
+    slots = NULL;
+    capacity = 0;
+    count = 0;
+}
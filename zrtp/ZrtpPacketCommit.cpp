@@ -34,9 +34,12 @@ ZrtpPacketCommit::ZrtpPacketCommit() {
 
 void ZrtpPacketCommit::setNonce(uint8_t* text) {
     memcpy(commitHeader->hvi, text, sizeof(data.commit.hvi)-4*ZRTP_WORD_SIZE);
-    uint16_t len = getLength();
-    len -= 4;
-    setLength(len);
+    setLength(COMMIT_MULTI);
+}
+
+void ZrtpPacketCommit::setKeyId(uint8_t* text) {
+    memcpy(commitHeader->hvi+4*ZRTP_WORD_SIZE, text, 2*ZRTP_WORD_SIZE);
+    setLength(COMMIT_PRSH);
 }
 
 ZrtpPacketCommit::ZrtpPacketCommit(uint8_t *data) {
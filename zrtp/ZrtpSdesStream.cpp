@@ -141,10 +141,10 @@ static suiteParam knownSuites[] = {
     {(ZrtpSdesStream::sdesSuites)0, NULL, 0, 0, 0, 0, 0, 0, 0, 0}
 };
 
-ZrtpSdesStream::ZrtpSdesStream(const sdesSuites s) :
+ZrtpSdesStream::ZrtpSdesStream(const sdesSuites s, int32_t replayWindow) :
     state(STREAM_INITALIZED), suite(s), recvSrtp(NULL), recvSrtcp(NULL), sendSrtp(NULL),
     sendSrtcp(NULL), srtcpIndex(0), recvZrtpTunnel(0), sendZrtpTunnel(0), cryptoMixHashLength(0), 
-    cryptoMixHashType(MIX_NONE)  {
+    cryptoMixHashType(MIX_NONE), replayWindowSize(replayWindow > 0 ? replayWindow : REPLAY_WINDOW_SIZE)  {
 }
 
 ZrtpSdesStream::~ZrtpSdesStream() {
@@ -257,6 +257,24 @@ int ZrtpSdesStream::incomingRtp(uint8_t *packet, size_t length, size_t *newLengt
     return rc;
 }
 
+bool ZrtpSdesStream::outgoingDoubleRtp(CryptoContext* outer, uint8_t *packet, size_t length, size_t *newLength) {
+
+    if (state != SDES_SRTP_ACTIVE || sendSrtp == NULL) {
+        return SrtpHandler::protect(outer, packet, length, newLength);
+    }
+    return SrtpHandler::protectDouble(sendSrtp, outer, packet, length, newLength);
+}
+
+int ZrtpSdesStream::incomingDoubleRtp(CryptoContext* outer, uint8_t *packet, size_t length, size_t *newLength,
+                                      bool* outerValid, SrtpErrorData* errorData) {
+
+    if (state != SDES_SRTP_ACTIVE || recvSrtp == NULL) {
+        int32_t rc = SrtpHandler::unprotect(outer, packet, length, newLength, errorData);
+        *outerValid = (rc == 1);
+        return rc;
+    }
+    return SrtpHandler::unprotectDouble(recvSrtp, outer, packet, length, newLength, outerValid, errorData);
+}
 
 bool ZrtpSdesStream::outgoingZrtpTunnel(uint8_t *packet, size_t length, size_t *newLength) {
 
@@ -596,7 +614,8 @@ void ZrtpSdesStream::createSrtpContexts(bool sipInvite) {
                                  remoteKeyLenBytes,           // encryption keylen
                                  remoteAuthKeyLen,            // authentication key len (HMAC key lenght)
                                  remoteSaltLenBytes,          // session salt len
-                                 remoteTagLength);            // authentication tag len
+                                 remoteTagLength,             // authentication tag len
+                                 replayWindowSize);           // replay window size
     recvSrtp->deriveSrtpKeys(0L);
 
     recvZrtpTunnel = new CryptoContext(0,                     // SSRC (used for lookup)
@@ -611,7 +630,8 @@ void ZrtpSdesStream::createSrtpContexts(bool sipInvite) {
                                  remoteKeyLenBytes,           // encryption keylen
                                  remoteAuthKeyLen,            // authentication key len (HMAC key lenght)
                                  remoteSaltLenBytes,          // session salt len
-                                 ZRTP_TUNNEL_AUTH_LEN);       // authentication tag len
+                                 ZRTP_TUNNEL_AUTH_LEN,        // authentication tag len
+                                 replayWindowSize);           // replay window size
 
     recvZrtpTunnel->setLabelbase(ZRTP_TUNNEL_LABEL);
     recvZrtpTunnel->deriveSrtpKeys(0L);
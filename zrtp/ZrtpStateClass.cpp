@@ -47,7 +47,7 @@ state_t states[numberOfStates] = {
 
 
 ZrtpStateClass::ZrtpStateClass(ZRtp *p) : parent(p), commitPkt(NULL), t1Resend(20), t1ResendExtend(60), t2Resend(10),
-                                          multiStream(false), secSubstate(Normal), sentVersion(0) {
+                                          multiStream(false), presharedRetry(false), secSubstate(Normal), sentVersion(0) {
 
     engine = new ZrtpStates(states, numberOfStates, Initial);
     memset(retryCounters, 0, sizeof(retryCounters));
@@ -481,7 +481,7 @@ void ZrtpStateClass::evAckSent(void) {
             cancelTimer();
             ZrtpPacketCommit cpkt(pkt);
 
-            if (!multiStream) {
+            if (!multiStream && !parent->isPresharedCommit(&cpkt)) {
                 ZrtpPacketDHPart* dhPart1 = parent->prepareDHPart1(&cpkt, &errorCode);
 
                 // Something went wrong during processing of the Commit packet
@@ -496,7 +496,8 @@ void ZrtpStateClass::evAckSent(void) {
                 nextState(WaitDHPart2);
             }
             else {
-                ZrtpPacketConfirm* confirm = parent->prepareConfirm1MultiStream(&cpkt, &errorCode);
+                ZrtpPacketConfirm* confirm = multiStream ? parent->prepareConfirm1MultiStream(&cpkt, &errorCode) :
+                                                           parent->prepareConfirm1Preshared(&cpkt, &errorCode);
 
                 // Something went wrong during processing of the Commit packet
                 if (confirm == NULL) {
@@ -700,7 +701,7 @@ void ZrtpStateClass::evWaitCommit(void) {
         if (first == 'c' && last == ' ') {
             ZrtpPacketCommit cpkt(pkt);
 
-            if (!multiStream) {
+            if (!multiStream && !parent->isPresharedCommit(&cpkt)) {
                 ZrtpPacketDHPart* dhPart1 = parent->prepareDHPart1(&cpkt, &errorCode);
 
                 // Something went wrong during processing of the Commit packet
@@ -714,7 +715,8 @@ void ZrtpStateClass::evWaitCommit(void) {
                 nextState(WaitDHPart2);
             }
             else {
-                ZrtpPacketConfirm* confirm = parent->prepareConfirm1MultiStream(&cpkt, &errorCode);
+                ZrtpPacketConfirm* confirm = multiStream ? parent->prepareConfirm1MultiStream(&cpkt, &errorCode) :
+                                                           parent->prepareConfirm1Preshared(&cpkt, &errorCode);
 
                 // Something went wrong during processing of the Commit packet
                 if (confirm == NULL) {
@@ -809,7 +811,9 @@ void ZrtpStateClass::evCommitSent(void) {
             }
             cancelTimer();         // this cancels the Commit timer T2
 
-            if (!zpCo.isLengthOk(multiStream ? ZrtpPacketCommit::MultiStream : ZrtpPacketCommit::DhExchange)) {
+            ZrtpPacketCommit::commitType type = multiStream ? ZrtpPacketCommit::MultiStream :
+                (parent->isPresharedCommit(&zpCo) ? ZrtpPacketCommit::Preshared : ZrtpPacketCommit::DhExchange);
+            if (!zpCo.isLengthOk(type)) {
                 sendErrorPacket(CriticalSWError);
                 return;
             }
@@ -819,7 +823,7 @@ void ZrtpStateClass::evCommitSent(void) {
             // necessary
             //
             if (parent->compareCommit(&zpCo) < 0) {
-                if (!multiStream) {
+                if (!multiStream && !parent->isPresharedCommit(&zpCo)) {
                     ZrtpPacketDHPart* dhPart1 = parent->prepareDHPart1(&zpCo, &errorCode);
 
                     // Something went wrong during processing of the Commit packet
@@ -833,7 +837,8 @@ void ZrtpStateClass::evCommitSent(void) {
                     sentPacket = static_cast<ZrtpPacketBase *>(dhPart1);
                 }
                 else {
-                    ZrtpPacketConfirm* confirm = parent->prepareConfirm1MultiStream(&zpCo, &errorCode);
+                    ZrtpPacketConfirm* confirm = multiStream ? parent->prepareConfirm1MultiStream(&zpCo, &errorCode) :
+                                                               parent->prepareConfirm1Preshared(&zpCo, &errorCode);
 
                     // Something went wrong during processing of the Commit packet
                     if (confirm == NULL) {
@@ -899,15 +904,16 @@ void ZrtpStateClass::evCommitSent(void) {
         }
 
         /*
-         * Confirm1 and multi-stream mode
+         * Confirm1 and multi-stream or Preshared mode
          * - switch off resending commit
          * - prepare Confirm2
          */
-        if (multiStream && (first == 'c' && last == '1')) {
+        if ((multiStream || parent->isPresharedMode()) && (first == 'c' && last == '1')) {
             cancelTimer();
             ZrtpPacketConfirm cpkt(pkt);
 
-            ZrtpPacketConfirm* confirm = parent->prepareConfirm2MultiStream(&cpkt, &errorCode);
+            ZrtpPacketConfirm* confirm = multiStream ? parent->prepareConfirm2MultiStream(&cpkt, &errorCode) :
+                                                       parent->prepareConfirm2Preshared(&cpkt, &errorCode);
 
             // Something went wrong during processing of the Confirm1 packet
             if (confirm == NULL) {
@@ -935,6 +941,31 @@ void ZrtpStateClass::evCommitSent(void) {
             }
         }
     }
+    /*
+     * Error NoSharedSecret in Preshared mode:
+     * - the Responder has no retained secret that matches our Preshared Commit,
+     *   ErrorAck was sent already
+     * - prepare and send a DH Commit, restart timer, stay in CommitSent
+     * - a repeated Error (lost ErrorAck) just resends the DH Commit
+     */
+    else if (event->type == ErrorPkt && (parent->isPresharedMode() || parent->presharedRejected) &&
+             ZrtpPacketError(event->packet).getErrorCode() == NoSharedSecret) {
+        if (parent->isPresharedMode()) {
+            ZrtpPacketCommit* commit = parent->prepareCommitFallback(&errorCode);
+            if (commit == NULL) {
+                sendErrorPacket(errorCode);
+                return;
+            }
+            sentPacket = static_cast<ZrtpPacketBase *>(commit);
+        }
+        if (!parent->sendPacketZRTP(sentPacket)) {
+            sendFailed();       // returns to state Initial
+            return;
+        }
+        if (startTimer(&T2) <= 0) {
+            timerFailed(SevereNoTimer);       // returns to state Initial
+        }
+    }
     // Timer event triggered, resend the Commit packet
     else if (event->type == Timer) {
         if (!parent->sendPacketZRTP(sentPacket)) {
@@ -1163,7 +1194,7 @@ void ZrtpStateClass::evWaitConfirm2(void) {
          * - resend Confirm1 packet
          * - stay in state
          */
-        if ((first == 'd' && secondLast == '2') || (multiStream && (first == 'c' && last == ' '))) {
+        if ((first == 'd' && secondLast == '2') || ((multiStream || parent->isPresharedMode()) && (first == 'c' && last == ' '))) {
             if (!parent->sendPacketZRTP(sentPacket)) {
                 sendFailed();             // returns to state Initial
             }
@@ -1197,6 +1228,9 @@ void ZrtpStateClass::evWaitConfirm2(void) {
             }
             nextState(SecureState);
             parent->sendInfo(Info, InfoSecureStateOn);
+            // sentPacket is the Conf2Ack, it does not belong to the handshake data
+            if (parent->compactSecureState)
+                parent->releaseHandshakeData();
         }
     }
     else {  // unknown Event type for this state (covers Error and ZrtpClose)
@@ -1256,6 +1290,8 @@ void ZrtpStateClass::evWaitConfAck(void) {
             nextState(SecureState);
             // TODO: call parent to clear signature data at initiator
             parent->sendInfo(Info, InfoSecureStateOn);
+            if (parent->compactSecureState)
+                parent->releaseHandshakeData();
         }
     }
     else if (event->type == Timer) {
@@ -1370,6 +1406,13 @@ void ZrtpStateClass::evWaitErrorAck(void) {
         if (first == 'e' && last =='k') {
             cancelTimer();
             sentPacket = NULL;
+            // We rejected a Preshared Commit, wait for the Initiator's DH Commit
+            if (presharedRetry) {
+                presharedRetry = false;
+                sentPacket = static_cast<ZrtpPacketBase *>(parent->prepareHelloAck());
+                nextState(WaitCommit);
+                return;
+            }
             nextState(Initial);
         }
     }
@@ -1521,18 +1564,26 @@ int32_t ZrtpStateClass::nextTimer(zrtpTimer_t *t) {
     t->time = (t->time > t->capping)? t->capping : t->time;
     if (t->maxResend > 0) {
         t->counter++;
-        if (t->counter > t->maxResend) {
-            return -1;
-        }
     }
-    return parent->activateTimer(t->time);
+    if (t->maxResend > 0 && t->counter > t->maxResend) {
+        return -1;
+    }
+    int32_t rc = parent->activateTimer(t->time);
+    // Trace the retransmit timeout only if the timer runs again
+    if (rc > 0)
+        parent->handshakeTrace.timeout((t == &T1) ? 1 : 2, t->counter);
+    return rc;
 }
 
 void ZrtpStateClass::sendErrorPacket(uint32_t errorCode) {
     cancelTimer();
 
     ZrtpPacketError* err = parent->prepareError(errorCode);
-    parent->zrtpNegotiationFailed(ZrtpError, errorCode);
+
+    // NoSharedSecret rejects a Preshared Commit only, the Initiator falls back to DH mode.
+    presharedRetry = (errorCode == NoSharedSecret);
+    if (!presharedRetry)
+        parent->zrtpNegotiationFailed(ZrtpError, errorCode);
 
     sentPacket =  static_cast<ZrtpPacketBase *>(err);
     nextState(WaitErrorAck);
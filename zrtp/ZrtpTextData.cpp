@@ -65,6 +65,7 @@ char zrtpSessionKey[] = "ZRTP Session Key";
 char zrtpExportedKey[] = "Exported key";
 
 char zrtpMsk[] = "ZRTP MSK";
+char zrtpPsk[] = "ZRTP PSK";
 char zrtpTrustedMitm[] = "Trusted MiTM key";
 
 char s256[] = "S256";
@@ -88,6 +89,7 @@ char ec38[] = "EC38";
 char e255[] = "E255";
 char e414[] = "E414";
 char mult[] = "Mult";
+char prsh[] = "Prsh";
 const char* mandatoryPubKey = dh3k;
 
 char b32[] =  "B32 ";
@@ -183,6 +183,75 @@ const uint_32t k256[64] =
     0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
 };
 
+/* x86 CPUs with the SHA extensions compute the SHA256 rounds */
+/* in hardware. The CPU is checked at run time, define       */
+/* SHA2_NO_SHANI to always use the C code.                   */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SHA2_NO_SHANI)
+#define SHA256_SHANI
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+static int sha256_have_shani(void)
+{   static int have_shani = -1;
+    unsigned int a, b, c, d;
+
+    if(have_shani < 0)
+        have_shani = __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29)) &&
+                     __get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_1) && (c & bit_SSSE3);
+    return have_shani;
+}
+
+/* The state is kept as ABEF and CDGH in two registers, each */
+/* sha256rnds2 does two rounds, sha256msg1/2 extend the      */
+/* message schedule four words at a time                     */
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_compile_shani(sha256_ctx ctx[1])
+{   __m128i s0, s1, t, abef, cdgh, msg, w0, w1, w2, w3;
+    int i;
+
+    t  = _mm_loadu_si128((const __m128i*)&ctx->hash[0]);   /* DCBA */
+    s1 = _mm_loadu_si128((const __m128i*)&ctx->hash[4]);   /* HGFE */
+    t  = _mm_shuffle_epi32(t, 0xb1);                        /* CDAB */
+    s1 = _mm_shuffle_epi32(s1, 0x1b);                       /* EFGH */
+    s0 = _mm_alignr_epi8(t, s1, 8);                         /* ABEF */
+    s1 = _mm_blend_epi16(s1, t, 0xf0);                      /* CDGH */
+    abef = s0; cdgh = s1;
+
+    w0 = _mm_loadu_si128((const __m128i*)&ctx->wbuf[0]);
+    w1 = _mm_loadu_si128((const __m128i*)&ctx->wbuf[4]);
+    w2 = _mm_loadu_si128((const __m128i*)&ctx->wbuf[8]);
+    w3 = _mm_loadu_si128((const __m128i*)&ctx->wbuf[12]);
+
+    for(i = 0; i < 16; ++i)
+    {
+        msg = _mm_add_epi32(w0, _mm_loadu_si128((const __m128i*)&k256[4 * i]));
+        s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+        s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e));
+
+        t = w0; w0 = w1; w1 = w2; w2 = w3;
+        if(i < 12)  /* next four words of the message schedule */
+        {
+            t  = _mm_add_epi32(_mm_sha256msg1_epu32(t, w0), _mm_alignr_epi8(w2, w1, 4));
+            w3 = _mm_sha256msg2_epu32(t, w2);
+        }
+    }
+
+    s0 = _mm_add_epi32(s0, abef);
+    s1 = _mm_add_epi32(s1, cdgh);
+
+    t  = _mm_shuffle_epi32(s0, 0x1b);                       /* FEBA */
+    s1 = _mm_shuffle_epi32(s1, 0xb1);                       /* DCHG */
+    s0 = _mm_blend_epi16(t, s1, 0xf0);                      /* DCBA */
+    s1 = _mm_alignr_epi8(s1, t, 8);                         /* HGFE */
+
+    _mm_storeu_si128((__m128i*)&ctx->hash[0], s0);
+    _mm_storeu_si128((__m128i*)&ctx->hash[4], s1);
+}
+#endif
+
 /* Compile 64 bytes of hash data into SHA256 digest value   */
 /* NOTE: this routine assumes that the byte order in the    */
 /* ctx->wbuf[] at this point is such that low address bytes */
@@ -191,6 +260,13 @@ const uint_32t k256[64] =
 
 VOID_RETURN sha256_compile(sha256_ctx ctx[1])
 {
+#if defined(SHA256_SHANI)
+    if(sha256_have_shani())
+    {
+        sha256_compile_shani(ctx);
+        return;
+    }
+#endif
 #if !defined(UNROLL_SHA2)
 
     uint_32t j, *p = ctx->wbuf, v[8];
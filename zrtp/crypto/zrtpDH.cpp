@@ -64,8 +64,19 @@ typedef struct _dhCtx {
     BigNum pubKey;
     EcCurve curve;
     EcPoint pubPoint;
+    uint8_t privKey25519[32];   // E255 works on the byte arrays, no curve and BigNum setup
+    uint8_t pubKey25519[32];
 } dhCtx;
 
+static const uint8_t basePoint25519[32] = {9};
+
+/*
+ * memset_volatile is a volatile pointer to the memset function.
+ * The compiler cannot optimize away a call through it, thus use it to
+ * clear the private key.
+ */
+static void * (*volatile memset_volatile)(void *, int, size_t) = memset;
+
 void randomZRTP(uint8_t *buf, int32_t length)
 {
     ZrtpRandom::getRandomData(buf, length);
@@ -254,8 +265,10 @@ ZrtpDH::ZrtpDH(const char* type) {
         break;
 
     case E255:
-        ecGetCurvesCurve(Curve25519, &tmpCtx->curve);
-        ecGenerateRandomNumber(&tmpCtx->curve, &tmpCtx->privKey);
+        memcpy(tmpCtx->privKey25519, random, sizeof(tmpCtx->privKey25519));
+        tmpCtx->privKey25519[0] &= 248;
+        tmpCtx->privKey25519[31] &= 127;
+        tmpCtx->privKey25519[31] |= 64;
         break;
 
     case E414:
@@ -285,6 +298,9 @@ ZrtpDH::~ZrtpDH() {
         break;
 
     case E255:
+        memset_volatile(tmpCtx->privKey25519, 0, sizeof(tmpCtx->privKey25519));
+        break;
+
     case E414:
         ecFreeCurvesCurve(&tmpCtx->curve);
         break;
@@ -343,20 +359,8 @@ int32_t ZrtpDH::computeSecretKey(uint8_t *pubKeyBytes, uint8_t *secret) {
         return length;
     }
     if (pkType == E255) {
-        int32_t len = getPubKeySize();
-        EcPoint pub;
-
-        bnBegin(&sec);
-        INIT_EC_POINT(&pub);
-
-        bnInsertLittleBytes(pub.x, pubKeyBytes, 0, len);
-
         /* Generate agreement for responder: sec = pub * privKey */
-        ecdhComputeAgreement(&tmpCtx->curve, &sec, &pub, &tmpCtx->privKey);
-        bnExtractLittleBytes(&sec, secret, 0, length);
-        bnEnd(&sec);
-        FREE_EC_POINT(&pub);
-
+        curve25519_donna(secret, tmpCtx->privKey25519, pubKeyBytes);
         return length;
     }
     return -1;
@@ -376,9 +380,12 @@ int32_t ZrtpDH::generatePublicKey()
         bnExpMod(&tmpCtx->pubKey, &two, &tmpCtx->privKey, &bnP3072);
         break;
 
+    case E255:
+        curve25519_donna(tmpCtx->pubKey25519, tmpCtx->privKey25519, basePoint25519);
+        break;
+
     case EC25:
     case EC38:
-    case E255:
     case E414:
         while (!ecdhGeneratePublic(&tmpCtx->curve, &tmpCtx->pubPoint, &tmpCtx->privKey))
             ecGenerateRandomNumber(&tmpCtx->curve, &tmpCtx->privKey);
@@ -423,7 +430,7 @@ int32_t ZrtpDH::getPubKeySize() const
         return bnBytes(tmpCtx->curve.p) * 2;   // *2 -> x and y coordinate
 
     if (pkType == E255)
-        return bnBytes(tmpCtx->curve.p);
+        return sizeof(tmpCtx->pubKey25519);
     return 0;
 
 }
@@ -451,9 +458,8 @@ int32_t ZrtpDH::getPubKeyBytes(uint8_t *buf) const
         return len * 2;
     }
     if (pkType == E255) {
-        int32_t len = getPubKeySize();
-        bnExtractLittleBytes(tmpCtx->pubPoint.x, buf, 0, len);
-        return len;
+        memcpy(buf, tmpCtx->pubKey25519, sizeof(tmpCtx->pubKey25519));
+        return sizeof(tmpCtx->pubKey25519);
     }
     return 0;
 }
@@ -42,6 +42,8 @@
 #include <libzrtpcpp/ZrtpPacketRelayAck.h>
 #include <libzrtpcpp/ZrtpCallback.h>
 #include <libzrtpcpp/ZIDCache.h>
+#include <libzrtpcpp/ZrtpHandshakeTrace.h>
+#include <libzrtpcpp/ZrtpNonceSet.h>
 
 #include <cryptcommon/skeinApi.h>
 #ifdef ZRTP_OPENSSL
@@ -392,6 +394,18 @@ class __EXPORT ZRtp {
      */
     bool isMultiStreamAvailable();
 
+    /**
+     * Check if this ZRTP session uses Preshared mode.
+     *
+     * Preshared mode derives the keys from the retained secret of a
+     * previous call instead of a DH key agreement. Refer to chapter
+     * 4.4.2 in the ZRTP specification and to ZrtpConfigure::setPreSharedPolicy.
+     *
+     * @return
+     *     True if Preshared mode is used, false otherwise.
+     */
+    bool isPresharedMode();
+
     /**
      * Accept a PBX enrollment request.
      *
@@ -697,6 +711,32 @@ class __EXPORT ZRtp {
       */
      bool isPeerDisclosureFlag(){ return peerDisclosureFlagSeen; }
 
+     /**
+      * @brief Get the timing trace of the ZRTP handshake.
+      *
+      * The trace records state changes, timer resends, and the durations of
+      * the handshake phases since the ZRTP engine started, refer to
+      * ZrtpHandshakeTrace.h. Call this from the ZRTP protocol thread, for
+      * example in the @c srtpSecretsOn callback.
+      *
+      * @param entries array that receives the entries, oldest first
+      * @param maxEntries size of the array, the trace holds up to
+      *        ZRTP_TRACE_ENTRIES entries
+      * @return number of copied entries.
+      */
+     int32_t getHandshakeTrace(ZrtpTraceEntry* entries, int32_t maxEntries) {
+         return handshakeTrace.getEntries(entries, maxEntries);
+     }
+
+     /**
+      * @brief Get the phase durations of all ZRTP handshakes.
+      *
+      * @param histogram receives the aggregate histogram of all sessions.
+      */
+     static void getHandshakeHistogram(ZrtpPhaseHistogram* histogram) {
+         ZrtpHandshakeTrace::getPhaseHistogram(histogram);
+     }
+
 private:
      typedef union _hashCtx {
          SkeinCtx_t  skeinCtx;
@@ -709,6 +749,67 @@ private:
 #endif
      } HashCtx;
 
+    /**
+     * Data that only the key negotiation needs.
+     *
+     * ZRtp allocates this data in its constructor. In compact secure state
+     * mode ZRtp wipes and frees it when the handshake reaches SecureState,
+     * see ZrtpConfigure::setCompactSecureState().
+     */
+    struct HandshakeData {
+        /**
+         * The Hash images as defined in chapter 5.1.1 (H0 is a random value,
+         * not stored here). Need full SHA 256 lenght to store hash value but
+         * only the leftmost 128 bits are used in computations and comparisons.
+         */
+        uint8_t H0[IMPL_MAX_DIGEST_LENGTH];
+        uint8_t H1[IMPL_MAX_DIGEST_LENGTH];
+        uint8_t H2[IMPL_MAX_DIGEST_LENGTH];
+        uint8_t H3[IMPL_MAX_DIGEST_LENGTH];
+
+        // We get the peer's H? from the message where length is defined as 8 words
+        uint8_t peerH0[8*ZRTP_WORD_SIZE];
+        uint8_t peerH1[8*ZRTP_WORD_SIZE];
+        uint8_t peerH2[8*ZRTP_WORD_SIZE];
+        uint8_t peerH3[8*ZRTP_WORD_SIZE];
+
+        /**
+         * My hvi
+         */
+        uint8_t hvi[MAX_DIGEST_LENGTH];
+
+        /**
+         * The peer's hvi
+         */
+        uint8_t peerHvi[8*ZRTP_WORD_SIZE];
+
+        /**
+         * The SHA256 hash over selected messages
+         */
+        uint8_t messageHash[MAX_DIGEST_LENGTH];
+
+        HashCtx hashCtx;
+
+        /**
+         * My computed public key
+         */
+        uint8_t pubKeyBytes[400];
+
+        uint8_t tempMsgBuffer[1024];
+        int32_t lengthOfMsgData;
+
+        /**
+         * Pre-initialized packets of the key negotiation.
+         */
+        ZrtpPacketHello    zrtpHello_11;
+        ZrtpPacketHello    zrtpHello_12;   // Prepare for ZRTP protocol version 1.2
+        ZrtpPacketCommit   zrtpCommit;
+        ZrtpPacketDHPart   zrtpDH1;
+        ZrtpPacketDHPart   zrtpDH2;
+        ZrtpPacketConfirm  zrtpConfirm1;
+        ZrtpPacketConfirm  zrtpConfirm2;
+    };
+
      friend class ZrtpStateClass;
 
     /**
@@ -716,6 +817,21 @@ private:
      */
     ZrtpStateClass* stateEngine;
 
+    /**
+     * Handshake-only data, NULL after ZRtp released it in SecureState.
+     */
+    HandshakeData* handshake;
+
+    /**
+     * If true release the handshake data when reaching SecureState.
+     */
+    bool compactSecureState;
+
+    /**
+     * Timing trace of the handshake, the state engine records its state changes here.
+     */
+    ZrtpHandshakeTrace handshakeTrace;
+
     /**
      * This is my ZID that I send to the peer.
      */
@@ -742,10 +858,6 @@ private:
      */
     uint8_t* DHss;
 
-    /**
-     * My computed public key
-     */
-    uint8_t pubKeyBytes[400];
     /**
      * Length off public key
      */
@@ -790,16 +902,6 @@ private:
      */
     bool rs1Valid;
     bool rs2Valid;
-    /**
-     * My hvi
-     */
-    uint8_t hvi[MAX_DIGEST_LENGTH];
-
-    /**
-     * The peer's hvi
-     */
-    uint8_t peerHvi[8*ZRTP_WORD_SIZE];
-
     /**
      * Context to compute the SHA256 hash of selected messages.
      * Used to compute the s0, refer to chapter 4.4.1.4
@@ -821,30 +923,9 @@ private:
      */
     AlgorithmEnum* authLength;
 
-    /**
-     * The Hash images as defined in chapter 5.1.1 (H0 is a random value,
-     * not stored here). Need full SHA 256 lenght to store hash value but
-     * only the leftmost 128 bits are used in computations and comparisons.
-     */
-    uint8_t H0[IMPL_MAX_DIGEST_LENGTH];
-    uint8_t H1[IMPL_MAX_DIGEST_LENGTH];
-    uint8_t H2[IMPL_MAX_DIGEST_LENGTH];
-    uint8_t H3[IMPL_MAX_DIGEST_LENGTH];
-
     uint8_t peerHelloHash[IMPL_MAX_DIGEST_LENGTH];
     uint8_t peerHelloVersion[ZRTP_WORD_SIZE + 1];   // +1 for nul byte
 
-    // We get the peer's H? from the message where length is defined as 8 words
-    uint8_t peerH0[8*ZRTP_WORD_SIZE];
-    uint8_t peerH1[8*ZRTP_WORD_SIZE];
-    uint8_t peerH2[8*ZRTP_WORD_SIZE];
-    uint8_t peerH3[8*ZRTP_WORD_SIZE];
-
-    /**
-     * The SHA256 hash over selected messages
-     */
-    uint8_t messageHash[MAX_DIGEST_LENGTH];
-
     /**
      * The s0
      */
@@ -879,8 +960,6 @@ private:
     uint8_t zrtpKeyI[MAX_DIGEST_LENGTH];
     uint8_t zrtpKeyR[MAX_DIGEST_LENGTH];
 
-    HashCtx hashCtx;
-
     /**
      * Pointers to negotiated hash and HMAC functions
      */
@@ -953,6 +1032,22 @@ private:
      */
     bool multiStreamAvailable;
 
+    /**
+     * True if this ZRTP instance committed to, or accepted, Preshared mode.
+     */
+    bool presharedMode;
+
+    /**
+     * True if our peer rejected our Preshared Commit, don't try it again in this session.
+     */
+    bool presharedRejected;
+
+    /**
+     * The preshared key computed from the retained secrets, refer to chapter 4.4.2.
+     * Valid between Commit and the computation of s0 only.
+     */
+    uint8_t presharedKey[MAX_DIGEST_LENGTH];
+
     /**
      * Enable MitM (PBX) enrollment
      * 
@@ -995,20 +1090,12 @@ private:
     /**
      * Pre-initialized packets.
      */
-    ZrtpPacketHello    zrtpHello_11;
-    ZrtpPacketHello    zrtpHello_12;   // Prepare for ZRTP protocol version 1.2
-
     ZrtpPacketHelloAck zrtpHelloAck;
     ZrtpPacketConf2Ack zrtpConf2Ack;
     ZrtpPacketClearAck zrtpClearAck;
     ZrtpPacketGoClear  zrtpGoClear;
     ZrtpPacketError    zrtpError;
     ZrtpPacketErrorAck zrtpErrorAck;
-    ZrtpPacketDHPart   zrtpDH1;
-    ZrtpPacketDHPart   zrtpDH2;
-    ZrtpPacketCommit   zrtpCommit;
-    ZrtpPacketConfirm  zrtpConfirm1;
-    ZrtpPacketConfirm  zrtpConfirm2;
     ZrtpPacketPingAck  zrtpPingAck;
     ZrtpPacketSASrelay zrtpSasRelay;
     ZrtpPacketRelayAck zrtpRelayAck;
@@ -1035,9 +1122,6 @@ private:
      */
     uint8_t randomIV[16];
 
-    uint8_t tempMsgBuffer[1024];
-    int32_t lengthOfMsgData;
-
     /**
      * Variables to store signature data. Includes the signature type block
      */
@@ -1056,8 +1140,8 @@ private:
     std::string peerClientId;    // store the peer's client Id
 
     ZRtp* masterStream;                    // This is the master stream in case this is a multi-stream
-    std::vector<std::string> peerNonces;   // Store nonces we got from our partner. Using std::string
-                                           // just simplifies memnory management, nonces are binary data, not strings :-)
+    ZrtpNonceSet peerNonces;               // Nonces we got from our partner, the streams of a session use
+                                           // the master stream's set
     /**
      * Enable or disable paranoid mode.
      *
@@ -1184,6 +1268,35 @@ private:
      */
     bool checkMultiStream(ZrtpPacketHello* hello);
 
+    /**
+     * Check if we can use Preshared mode with the peer of this Hello.
+     *
+     * Checks the configured Preshared policy, if the peer offers Preshared
+     * mode and if the peer's ZID record contains a usable retained secret.
+     *
+     * @param hello
+     *    The Hello packet.
+     * @return
+     *    True if we shall commit to Preshared mode, false otherwise.
+     */
+    bool checkPreshared(ZrtpPacketHello* hello);
+
+    /**
+     * Check if a Commit packet commits to Preshared mode.
+     */
+    bool isPresharedCommit(ZrtpPacketCommit* commit);
+
+    /**
+     * Compute the preshared key and its key id.
+     *
+     * Uses the retained secret rs1 and the auxiliary and PBX secrets, if
+     * available, as defined in chapter 4.4.2.
+     *
+     * @param keyId
+     *    Points to a buffer that gets the 8 byte key id.
+     */
+    void computePresharedKey(uint8_t* keyId);
+
     /**
      * Checks if Hello packet contains a strong (384bit) hash based on selection policy.
      * 
@@ -1280,6 +1393,8 @@ private:
 
     void generateKeysMultiStream();
 
+    void generateKeysPreshared();
+
     void computePBXSecret();
 
     void setNegotiatedHash(AlgorithmEnum* hash);
@@ -1372,6 +1487,33 @@ private:
      */
     ZrtpPacketCommit* prepareCommitMultiStream(ZrtpPacketHello *hello);
 
+    /**
+     * Prepare a Commit packet for Preshared mode.
+     *
+     * Using the selected values and the retained secret of the peer's ZID
+     * record prepare a Commit packet and return it to protocol state engine.
+     *
+     * @param hello
+     *    Points to the received Hello packet
+     * @return
+     *    A pointer to the prepared Commit packet for Preshared mode
+     */
+    ZrtpPacketCommit* prepareCommitPreshared(ZrtpPacketHello *hello);
+
+    /**
+     * Prepare a DH Commit packet after the peer rejected our Preshared Commit.
+     *
+     * The peer sends an Error packet with code NoSharedSecret if it does not
+     * have a retained secret that matches our key id. Re-run the Commit
+     * preparation with the stored Hello packet, this time for DH mode.
+     *
+     * @param errMsg
+     *    Points to an integer that can hold a ZRTP error code.
+     * @return
+     *    A pointer to the prepared Commit packet for DH mode
+     */
+    ZrtpPacketCommit* prepareCommitFallback(uint32_t* errMsg);
+
     /**
      * Prepare the DHPart1 packet.
      *
@@ -1418,6 +1560,18 @@ private:
      */
     ZrtpPacketConfirm* prepareConfirm1MultiStream(ZrtpPacketCommit* commit, uint32_t* errMsg);
 
+    /**
+     * Prepare the Confirm1 packet in Preshared mode.
+     *
+     * This method prepares the Confirm1 packet. The state engine calls this method
+     * if it received a Commit packet for Preshared mode. The input to this method
+     * is the Commit. If we don't have a retained secret that matches the
+     * Commit's key id the method sets the error code NoSharedSecret.
+     * Here we are in the role of the Responder
+     *
+     */
+    ZrtpPacketConfirm* prepareConfirm1Preshared(ZrtpPacketCommit* commit, uint32_t* errMsg);
+
     /**
      * Prepare the Confirm2 packet.
      *
@@ -1438,6 +1592,17 @@ private:
      */
     ZrtpPacketConfirm* prepareConfirm2MultiStream(ZrtpPacketConfirm* confirm1, uint32_t* errMsg);
 
+    /**
+     * Prepare the Confirm2 packet in Preshared mode.
+     *
+     * This method prepares the Confirm2 packet. The state engine calls this method if
+     * Preshared mode is active and in state CommitSent. The input to this method is
+     * the Confirm1 packet received from our peer. The peer sends the Confirm1 packet
+     * as response of our Commit packet in Preshared mode.
+     * Here we are in the role of the Initiator
+     */
+    ZrtpPacketConfirm* prepareConfirm2Preshared(ZrtpPacketConfirm* confirm1, uint32_t* errMsg);
+
     /**
      * Prepare the Conf2Ack packet.
      *
@@ -1451,7 +1616,9 @@ private:
      * Prepare the ErrorAck packet.
      *
      * This method prepares the ErrorAck packet. The input to this method is the
-     * Error packet received from the peer.
+     * Error packet received from the peer. It reports the error to the
+     * application, except a NoSharedSecret that rejects our Preshared Commit:
+     * the Initiator falls back to DH mode.
      */
     ZrtpPacketErrorAck* prepareErrorAck(ZrtpPacketError* epkt);
 
@@ -1658,7 +1825,8 @@ private:
       * Check and set a nonce.
       * 
       * The function first checks if the nonce is already in use (was seen) in this ZRTP
-      * session. Refer to 4.4.3.1.
+      * session. Refer to 4.4.3.1. The nonces of Preshared and multi-stream Commits
+      * go to the nonce set of the master stream.
       * 
       * @param nonce
       *     The nonce to check and to store if not already seen.
@@ -1667,6 +1835,15 @@ private:
       *     True if the the nonce was stroed, thus not yet seen.
       */
      bool checkAndSetNonce(uint8_t* nonce);
+
+     /**
+      * Wipe and free the handshake data.
+      *
+      * The state engine calls this function when it enters SecureState and
+      * compact secure state mode is enabled. After this call the ZRtp instance
+      * cannot start a new key negotiation.
+      */
+     void releaseHandshakeData();
 };
 
 /**
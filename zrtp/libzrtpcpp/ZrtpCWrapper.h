@@ -1113,6 +1113,57 @@ extern "C"
       */
      int32_t zrtp_getCurrentProtocolVersion(ZrtpContext* zrtpContext);
 
+    /* Keep in synch with the defines and structures in ZrtpHandshakeTrace.h */
+#define ZRTP_C_TRACE_ENTRIES    64      /*!< Size of the per-session trace ring */
+#define ZRTP_C_TRACE_PHASES     27      /*!< Number of handshake phases, including the 16 state phases */
+#define ZRTP_C_TRACE_BUCKETS    28      /*!< Histogram buckets, bucket n holds times < 2^n us */
+
+    /**
+     * One entry of the handshake trace, see ZrtpHandshakeTrace.h.
+     */
+    typedef struct zrtp_TraceEntry {
+        uint32_t timeUs;        /*!< Time of the event in us since the ZRTP engine started */
+        uint32_t durationUs;    /*!< Duration of a state or phase in us */
+        uint8_t  event;         /*!< 1: state change, 2: timeout, 3: phase finished */
+        uint8_t  code;          /*!< State, timer, or phase, depends on @c event */
+        uint16_t counter;       /*!< Resend counter of a timeout event */
+    } zrtp_TraceEntry;
+
+    /**
+     * Aggregate phase durations of all sessions, see ZrtpHandshakeTrace.h.
+     */
+    typedef struct zrtp_PhaseHistogram {
+        uint32_t counts[ZRTP_C_TRACE_PHASES][ZRTP_C_TRACE_BUCKETS];
+        uint64_t sumUs[ZRTP_C_TRACE_PHASES];
+    } zrtp_PhaseHistogram;
+
+    /**
+     * Get the timing trace of the ZRTP handshake.
+     *
+     * The trace records state changes, timer resends, and the durations
+     * of the handshake phases since the ZRTP engine started. Call this
+     * function from the ZRTP protocol thread, for example in the
+     * @c srtpSecretsOn callback.
+     *
+     * @param zrtpContext
+     *    Pointer to the opaque ZrtpContext structure.
+     * @param entries
+     *    Array that receives the trace entries, oldest first.
+     * @param maxEntries
+     *    Size of the array, the trace holds up to ZRTP_C_TRACE_ENTRIES entries.
+     * @return
+     *    Number of copied entries.
+     */
+    int32_t zrtp_getHandshakeTrace(ZrtpContext* zrtpContext, zrtp_TraceEntry* entries, int32_t maxEntries);
+
+    /**
+     * Get the phase durations of all ZRTP handshakes.
+     *
+     * @param histogram
+     *    Receives the aggregate histogram of all sessions.
+     */
+    void zrtp_getHandshakeHistogram(zrtp_PhaseHistogram* histogram);
+
      /**
      * This enumerations list all configurable algorithm types.
      */
@@ -1373,6 +1424,29 @@ extern "C"
      */
     int32_t zrtp_isSasSignature(ZrtpContext* zrtpContext);
 
+    /**
+     * Enables or disables compact secure state mode.
+     *
+     * In compact secure state mode ZRTP frees the data of the key negotiation
+     * when it reaches secure state. Refer to ZrtpConfigure::setCompactSecureState.
+     *
+     * @param zrtpContext
+     *    Pointer to the opaque ZrtpContext structure.
+     * @param yesNo
+     *    If true then compact secure state mode is enabled.
+     */
+    void zrtp_setCompactSecureState(ZrtpContext* zrtpContext, int32_t yesNo);
+
+    /**
+     * Check status of compact secure state mode.
+     *
+     * @param zrtpContext
+     *    Pointer to the opaque ZrtpContext structure.
+     * @return
+     *    Returns true if compact secure state mode is enabled.
+     */
+    int32_t zrtp_isCompactSecureState(ZrtpContext* zrtpContext);
+
 #ifdef __cplusplus
 }
 #ifdef __GNUC__ 
@@ -188,7 +188,8 @@ enum InfoEnrollment {
 typedef enum {
     DecodeError = 1,
     ReplayError = 2,
-    AuthError   = 3
+    AuthError   = 3,
+    AuthLimitError = 4              //!< dropped without MAC check, the context throttles after many auth errors
 } SrtpErrorType;
 
 /**
@@ -322,6 +322,15 @@ public:
         PreferNonNist = 2
     } Policy;
 
+    /**
+     * Define when ZRTP uses Preshared mode, refer to RFC6189, chapter 4.4.2.
+     */
+    typedef enum _preSharedPolicies {
+        PreSharedNever = 0,         ///< Don't offer Preshared mode, always use DH mode
+        PreSharedIfVerified = 1,    ///< Preshared mode if a retained secret is available and its SAS was verified
+        PreSharedAlways = 2         ///< Preshared mode if a retained secret is available
+    } PreSharedPolicy;
+
     /**
      * Set the maximum number of algorithms per algorithm type that an application can
      * configure.
@@ -533,12 +542,63 @@ public:
      */
     bool isDisclosureFlag();
 
+    /**
+     * Enables or disables compact secure state mode.
+     *
+     * In compact secure state mode ZRtp wipes and frees the data that only
+     * the key negotiation needs, for example the Hello, Commit, DHPart, and
+     * Confirm packets, as soon as it reaches SecureState. This reduces the
+     * memory of a secure ZRTP session to less than half. GoClear and SAS
+     * relay processing keep working. The ZRtp instance cannot start a new
+     * key negotiation after it released the data.
+     *
+     * @param yesNo
+     *    If set to true then compact secure state mode is enabled.
+     */
+    void setCompactSecureState(bool yesNo);
+
+    /**
+     * Check status of compact secure state mode.
+     *
+     * @return
+     *    Returns true if compact secure state mode is enabled.
+     */
+    bool isCompactSecureState();
+
     /// Helper function to print some internal data
     void printConfiguredAlgos(AlgoTypes algoTyp);
 
     Policy getSelectionPolicy()         {return selectionPolicy;}
     void setSelectionPolicy(Policy pol) {selectionPolicy = pol;}
 
+    /**
+     * Set the Preshared mode policy.
+     *
+     * Preshared mode derives the keys from the retained secret of a previous
+     * call and skips the DH key agreement. Any policy other than
+     * @c PreSharedNever adds Preshared mode to the public key algorithms
+     * announced in Hello, @c PreSharedNever removes it. A ZRTP session
+     * initiates Preshared mode only if the peer announced it as well. As
+     * Responder ZRTP accepts a Preshared Commit only if the policy allows it
+     * and the Initiator used a matching retained secret, otherwise the
+     * Initiator falls back to DH mode.
+     *
+     * Call this function after setting the public key algorithms, the
+     * standard and mandatory configurations keep an enabled policy.
+     *
+     * @param pol
+     *    The Preshared mode policy, default is @c PreSharedNever.
+     */
+    void setPreSharedPolicy(PreSharedPolicy pol);
+
+    /**
+     * Get the Preshared mode policy.
+     *
+     * @return
+     *    The Preshared mode policy.
+     */
+    PreSharedPolicy getPreSharedPolicy()  {return preSharedPolicy;}
+
   private:
     std::vector<AlgorithmEnum* > hashes;
     std::vector<AlgorithmEnum* > symCiphers;
@@ -550,6 +610,7 @@ public:
     bool enableSasSignature;
     bool enableParanoidMode;
     bool enableDisclosureFlag;
+    bool enableCompactSecureState;
 
 
     AlgorithmEnum& getAlgoAt(std::vector<AlgorithmEnum* >& a, int32_t index);
@@ -563,6 +624,7 @@ public:
     void printConfiguredAlgos(std::vector<AlgorithmEnum* >& a);
 
     Policy selectionPolicy;
+    PreSharedPolicy preSharedPolicy;
 
   protected:
 
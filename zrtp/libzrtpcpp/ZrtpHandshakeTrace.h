@@ -0,0 +1,223 @@
+/*
+  Copyright (C) 2006-2013 Werner Dittmann
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ZRTPHANDSHAKETRACE_H_
+#define _ZRTPHANDSHAKETRACE_H_
+
+/**
+ * @file ZrtpHandshakeTrace.h
+ * @brief Timing trace of the ZRTP handshake
+ *
+ * @ingroup GNU_ZRTP
+ * @{
+ */
+
+#include <stdint.h>
+
+#include <common/osSpecifics.h>
+
+/*
+ * Keep the following defines, enums and structures in synch with the copies
+ * in ZrtpCWrapper.h
+ */
+#define ZRTP_TRACE_ENTRIES      64      ///< Size of the per-session trace ring
+#define ZRTP_TRACE_MAX_STATES   16      ///< Room for the ZRTP protocol states, see ZrtpStateClass.h
+#define ZRTP_TRACE_BUCKETS      28      ///< Histogram buckets, bucket n holds times < 2^n us
+
+/**
+ * Types of trace entries.
+ */
+enum ZrtpTraceEvents {
+    TraceStateChange = 1,   ///< Entered state @c code, @c durationUs is the time spent in the previous state
+    TraceTimeout,           ///< Timer @c code (1: T1, 2: T2) expired and resent a packet, @c counter is the resend count
+    TracePhase              ///< Phase @c code finished, @c durationUs is its duration
+};
+
+/**
+ * Handshake phases of the trace and of the aggregate histogram.
+ *
+ * The time a session spent in a protocol state has the phase number
+ * <code>PhaseStateBase + state</code>.
+ */
+enum ZrtpTracePhases {
+    PhaseCommit,            ///< prepareCommit and its multi-stream and preshared variants
+    PhaseDHPart1,           ///< prepareDHPart1
+    PhaseDHPart2,           ///< prepareDHPart2
+    PhaseConfirm1,          ///< prepareConfirm1 and variants
+    PhaseConfirm2,          ///< prepareConfirm2 and variants
+    PhaseConf2Ack,          ///< prepareConf2Ack
+    PhaseDHKeyGen,          ///< Generate the DH key pair
+    PhaseDHSecret,          ///< Compute the DH shared secret
+    PhaseCacheRead,         ///< Read the peer's ZID cache record
+    PhaseCacheWrite,        ///< Store the peer's ZID cache record
+    PhaseHandshake,         ///< Start of ZRTP engine until SecureState
+    PhaseStateBase,         ///< First state dwell time phase
+    numberOfTracePhases = PhaseStateBase + ZRTP_TRACE_MAX_STATES
+};
+
+/**
+ * One entry of the handshake trace.
+ */
+typedef struct _ZrtpTraceEntry {
+    uint32_t timeUs;        ///< Time of the event in us since the ZRTP engine started
+    uint32_t durationUs;    ///< Duration of a state or phase in us
+    uint8_t  event;         ///< One of @c ZrtpTraceEvents
+    uint8_t  code;          ///< State, timer, or phase, depends on @c event
+    uint16_t counter;       ///< Resend counter of a timeout event
+} ZrtpTraceEntry;
+
+/**
+ * Aggregate phase durations of all sessions.
+ */
+typedef struct _ZrtpPhaseHistogram {
+    uint32_t counts[numberOfTracePhases][ZRTP_TRACE_BUCKETS];  ///< bucket n counts durations < 2^n us
+    uint64_t sumUs[numberOfTracePhases];                        ///< Sum of all durations of a phase
+} ZrtpPhaseHistogram;
+
+/**
+ * Records the timing of a ZRTP handshake.
+ *
+ * Each ZRtp instance owns a trace. The state engine records state changes
+ * and timer resends, the ZRtp prepare functions record the durations of
+ * their phases, the DH computations and the ZID cache access. The trace
+ * uses a fixed size ring and the monotonic clock, recording an event costs
+ * a clock read and a few stores. All durations also go to an aggregate
+ * histogram that collects the phase times of all sessions.
+ *
+ * The ZRTP protocol thread records the events, thus an application should
+ * read the trace from this thread, for example in a callback.
+ */
+class __EXPORT ZrtpHandshakeTrace {
+
+public:
+    ZrtpHandshakeTrace();
+
+    /**
+     * @brief Clear the trace and restart its clock.
+     *
+     * ZRtp calls this when it starts the ZRTP engine.
+     */
+    void reset();
+
+    /**
+     * @brief Record a state change.
+     *
+     * @param newState the state the engine enters
+     * @param secure if true the engine enters SecureState, record the handshake time
+     */
+    void stateChange(int32_t newState, bool secure);
+
+    /**
+     * @brief Record a timeout that resends a packet.
+     *
+     * @param timer 1 for T1, 2 for T2
+     * @param counter the timer's resend counter
+     */
+    void timeout(int32_t timer, int32_t counter);
+
+    /**
+     * @brief Record the end of a phase.
+     *
+     * @param phase one of the @c ZrtpTracePhases
+     * @param startTime start time of the phase, see now()
+     */
+    void phaseEnd(int32_t phase, uint64_t startTime);
+
+    /**
+     * @brief Copy the trace entries.
+     *
+     * @param entries array that receives the entries, oldest first
+     * @param maxEntries size of the array, at most ZRTP_TRACE_ENTRIES entries
+     *        are available
+     * @return number of copied entries.
+     */
+    int32_t getEntries(ZrtpTraceEntry* entries, int32_t maxEntries) const;
+
+    /**
+     * @brief Get the number of events since the last reset.
+     *
+     * If this is larger than ZRTP_TRACE_ENTRIES the ring overwrote old entries.
+     */
+    uint32_t getNumberOfEvents() const { return total; }
+
+    /**
+     * @brief Get the current time of the monotonic trace clock in us.
+     */
+    static uint64_t now();
+
+    /**
+     * @brief Copy the aggregate phase histogram of all sessions.
+     */
+    static void getPhaseHistogram(ZrtpPhaseHistogram* histogram);
+
+    /**
+     * @brief Clear the aggregate phase histogram.
+     */
+    static void resetPhaseHistogram();
+
+private:
+    friend class ZrtpTraceScope;
+
+    void add(uint8_t event, uint8_t code, uint32_t durationUs, uint16_t counter, uint64_t nowUs);
+
+    ZrtpTraceEntry ring[ZRTP_TRACE_ENTRIES];
+    uint32_t total;             ///< Number of events since reset, next ring index is total % ZRTP_TRACE_ENTRIES
+    uint64_t startUs;           ///< Start of the ZRTP engine
+    uint64_t stateStartUs;      ///< Time the engine entered the current state
+    int32_t currentState;       ///< State entered last, -1 before the first state change
+    bool inPrepare;             ///< A prepare function is running, don't record nested prepare functions
+};
+
+/**
+ * Records the duration of a phase when the scope ends.
+ *
+ * Prepare functions may call other prepare functions, for example
+ * prepareCommit calls prepareCommitPreshared. Only the outermost prepare
+ * function records its phase.
+ */
+class ZrtpTraceScope {
+public:
+    ZrtpTraceScope(ZrtpHandshakeTrace& t, int32_t p): trace(t), phase(p), active(true) {
+        if (phase < PhaseDHKeyGen) {
+            active = !trace.inPrepare;
+            trace.inPrepare = true;
+        }
+        startUs = ZrtpHandshakeTrace::now();
+    }
+
+    ~ZrtpTraceScope() {
+        if (!active)
+            return;
+        if (phase < PhaseDHKeyGen)
+            trace.inPrepare = false;
+        trace.phaseEnd(phase, startUs);
+    }
+
+private:
+    ZrtpTraceScope(const ZrtpTraceScope& other);
+    ZrtpTraceScope& operator=(const ZrtpTraceScope& other);
+
+    ZrtpHandshakeTrace& trace;
+    int32_t phase;
+    bool active;
+    uint64_t startUs;
+};
+
+/**
+ * @}
+ */
+#endif
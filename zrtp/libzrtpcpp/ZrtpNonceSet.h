@@ -0,0 +1,102 @@
+/*
+  Copyright (C) 2006-2013 Werner Dittmann
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ZRTPNONCESET_H_
+#define _ZRTPNONCESET_H_
+
+/**
+ * @file ZrtpNonceSet.h
+ * @brief Set of the multi-stream nonces of a ZRTP session
+ *
+ * @ingroup GNU_ZRTP
+ * @{
+ */
+
+#include <stdint.h>
+#include <mutex>
+
+#include <common/osSpecifics.h>
+
+#define ZRTP_NONCE_SIZE         16      ///< Size of a Commit nonce, 4 ZRTP words
+#define ZRTP_NONCE_SET_INITIAL  64      ///< Initial number of slots, must be a power of 2
+
+/**
+ * Stores the nonces the peer used in the multi-stream Commits of a session.
+ *
+ * RFC 6189, chapter 4.4.3.1 requires that each multi-stream Commit uses a
+ * new nonce. The master stream owns the set, all its multi-stream streams
+ * check and insert their peer's nonce here.
+ *
+ * The set uses open addressing with linear probing on a flat array of fixed
+ * size keys, thus a lookup is a hash and a few compares without any memory
+ * allocation. The table doubles its size if it becomes half full. Because
+ * the peer chooses the nonces the hash function mixes the nonce with a random
+ * per-set seed, a peer cannot produce long probe sequences on purpose.
+ *
+ * The streams of a session usually run in different threads, a mutex
+ * protects the set. The lock covers just the lookup and insert.
+ */
+class __EXPORT ZrtpNonceSet {
+
+public:
+    ZrtpNonceSet();
+
+    ~ZrtpNonceSet();
+
+    /**
+     * @brief Insert a nonce if the set does not contain it.
+     *
+     * @param nonce the nonce, ZRTP_NONCE_SIZE bytes
+     * @return true if the set did not contain the nonce and stored it,
+     *         false if the nonce is a duplicate or if the set cannot grow.
+     */
+    bool insert(const uint8_t* nonce);
+
+    /**
+     * @brief Get the number of nonces in the set.
+     */
+    uint32_t size();
+
+    /**
+     * @brief Remove all nonces and free the table.
+     */
+    void clear();
+
+private:
+    ZrtpNonceSet(const ZrtpNonceSet& other);
+    ZrtpNonceSet& operator=(const ZrtpNonceSet& other);
+
+    struct Slot {
+        uint8_t nonce[ZRTP_NONCE_SIZE];
+        bool used;
+    };
+
+    uint32_t hash(const uint8_t* nonce) const;
+    Slot* find(Slot* table, uint32_t tableSize, const uint8_t* nonce, bool* found) const;
+    bool grow();
+
+    std::mutex lock;
+    Slot* slots;            ///< Allocated on the first insert, most sessions never use multi-stream mode
+    uint32_t capacity;      ///< Number of slots, a power of 2
+    uint32_t count;         ///< Number of used slots
+    uint64_t seed[2];       ///< Random hash seed
+};
+
+/**
+ * @}
+ */
+#endif
@@ -138,8 +138,12 @@ public:
      *
      * @param suite defines which crypto suite to use for this stream. The values are
      *              @c AES_CM_128_HMAC_SHA1_80 or @c AES_CM_128_HMAC_SHA1_32.
+     *
+     * @param replayWindowSize the number of packets the replay check of the receiving
+     *              SRTP contexts tracks, at most @c SRTP_MAX_REPLAY_WINDOW. Zero selects
+     *              the default size @c REPLAY_WINDOW_SIZE.
      */
-    ZrtpSdesStream(const sdesSuites suite =AES_CM_128_HMAC_SHA1_32);
+    ZrtpSdesStream(const sdesSuites suite =AES_CM_128_HMAC_SHA1_32, int32_t replayWindowSize =0);
 
     ~ZrtpSdesStream();
 
@@ -274,6 +278,28 @@ public:
      */
     bool outgoingRtp(uint8_t *packet, size_t length, size_t *newLength);
 
+    /**
+     * @brief Process an outgoing RTP packet with SDES and another SRTP context
+     *
+     * If SDES is active the function protects the packet with the SDES key data and
+     * then with the @c outer crypto context, for example the ZRTP context of a stream
+     * where the other client did not send a matching zrtp-hash. Both protections run
+     * in one pass over the payload, see @c SrtpHandler::protectDouble. If SDES is not
+     * active only the @c outer crypto context protects the packet.
+     *
+     * @param outer the crypto context of the second protection
+     *
+     * @param packet the buffer that contains the RTP packet. The buffer must be big enough
+     *               to hold the SRTP data of both protections.
+     *
+     * @param length length of the RTP packet
+     *
+     * @param newLength to an integer that get the new length of the packet including SRTP data.
+     *
+     * @return @c true if encryption is successful, @c false otherwise.
+     */
+    bool outgoingDoubleRtp(CryptoContext* outer, uint8_t *packet, size_t length, size_t *newLength);
+
     /**
      * @brief Process an outgoing RTCP packet
      *
@@ -329,6 +355,30 @@ public:
      */
     int incomingRtp(uint8_t *packet, size_t length, size_t *newLength, SrtpErrorData* errorData=NULL);
 
+    /**
+     * @brief Process an incoming SRTP packet protected by another SRTP context and SDES
+     *
+     * The reverse of @c outgoingDoubleRtp. If @c outerValid is @c false after the call
+     * the @c outer crypto context did not accept the packet and the packet buffer is
+     * unchanged, thus the caller may try @c incomingRtp.
+     *
+     * @param outer the crypto context of the second protection
+     *
+     * @param packet the buffer that contains the SRTP packet
+     *
+     * @param length length of the SRTP packet
+     *
+     * @param newLength to an integer that get the new length of the packet excluding SRTP data.
+     *
+     * @param outerValid set to @c true if the @c outer crypto context accepted the packet
+     *
+     * @param errorData Pointer to @c errorData structure or @c NULL, default is @c NULL
+     *
+     * @return the same values as @c incomingRtp
+     */
+    int incomingDoubleRtp(CryptoContext* outer, uint8_t *packet, size_t length, size_t *newLength,
+                          bool* outerValid, SrtpErrorData* errorData=NULL);
+
     /**
      * @brief Process an incoming RTCP or SRTCP packet
      *
@@ -415,6 +465,20 @@ public:
      */
     const char* getAuthAlgo();
 
+    /**
+     * @brief Return the SRTP context that protects outgoing RTP packets.
+     *
+     * @return the send context or @c NULL if SDES SRTP is not active.
+     */
+    const CryptoContext* getSendSrtpContext() {return state == SDES_SRTP_ACTIVE ? sendSrtp : NULL;}
+
+    /**
+     * @brief Return the SRTP context that unprotects incoming RTP packets.
+     *
+     * @return the receive context or @c NULL if SDES SRTP is not active.
+     */
+    const CryptoContext* getRecvSrtpContext() {return state == SDES_SRTP_ACTIVE ? recvSrtp : NULL;}
+
 
     /*
      * ******** Lower layer functions
@@ -536,6 +600,7 @@ private:
 
     int32_t cryptoMixHashLength;
     sdesHmacTypeMix cryptoMixHashType;
+    int32_t replayWindowSize;
 
     // Variables for crypto that this client creates and sends to the other client, filled during SDES create
     uint8_t localKeySalt[((MAX_KEY_LEN + MAX_SALT_LEN + 3)/4)*4];  //!< Some buffer for key and salt, multiple of 4
@@ -147,6 +147,12 @@ private:
      */
     bool multiStream;
 
+    /*
+     * Set to true if we sent Error NoSharedSecret to reject a Preshared Commit.
+     * The Initiator retries with a DH Commit, thus wait for it after ErrorAck.
+     */
+    bool presharedRetry;
+
     // Secure substate to handle SAS relay packets
     SecureSubStates secSubstate;
 
@@ -182,7 +188,7 @@ public:
     bool inState(const int32_t state) { return engine->inState(state); };
 
     /// Switch to the specified state
-    void nextState(int32_t state)        { engine->nextState(state); };
+    void nextState(int32_t state)        { parent->handshakeTrace.stateChange(state, state == SecureState); engine->nextState(state); };
 
     /// Process an event, the main entry point into the state engine
     void processEvent(Event_t *ev);
@@ -87,6 +87,7 @@ extern char KDFString[];
 extern char zrtpSessionKey[];
 extern char zrtpExportedKey[];
 extern char zrtpMsk[];
+extern char zrtpPsk[];
 extern char zrtpTrustedMitm[];
 
 
@@ -113,6 +114,7 @@ extern char e255[];
 extern char e414[];
 
 extern char mult[];
+extern char prsh[];
 
 extern const char* mandatoryPubKey;
 